@@ -1,18 +1,390 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
 #include "cpu_core.h"
+#include "run_loop.h"
+#include "replay.h"
+#include "fuzz.h"
+#include "log.h"
+#include "gdb_stub.h"
 
 
-int main() 
+int main(int argc, char* argv[]) 
 {
 	std::cout << "Hello there!" << std::endl;
+
+	// PSXEMU [--exe file.exe [--fast-boot] [--kernel snapshot.bin]] [--hle | --hle-count]
+	//        [--dump-kernel snapshot.bin]
+	//        [--profile [--profile-interval cycles] [--profile-map file.map]]
+	//        [--stats file|unix:socket [--stats-format json|prometheus] [--stats-period ms] [--stats-time]]
+	//        [--block-cache file]
+	//        [--realtime | --speed ratio] [--max-cycles n] [--stop-pc address] [--timeout seconds]
+	//        [--tty file] [--stop-output text]
+	//        [--record log | --replay log]
+	//        [--fuzz iterations --fuzz-input address[:size]]
+	//        [--gdb unix:path|port]
+	//        [--log level|subsystem=level,...]
+	//        [disc image]
+	const char* exe_path = nullptr;
+	const char* kernel_path = nullptr;
+	const char* dump_kernel_path = nullptr;
+	const char* disc_path = nullptr;
+	bool fast_boot = false;
+	HleMode hle_mode = HleMode::Off;
+	bool profile = false;
+	u64 profile_interval = PROFILER_DEFAULT_INTERVAL;
+	const char* profile_map = nullptr;
+	const char* stats_target = nullptr;
+	StatsFormat stats_format = StatsFormat::Json;
+	u32 stats_period = 1000;
+	bool stats_time = false;
+	const char* block_cache_path = nullptr;
+	RunOptions run_options;
+	const char* tty_path = "tty_output.txt";
+	const char* record_path = nullptr;
+	const char* replay_path = nullptr;
+	u64 fuzz_iterations = 0;
+	FuzzOptions fuzz_options;
+	const char* gdb_target = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--exe") == 0 && i + 1 < argc)
+		{
+			exe_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc)
+		{
+			kernel_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--dump-kernel") == 0 && i + 1 < argc)
+		{
+			dump_kernel_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--fast-boot") == 0)
+		{
+			fast_boot = true;
+		}
+		else if (strcmp(argv[i], "--hle") == 0)
+		{
+			hle_mode = HleMode::On;
+		}
+		else if (strcmp(argv[i], "--hle-count") == 0)
+		{
+			hle_mode = HleMode::CountOnly;
+		}
+		else if (strcmp(argv[i], "--profile") == 0)
+		{
+			profile = true;
+		}
+		else if (strcmp(argv[i], "--profile-interval") == 0 && i + 1 < argc)
+		{
+			profile_interval = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (strcmp(argv[i], "--profile-map") == 0 && i + 1 < argc)
+		{
+			profile_map = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+		{
+			stats_target = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stats-format") == 0 && i + 1 < argc)
+		{
+			stats_format = (strcmp(argv[++i], "prometheus") == 0) ? StatsFormat::Prometheus : StatsFormat::Json;
+		}
+		else if (strcmp(argv[i], "--stats-period") == 0 && i + 1 < argc)
+		{
+			stats_period = static_cast<u32>(strtoul(argv[++i], nullptr, 0));
+		}
+		else if (strcmp(argv[i], "--stats-time") == 0)
+		{
+			stats_time = true;
+		}
+		else if (strcmp(argv[i], "--block-cache") == 0 && i + 1 < argc)
+		{
+			block_cache_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--realtime") == 0)
+		{
+			run_options.pacing = Pacing::RealTime;
+		}
+		else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+		{
+			run_options.pacing = Pacing::Ratio;
+			run_options.speed = strtod(argv[++i], nullptr);
+		}
+		else if (strcmp(argv[i], "--max-cycles") == 0 && i + 1 < argc)
+		{
+			run_options.max_cycles = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (strcmp(argv[i], "--stop-pc") == 0 && i + 1 < argc)
+		{
+			run_options.stop_at_pc = true;
+			run_options.stop_pc = static_cast<u32>(strtoul(argv[++i], nullptr, 16));
+		}
+		else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc)
+		{
+			run_options.max_seconds = strtod(argv[++i], nullptr);
+		}
+		else if (strcmp(argv[i], "--tty") == 0 && i + 1 < argc)
+		{
+			tty_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stop-output") == 0 && i + 1 < argc)
+		{
+			run_options.stop_output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+		{
+			record_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replay_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--fuzz") == 0 && i + 1 < argc)
+		{
+			fuzz_iterations = strtoull(argv[++i], nullptr, 0);
+		}
+		else if (strcmp(argv[i], "--fuzz-input") == 0 && i + 1 < argc)
+		{
+			char* size = nullptr;
+			fuzz_options.input_address = static_cast<u32>(strtoul(argv[++i], &size, 16));
+			if (*size == ':')
+			{
+				fuzz_options.max_input_size = static_cast<u32>(strtoul(size + 1, nullptr, 0));
+			}
+		}
+		else if (strcmp(argv[i], "--gdb") == 0 && i + 1 < argc)
+		{
+			gdb_target = argv[++i];
+		}
+		else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+		{
+			if (!log_configure(argv[++i]))
+			{
+				std::cerr << "Bad log levels: " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			disc_path = argv[i];
+		}
+	}
+
+	ReplayBoot boot;
+	ReplayLog replay_log;
+	if (replay_path != nullptr)
+	{
+		if (!replay_log.load(replay_path))
+		{
+			return 1;
+		}
+		boot = replay_log.boot;
+	}
+	else
+	{
+		// Without a kernel in RAM, only HLE answers the kernel calls
+		if (fast_boot && kernel_path == nullptr && hle_mode != HleMode::On)
+		{
+			std::cerr << "Fast boot needs --kernel or --hle" << std::endl;
+			return 1;
+		}
+		if (dump_kernel_path != nullptr && exe_path != nullptr)
+		{
+			std::cerr << "--dump-kernel boots the BIOS alone, without --exe" << std::endl;
+			return 1;
+		}
+		boot.hle_mode = hle_mode;
+		boot.fast_boot = fast_boot;
+		if (exe_path != nullptr && !read_file(exe_path, boot.exe))
+		{
+			return 1;
+		}
+		if (fast_boot && kernel_path != nullptr && !load_kernel_snapshot(kernel_path, boot.kernel))
+		{
+			return 1;
+		}
+		boot.disc_path = (disc_path != nullptr) ? disc_path : "";
+	}
+
 	Bios bios = Bios("SCPH1001.BIN");
 	Interconnect interconnect = Interconnect(bios);
+	WavSink wav_sink("spu_output.wav");
+	interconnect.spu().set_sink(&wav_sink);
+	TtyFile tty_file(tty_path);
+	interconnect.tty().set_sink(&tty_file);
 	CPU::Core cpu_core = CPU::Core(interconnect);
+	if (replay_path != nullptr && replay_log.bios_hash != BlockCache::hash(cpu_core.interconnect().bios()))
+	{
+		std::cerr << "The replay log was recorded with another BIOS" << std::endl;
+		return 1;
+	}
+	if (!boot_core(cpu_core, boot))
+	{
+		return 1;
+	}
+	if (replay_path != nullptr && replay_log.disc_hash != disc_hash(cpu_core))
+	{
+		std::cerr << "The replay log was recorded with another disc" << std::endl;
+		return 1;
+	}
+	std::unique_ptr<GuestProfiler> profiler;
+	if (profile)
+	{
+		profiler.reset(new GuestProfiler(profile_interval));
+		if (profile_map != nullptr)
+		{
+			profiler->load_map(profile_map);
+		}
+		cpu_core.set_profiler(profiler.get());
+	}
+	cpu_core.stats().time_devices = stats_time;
+	std::unique_ptr<BlockCache> block_cache;
+	if (block_cache_path != nullptr)
+	{
+		block_cache.reset(new BlockCache(cpu_core.interconnect().bios()));
+		block_cache->load(block_cache_path);
+		cpu_core.set_block_cache(block_cache.get());
+	}
+	std::unique_ptr<StatsReporter> stats_reporter;
+	if (stats_target != nullptr)
+	{
+		stats_reporter.reset(new StatsReporter(stats_target, stats_format, stats_period));
+	}
 
-	for (;;)
+	RunLoop run_loop(cpu_core);
+	usize known_blocks = 0;
+	u32 quiet_slices = 0;
+	auto on_slice = [&]()
+	{
+		// Written once discovery settles, runs without a stop condition don't exit cleanly
+		if (block_cache)
+		{
+			quiet_slices = (block_cache->n_blocks() == known_blocks) ? quiet_slices + 1 : 0;
+			known_blocks = block_cache->n_blocks();
+			if (quiet_slices == 500)
+			{
+				block_cache->save(block_cache_path);
+			}
+		}
+		if (stats_reporter)
+		{
+			stats_reporter->poll(cpu_core.stats());
+		}
+	};
+	run_loop.set_slice_callback(on_slice);
+	if (replay_path != nullptr)
+	{
+		// Unthrottled, without the stop conditions of the command line
+		Replayer replayer(cpu_core, replay_log);
+		bool same = replayer.verify();
+		std::cout << "Replay " << (same ? "reproduced" : "diverged from") << " the recorded run, "
+			<< std::dec << cpu_core.state().cycles << " cycles" << std::endl;
+		return same ? 0 : 1;
+	}
+
+	if (fuzz_iterations != 0)
+	{
+		// Iterations start from the booted machine, with the run budget and stop pc
+		if (run_options.max_cycles != 0)
+		{
+			fuzz_options.max_cycles = run_options.max_cycles;
+		}
+		fuzz_options.stop_at_pc = run_options.stop_at_pc;
+		fuzz_options.stop_pc = run_options.stop_pc;
+		Fuzzer fuzzer(cpu_core, fuzz_options);
+		auto start = std::chrono::steady_clock::now();
+		fuzzer.fuzz(fuzz_iterations);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << std::dec << fuzzer.iterations() << " iterations, " <<
+			static_cast<u64>(fuzzer.iterations() / seconds) << " per second, " <<
+			fuzzer.corpus().size() << " inputs in the corpus, " << fuzzer.edges() << " edges" << std::endl;
+		for (const FuzzFinding& finding : fuzzer.findings())
+		{
+			std::ostringstream name;
+			name << "crash-" << Fuzzer::name(finding.crash) << "-" << std::hex << finding.pc << ".bin";
+			std::ofstream file(name.str(), std::ios::binary);
+			file.write(reinterpret_cast<const char*>(finding.input.data()), finding.input.size());
+			std::cout << Fuzzer::name(finding.crash) << " at " << std::hex << finding.pc <<
+				", input in " << name.str() << std::endl;
+		}
+		return fuzzer.findings().empty() ? 0 : 1;
+	}
+
+	if (gdb_target != nullptr)
+	{
+		// Runs are started by the debugger, with the stop conditions of the command line
+		GdbStub stub(cpu_core, run_options);
+		stub.set_slice_callback(on_slice);
+		if (!stub.listen(gdb_target))
+		{
+			return 1;
+		}
+		std::cout << "Waiting for GDB on " << gdb_target << std::endl;
+		stub.serve();
+		cpu_core.interconnect().tty().flush_line();
+		return 0;
+	}
+
+	if (dump_kernel_path != nullptr)
+	{
+		// The kernel is initialized once the BIOS reaches the shell
+		run_options.stop_at_pc = true;
+		run_options.stop_pc = PSX_EXE_SHELL_ENTRY;
+		RunResult result = run_loop.run(run_options);
+		if (result.reason != StopReason::PcHit)
+		{
+			RunLoop::report(result, std::cout);
+			std::cerr << "The BIOS didn't reach the shell, no kernel snapshot written" << std::endl;
+			return 1;
+		}
+		if (!save_kernel_snapshot(dump_kernel_path, cpu_core.interconnect().ram().data()))
+		{
+			return 1;
+		}
+		std::cout << "Kernel snapshot written to " << dump_kernel_path << " after "
+			<< std::dec << cpu_core.state().cycles << " cycles" << std::endl;
+		return 0;
+	}
+
+	std::unique_ptr<ReplayRecorder> recorder;
+	if (record_path != nullptr)
+	{
+		recorder.reset(new ReplayRecorder(cpu_core, boot));
+	}
+	RunResult result = run_loop.run(run_options);
+	cpu_core.interconnect().tty().flush_line();
+	RunLoop::report(result, std::cout);
+	if (recorder)
+	{
+		recorder->finish().save(record_path);
+	}
+
+	if (block_cache)
+	{
+		block_cache->save(block_cache_path);
+	}
+	if (stats_reporter)
+	{
+		stats_reporter->write(cpu_core.stats());
+	}
+	if (profiler)
+	{
+		std::ofstream report("profile.txt");
+		profiler->flat_report(report);
+		profiler->call_graph_report(report);
+		std::ofstream folded("profile.folded");
+		profiler->write_folded(folded);
+	}
+	if (boot.hle_mode != HleMode::Off)
 	{
-		cpu_core.run_next_instruction();
+		std::cout << cpu_core.bios_hle().tty();
+		cpu_core.bios_hle().report(std::cout);
 	}
 
-	return 0;
-}
\ No newline at end of file
+	return (result.reason == StopReason::Error) ? 1 : 0;
+}
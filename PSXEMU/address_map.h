@@ -25,6 +25,18 @@
 #define SPU_ADDR_SPACE_SIZE 640
 #define SPU_END_ADDRESS (SPU_START_ADDRESS + SPU_ADDR_SPACE_SIZE)
 
+#define CDROM_START_ADDRESS 0x1f801800
+#define CDROM_ADDR_SPACE_SIZE 4
+#define CDROM_END_ADDRESS (CDROM_START_ADDRESS + CDROM_ADDR_SPACE_SIZE)
+
+#define MDEC_START_ADDRESS 0x1f801820
+#define MDEC_ADDR_SPACE_SIZE 8
+#define MDEC_END_ADDRESS (MDEC_START_ADDRESS + MDEC_ADDR_SPACE_SIZE)
+
+#define DMA_START_ADDRESS 0x1f801080
+#define DMA_ADDR_SPACE_SIZE 0x80
+#define DMA_END_ADDRESS (DMA_START_ADDRESS + DMA_ADDR_SPACE_SIZE)
+
 #define EXPANSION2_START_ADDRESS 0x1f802000
 #define EXPANSION2_ADDR_SPACE_SIZE 66
 #define EXPANSION2_END_ADDRESS (EXPANSION2_START_ADDRESS + EXPANSION2_ADDR_SPACE_SIZE)
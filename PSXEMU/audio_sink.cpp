@@ -0,0 +1,81 @@
+#include "audio_sink.h"
+#include <cstring>
+#include <iostream>
+
+#define WAV_SAMPLE_RATE 44100
+#define WAV_CHANNELS 2
+#define WAV_BYTES_PER_FRAME (WAV_CHANNELS * 2)
+
+static void put16(u8* p, u16 value)
+{
+	p[0] = static_cast<u8>(value >> 0);
+	p[1] = static_cast<u8>(value >> 8);
+}
+
+static void put32(u8* p, u32 value)
+{
+	p[0] = static_cast<u8>(value >> 0);
+	p[1] = static_cast<u8>(value >> 8);
+	p[2] = static_cast<u8>(value >> 16);
+	p[3] = static_cast<u8>(value >> 24);
+}
+
+WavSink::WavSink(std::string path) :
+	file_(path, std::ios::binary | std::ios::trunc),
+	data_bytes_(0)
+{
+	if (!file_)
+	{
+		std::cerr << "Error opening WAV output file " << path << std::endl;
+		return;
+	}
+	write_header_();
+}
+
+WavSink::~WavSink()
+{
+	if (file_)
+	{
+		file_.close();
+	}
+}
+
+void WavSink::write_header_()
+{
+	u8 header[44];
+	memcpy(header + 0, "RIFF", 4);
+	put32(header + 4, 36 + data_bytes_);
+	memcpy(header + 8, "WAVE", 4);
+	memcpy(header + 12, "fmt ", 4);
+	put32(header + 16, 16);							// fmt chunk size
+	put16(header + 20, 1);							// PCM
+	put16(header + 22, WAV_CHANNELS);
+	put32(header + 24, WAV_SAMPLE_RATE);
+	put32(header + 28, WAV_SAMPLE_RATE * WAV_BYTES_PER_FRAME);
+	put16(header + 32, WAV_BYTES_PER_FRAME);
+	put16(header + 34, 16);							// bits per sample
+	memcpy(header + 36, "data", 4);
+	put32(header + 40, data_bytes_);
+
+	file_.seekp(0, std::ios::beg);
+	file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+	file_.seekp(0, std::ios::end);
+}
+
+void WavSink::write(const s16* frames, usize n_frames)
+{
+	if (!file_)
+	{
+		return;
+	}
+
+	// WAV is little endian, like the host
+	file_.write(reinterpret_cast<const char*>(frames), n_frames * WAV_BYTES_PER_FRAME);
+	data_bytes_ += static_cast<u32>(n_frames * WAV_BYTES_PER_FRAME);
+	write_header_();
+}
+
+u32 WavSink::frames_written() const
+{
+	return data_bytes_ / WAV_BYTES_PER_FRAME;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "types.h"
+#include <fstream>
+#include <string>
+
+// Receives interleaved 16 bit stereo frames produced by the SPU
+class AudioSink
+{
+public:
+	virtual ~AudioSink() {}
+	virtual void write(const s16* frames, usize n_frames) = 0;
+};
+
+// Headless output: 44.1 kHz 16 bit stereo WAV file.
+// The header is kept up to date after every write so the file stays valid
+// even if the emulator is killed.
+class WavSink : public AudioSink
+{
+private:
+	std::ofstream file_;
+	u32 data_bytes_;
+
+	void write_header_();
+
+public:
+	WavSink(std::string path);
+	~WavSink();
+	WavSink(const WavSink&) = delete;
+	WavSink& operator=(const WavSink&) = delete;
+	void write(const s16* frames, usize n_frames) override;
+	u32 frames_written() const;
+};
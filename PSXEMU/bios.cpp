@@ -1,46 +1,39 @@
 #include "bios.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
 Bios::Bios(std::string path)
 {
-	bios_data_ = new u8[BIOS_ADDR_SPACE_SIZE];
+	std::vector<u8> image(BIOS_ADDR_SPACE_SIZE, 0);
 	std::ifstream file(path, std::ios::binary);
 	if (!file) {
 		std::cerr << "Error opening file "<< std::endl;
 	}
 	file.read(
-		reinterpret_cast<char*>(bios_data_),//.data()),
+		reinterpret_cast<char*>(image.data()),
 		BIOS_ADDR_SPACE_SIZE);
 	if (!file) {
 		std::cerr << "Error reading file, could only read " 
 			<< file.gcount() << " bytes" << std::endl;
 	}
 	file.close();
+	image_ = std::make_shared<const std::vector<u8>>(std::move(image));
+	bios_data_ = image_->data();
 }
 
-Bios::~Bios()
+Bios::Bios(const std::vector<u8>& image)
 {
-	delete bios_data_;
-	bios_data_ = nullptr;
+	std::vector<u8> padded(BIOS_ADDR_SPACE_SIZE, 0);
+	memcpy(padded.data(), image.data(), std::min<usize>(image.size(), BIOS_ADDR_SPACE_SIZE));
+	image_ = std::make_shared<const std::vector<u8>>(std::move(padded));
+	bios_data_ = image_->data();
 }
 
-Bios::Bios(const Bios& bios)
+void Bios::patch32(u32 offset, u32 value)
 {
-	bios_data_ = new u8[BIOS_ADDR_SPACE_SIZE];
-	memcpy(bios_data_, bios.bios_data_, BIOS_ADDR_SPACE_SIZE * sizeof(u8));
+	std::shared_ptr<std::vector<u8>> image = std::make_shared<std::vector<u8>>(*image_);
+	memcpy(image->data() + offset, &value, sizeof(value));
+	image_ = image;
+	bios_data_ = image_->data();
 }
-
-u32 Bios::load32(u32 offset)
-{
-	u32 data =
-		(static_cast<u32>(bios_data_[offset + 0])) |
-		(static_cast<u32>(bios_data_[offset + 1]) << 8) |
-		(static_cast<u32>(bios_data_[offset + 2]) << 16) |
-		(static_cast<u32>(bios_data_[offset + 3]) << 24);
-	return data;
-}
-
-u8 Bios::load8(u32 offset)
-{
-	return bios_data_[offset];
-}
\ No newline at end of file
@@ -2,19 +2,43 @@
 #include"types.h"
 #include"address_map.h"
 #include<array>
+#include<cstring>
 #include<iostream>
+#include<memory>
+#include<vector>
 
 
+// The BIOS ROM. Images never change once loaded, so copies share the image
+// and copying or assigning one costs a reference count.
 class Bios
 {
 private:
-	//std::array<u8, BIOS_ADDR_SPACE_SIZE> bios_data_;
-	u8* bios_data_;
+	std::shared_ptr<const std::vector<u8>> image_;
+	const u8* bios_data_;
 public:
 	Bios(std::string path);
-	~Bios();
-	Bios(const Bios& bios);
-	u32 load32(u32 offset);
-	u8 load8(u32 offset);
+	// Image already in memory, zero padded to the BIOS size
+	Bios(const std::vector<u8>& image);
+	// Native little endian loads of any width, at offsets aligned to it
+	template <typename T>
+	T load(u32 offset) const
+	{
+		T value;
+		memcpy(&value, bios_data_ + offset, sizeof(T));
+		return value;
+	}
+	// The whole image, BIOS_ADDR_SPACE_SIZE bytes
+	const u8* data() const
+	{
+		return bios_data_;
+	}
+	// Same image, which copies share until one is patched
+	bool shares_image(const Bios& bios) const
+	{
+		return bios_data_ == bios.bios_data_;
+	}
+	// Replaces a word of this instance's image, which stops sharing it. For
+	// debugger breakpoints.
+	void patch32(u32 offset, u32 value);
 };
 
@@ -0,0 +1,464 @@
+#include "bios_hle.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <vector>
+
+struct HleName
+{
+	u32 vector;
+	u32 function;
+	const char* name;
+};
+
+static const HleName NAMES[] =
+{
+	{0xa0, 0x00, "open"}, {0xa0, 0x01, "lseek"}, {0xa0, 0x02, "read"}, {0xa0, 0x03, "write"},
+	{0xa0, 0x04, "close"}, {0xa0, 0x13, "setjmp"}, {0xa0, 0x14, "longjmp"}, {0xa0, 0x17, "strcmp"},
+	{0xa0, 0x19, "strcpy"}, {0xa0, 0x1b, "strlen"}, {0xa0, 0x25, "toupper"}, {0xa0, 0x28, "bzero"},
+	{0xa0, 0x2a, "memcpy"}, {0xa0, 0x2b, "memset"}, {0xa0, 0x2c, "memmove"}, {0xa0, 0x2f, "rand"},
+	{0xa0, 0x33, "malloc"}, {0xa0, 0x34, "free"}, {0xa0, 0x3c, "putchar"}, {0xa0, 0x3e, "puts"},
+	{0xa0, 0x3f, "printf"}, {0xa0, 0x44, "FlushCache"}, {0xa0, 0x72, "CdRemove"},
+	{0xa0, 0x96, "AddCDROMDevice"}, {0xa0, 0x97, "AddMemCardDevice"}, {0xa0, 0x99, "AddDummyTtyDevice"},
+	{0xa0, 0xa2, "EnqueueCdIntr"}, {0xa0, 0xa3, "DequeueCdIntr"},
+	{0xb0, 0x00, "alloc_kernel_memory"}, {0xb0, 0x07, "DeliverEvent"}, {0xb0, 0x08, "OpenEvent"},
+	{0xb0, 0x09, "CloseEvent"}, {0xb0, 0x0a, "WaitEvent"}, {0xb0, 0x0b, "TestEvent"},
+	{0xb0, 0x0c, "EnableEvent"}, {0xb0, 0x0d, "DisableEvent"}, {0xb0, 0x17, "ReturnFromException"},
+	{0xb0, 0x18, "SetDefaultExitFromException"}, {0xb0, 0x19, "SetCustomExitFromException"},
+	{0xb0, 0x3d, "putchar"}, {0xb0, 0x3f, "puts"}, {0xb0, 0x47, "AddDevice"}, {0xb0, 0x5b, "ChangeClearPad"},
+	{0xc0, 0x00, "EnqueueTimerAndVblankIrqs"}, {0xc0, 0x01, "EnqueueSyscallHandler"},
+	{0xc0, 0x02, "SysEnqIntRP"}, {0xc0, 0x03, "SysDeqIntRP"}, {0xc0, 0x07, "InstallExceptionHandlers"},
+	{0xc0, 0x08, "SysInitMemory"}, {0xc0, 0x0a, "ChangeClearRCnt"}, {0xc0, 0x12, "InstallDevices"},
+	{0xc0, 0x1c, "AdjustA0Table"}
+};
+
+static u32 vector_index(u32 vector)
+{
+	return (vector - 0xa0) >> 4;
+}
+
+// RAM offset of [address, address + size), false if the range leaves RAM
+static bool ram_range(u32 address, u32 size, u32& offset)
+{
+	offset = address & 0x1fffffff;
+	return offset < RAM_ADDR_SPACE_SIZE && size <= RAM_ADDR_SPACE_SIZE - offset;
+}
+
+// RAM offset and length of a NUL terminated string
+static bool ram_string(const Ram& ram, u32 address, u32& offset, u32& length)
+{
+	if (!ram_range(address, 0, offset))
+	{
+		return false;
+	}
+	const u8* data = ram.data();
+	const void* end = memchr(data + offset, 0, RAM_ADDR_SPACE_SIZE - offset);
+	if (end == nullptr)
+	{
+		return false;
+	}
+	length = static_cast<u32>(static_cast<const u8*>(end) - (data + offset));
+	return true;
+}
+
+BiosHle::BiosHle() :
+	mode_(HleMode::Off)
+{
+	memset(calls_, 0, sizeof(calls_));
+	memset(handled_, 0, sizeof(handled_));
+}
+
+void BiosHle::set_mode(HleMode mode)
+{
+	mode_ = mode;
+}
+
+HleMode BiosHle::mode() const
+{
+	return mode_;
+}
+
+bool BiosHle::call(const HleCall& call, Ram& ram, u32& result)
+{
+	u32 vector = vector_index(call.vector);
+	u32 function = call.function & (BIOS_HLE_N_FUNCTIONS - 1);
+	calls_[vector][function]++;
+	if (mode_ != HleMode::On)
+	{
+		return false;
+	}
+
+	bool handled = false;
+	switch (call.vector)
+	{
+	case 0xa0:
+		handled = call_a_(call, ram, result);
+		break;
+	case 0xb0:
+		handled = call_b_(call, ram, result);
+		break;
+	default:
+		break;
+	}
+	if (handled)
+	{
+		handled_[vector][function]++;
+	}
+	return handled;
+}
+
+bool BiosHle::call_a_(const HleCall& call, Ram& ram, u32& result)
+{
+	const u8* data = static_cast<const Ram&>(ram).data();
+	u32 dst;
+	u32 src;
+	u32 length;
+
+	switch (call.function)
+	{
+	case a_memcpy_:
+	case a_memmove_:
+		// Null pointers are rejected by the BIOS without touching the kernel area
+		if (call.args[0] == 0 || call.args[1] == 0)
+		{
+			result = 0;
+			return true;
+		}
+		if (!ram_range(call.args[0], call.args[2], dst) || !ram_range(call.args[1], call.args[2], src))
+		{
+			return false;
+		}
+		// The BIOS memcpy copies forward one byte at a time, overlaps included
+		if (call.function == a_memcpy_ && dst > src && dst < src + call.args[2])
+		{
+			return false;
+		}
+		memmove(ram.writable(dst, call.args[2]), data + src, call.args[2]);
+		result = call.args[0];
+		return true;
+	case a_memset_:
+		if (call.args[0] == 0)
+		{
+			result = 0;
+			return true;
+		}
+		if (!ram_range(call.args[0], call.args[2], dst))
+		{
+			return false;
+		}
+		memset(ram.writable(dst, call.args[2]), static_cast<u8>(call.args[1]), call.args[2]);
+		result = call.args[0];
+		return true;
+	case a_bzero_:
+		if (call.args[0] == 0)
+		{
+			result = 0;
+			return true;
+		}
+		if (!ram_range(call.args[0], call.args[1], dst))
+		{
+			return false;
+		}
+		memset(ram.writable(dst, call.args[1]), 0, call.args[1]);
+		result = call.args[0];
+		return true;
+	case a_strlen_:
+		if (call.args[0] == 0)
+		{
+			result = 0;
+			return true;
+		}
+		if (!ram_string(ram, call.args[0], src, length))
+		{
+			return false;
+		}
+		result = length;
+		return true;
+	case a_strcpy_:
+		if (call.args[0] == 0 || call.args[1] == 0)
+		{
+			result = 0;
+			return true;
+		}
+		if (!ram_string(ram, call.args[1], src, length) || !ram_range(call.args[0], length + 1, dst))
+		{
+			return false;
+		}
+		memmove(ram.writable(dst, length + 1), data + src, length + 1);
+		result = call.args[0];
+		return true;
+	case a_strcmp_:
+	{
+		u32 length2;
+		if (call.args[0] == 0 || call.args[1] == 0 ||
+			!ram_string(ram, call.args[0], dst, length) || !ram_string(ram, call.args[1], src, length2))
+		{
+			return false;
+		}
+		s32 compare = strcmp(reinterpret_cast<const char*>(data + dst), reinterpret_cast<const char*>(data + src));
+		result = static_cast<u32>((compare > 0) - (compare < 0));
+		return true;
+	}
+	case a_putchar_:
+		putchar_(static_cast<u8>(call.args[0]));
+		result = call.args[0];
+		return true;
+	case a_puts_:
+		if (!ram_string(ram, call.args[0], src, length))
+		{
+			return false;
+		}
+		tty_.append(reinterpret_cast<const char*>(data + src), length);
+		tty_.push_back('\n');
+		result = 0;
+		return true;
+	case a_printf_:
+		if (!printf_(call, ram))
+		{
+			return false;
+		}
+		result = 0;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool BiosHle::call_b_(const HleCall& call, const Ram& ram, u32& result)
+{
+	u32 src;
+	u32 length;
+
+	switch (call.function)
+	{
+	case b_putchar_:
+		putchar_(static_cast<u8>(call.args[0]));
+		result = call.args[0];
+		return true;
+	case b_puts_:
+		if (!ram_string(ram, call.args[0], src, length))
+		{
+			return false;
+		}
+		tty_.append(reinterpret_cast<const char*>(ram.data() + src), length);
+		tty_.push_back('\n');
+		result = 0;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// printf with the conversions of the BIOS: c, d, i, o, u, x, X, p, s.
+// The output only reaches the TTY if every argument could be read.
+bool BiosHle::printf_(const HleCall& call, const Ram& ram)
+{
+	u32 offset;
+	u32 length;
+	if (!ram_string(ram, call.args[0], offset, length))
+	{
+		return false;
+	}
+	const char* format = reinterpret_cast<const char*>(ram.data() + offset);
+	const char* format_end = format + length;
+
+	// Argument n lives in a register for n < 4, at sp + 4n otherwise
+	u32 next_arg = 1;
+	bool args_ok = true;
+	auto arg = [&]() -> u32
+	{
+		u32 n = next_arg++;
+		if (n < 4)
+		{
+			return call.args[n];
+		}
+		u32 stack;
+		if (!ram_range(call.sp + n * 4, 4, stack))
+		{
+			args_ok = false;
+			return 0;
+		}
+		return ram.load<u32>(stack);
+	};
+
+	std::string out;
+	char buffer[256];
+	for (const char* p = format; p < format_end; p++)
+	{
+		if (*p != '%')
+		{
+			out.push_back(*p);
+			continue;
+		}
+
+		std::string spec = "%";
+		p++;
+		while (p < format_end && strchr("-+ #0", *p) != nullptr)
+		{
+			spec.push_back(*p++);
+		}
+		s32 width = -1;
+		s32 precision = -1;
+		if (p < format_end && *p == '*')
+		{
+			width = static_cast<s32>(arg());
+			p++;
+		}
+		while (p < format_end && *p >= '0' && *p <= '9')
+		{
+			width = (width < 0 ? 0 : width * 10) + (*p++ - '0');
+		}
+		if (p < format_end && *p == '.')
+		{
+			precision = 0;
+			p++;
+			while (p < format_end && *p >= '0' && *p <= '9')
+			{
+				precision = precision * 10 + (*p++ - '0');
+			}
+		}
+		while (p < format_end && strchr("hlL", *p) != nullptr)
+		{
+			p++;
+		}
+		if (p >= format_end)
+		{
+			break;
+		}
+		width = std::min(width, 200);
+		precision = std::min(precision, 200);
+
+		spec += (*p == 'c') ? "*" : "*.*";
+		spec.push_back(*p);
+		switch (*p)
+		{
+		case 'c':
+			snprintf(buffer, sizeof(buffer), spec.c_str(), width, static_cast<s32>(arg()));
+			out += buffer;
+			break;
+		case 'd':
+		case 'i':
+			snprintf(buffer, sizeof(buffer), spec.c_str(), width, precision, static_cast<s32>(arg()));
+			out += buffer;
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			snprintf(buffer, sizeof(buffer), spec.c_str(), width, precision, arg());
+			out += buffer;
+			break;
+		case 'p':
+			snprintf(buffer, sizeof(buffer), "%08x", arg());
+			out += buffer;
+			break;
+		case 's':
+		{
+			u32 string;
+			u32 string_length;
+			if (!ram_string(ram, arg(), string, string_length))
+			{
+				return false;
+			}
+			std::string value(reinterpret_cast<const char*>(ram.data() + string), string_length);
+			if (precision >= 0 && static_cast<u32>(precision) < string_length)
+			{
+				value.resize(precision);
+			}
+			if (width > static_cast<s32>(value.size()))
+			{
+				std::string padding(width - value.size(), ' ');
+				value = (spec.find('-') != std::string::npos) ? value + padding : padding + value;
+			}
+			out += value;
+			break;
+		}
+		case '%':
+			out.push_back('%');
+			break;
+		default:
+			out.push_back('%');
+			out.push_back(*p);
+			break;
+		}
+	}
+
+	if (!args_ok)
+	{
+		return false;
+	}
+	tty_ += out;
+	return true;
+}
+
+void BiosHle::putchar_(u8 c)
+{
+	// Tabs and carriage returns are kept, the BIOS only expands them on real terminals
+	tty_.push_back(static_cast<char>(c));
+}
+
+const std::string& BiosHle::tty() const
+{
+	return tty_;
+}
+
+void BiosHle::clear_tty()
+{
+	tty_.clear();
+}
+
+u64 BiosHle::calls(u32 vector, u32 function) const
+{
+	return calls_[vector_index(vector)][function & (BIOS_HLE_N_FUNCTIONS - 1)];
+}
+
+void BiosHle::report(std::ostream& out) const
+{
+	struct Entry
+	{
+		u32 vector;
+		u32 function;
+		u64 calls;
+		u64 handled;
+	};
+
+	std::vector<Entry> entries;
+	for (u32 v = 0; v < 3; v++)
+	{
+		for (u32 f = 0; f < BIOS_HLE_N_FUNCTIONS; f++)
+		{
+			if (calls_[v][f] > 0)
+			{
+				entries.push_back({0xa0 + v * 0x10, f, calls_[v][f], handled_[v][f]});
+			}
+		}
+	}
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+	{
+		return a.calls > b.calls;
+	});
+
+	out << "BIOS calls (* run by the BIOS)" << std::endl;
+	for (const Entry& entry : entries)
+	{
+		const char* function_name = name(entry.vector, entry.function);
+		out << ((entry.handled < entry.calls) ? "* " : "  ")
+			<< static_cast<char>('A' + (entry.vector - 0xa0) / 0x10) << "(" << std::hex << std::setw(2)
+			<< std::setfill('0') << entry.function << ") " << std::dec << std::setfill(' ') << std::left
+			<< std::setw(28) << ((function_name != nullptr) ? function_name : "?") << std::right
+			<< std::setw(12) << entry.calls << std::setw(12) << entry.handled << std::endl;
+	}
+}
+
+const char* BiosHle::name(u32 vector, u32 function)
+{
+	for (const HleName& entry : NAMES)
+	{
+		if (entry.vector == vector && entry.function == function)
+		{
+			return entry.name;
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "types.h"
+#include "ram.h"
+#include <ostream>
+#include <string>
+
+#define BIOS_HLE_N_FUNCTIONS 256
+
+enum class HleMode
+{
+	Off,
+	CountOnly,						// calls are counted and run by the BIOS
+	On
+};
+
+// Arguments of a kernel call: a0-a3 in registers, the rest on the stack
+struct HleCall
+{
+	u32 vector;						// 0xa0, 0xb0 or 0xc0
+	u32 function;					// t1
+	u32 args[4];					// a0-a3
+	u32 sp;
+};
+
+// Native implementation of the hot BIOS A0/B0/C0 functions. Anything not
+// implemented, or touching memory outside of RAM, is left to the BIOS.
+class BiosHle
+{
+private:
+	HleMode mode_;
+	u64 calls_[3][BIOS_HLE_N_FUNCTIONS];
+	u64 handled_[3][BIOS_HLE_N_FUNCTIONS];
+	std::string tty_;
+
+	static const u32
+		a_strcmp_ = 0x17,
+		a_strcpy_ = 0x19,
+		a_strlen_ = 0x1b,
+		a_bzero_ = 0x28,
+		a_memcpy_ = 0x2a,
+		a_memset_ = 0x2b,
+		a_memmove_ = 0x2c,
+		a_putchar_ = 0x3c,
+		a_puts_ = 0x3e,
+		a_printf_ = 0x3f,
+		b_putchar_ = 0x3d,
+		b_puts_ = 0x3f;
+
+	bool call_a_(const HleCall& call, Ram& ram, u32& result);
+	bool call_b_(const HleCall& call, const Ram& ram, u32& result);
+	bool printf_(const HleCall& call, const Ram& ram);
+	void putchar_(u8 c);
+
+public:
+	BiosHle();
+	void set_mode(HleMode mode);
+	HleMode mode() const;
+	// Counts the call and runs it natively when possible. Returns false when
+	// the BIOS has to run it, result is the value of v0 otherwise.
+	bool call(const HleCall& call, Ram& ram, u32& result);
+
+	// Output of putchar, puts and printf
+	const std::string& tty() const;
+	void clear_tty();
+	u64 calls(u32 vector, u32 function) const;
+	// Call counts, most called first, with the functions run by the BIOS marked
+	void report(std::ostream& out) const;
+
+	static const char* name(u32 vector, u32 function);
+};
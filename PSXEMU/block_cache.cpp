@@ -0,0 +1,158 @@
+#include "block_cache.h"
+#include "hash.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#define BLOCK_CACHE_MAGIC "PSXBLKC"
+
+// Instructions that may change the fetch address: jumps, branches, and the
+// exceptions raised by syscall and break
+static bool ends_block(u32 instruction)
+{
+	u32 function = instruction >> 26;
+	if (function == 0x00)
+	{
+		u32 subfunction = instruction & 0x3f;
+		return subfunction == 0x08 || subfunction == 0x09 || subfunction == 0x0c || subfunction == 0x0d;
+	}
+	return function >= 0x01 && function <= 0x07;
+}
+
+BlockCache::BlockCache(const Bios& bios) :
+	bios_(bios),
+	owned_(BLOCK_CACHE_N_ENTRIES, 0),
+	n_blocks_(0),
+	dirty_(false)
+{
+	lengths_ = owned_.data();
+}
+
+u32 BlockCache::discover_(u32 offset)
+{
+	// Stops after the delay slot of the first branch, or at the end of the image
+	u32 length = 0;
+	u32 end = offset;
+	while (end < BIOS_ADDR_SPACE_SIZE && length < BLOCK_CACHE_MAX_LENGTH)
+	{
+		bool branch = ends_block(bios_.load<u32>(end));
+		end += 4;
+		length++;
+		if (branch)
+		{
+			// The branch runs while its delay slot is fetched
+			length += (end < BIOS_ADDR_SPACE_SIZE) ? 1 : 0;
+			break;
+		}
+	}
+
+	// Mapped pages stay shared until something new is found
+	if (lengths_ != owned_.data())
+	{
+		owned_.assign(lengths_, lengths_ + BLOCK_CACHE_N_ENTRIES);
+		lengths_ = owned_.data();
+		file_.close();
+	}
+	owned_[offset >> 2] = static_cast<u16>(length);
+	n_blocks_++;
+	dirty_ = true;
+	return length;
+}
+
+usize BlockCache::n_blocks() const
+{
+	return n_blocks_;
+}
+
+u64 BlockCache::hash(const Bios& bios)
+{
+	return fnv1a(FNV1A_SEED, bios.data(), BIOS_ADDR_SPACE_SIZE);
+}
+
+bool BlockCache::load(const std::string& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		return false;
+	}
+
+	BlockCacheHeader header;
+	if (file.size() != sizeof(header) + BLOCK_CACHE_N_ENTRIES * sizeof(u16))
+	{
+		std::cerr << "Ignoring block cache " << path << ": bad size" << std::endl;
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, BLOCK_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != BLOCK_CACHE_VERSION || header.n_entries != BLOCK_CACHE_N_ENTRIES)
+	{
+		std::cerr << "Ignoring block cache " << path << ": other format version" << std::endl;
+		return false;
+	}
+	if (header.bios_hash != hash(bios_))
+	{
+		std::cerr << "Ignoring block cache " << path << ": made for another BIOS" << std::endl;
+		return false;
+	}
+
+	const u16* lengths = reinterpret_cast<const u16*>(file.data() + sizeof(header));
+	usize n_blocks = 0;
+	for (u32 i = 0; i < BLOCK_CACHE_N_ENTRIES; i++)
+	{
+		if (lengths[i] > BLOCK_CACHE_MAX_LENGTH || (i + lengths[i]) > BLOCK_CACHE_N_ENTRIES)
+		{
+			std::cerr << "Ignoring block cache " << path << ": corrupted" << std::endl;
+			return false;
+		}
+		n_blocks += (lengths[i] != 0) ? 1 : 0;
+	}
+
+	file_.open(path);
+	lengths_ = reinterpret_cast<const u16*>(file_.data() + sizeof(header));
+	owned_.clear();
+	owned_.shrink_to_fit();
+	n_blocks_ = n_blocks;
+	dirty_ = false;
+	return true;
+}
+
+bool BlockCache::save(const std::string& path)
+{
+	if (!dirty_)
+	{
+		return true;
+	}
+
+	BlockCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BLOCK_CACHE_MAGIC, sizeof(BLOCK_CACHE_MAGIC));
+	header.version = BLOCK_CACHE_VERSION;
+	header.n_entries = BLOCK_CACHE_N_ENTRIES;
+	header.bios_hash = hash(bios_);
+
+	// Other instances may be mapping the old file
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(lengths_), BLOCK_CACHE_N_ENTRIES * sizeof(u16));
+		if (!file)
+		{
+			std::cerr << "Error writing block cache " << temporary << std::endl;
+			return false;
+		}
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0)
+	{
+		// Windows doesn't replace existing files
+		std::remove(path.c_str());
+		if (std::rename(temporary.c_str(), path.c_str()) != 0)
+		{
+			std::cerr << "Error replacing block cache " << path << std::endl;
+			return false;
+		}
+	}
+	dirty_ = false;
+	return true;
+}
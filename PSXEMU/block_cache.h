@@ -0,0 +1,66 @@
+#pragma once
+#include "types.h"
+#include "bios.h"
+#include "mapped_file.h"
+#include "stats.h"
+#include <string>
+#include <vector>
+
+#define BLOCK_CACHE_VERSION 1
+#define BLOCK_CACHE_MAX_LENGTH 1024						// fetches
+#define BLOCK_CACHE_N_ENTRIES (BIOS_ADDR_SPACE_SIZE / 4)
+
+// Blocks of the read-only BIOS: for every word offset a block starts at,
+// the number of sequential fetches up to and including the delay slot of
+// the first branch. Found on first use, or memory-mapped from a file
+// written by an earlier run with the same BIOS.
+//
+// File layout: BlockCacheHeader, then u16 lengths[BLOCK_CACHE_N_ENTRIES]
+// (0 for offsets not discovered yet), native byte order.
+struct BlockCacheHeader
+{
+	char magic[8];				// "PSXBLKC"
+	u32 version;
+	u32 n_entries;
+	u64 bios_hash;				// FNV-1a of the whole image
+};
+
+class BlockCache
+{
+private:
+	const Bios& bios_;
+	MappedFile file_;
+	const u16* lengths_;		// mapped file, or owned_ once anything is discovered
+	std::vector<u16> owned_;
+	usize n_blocks_;
+	bool dirty_;
+
+	u32 discover_(u32 offset);
+
+public:
+	// The BIOS must outlive the cache, usually it's the one of the core running it
+	explicit BlockCache(const Bios& bios);
+	BlockCache(const BlockCache&) = delete;
+	BlockCache& operator=(const BlockCache&) = delete;
+
+	// Number of fetches of the block starting at a word aligned BIOS offset
+	u32 length(u32 offset, Stats& stats)
+	{
+		u16 length = lengths_[offset >> 2];
+		if (length != 0)
+		{
+			stats.cache_hits++;
+			return length;
+		}
+		stats.cache_misses++;
+		return discover_(offset);
+	}
+
+	usize n_blocks() const;
+	// false when the file is missing, from another version or for another BIOS
+	bool load(const std::string& path);
+	// Only writes when blocks were discovered, through a temporary file
+	bool save(const std::string& path);
+
+	static u64 hash(const Bios& bios);
+};
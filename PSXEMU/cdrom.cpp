@@ -0,0 +1,558 @@
+#include "cdrom.h"
+#include "log.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstring>
+
+static u8 bcd_to_bin(u8 value)
+{
+	return (value >> 4) * 10 + (value & 0xf);
+}
+
+static u8 bin_to_bcd(u32 value)
+{
+	return static_cast<u8>(((value / 10) << 4) | (value % 10));
+}
+
+// Absolute MSF of a sector, as BCD minutes, seconds and frames
+static void lba_to_bcd_msf(u32 lba, u8& m, u8& s, u8& f)
+{
+	u32 sectors = lba + CD_LEAD_IN_SECTORS;
+	m = bin_to_bcd(sectors / (60 * CD_SECTORS_PER_SECOND));
+	s = bin_to_bcd((sectors / CD_SECTORS_PER_SECOND) % 60);
+	f = bin_to_bcd(sectors % CD_SECTORS_PER_SECOND);
+}
+
+Cdrom::Cdrom() :
+	index_(0),
+	interrupt_enable_(0),
+	interrupt_flag_(0),
+	data_index_(0),
+	busy_(false),
+	command_(0),
+	mode_(0),
+	motor_on_(false),
+	reading_(false),
+	seeking_(false),
+	playing_(false),
+	seek_pending_(false),
+	seek_lba_(0),
+	read_lba_(0),
+	sector_ready_(false)
+{
+	ack_.type = CdromInt::None;
+	second_.type = CdromInt::None;
+	memset(sector_, 0, sizeof(sector_));
+}
+
+void Cdrom::insert_disc(std::shared_ptr<DiscImage> disc)
+{
+	disc_ = disc;
+	motor_on_ = (disc_ != nullptr);
+}
+
+DiscImage* Cdrom::disc() const
+{
+	return disc_.get();
+}
+
+u8 Cdrom::stat_() const
+{
+	u8 stat = 0;
+	stat |= (disc_ == nullptr) ? stat_shell_open_ : 0;
+	stat |= motor_on_ ? stat_motor_ : 0;
+	stat |= reading_ ? stat_reading_ : 0;
+	stat |= seeking_ ? stat_seeking_ : 0;
+	stat |= playing_ ? stat_playing_ : 0;
+	return stat;
+}
+
+u8 Cdrom::status_register_() const
+{
+	u8 status = index_;
+	status |= parameters_.empty() ? 0x08 : 0;
+	status |= (parameters_.size() < CDROM_FIFO_SIZE) ? 0x10 : 0;
+	status |= responses_.empty() ? 0 : 0x20;
+	status |= (data_index_ < data_.size()) ? 0x40 : 0;
+	status |= busy_ ? 0x80 : 0;
+	return status;
+}
+
+CdromResponse Cdrom::error_(u8 code) const
+{
+	return CdromResponse{ CdromInt::Error, { static_cast<u8>(stat_() | stat_error_), code } };
+}
+
+u32 Cdrom::sector_cycles_() const
+{
+	return (mode_ & mode_double_speed_) ? CDROM_SECTOR_CYCLES / 2 : CDROM_SECTOR_CYCLES;
+}
+
+const DiscTrack* Cdrom::track_of_(u32 lba) const
+{
+	const DiscTrack* found = nullptr;
+	for (const DiscTrack& track : disc_->tracks())
+	{
+		if (track.start_lba <= lba)
+		{
+			found = &track;
+		}
+	}
+	return found;
+}
+
+// Region letter of the license string in sector 4
+char Cdrom::region_() const
+{
+	u8 sector[CD_SECTOR_SIZE];
+	if (!disc_->read_sector(4, sector))
+	{
+		return 'I';
+	}
+
+	std::string license(reinterpret_cast<const char*>(sector + 24), 2048);
+	if (license.find("Europe") != std::string::npos)
+	{
+		return 'E';
+	}
+	if (license.find("Amer") != std::string::npos)
+	{
+		return 'A';
+	}
+	return 'I';
+}
+
+u8 Cdrom::load8(u32 offset)
+{
+	switch (offset)
+	{
+	case 0:
+		return status_register_();
+	case 1:
+	{
+		if (responses_.empty())
+		{
+			return 0;
+		}
+		u8 value = responses_.front();
+		responses_.pop_front();
+		return value;
+	}
+	case 2:
+		return (data_index_ < data_.size()) ? data_[data_index_++] : 0;
+	default:
+		// The 3 unused flag bits read as 1
+		return ((index_ & 0x1) == 0) ? (interrupt_enable_ | 0xe0) : (interrupt_flag_ | 0xe0);
+	}
+}
+
+void Cdrom::store8(u32 offset, u8 value, Scheduler& scheduler)
+{
+	switch ((offset << 2) | index_)
+	{
+	case (0 << 2) | 0:
+	case (0 << 2) | 1:
+	case (0 << 2) | 2:
+	case (0 << 2) | 3:
+		index_ = value & 0x3;
+		break;
+	case (1 << 2) | 0:
+		execute_command_(value, scheduler);
+		break;
+	case (2 << 2) | 0:
+		if (parameters_.size() < CDROM_FIFO_SIZE)
+		{
+			parameters_.push_back(value);
+		}
+		break;
+	case (2 << 2) | 1:
+		interrupt_enable_ = value & 0x1f;
+		break;
+	case (3 << 2) | 0:
+		// Request register, bit 7 loads the data FIFO with the sector buffer
+		if (value & 0x80)
+		{
+			load_data_fifo_();
+		}
+		else
+		{
+			data_.clear();
+			data_index_ = 0;
+		}
+		break;
+	case (3 << 2) | 1:
+		interrupt_flag_ &= ~(value & 0x1f);
+		if (value & 0x40)
+		{
+			parameters_.clear();
+		}
+		break;
+	default:
+		// Sound map and CD audio volume registers
+		break;
+	}
+}
+
+void Cdrom::execute_command_(u8 command, Scheduler& scheduler)
+{
+	std::vector<u8> params(parameters_.begin(), parameters_.end());
+	parameters_.clear();
+
+	command_ = command;
+	ack_ = CdromResponse{ CdromInt::Acknowledge, { stat_() } };
+	second_.type = CdromInt::None;
+	u64 second_delay = CDROM_SECOND_RESPONSE_CYCLES;
+
+	auto need_params = [&](usize n)
+	{
+		if (params.size() < n)
+		{
+			ack_ = error_(0x20);
+			return false;
+		}
+		return true;
+	};
+	auto need_disc = [&]()
+	{
+		if (disc_ == nullptr)
+		{
+			ack_ = error_(0x80);
+			return false;
+		}
+		return true;
+	};
+
+	switch (command)
+	{
+	case cmd_getstat_:
+		break;
+	case cmd_setloc_:
+		if (need_params(3))
+		{
+			u32 sectors = (bcd_to_bin(params[0]) * 60 + bcd_to_bin(params[1])) * CD_SECTORS_PER_SECOND +
+				bcd_to_bin(params[2]);
+			seek_lba_ = (sectors >= CD_LEAD_IN_SECTORS) ? sectors - CD_LEAD_IN_SECTORS : 0;
+			seek_pending_ = true;
+		}
+		break;
+	case cmd_play_:
+		// CD audio isn't streamed to the SPU yet
+		if (need_disc())
+		{
+			reading_ = false;
+			playing_ = true;
+		}
+		break;
+	case cmd_readn_:
+	case cmd_reads_:
+		if (need_disc())
+		{
+			start_reading_(scheduler);
+		}
+		break;
+	case cmd_motor_on_:
+		motor_on_ = true;
+		second_ = CdromResponse{ CdromInt::Complete, { stat_() } };
+		break;
+	case cmd_stop_:
+		reading_ = false;
+		playing_ = false;
+		motor_on_ = false;
+		scheduler.cancel(SchedulerEvent::CdromSector);
+		second_ = CdromResponse{ CdromInt::Complete, { stat_() } };
+		break;
+	case cmd_pause_:
+		reading_ = false;
+		playing_ = false;
+		scheduler.cancel(SchedulerEvent::CdromSector);
+		second_ = CdromResponse{ CdromInt::Complete, { stat_() } };
+		break;
+	case cmd_init_:
+	case cmd_reset_:
+		mode_ = 0x20;
+		reading_ = false;
+		playing_ = false;
+		seeking_ = false;
+		motor_on_ = (disc_ != nullptr);
+		scheduler.cancel(SchedulerEvent::CdromSector);
+		if (command == cmd_init_)
+		{
+			second_ = CdromResponse{ CdromInt::Complete, { stat_() } };
+			second_delay = CDROM_INIT_CYCLES;
+		}
+		break;
+	case cmd_mute_:
+	case cmd_demute_:
+	case cmd_setfilter_:
+		break;
+	case cmd_setmode_:
+		if (need_params(1))
+		{
+			mode_ = params[0];
+		}
+		break;
+	case cmd_getparam_:
+		ack_.bytes = { stat_(), mode_, 0x00, 0x00, 0x00 };
+		break;
+	case cmd_getlocl_:
+		if (!sector_ready_)
+		{
+			ack_ = error_(0x80);
+			break;
+		}
+		ack_.bytes.assign(sector_ + 12, sector_ + 20);
+		break;
+	case cmd_getlocp_:
+		if (need_disc())
+		{
+			u32 lba = (read_lba_ > 0) ? read_lba_ - 1 : 0;
+			const DiscTrack* track = track_of_(lba);
+			u32 track_number = (track != nullptr) ? track->number : 1;
+			u32 relative = (track != nullptr && lba >= track->start_lba) ? lba - track->start_lba : 0;
+			u8 am, as, af;
+			u8 m = bin_to_bcd(relative / (60 * CD_SECTORS_PER_SECOND));
+			u8 s = bin_to_bcd((relative / CD_SECTORS_PER_SECOND) % 60);
+			u8 f = bin_to_bcd(relative % CD_SECTORS_PER_SECOND);
+			lba_to_bcd_msf(lba, am, as, af);
+			ack_.bytes = { bin_to_bcd(track_number), 0x01, m, s, f, am, as, af };
+		}
+		break;
+	case cmd_gettn_:
+		if (need_disc())
+		{
+			const std::vector<DiscTrack>& tracks = disc_->tracks();
+			ack_.bytes = { stat_(), bin_to_bcd(tracks.front().number), bin_to_bcd(tracks.back().number) };
+		}
+		break;
+	case cmd_gettd_:
+		if (need_params(1) && need_disc())
+		{
+			u32 number = bcd_to_bin(params[0]);
+			u32 lba = disc_->n_sectors();	// track 0 is the lead out
+			bool found = (number == 0);
+			for (const DiscTrack& track : disc_->tracks())
+			{
+				if (track.number == number)
+				{
+					lba = track.start_lba;
+					found = true;
+				}
+			}
+			if (!found)
+			{
+				ack_ = error_(0x10);
+				break;
+			}
+			u8 m, s, f;
+			lba_to_bcd_msf(lba, m, s, f);
+			ack_.bytes = { stat_(), m, s };
+		}
+		break;
+	case cmd_seekl_:
+	case cmd_seekp_:
+		if (need_disc())
+		{
+			reading_ = false;
+			playing_ = false;
+			scheduler.cancel(SchedulerEvent::CdromSector);
+			read_lba_ = seek_lba_;
+			seek_pending_ = false;
+			seeking_ = true;
+			ack_.bytes = { stat_() };
+			seeking_ = false;
+			second_ = CdromResponse{ CdromInt::Complete, { stat_() } };
+		}
+		break;
+	case cmd_test_:
+		if (need_params(1))
+		{
+			if (params[0] == 0x20)
+			{
+				// Controller BIOS date and version
+				ack_.bytes = { 0x94, 0x09, 0x19, 0xc0 };
+			}
+			else
+			{
+				LOG_WARN(Cdrom, "Unhandled CDROM test command: {}", params[0]);
+				ack_ = error_(0x10);
+			}
+		}
+		break;
+	case cmd_getid_:
+		if (disc_ == nullptr)
+		{
+			second_ = CdromResponse{ CdromInt::Error, { 0x08, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } };
+		}
+		else
+		{
+			second_ = CdromResponse{ CdromInt::Complete,
+				{ stat_(), 0x00, 0x20, 0x00, 'S', 'C', 'E', static_cast<u8>(region_()) } };
+		}
+		break;
+	case cmd_readtoc_:
+		if (need_disc())
+		{
+			second_ = CdromResponse{ CdromInt::Complete, { stat_() } };
+			second_delay = CDROM_INIT_CYCLES;
+		}
+		break;
+	default:
+		LOG_WARN(Cdrom, "Unhandled CDROM command: {}", command);
+		ack_ = error_(0x40);
+		break;
+	}
+
+	if (ack_.type == CdromInt::Error)
+	{
+		second_.type = CdromInt::None;
+	}
+
+	busy_ = true;
+	scheduler.schedule(SchedulerEvent::CdromAck, scheduler.now() + CDROM_ACK_CYCLES);
+	if (second_.type != CdromInt::None)
+	{
+		scheduler.schedule(SchedulerEvent::CdromResponse, scheduler.now() + CDROM_ACK_CYCLES + second_delay);
+	}
+	else
+	{
+		scheduler.cancel(SchedulerEvent::CdromResponse);
+	}
+}
+
+void Cdrom::start_reading_(Scheduler& scheduler)
+{
+	if (seek_pending_)
+	{
+		read_lba_ = seek_lba_;
+		seek_pending_ = false;
+	}
+
+	motor_on_ = true;
+	playing_ = false;
+	reading_ = true;
+	scheduler.schedule(SchedulerEvent::CdromSector, scheduler.now() + CDROM_ACK_CYCLES + sector_cycles_());
+}
+
+void Cdrom::read_sector_(Scheduler& scheduler)
+{
+	if (!disc_->read_sector(read_lba_, sector_))
+	{
+		reading_ = false;
+		deliver_(error_(0x04));
+		return;
+	}
+
+	read_lba_++;
+	sector_ready_ = true;
+	deliver_(CdromResponse{ CdromInt::DataReady, { stat_() } });
+	scheduler.schedule(SchedulerEvent::CdromSector, scheduler.now() + sector_cycles_());
+}
+
+void Cdrom::deliver_(const CdromResponse& response)
+{
+	interrupt_flag_ = (interrupt_flag_ & ~0x7) | static_cast<u8>(response.type);
+	responses_.assign(response.bytes.begin(), response.bytes.end());
+}
+
+void Cdrom::run_event(SchedulerEvent event, Scheduler& scheduler)
+{
+	// The controller waits for the CPU to acknowledge the previous interrupt
+	if ((interrupt_flag_ & 0x7) != 0)
+	{
+		scheduler.schedule(event, scheduler.now() + CDROM_INT_RETRY_CYCLES);
+		return;
+	}
+
+	switch (event)
+	{
+	case SchedulerEvent::CdromAck:
+		busy_ = false;
+		deliver_(ack_);
+		break;
+	case SchedulerEvent::CdromResponse:
+		deliver_(second_);
+		second_.type = CdromInt::None;
+		break;
+	case SchedulerEvent::CdromSector:
+		if (reading_)
+		{
+			read_sector_(scheduler);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void Cdrom::load_data_fifo_()
+{
+	if (!sector_ready_)
+	{
+		data_.clear();
+		data_index_ = 0;
+		return;
+	}
+
+	if (mode_ & mode_whole_sector_)
+	{
+		// Everything after the sync pattern: header, subheader and data
+		data_.assign(sector_ + 12, sector_ + CD_SECTOR_SIZE);
+	}
+	else
+	{
+		// Mode 2 form 1 user data
+		data_.assign(sector_ + 24, sector_ + 24 + 2048);
+	}
+	data_index_ = 0;
+}
+
+u32 Cdrom::read_data_word()
+{
+	u32 value = 0;
+	for (u32 i = 0; i < 4; i++)
+	{
+		u32 byte = (data_index_ < data_.size()) ? data_[data_index_++] : 0;
+		value |= byte << (i * 8);
+	}
+	return value;
+}
+
+static u64 hash_response(u64 hash, const CdromResponse& response)
+{
+	hash = fnv1a_value(hash, response.type);
+	return fnv1a(hash, response.bytes.data(), response.bytes.size());
+}
+
+u64 Cdrom::hash(u64 seed) const
+{
+	u64 hash = fnv1a_value(seed, index_);
+	hash = fnv1a_value(hash, interrupt_enable_);
+	hash = fnv1a_value(hash, interrupt_flag_);
+	for (u8 parameter : parameters_)
+	{
+		hash = fnv1a_value(hash, parameter);
+	}
+	hash = fnv1a_value(hash, static_cast<u32>(parameters_.size()));
+	for (u8 response : responses_)
+	{
+		hash = fnv1a_value(hash, response);
+	}
+	hash = fnv1a_value(hash, static_cast<u32>(responses_.size()));
+	hash = fnv1a(hash, data_.data() + data_index_, data_.size() - std::min(data_index_, data_.size()));
+	hash = fnv1a_value(hash, busy_);
+	hash = hash_response(hash, ack_);
+	hash = hash_response(hash, second_);
+	hash = fnv1a_value(hash, command_);
+	hash = fnv1a_value(hash, mode_);
+	u8 flags = (motor_on_ ? 0x1 : 0) | (reading_ ? 0x2 : 0) | (seeking_ ? 0x4 : 0) |
+		(playing_ ? 0x8 : 0) | (seek_pending_ ? 0x10 : 0) | (sector_ready_ ? 0x20 : 0);
+	hash = fnv1a_value(hash, flags);
+	hash = fnv1a_value(hash, seek_lba_);
+	hash = fnv1a_value(hash, read_lba_);
+	return fnv1a(hash, sector_, sizeof(sector_));
+}
+
+bool Cdrom::irq() const
+{
+	return (interrupt_flag_ & interrupt_enable_ & 0x1f) != 0;
+}
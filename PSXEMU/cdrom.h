@@ -0,0 +1,127 @@
+#pragma once
+#include "types.h"
+#include "disc_image.h"
+#include "scheduler.h"
+#include <deque>
+#include <memory>
+#include <vector>
+
+#define CDROM_FIFO_SIZE 16
+#define CDROM_ACK_CYCLES 50401				// command to first response
+#define CDROM_SECOND_RESPONSE_CYCLES 33868	// first to second response (GetID, seeks...)
+#define CDROM_INIT_CYCLES 81102
+#define CDROM_INT_RETRY_CYCLES 1000			// delay when the previous interrupt isn't acknowledged
+#define CDROM_SECTOR_CYCLES (33868800 / CD_SECTORS_PER_SECOND)	// single speed
+
+enum class CdromInt
+{
+	None = 0,
+	DataReady = 1,
+	Complete = 2,
+	Acknowledge = 3,
+	DataEnd = 4,
+	Error = 5
+};
+
+struct CdromResponse
+{
+	CdromInt type;
+	std::vector<u8> bytes;
+};
+
+// CD-ROM controller at 0x1f801800: four 8 bit ports multiplexed by an index
+class Cdrom
+{
+private:
+	std::shared_ptr<DiscImage> disc_;
+
+	u8 index_;
+	u8 interrupt_enable_;
+	u8 interrupt_flag_;
+	std::deque<u8> parameters_;
+	std::deque<u8> responses_;
+	std::vector<u8> data_;					// data FIFO, loaded from the sector buffer
+	usize data_index_;
+
+	bool busy_;
+	CdromResponse ack_;						// delivered at the CdromAck event
+	CdromResponse second_;					// delivered at the CdromResponse event
+	u8 command_;
+
+	u8 mode_;
+	bool motor_on_;
+	bool reading_;
+	bool seeking_;
+	bool playing_;
+	bool seek_pending_;
+	u32 seek_lba_;							// Setloc target
+	u32 read_lba_;							// next sector to read
+	u8 sector_[CD_SECTOR_SIZE];				// last sector read
+	bool sector_ready_;
+
+	static const u8
+		cmd_getstat_ = 0x01,
+		cmd_setloc_ = 0x02,
+		cmd_play_ = 0x03,
+		cmd_readn_ = 0x06,
+		cmd_motor_on_ = 0x07,
+		cmd_stop_ = 0x08,
+		cmd_pause_ = 0x09,
+		cmd_init_ = 0x0a,
+		cmd_mute_ = 0x0b,
+		cmd_demute_ = 0x0c,
+		cmd_setfilter_ = 0x0d,
+		cmd_setmode_ = 0x0e,
+		cmd_getparam_ = 0x0f,
+		cmd_getlocl_ = 0x10,
+		cmd_getlocp_ = 0x11,
+		cmd_gettn_ = 0x13,
+		cmd_gettd_ = 0x14,
+		cmd_seekl_ = 0x15,
+		cmd_seekp_ = 0x16,
+		cmd_test_ = 0x19,
+		cmd_getid_ = 0x1a,
+		cmd_reads_ = 0x1b,
+		cmd_reset_ = 0x1c,
+		cmd_readtoc_ = 0x1e;
+
+	static const u8
+		stat_error_ = 0x01,
+		stat_motor_ = 0x02,
+		stat_shell_open_ = 0x10,
+		stat_reading_ = 0x20,
+		stat_seeking_ = 0x40,
+		stat_playing_ = 0x80;
+
+	static const u8
+		mode_double_speed_ = 0x80,
+		mode_whole_sector_ = 0x20;
+
+	u8 stat_() const;
+	u8 status_register_() const;
+	CdromResponse error_(u8 code) const;
+	void execute_command_(u8 command, Scheduler& scheduler);
+	void start_reading_(Scheduler& scheduler);
+	void read_sector_(Scheduler& scheduler);
+	void deliver_(const CdromResponse& response);
+	void load_data_fifo_();
+	u32 sector_cycles_() const;
+	const DiscTrack* track_of_(u32 lba) const;
+	char region_() const;
+
+public:
+	Cdrom();
+	void insert_disc(std::shared_ptr<DiscImage> disc);
+	// nullptr without a disc
+	DiscImage* disc() const;
+	u8 load8(u32 offset);
+	void store8(u32 offset, u8 value, Scheduler& scheduler);
+	// Handles the CdromAck, CdromResponse and CdromSector events
+	void run_event(SchedulerEvent event, Scheduler& scheduler);
+	// Data FIFO read for DMA channel 3
+	u32 read_data_word();
+	// Chains the state of the device onto an FNV-1a hash
+	u64 hash(u64 seed) const;
+	// Interrupt line towards the interrupt controller
+	bool irq() const;
+};
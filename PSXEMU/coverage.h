@@ -0,0 +1,37 @@
+#pragma once
+#include "types.h"
+#include <cstring>
+
+#define COVERAGE_MAP_SIZE 0x10000
+
+// Hit counts of guest control flow edges for coverage guided fuzzing. An
+// edge is a taken branch or jump, from its site to its target, hashed into a
+// fixed size map like AFL does. Counts saturate at 255.
+class EdgeCoverage
+{
+private:
+	u8 hits_[COVERAGE_MAP_SIZE];
+
+public:
+	EdgeCoverage()
+	{
+		clear();
+	}
+
+	void record(u32 site, u32 target)
+	{
+		u32 edge = ((site >> 2) * 0x9e3779b1u) ^ ((target >> 2) * 0x85ebca6bu);
+		u8& count = hits_[edge >> 16];
+		count += (count != 0xff) ? 1 : 0;
+	}
+
+	void clear()
+	{
+		memset(hits_, 0, sizeof(hits_));
+	}
+
+	const u8* hits() const
+	{
+		return hits_;
+	}
+};
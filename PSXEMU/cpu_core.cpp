@@ -1,43 +1,73 @@
 #include "cpu_core.h"
+#include "log.h"
+#include "hash.h"
+#include "debug_traps.h"
 
 namespace CPU
 {
-	u32 Core::load32_(u32 address)
+	// Code runs from KSEG0 or, for the BIOS, KSEG1: those skip the segment
+	// lookup. Fetches are never watched.
+	u32 Core::fetch_(u32 pc)
 	{
-		return interconnect_.load32(address);
-	}
-
-	u8 Core::load8_(u32 address)
-	{
-		return interconnect_.load8(address);
+		switch (static_cast<Segment>(pc >> 29))
+		{
+		case Segment::Kseg0:
+			return interconnect_.load_segment<u32, Segment::Kseg0>(pc);
+		case Segment::Kseg1:
+			return interconnect_.load_segment<u32, Segment::Kseg1>(pc);
+		default:
+			return interconnect_.load_physical<u32>(interconnect_.mask_region(pc));
+		}
 	}
 
-	void Core::store32_(u32 address, u32 value)
+	void Core::branch(u32 offset)
 	{
-		interconnect_.store32(address, value);
+		auto shifted_offset = offset << 2;		// align on 32bits
+		jump_(state_.pc + shifted_offset - INSTR_LENGTH);	// compensation for pipeline
 	}
 
-	void Core::store16_(u32 address, u16 value)
+	void Core::jump_(u32 target)
 	{
-		interconnect_.store16(address, value);
+		if (coverage_ != nullptr)
+		{
+			coverage_->record(state_.pc, target);
+		}
+		state_.pc = target;
 	}
 
-	void Core::store8_(u32 address, u8 value)
+	void Core::exception_(Exception cause, u32 bad_vaddr)
 	{
-		interconnect_.store8(address, value);
+		Cop0Regs& cop0 = state_.cop0regs;
+		// Interrupt enable and user mode bits are pushed on a 3 level stack
+		cop0.sr = (cop0.sr & ~0x3fu) | ((cop0.sr << 2) & 0x3f);
+		cop0.cause = (cop0.cause & ~0x8000007cu) | (static_cast<u32>(cause) << 2);
+		cop0.epc = instruction_pc_;
+		cop0.bad_vaddr = bad_vaddr;
+		// In the delay slot of a taken jump, the jump runs again on return
+		if (next_instruction_pc_ != instruction_pc_ + INSTR_LENGTH)
+		{
+			cop0.epc -= INSTR_LENGTH;
+			cop0.cause |= 0x80000000;
+		}
+		interconnect_.stats().exceptions++;
+		// BEV selects the handler in the BIOS
+		set_pc(((cop0.sr & 0x400000) != 0) ? 0xbfc00180 : 0x80000080);
 	}
 
-	void Core::branch(u32 offset)
+	bool Core::misaligned_(u32 address, u32 size, Exception cause)
 	{
-		auto shifted_offset = offset << 2;		// align on 32bits
-		state_.pc = state_.pc + shifted_offset;
-		state_.pc = state_.pc - INSTR_LENGTH;	// compensation for pipeline
+		if ((address & (size - 1)) == 0)
+		{
+			return false;
+		}
+		LOG_DEBUG(Cpu, "Address error: {}", address);
+		exception_(cause, address);
+		return true;
 	}
 
 	void Core::decode_and_execute_(Instruction instruction)
 	{
-		std::cout << "Instruction: " << std::hex << instruction.value << 
-			"\tPC: " << state_.pc << std::endl;
+		LOG_TRACE(Cpu, "Instruction: {} PC: {}", instruction.value, state_.pc);
 		u32 ins = instruction.function();
 		switch (ins)
 		{
@@ -107,9 +137,19 @@ namespace CPU
 			case ins_cop0_:
 				exec_cop0_(instruction);
 				break;
+			case ins_cop2_:
+				exec_cop2_(instruction);
+				break;
+			case ins_lwc2_:
+				exec_lwc2_(instruction);
+				break;
+			case ins_swc2_:
+				exec_swc2_(instruction);
+				break;
 			default:
 			{
-				std::cerr << "Unhandled command" << std::endl;
+				LOG_ERROR(Cpu, "Unhandled opcode: {}", instruction.function());
+				interconnect_.set_fault(Fault::Reserved);
 				throw - 1;
 			}break;
 		}
@@ -139,7 +179,7 @@ namespace CPU
 
 		if ((state_.cop0regs.sr & 0x10000) != 0)
 		{
-			std::cout << "Ignoring store while cache is isolated" << std::endl;
+			LOG_DEBUG(Cpu, "Ignoring store while cache is isolated");
 			return;
 		}
 
@@ -149,8 +189,12 @@ namespace CPU
 
 		auto addr = get_reg(s) + i;
 		auto v = get_reg(t);
+		if (misaligned_(addr, 4, Exception::StoreAddressError))
+		{
+			return;
+		}
 
-		store32_(addr, v);
+		store_<u32>(addr, v);
 	}
 
 	void Core::exec_addiu_(Instruction instruction)
@@ -175,7 +219,9 @@ namespace CPU
 		if ((i > 0 && ss > INT_MAX - i) || // `a + x` would overflow
 			(i < 0 && ss < INT_MIN - i)) // `a + x` would underflow
 		{
-			std::cerr << "Overflow detected" << std::endl;
+			LOG_ERROR(Cpu, "Overflow detected");
+			interconnect_.stats().exceptions++;
+			interconnect_.set_fault(Fault::Overflow);
 			throw - 1;
 		}
 
@@ -188,7 +234,7 @@ namespace CPU
 	{
 		auto i = instruction.imm_jump();
 
-		state_.pc = (state_.pc & 0xf0000000) | (i << 2);
+		jump_((state_.pc & 0xf0000000) | (i << 2));
 	}
 
 	void Core::exec_bne_(Instruction instruction)
@@ -207,7 +253,7 @@ namespace CPU
 	{
 		if ((state_.cop0regs.sr & 0x10000) != 0)
 		{
-			std::cout << "Ignoring store while cache is isolated" << std::endl;
+			LOG_DEBUG(Cpu, "Ignoring store while cache is isolated");
 			return;
 		}
 
@@ -216,8 +262,12 @@ namespace CPU
 		auto s = instruction.s();
 
 		auto addr = get_reg(s) + i;
+		if (misaligned_(addr, 4, Exception::LoadAddressError))
+		{
+			return;
+		}
 
-		auto v = load32_(addr);
+		auto v = load_<u32>(addr);
 		state_.load.first = t; 
 		state_.load.second = v;
 	}
@@ -226,7 +276,7 @@ namespace CPU
 	{
 		if ((state_.cop0regs.sr & 0x10000) != 0)
 		{
-			std::cout << "Ignoring store while cache is isolated" << std::endl;
+			LOG_DEBUG(Cpu, "Ignoring store while cache is isolated");
 			return;
 		}
 
@@ -236,8 +286,12 @@ namespace CPU
 
 		auto addr = get_reg(s) + i;
 		u16 v = static_cast<u16>(get_reg(t));
+		if (misaligned_(addr, 2, Exception::StoreAddressError))
+		{
+			return;
+		}
 
-		store16_(addr, v);
+		store_<u16>(addr, v);
 
 	}
 
@@ -254,7 +308,7 @@ namespace CPU
 	{
 		if ((state_.cop0regs.sr & 0x10000) != 0)
 		{
-			std::cout << "Ignoring store while cache is isolated" << std::endl;
+			LOG_DEBUG(Cpu, "Ignoring store while cache is isolated");
 			return;
 		}
 
@@ -265,7 +319,7 @@ namespace CPU
 		auto addr = get_reg(s) + i;
 		u8 v = static_cast<u8>(get_reg(t));
 
-		store8_(addr, v);
+		store_<u8>(addr, v);
 	}
 
 	void Core::exec_spec_(Instruction instruction)
@@ -321,15 +375,41 @@ namespace CPU
 		case ins_slt_:
 			exec_slt_(instruction);
 			break;
+		case ins_break_:
+			exec_break_(instruction);
+			break;
 		default:
-			std::cerr << "Unhandled subfunction: " <<
-				std::hex << subfunc <<std::endl;
+			LOG_ERROR(Cpu, "Unhandled subfunction: {}", subfunc);
+			interconnect_.set_fault(Fault::Reserved);
 			throw - 1;
 			break;
 		}
 		
 	}
 
+	// The only check for debugger breakpoints, and for watchpoints besides
+	// the RAM watcher: they replace instructions with BREAKs
+	void Core::exec_break_(Instruction instruction)
+	{
+		u32 address;
+		u32 original;
+		if (debug_traps_ == nullptr || !debug_traps_->take(instruction.value, address, original))
+		{
+			LOG_ERROR(Cpu, "Break without a debugger trap: {}", instruction.value);
+			interconnect_.set_fault(Fault::Break);
+			throw - 1;
+		}
+		// Back to before the step, with the replaced instruction fetched. A
+		// pending load is already in out_regs, it still lands after it. The
+		// trap ran through the segment of the next fetch, not necessarily the
+		// one of the breakpoint address.
+		u32 pc = (next_instruction_pc_ & 0xe0000000) | (address & 0x1fffffff);
+		state_.pc = next_instruction_pc_;
+		next_instruction_pc_ = pc;
+		next_instruction_ = Instruction(original);
+		throw DebugTrap{ pc };
+	}
+
 	void Core::exec_sll_(Instruction instruction)
 	{
 		auto i = instruction.shift();
@@ -393,7 +473,7 @@ namespace CPU
 
 		auto addr = get_reg(s) + i;
 
-		s32 v = static_cast<s8>(load8_(addr));
+		s32 v = static_cast<s8>(load_<u8>(addr));
 
 		state_.load.first = t;
 		state_.load.second = static_cast<u32>(v);
@@ -445,7 +525,7 @@ namespace CPU
 
 		auto addr = get_reg(s) + i;
 
-		u32 v = static_cast<u32>(load8_(addr)) & 0x000000ff;
+		u32 v = static_cast<u32>(load_<u8>(addr)) & 0x000000ff;
 
 		state_.load.first = t;
 		state_.load.second = v;
@@ -505,7 +585,7 @@ namespace CPU
 	{
 		auto s = instruction.s();
 
-		state_.pc = get_reg(s);
+		jump_(get_reg(s));
 	}
 
 	void Core::exec_and_(Instruction instruction)
@@ -531,7 +611,9 @@ namespace CPU
 		if ((tt > 0 && ss > INT_MAX - tt) || // `a + x` would overflow
 			(tt < 0 && ss < INT_MIN - tt)) // `a + x` would underflow
 		{
-			std::cerr << "Overflow detected" << std::endl;
+			LOG_ERROR(Cpu, "Overflow detected");
+			interconnect_.stats().exceptions++;
+			interconnect_.set_fault(Fault::Overflow);
 			throw - 1;
 		}
 
@@ -548,7 +630,7 @@ namespace CPU
 		auto ra = state_.pc;
 
 		set_reg(d, ra);
-		state_.pc = get_reg(s);
+		jump_(get_reg(s));
 	}
 
 	void Core::exec_subu_(Instruction instruction)
@@ -675,9 +757,12 @@ namespace CPU
 		case ins_mfc0_:
 			exec_mfc0_(instruction);
 			break;
+		case ins_rfe_:
+			exec_rfe_(instruction);
+			break;
 		default:
-			std::cerr << "Unhandled Coprocessor 0 instruction : " <<
-				std::hex << instruction.cop_opcode() << std::endl;
+			LOG_ERROR(Cpu, "Unhandled Coprocessor 0 instruction: {}", instruction.cop_opcode());
+			interconnect_.set_fault(Fault::Coprocessor);
 			throw - 1;
 		}
 	}
@@ -699,8 +784,8 @@ namespace CPU
 		case 11:
 			if (v != 0)
 			{
-				std::cout << "Coprocessors Breakpoint registers " << cop_r <<
-					": Unhandled write" << std::endl;
+				LOG_ERROR(Cpu, "Coprocessors Breakpoint registers {d}: Unhandled write", cop_r);
+				interconnect_.set_fault(Fault::Coprocessor);
 				throw - 1;
 			}
 			break;
@@ -710,13 +795,14 @@ namespace CPU
 		case 13:
 			if (v != 0)
 			{
-				std::cout << "Coprocessors CAUSE registers " << cop_r <<
-					": Unhandled write" << std::endl;
+				LOG_ERROR(Cpu, "Coprocessors CAUSE registers {d}: Unhandled write", cop_r);
+				interconnect_.set_fault(Fault::Coprocessor);
 				throw - 1;
 			}
 			break;
 		default:
-			std::cout << "Unhandled Coprocessor Register : " << v << std::endl;
+			LOG_ERROR(Cpu, "Unhandled Coprocessor Register {d} write: {}", cop_r, v);
+			interconnect_.set_fault(Fault::Coprocessor);
 			throw - 1;
 		}
 	}
@@ -730,15 +816,21 @@ namespace CPU
 
 		switch (cop_r)
 		{
+		case 8:
+			v = state_.cop0regs.bad_vaddr;
+			break;
 		case 12:
 			v = state_.cop0regs.sr;
 			break;
 		case 13:
-			std::cout << "Coprocessors CAUSE registers " << cop_r <<
-				": Unhandled read" << std::endl;
-			throw - 1;
+			v = state_.cop0regs.cause;
+			break;
+		case 14:
+			v = state_.cop0regs.epc;
+			break;
 		default:
-			std::cout << "Unhandled Read From Coprocessor 0 Register" << std::endl;
+			LOG_ERROR(Cpu, "Unhandled Read From Coprocessor 0 Register {d}", cop_r);
+			interconnect_.set_fault(Fault::Coprocessor);
 			throw - 1;
 		}
 
@@ -747,11 +839,137 @@ namespace CPU
 
 	}
 
+	void Core::exec_rfe_(Instruction instruction)
+	{
+		if (instruction.subfuction() != 0x10)
+		{
+			LOG_ERROR(Cpu, "Unhandled Coprocessor 0 instruction: {}", instruction.value);
+			interconnect_.set_fault(Fault::Coprocessor);
+			throw - 1;
+		}
+		// Pops the mode stack, the oldest level is kept
+		u32 sr = state_.cop0regs.sr;
+		state_.cop0regs.sr = (sr & ~0xfu) | ((sr >> 2) & 0xf);
+	}
+
+	void Core::exec_cop2_(Instruction instruction)
+	{
+		// Bit 25 set: imm25 GTE command
+		if ((instruction.value >> 25) & 0x1)
+		{
+			try
+			{
+				gte_.execute(instruction.value & 0x1ffffff);
+			}
+			catch (int)
+			{
+				interconnect_.set_fault(Fault::Coprocessor);
+				throw;
+			}
+			return;
+		}
+
+		switch (instruction.cop_opcode())
+		{
+		case ins_mfc2_:
+			exec_mfc2_(instruction);
+			break;
+		case ins_cfc2_:
+			exec_cfc2_(instruction);
+			break;
+		case ins_mtc2_:
+			exec_mtc2_(instruction);
+			break;
+		case ins_ctc2_:
+			exec_ctc2_(instruction);
+			break;
+		default:
+			LOG_ERROR(Cpu, "Unhandled Coprocessor 2 instruction: {}", instruction.cop_opcode());
+			interconnect_.set_fault(Fault::Coprocessor);
+			throw - 1;
+		}
+	}
+
+	void Core::exec_mfc2_(Instruction instruction)
+	{
+		auto cpu_r = instruction.t();
+		auto cop_r = instruction.d().value;
+
+		state_.load.first = cpu_r;
+		state_.load.second = gte_.get_data(cop_r);
+	}
+
+	void Core::exec_cfc2_(Instruction instruction)
+	{
+		auto cpu_r = instruction.t();
+		auto cop_r = instruction.d().value;
+
+		state_.load.first = cpu_r;
+		state_.load.second = gte_.get_control(cop_r);
+	}
+
+	void Core::exec_mtc2_(Instruction instruction)
+	{
+		auto cpu_r = instruction.t();
+		auto cop_r = instruction.d().value;
+
+		gte_.set_data(cop_r, get_reg(cpu_r));
+	}
+
+	void Core::exec_ctc2_(Instruction instruction)
+	{
+		auto cpu_r = instruction.t();
+		auto cop_r = instruction.d().value;
+
+		gte_.set_control(cop_r, get_reg(cpu_r));
+	}
+
+	void Core::exec_lwc2_(Instruction instruction)
+	{
+		auto i = instruction.signed_immediate();
+		auto t = instruction.t();
+		auto s = instruction.s();
+
+		auto addr = get_reg(s) + i;
+		if (misaligned_(addr, 4, Exception::LoadAddressError))
+		{
+			return;
+		}
+
+		gte_.set_data(t.value, load_<u32>(addr));
+	}
+
+	void Core::exec_swc2_(Instruction instruction)
+	{
+		if ((state_.cop0regs.sr & 0x10000) != 0)
+		{
+			LOG_DEBUG(Cpu, "Ignoring store while cache is isolated");
+			return;
+		}
+
+		auto i = instruction.signed_immediate();
+		auto t = instruction.t();
+		auto s = instruction.s();
+
+		auto addr = get_reg(s) + i;
+		if (misaligned_(addr, 4, Exception::StoreAddressError))
+		{
+			return;
+		}
+
+		store_<u32>(addr, gte_.get_data(t.value));
+	}
 
 	Core::Core(Interconnect interconnect) :
-		interconnect_(interconnect)
+		interconnect_(interconnect),
+		profiler_(nullptr),
+		block_cache_(nullptr),
+		coverage_(nullptr),
+		debug_traps_(nullptr)
 	{
 		state_.pc = CPU_RESET_ADDRESS;
+		next_instruction_pc_ = CPU_RESET_ADDRESS;
+		instruction_pc_ = CPU_RESET_ADDRESS;
 		state_.hi = 0xdeadbeef;
 		state_.lo = 0xdeadbeef;
 		for (int i = 0; i < N_GP_REG; i++)
@@ -765,7 +983,8 @@ namespace CPU
 		state_.load.first = RegisterIdx(0);
 		state_.load.second = 0;
 
-		state_.cop0regs.sr = 0;
+		state_.cop0regs = Cop0Regs();		// zeroed, so that states hash the same
+		state_.cycles = 0;
 	}
 
 	void Core::copy_regs()
@@ -776,17 +995,298 @@ namespace CPU
 		}
 	}
 
+	void Core::sideload_exe(std::shared_ptr<const PsxExe> exe)
+	{
+		pending_exe_ = exe;
+	}
+
+	void Core::fast_boot(const PsxExe& exe, const std::vector<u8>* kernel_snapshot)
+	{
+		if (kernel_snapshot != nullptr)
+		{
+			interconnect_.ram().store_block(0, kernel_snapshot->data(), kernel_snapshot->size());
+		}
+		start_exe_(exe);
+	}
+
+	void Core::start_exe_(const PsxExe& exe)
+	{
+		u32 text = interconnect_.mask_region(exe.text_address);
+		u32 bss = interconnect_.mask_region(exe.bss_address);
+		if (text + exe.text.size() > RAM_END_ADDRESS || bss + exe.bss_size > RAM_END_ADDRESS)
+		{
+			LOG_ERROR(Cpu, "PS-X EXE doesn't fit in RAM: {}", exe.text_address);
+			interconnect_.set_fault(Fault::Other);
+			throw - 1;
+		}
+		interconnect_.ram().store_block(text, exe.text.data(), exe.text.size());
+		if (exe.bss_size > 0)
+		{
+			interconnect_.ram().store_block(bss, nullptr, exe.bss_size);
+		}
+
+		// Registers are written on both sides of the load delay, there's no pending load
+		state_.regs[28] = state_.out_regs[28] = exe.gp;
+		if (exe.stack_address != 0)
+		{
+			state_.regs[29] = state_.out_regs[29] = exe.stack_address;
+			state_.regs[30] = state_.out_regs[30] = exe.stack_address;
+		}
+		state_.load.first = RegisterIdx(0);
+		state_.load.second = 0;
+		state_.pc = exe.pc;
+		next_instruction_ = Instruction(0x00000000);
+		next_instruction_pc_ = exe.pc;
+	}
+
+	BiosHle& Core::bios_hle()
+	{
+		return hle_;
+	}
+
+	void Core::set_block_cache(BlockCache* block_cache)
+	{
+		block_cache_ = block_cache;
+	}
+
+	void Core::set_coverage(EdgeCoverage* coverage)
+	{
+		coverage_ = coverage;
+	}
+
+	void Core::set_debug_traps(DebugTraps* debug_traps)
+	{
+		debug_traps_ = debug_traps;
+	}
+
+	void Core::set_pc(u32 pc)
+	{
+		next_instruction_pc_ = pc;
+		next_instruction_ = Instruction(fetch_(pc));
+		state_.pc = pc + INSTR_LENGTH;
+	}
+
+	u32 Core::swap_next_instruction(u32 word)
+	{
+		u32 previous = next_instruction_.value;
+		next_instruction_ = Instruction(word);
+		return previous;
+	}
+
+	void Core::set_profiler(GuestProfiler* profiler)
+	{
+		profiler_ = profiler;
+		Scheduler& scheduler = interconnect_.scheduler();
+		if (profiler_ == nullptr)
+		{
+			scheduler.cancel(SchedulerEvent::Profiler);
+			return;
+		}
+		scheduler.schedule(SchedulerEvent::Profiler, state_.cycles + profiler_->interval());
+	}
+
+	// Events of the scheduler handled by the CPU, pc is the instruction just run
+	void Core::run_cpu_events_(u32 pc)
+	{
+		if (profiler_ != nullptr)
+		{
+			profiler_->record(pc, state_.regs[31]);
+			interconnect_.scheduler().schedule(SchedulerEvent::Profiler, state_.cycles + profiler_->interval());
+		}
+	}
+
+	Stats& Core::stats()
+	{
+		return interconnect_.stats();
+	}
+
+	State& Core::state()
+	{
+		return state_;
+	}
+
+	u32 Core::current_pc() const
+	{
+		return next_instruction_pc_;
+	}
+
+	u64 Core::hash(u64 seed) const
+	{
+		u64 hash = fnv1a_value(seed, next_instruction_pc_);
+		hash = fnv1a_value(hash, next_instruction_.value);
+		hash = fnv1a_value(hash, state_.pc);
+		hash = fnv1a_value(hash, state_.hi);
+		hash = fnv1a_value(hash, state_.lo);
+		hash = fnv1a(hash, state_.regs, sizeof(state_.regs));
+		hash = fnv1a_value(hash, state_.load.first.value);
+		hash = fnv1a_value(hash, state_.load.second);
+		hash = fnv1a_value(hash, state_.cop0regs);
+		hash = fnv1a_value(hash, state_.cycles);
+		return gte_.hash(hash);
+	}
+
+	Interconnect& Core::interconnect()
+	{
+		return interconnect_;
+	}
+
+	const Interconnect& Core::interconnect() const
+	{
+		return interconnect_;
+	}
+
+	// Called when the instruction at a kernel vector is about to run, with the
+	// delay slot of the call (usually setting t1) already executed
+	bool Core::hle_call_(u32 vector)
+	{
+		// A load in the delay slot lands before the function body reads its arguments
+		u32 loaded = state_.load.first.value;
+		auto reg = [&](u32 index) -> u32
+		{
+			return (index == loaded && index != 0) ? state_.load.second : state_.regs[index];
+		};
+
+		HleCall call;
+		call.vector = vector;
+		call.function = reg(9);
+		for (u32 i = 0; i < 4; i++)
+		{
+			call.args[i] = reg(4 + i);
+		}
+		call.sp = reg(29);
+
+		u32 result;
+		usize tty_size = hle_.tty().size();
+		if (!hle_.call(call, interconnect_.ram(), result))
+		{
+			return false;
+		}
+		// Printed text also reaches the TTY device, its sink and run stop checks
+		if (hle_.tty().size() > tty_size)
+		{
+			interconnect_.tty().write(hle_.tty().data() + tty_size, hle_.tty().size() - tty_size);
+		}
+
+		// Return to the caller as if the function ended with jr ra
+		set_reg(state_.load.first, state_.load.second);
+		state_.load.first = RegisterIdx(0);
+		state_.load.second = 0;
+		set_reg(RegisterIdx(2), result);
+		copy_regs();
+		state_.pc = state_.regs[31];
+		next_instruction_ = Instruction(0x00000000);
+		next_instruction_pc_ = state_.pc;
+		state_.cycles += CYCLES_PER_INSTRUCTION;
+		interconnect_.stats().instructions++;
+		if (interconnect_.advance(state_.cycles))
+		{
+			run_cpu_events_(vector);
+		}
+		return true;
+	}
+
+	// Work done before a step: starting a sideloaded EXE and kernel calls.
+	// Returns true when the step has been replaced by an HLE call.
+	bool Core::intercept_()
+	{
+		if (pending_exe_ && state_.pc == PSX_EXE_SHELL_ENTRY)
+		{
+			start_exe_(*pending_exe_);
+			pending_exe_.reset();
+		}
+
+		if (hle_.mode() != HleMode::Off)
+		{
+			u32 address = next_instruction_pc_ & 0x1fffffff;
+			if ((address == 0xa0 || address == 0xb0 || address == 0xc0) && hle_call_(address))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
 	void Core::run_next_instruction()
 	{
-		auto pc = state_.pc;
+		if (intercept_())
+		{
+			return;
+		}
+		step_(fetch_(state_.pc));
+	}
+
+	// BIOS offset of a fetch address through KUSEG, KSEG0 or KSEG1, BIOS_ADDR_SPACE_SIZE if outside
+	static u32 bios_offset(u32 address)
+	{
+		u32 physical = (address >= 0x80000000 && address < 0xc0000000) ? (address & 0x1fffffff) : address;
+		u32 offset = physical - BIOS_START_ADDRESS;
+		return (offset < BIOS_ADDR_SPACE_SIZE && (offset % 4) == 0) ? offset : BIOS_ADDR_SPACE_SIZE;
+	}
+
+	u32 Core::run_block(u32 max_steps)
+	{
+		if (block_cache_ == nullptr || max_steps == 0)
+		{
+			run_next_instruction();
+			return 1;
+		}
+
+		u32 start = state_.pc;
+		u32 offset = bios_offset(start);
+		if (offset == BIOS_ADDR_SPACE_SIZE)
+		{
+			// Interpreted until the BIOS is reached again
+			u32 steps = 0;
+			do
+			{
+				run_next_instruction();
+				steps++;
+			} while (steps < max_steps && bios_offset(state_.pc) == BIOS_ADDR_SPACE_SIZE);
+			return steps;
+		}
+
+		Stats& stats = interconnect_.stats();
+		const Bios& bios = interconnect_.bios();
+		u32 length = block_cache_->length(offset, stats);
+		length = (length < max_steps) ? length : max_steps;
+		stats.blocks++;
+
+		for (u32 i = 0; i < length; i++)
+		{
+			if (intercept_())
+			{
+				return i + 1;
+			}
+			step_(bios.load<u32>(offset + i * INSTR_LENGTH));
+			// Not taken branches fall through, anything else ends the block
+			if (state_.pc != start + (i + 1) * INSTR_LENGTH)
+			{
+				return i + 1;
+			}
+		}
+		return length;
+	}
+
+	// Executes the prefetched instruction, with the word at pc as the next one
+	void Core::step_(u32 fetched)
+	{
+		u32 pc = next_instruction_pc_;
 		Instruction instruction = next_instruction_;
-		next_instruction_ = Instruction(load32_(state_.pc));
+		instruction_pc_ = pc;
+		next_instruction_pc_ = state_.pc;
+		next_instruction_ = Instruction(fetched);
 		state_.pc += INSTR_LENGTH;
 		set_reg(state_.load.first, state_.load.second);
 		state_.load.first = RegisterIdx(0);
 		state_.load.second = 0;
 		decode_and_execute_(instruction);
 		copy_regs();
+		state_.cycles += CYCLES_PER_INSTRUCTION;
+		interconnect_.stats().instructions++;
+		if (interconnect_.advance(state_.cycles))
+		{
+			run_cpu_events_(pc);
+		}
 	}
 
 	void Core::set_reg(RegisterIdx reg_idx, u32 value)
@@ -1,9 +1,19 @@
 #pragma once
 #include "types.h"
 #include "interconnect.h"
+#include "gte.h"
+#include "psx_exe.h"
+#include "bios_hle.h"
+#include "profiler.h"
+#include "block_cache.h"
+#include "coverage.h"
+#include <memory>
 
 #define N_GP_REG 32
 #define INSTR_LENGTH 4
+#define CYCLES_PER_INSTRUCTION 2	// average, until instruction timings are modelled
+
+class DebugTraps;
 
 namespace CPU
 {
@@ -19,10 +29,19 @@ namespace CPU
 		u32 bda;		// 5	
 		u32 _6;			// 6
 		u32 dcic;		// 7
+		u32 bad_vaddr;	// 8
 		u32 bdam;		// 9
 		u32 bpcm;		// 11
 		u32 sr;			// 12
 		u32 cause;		// 13
+		u32 epc;		// 14
+	};
+
+	// ExcCode field of the CAUSE register, for the exceptions the core raises
+	enum class Exception : u32
+	{
+		LoadAddressError = 0x4,
+		StoreAddressError = 0x5,
 	};
 
 	struct State
@@ -35,6 +54,7 @@ namespace CPU
 		std::pair<RegisterIdx, u32> load = {RegisterIdx(0),0};
 
 		Cop0Regs cop0regs;					// Coprocessor0 reg12: Status Register
+		u64 cycles;							// CPU cycles elapsed since reset
 	};
 
 	struct Instruction
@@ -110,18 +130,46 @@ namespace CPU
 	class Core
 	{
 	private:
+		// Runs steps of several cores on its own copy of their registers
+		friend class LockstepBatch;
+
 		State state_;
 		Instruction next_instruction_ = Instruction(0x00000000); //NOP
+		u32 next_instruction_pc_;		// address next_instruction_ was fetched from
+		u32 instruction_pc_;			// address of the instruction being executed
 		Interconnect interconnect_;
+		Gte gte_;
+		std::shared_ptr<const PsxExe> pending_exe_;	// started at the BIOS shell entry
+		BiosHle hle_;
+		GuestProfiler* profiler_;
+		BlockCache* block_cache_;
+		EdgeCoverage* coverage_;
+		DebugTraps* debug_traps_;
 
 		void copy_regs();
-		u32 load32_(u32 address);
-		u8 load8_(u32 address);
-		void store32_(u32 address, u32 value);
-		void store16_(u32 address, u16 value);
-		void store8_(u32 address, u8 value);
+		template <typename T>
+		T load_(u32 address)
+		{
+			return interconnect_.load<T>(address);
+		}
+		template <typename T>
+		void store_(u32 address, T value)
+		{
+			interconnect_.store<T>(address, value);
+		}
+		u32 fetch_(u32 pc);
 		void branch(u32 offset);
+		void jump_(u32 target);		// taken branches and jumps go through here
+		// Raises a guest exception for the instruction being executed
+		void exception_(Exception cause, u32 bad_vaddr);
+		// Address error if address isn't a multiple of size
+		bool misaligned_(u32 address, u32 size, Exception cause);
 		void decode_and_execute_(Instruction instruction);
+		void start_exe_(const PsxExe& exe);
+		bool hle_call_(u32 vector);
+		bool intercept_();
+		void step_(u32 fetched);
+		void run_cpu_events_(u32 pc);
 
 		static const u32
 			ins_lui_ = 0b001111,
@@ -144,6 +192,8 @@ namespace CPU
 			ins_bxx_ = 0b000001,
 			ins_slti_ = 0b001010,
 			ins_sltiu_ = 0b001011,
+			ins_lwc2_ = 0b110010,
+			ins_swc2_ = 0b111010,
 
 			ins_spec_ = 0b000000,
 			ins_sll_ = 0b000000,
@@ -162,10 +212,18 @@ namespace CPU
 			ins_divu_ = 0b011011,
 			ins_mfhi_ = 0b010000,
 			ins_slt_ = 0b101010,
+			ins_break_ = 0b001101,
 
 			ins_cop0_ = 0b010000,
 			ins_mtc0_ = 0b00100,
-			ins_mfc0_ = 0b00000;
+			ins_mfc0_ = 0b00000,
+			ins_rfe_ = 0b10000,
+
+			ins_cop2_ = 0b010010,
+			ins_mfc2_ = 0b00000,
+			ins_cfc2_ = 0b00010,
+			ins_mtc2_ = 0b00100,
+			ins_ctc2_ = 0b00110;
 
 
 		void exec_lui_(Instruction instruction);		// Load upper immediate
@@ -188,6 +246,8 @@ namespace CPU
 		void exec_bxx_(Instruction instruction);		// Branch if xx (BLTZ, BLTZAL, BGEZ, BGEZAL)
 		void exec_slti_(Instruction instruction);		// Set if less than immediate
 		void exec_sltiu_(Instruction instruction);		// Set on Less Than Immediate Unsigned
+		void exec_lwc2_(Instruction instruction);		// Load Word to Coprocessor 2
+		void exec_swc2_(Instruction instruction);		// Store Word from Coprocessor 2
 
 		void exec_spec_(Instruction instruction);		// Special function
 		void exec_sll_(Instruction instruction);		// Shift left logical
@@ -206,14 +266,55 @@ namespace CPU
 		void exec_divu_(Instruction instruction);		// Divide Unsigned
 		void exec_mfhi_(Instruction instruction);		// Move From Hi
 		void exec_slt_(Instruction instruction);		// Set on Less Than
+		void exec_break_(Instruction instruction);		// Breakpoint, debugger traps only
 		
 		void exec_cop0_(Instruction instruction);	// Instruction for the coprocessor 0
 		void exec_mtc0_(Instruction instruction);	//  Move to Coprocessor 0
 		void exec_mfc0_(Instruction instruction);	//  Move from Coprocessor 0
+		void exec_rfe_(Instruction instruction);	//  Return from exception
+
+		void exec_cop2_(Instruction instruction);	// Instruction for the coprocessor 2 (GTE)
+		void exec_mfc2_(Instruction instruction);	//  Move from Coprocessor 2 data register
+		void exec_cfc2_(Instruction instruction);	//  Move from Coprocessor 2 control register
+		void exec_mtc2_(Instruction instruction);	//  Move to Coprocessor 2 data register
+		void exec_ctc2_(Instruction instruction);	//  Move to Coprocessor 2 control register
 
 	public:
 		Core(Interconnect interconnect);
 		void run_next_instruction();
+		// Runs up to max_steps instructions of the BIOS block at pc, fetching
+		// them straight from the image. Outside the BIOS, interprets until pc
+		// gets back to it. Without a block cache, runs a single instruction.
+		// Returns the number of steps run.
+		u32 run_block(u32 max_steps);
+		void set_block_cache(BlockCache* block_cache);
+		// Loads the EXE when the BIOS reaches the shell, after the kernel is initialized
+		void sideload_exe(std::shared_ptr<const PsxExe> exe);
+		// Starts the EXE right away without running the BIOS. The kernel area of RAM
+		// is filled from the snapshot when one is given, BIOS calls fail otherwise.
+		void fast_boot(const PsxExe& exe, const std::vector<u8>* kernel_snapshot);
+		// Kernel calls through the A0/B0/C0 vectors, off unless its mode is changed
+		BiosHle& bios_hle();
+		// Samples pc and ra every profiler->interval() cycles, nullptr stops
+		void set_profiler(GuestProfiler* profiler);
+		// Counts the control flow edges taken from now on, nullptr stops
+		void set_coverage(EdgeCoverage* coverage);
+		// Lets the traps patched in by a debugger stop the core, nullptr detaches
+		void set_debug_traps(DebugTraps* debug_traps);
+		// Fetches from pc, as after a jump with its delay slot run
+		void set_pc(u32 pc);
+		// Replaces the instruction fetched for the next step, returning it
+		u32 swap_next_instruction(u32 word);
+		// Host side counters of this instance
+		Stats& stats();
+		// Direct access for test harnesses and tools
+		State& state();
+		// Address of the instruction the next step runs (pc is the fetch address)
+		u32 current_pc() const;
+		// Chains the registers, the pending load, COP0 and the GTE onto an FNV-1a hash
+		u64 hash(u64 seed) const;
+		Interconnect& interconnect();
+		const Interconnect& interconnect() const;
 		void set_reg(RegisterIdx reg_idx, u32 value);
 		u32 get_reg(RegisterIdx reg_idx) const;
 	};
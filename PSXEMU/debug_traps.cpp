@@ -0,0 +1,310 @@
+#include "debug_traps.h"
+
+DebugTraps::DebugTraps(CPU::Core& core) :
+	core_(core),
+	slots_(1, Slot{ 0, 0, false }),
+	stop_{ false, WatchKind::Write, 0 },
+	watch_hit_(false)
+{
+	core_.set_debug_traps(this);
+}
+
+DebugTraps::~DebugTraps()
+{
+	clear();
+	core_.set_debug_traps(nullptr);
+}
+
+u32 DebugTraps::trap_word_(u32 slot)
+{
+	return DEBUG_TRAP_BREAK | ((DEBUG_TRAP_CODE | slot) << 6);
+}
+
+bool DebugTraps::locate_(u32 address, u32& offset, bool& bios) const
+{
+	u32 physical = core_.interconnect().mask_region(address);
+	if (DEVICE_MAP(physical, RAM_START_ADDRESS, RAM_END_ADDRESS))
+	{
+		offset = physical - RAM_START_ADDRESS;
+		bios = false;
+		return true;
+	}
+	if (DEVICE_MAP(physical, BIOS_START_ADDRESS, BIOS_END_ADDRESS))
+	{
+		offset = physical - BIOS_START_ADDRESS;
+		bios = true;
+		return true;
+	}
+	return false;
+}
+
+u32 DebugTraps::load_(u32 offset, bool bios) const
+{
+	Interconnect& interconnect = core_.interconnect();
+	return bios ? interconnect.bios().load<u32>(offset) :
+		static_cast<const Ram&>(interconnect.ram()).load<u32>(offset);
+}
+
+void DebugTraps::patch_(u32 offset, bool bios, u32 word)
+{
+	Interconnect& interconnect = core_.interconnect();
+	if (bios)
+	{
+		interconnect.bios().patch32(offset, word);
+	}
+	else
+	{
+		interconnect.ram().store<u32>(offset, word);
+	}
+}
+
+void DebugTraps::unfetch_(u32 slot)
+{
+	Interconnect& interconnect = core_.interconnect();
+	if (interconnect.mask_region(core_.current_pc()) != interconnect.mask_region(slots_[slot].address))
+	{
+		return;
+	}
+	u32 fetched = core_.swap_next_instruction(slots_[slot].original);
+	if (fetched != trap_word_(slot))
+	{
+		core_.swap_next_instruction(fetched);
+	}
+}
+
+bool DebugTraps::add_breakpoint(u32 address)
+{
+	u32 offset;
+	bool bios;
+	if (address % INSTR_LENGTH != 0 || !locate_(address, offset, bios))
+	{
+		return false;
+	}
+	u32 free_slot = 0;
+	for (u32 slot = 1; slot < slots_.size(); slot++)
+	{
+		if (slots_[slot].used && slots_[slot].address == address)
+		{
+			return true;
+		}
+		if (!slots_[slot].used && free_slot == 0)
+		{
+			free_slot = slot;
+		}
+	}
+	if (free_slot == 0)
+	{
+		if (slots_.size() == DEBUG_TRAP_MAX_SLOTS)
+		{
+			return false;
+		}
+		free_slot = static_cast<u32>(slots_.size());
+		slots_.push_back(Slot());
+	}
+	// The instruction already fetched for the next step is left alone: a
+	// breakpoint at the current pc is hit the next time around
+	slots_[free_slot] = Slot{ address, load_(offset, bios), true };
+	patch_(offset, bios, trap_word_(free_slot));
+	return true;
+}
+
+bool DebugTraps::remove_breakpoint(u32 address)
+{
+	for (u32 slot = 1; slot < slots_.size(); slot++)
+	{
+		if (!slots_[slot].used || slots_[slot].address != address)
+		{
+			continue;
+		}
+		u32 offset;
+		bool bios;
+		if (locate_(address, offset, bios) && load_(offset, bios) == trap_word_(slot))
+		{
+			patch_(offset, bios, slots_[slot].original);
+		}
+		unfetch_(slot);
+		slots_[slot].used = false;
+		return true;
+	}
+	return false;
+}
+
+bool DebugTraps::add_watchpoint(u32 address, u32 size, WatchKind kind)
+{
+	u32 offset;
+	bool bios;
+	if (size == 0 || !locate_(address, offset, bios) || bios || offset + size > RAM_ADDR_SPACE_SIZE)
+	{
+		return false;
+	}
+	watches_.push_back(Watch{ address, offset, size, kind });
+	core_.interconnect().set_ram_watcher(this);
+	return true;
+}
+
+bool DebugTraps::remove_watchpoint(u32 address, u32 size, WatchKind kind)
+{
+	for (auto watch = watches_.begin(); watch != watches_.end(); ++watch)
+	{
+		if (watch->address != address || watch->size != size || watch->kind != kind)
+		{
+			continue;
+		}
+		watches_.erase(watch);
+		if (watches_.empty())
+		{
+			core_.interconnect().set_ram_watcher(nullptr);
+		}
+		return true;
+	}
+	return false;
+}
+
+void DebugTraps::clear()
+{
+	for (u32 slot = 1; slot < slots_.size(); slot++)
+	{
+		if (slots_[slot].used)
+		{
+			remove_breakpoint(slots_[slot].address);
+		}
+	}
+	while (!watches_.empty())
+	{
+		Watch watch = watches_.back();
+		remove_watchpoint(watch.address, watch.size, watch.kind);
+	}
+	take_watch_hit();
+}
+
+bool DebugTraps::read(u32 address, u8* data, u32 size) const
+{
+	for (u32 i = 0; i < size; i++)
+	{
+		u32 word_address = (address + i) & ~3u;
+		u32 offset;
+		bool bios;
+		if (!locate_(word_address, offset, bios))
+		{
+			return false;
+		}
+		u32 word = load_(offset, bios);
+		for (u32 slot = 1; slot < slots_.size(); slot++)
+		{
+			u32 slot_offset;
+			bool slot_bios;
+			if (slots_[slot].used && locate_(slots_[slot].address, slot_offset, slot_bios) &&
+				slot_offset == offset && slot_bios == bios && word == trap_word_(slot))
+			{
+				word = slots_[slot].original;
+			}
+		}
+		data[i] = static_cast<u8>(word >> (((address + i) & 3) * 8));
+	}
+	return true;
+}
+
+bool DebugTraps::write(u32 address, const u8* data, u32 size)
+{
+	for (u32 i = 0; i < size; i++)
+	{
+		u32 offset;
+		bool bios;
+		if (!locate_(address + i, offset, bios) || bios)
+		{
+			return false;
+		}
+		u32 shift = (offset & 3) * 8;
+		bool patched = false;
+		for (u32 slot = 1; slot < slots_.size(); slot++)
+		{
+			u32 slot_offset;
+			bool slot_bios;
+			if (slots_[slot].used && locate_(slots_[slot].address, slot_offset, slot_bios) &&
+				!slot_bios && slot_offset == (offset & ~3u) && load_(slot_offset, false) == trap_word_(slot))
+			{
+				slots_[slot].original = (slots_[slot].original & ~(0xffu << shift)) | (static_cast<u32>(data[i]) << shift);
+				patched = true;
+			}
+		}
+		if (!patched)
+		{
+			core_.interconnect().ram().store<u8>(offset, data[i]);
+		}
+	}
+	return true;
+}
+
+const DebugStop& DebugTraps::last_stop() const
+{
+	return stop_;
+}
+
+bool DebugTraps::watch_pending() const
+{
+	return watch_hit_;
+}
+
+bool DebugTraps::take_watch_hit()
+{
+	if (!watch_hit_)
+	{
+		return false;
+	}
+	if (slots_[0].used)
+	{
+		unfetch_(0);
+		slots_[0].used = false;
+	}
+	watch_hit_ = false;
+	return true;
+}
+
+bool DebugTraps::take(u32 word, u32& address, u32& original)
+{
+	u32 code = (word >> 6) & 0xfffff;
+	u32 slot = code & (DEBUG_TRAP_MAX_SLOTS - 1);
+	if ((code & ~(DEBUG_TRAP_MAX_SLOTS - 1)) != DEBUG_TRAP_CODE || slot >= slots_.size() || !slots_[slot].used)
+	{
+		return false;
+	}
+	address = slots_[slot].address;
+	original = slots_[slot].original;
+	if (slot == 0)
+	{
+		slots_[0].used = false;
+		watch_hit_ = false;
+	}
+	else
+	{
+		stop_ = DebugStop{ false, WatchKind::Write, address };
+	}
+	return true;
+}
+
+// The first hit stops the core before its next instruction, by trapping on it
+void DebugTraps::ram_access(u32 offset, u32 size, bool write)
+{
+	for (const Watch& watch : watches_)
+	{
+		if (offset + size <= watch.offset || offset >= watch.offset + watch.size ||
+			(watch.kind == WatchKind::Write && !write) || (watch.kind == WatchKind::Read && write))
+		{
+			continue;
+		}
+		if (watch_hit_)
+		{
+			return;
+		}
+		u32 accessed = (offset > watch.offset) ? offset - watch.offset : 0;
+		stop_ = DebugStop{ true, watch.kind, watch.address + accessed };
+		watch_hit_ = true;
+		if (!slots_[0].used)
+		{
+			slots_[0].address = core_.current_pc();
+			slots_[0].original = core_.swap_next_instruction(trap_word_(0));
+			slots_[0].used = true;
+		}
+		return;
+	}
+}
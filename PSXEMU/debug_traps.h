@@ -0,0 +1,109 @@
+#pragma once
+#include "cpu_core.h"
+#include <vector>
+
+#define DEBUG_TRAP_BREAK 0x0000000d			// SPECIAL BREAK, code in bits 6-25
+#define DEBUG_TRAP_CODE 0x80000				// code of the traps, ORed with their slot
+#define DEBUG_TRAP_MAX_SLOTS 0x10000
+
+enum class WatchKind
+{
+	Write,
+	Read,
+	Access				// read or write
+};
+
+// Thrown out of a step when a trap is hit. The core is left as it was
+// before the step, about to run the instruction at pc.
+struct DebugTrap
+{
+	u32 pc;
+};
+
+// Why the core last trapped
+struct DebugStop
+{
+	bool watch;
+	WatchKind kind;
+	u32 address;		// watched address accessed
+};
+
+// Breakpoints and watchpoints for a debugger, at no cost to code running
+// without them.
+//
+// A breakpoint replaces the instruction with a BREAK whose code selects a
+// slot, holding the address and the original word. Executing it puts the
+// original back in the fetched instruction and throws DebugTrap: the core
+// resumes exactly where it stopped.
+//
+// Watchpoints cover RAM. While there is one, the traps watch the RAM
+// accesses of the interconnect, see RamWatcher: loads and stores of the
+// CPU, not instruction fetches or DMA. A hit replaces the next instruction
+// of the core by a trap, so the core stops once the accessing instruction
+// is done.
+//
+// Guest reads of a patched instruction see the BREAK, and guest writes over
+// one remove the breakpoint.
+class DebugTraps : public RamWatcher
+{
+private:
+	struct Slot
+	{
+		u32 address;
+		u32 original;
+		bool used;
+	};
+	struct Watch
+	{
+		u32 address;
+		u32 offset;						// in RAM
+		u32 size;
+		WatchKind kind;
+	};
+
+	CPU::Core& core_;
+	std::vector<Slot> slots_;			// slot 0 stops the core after a watched access
+	std::vector<Watch> watches_;
+	DebugStop stop_;
+	bool watch_hit_;					// reported by ram_access, not by a trap yet
+
+	static u32 trap_word_(u32 slot);
+	// RAM offset of an address, or BIOS offset when bios is set
+	bool locate_(u32 address, u32& offset, bool& bios) const;
+	u32 load_(u32 offset, bool bios) const;
+	void patch_(u32 offset, bool bios, u32 word);
+	// Puts back the instruction a trap replaced in the core, if still there
+	void unfetch_(u32 slot);
+
+public:
+	explicit DebugTraps(CPU::Core& core);
+	~DebugTraps();
+	DebugTraps(const DebugTraps&) = delete;
+	DebugTraps& operator=(const DebugTraps&) = delete;
+
+	// Word aligned addresses of RAM or BIOS code, false elsewhere
+	bool add_breakpoint(u32 address);
+	bool remove_breakpoint(u32 address);
+	// RAM only
+	bool add_watchpoint(u32 address, u32 size, WatchKind kind);
+	bool remove_watchpoint(u32 address, u32 size, WatchKind kind);
+	void clear();
+
+	// RAM and BIOS as without the breakpoints, false for other addresses
+	bool read(u32 address, u8* data, u32 size) const;
+	// Keeps the breakpoints in the range
+	bool write(u32 address, const u8* data, u32 size);
+
+	const DebugStop& last_stop() const;
+	// A watched access not trapped on yet: the run should stop
+	bool watch_pending() const;
+	// Collects a watched access once the run stopped without trapping on it,
+	// an exception having replaced the trap for one
+	bool take_watch_hit();
+
+	// From the core: false when the BREAK isn't a trap, gives the address and
+	// original instruction otherwise
+	bool take(u32 word, u32& address, u32& original);
+	// From the interconnect
+	void ram_access(u32 offset, u32 size, bool write) override;
+};
@@ -0,0 +1,489 @@
+#include "disc_image.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined(PSXEMU_ZLIB)
+#include <zlib.h>
+#endif
+
+static u32 msf_to_sectors(const std::string& msf)
+{
+	u32 m = 0;
+	u32 s = 0;
+	u32 f = 0;
+	if (sscanf(msf.c_str(), "%u:%u:%u", &m, &s, &f) != 3)
+	{
+		std::cerr << "Bad MSF in CUE sheet: " << msf << std::endl;
+	}
+	return (m * 60 + s) * CD_SECTORS_PER_SECOND + f;
+}
+
+static std::string lower_extension(const std::string& path)
+{
+	usize dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return "";
+	}
+	std::string ext = path.substr(dot);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+	return ext;
+}
+
+static std::string directory_of(const std::string& path)
+{
+	usize slash = path.find_last_of("/\\");
+	return (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+}
+
+DiscImage::DiscImage() :
+	n_sectors_(0)
+{
+
+}
+
+const DiscSegment* DiscImage::find_segment_(u32 lba) const
+{
+	// Few segments per disc, most of the time one per track
+	for (const DiscSegment& segment : segments_)
+	{
+		if (lba >= segment.start_lba && lba - segment.start_lba < segment.n_sectors)
+		{
+			return &segment;
+		}
+	}
+	return nullptr;
+}
+
+const u8* DiscImage::sector_data(u32 lba)
+{
+	return nullptr;
+}
+
+const std::vector<DiscTrack>& DiscImage::tracks() const
+{
+	return tracks_;
+}
+
+u32 DiscImage::n_sectors() const
+{
+	return n_sectors_;
+}
+
+bool BinCueImage::open(const std::string& path)
+{
+	if (lower_extension(path) == ".cue")
+	{
+		return open_cue_(path);
+	}
+	return open_bin_(path);
+}
+
+bool BinCueImage::open_bin_(const std::string& path)
+{
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(path))
+	{
+		std::cerr << "Error opening disc image " << path << std::endl;
+		return false;
+	}
+
+	// A lone BIN is a single data track
+	n_sectors_ = static_cast<u32>(file->size() / CD_SECTOR_SIZE);
+	segments_.push_back(DiscSegment{ 0, n_sectors_, 0, 0 });
+	tracks_.push_back(DiscTrack{ 1, false, 0, n_sectors_ });
+	files_.push_back(std::move(file));
+	return true;
+}
+
+bool BinCueImage::open_cue_(const std::string& path)
+{
+	std::ifstream cue(path);
+	if (!cue)
+	{
+		std::cerr << "Error opening CUE sheet " << path << std::endl;
+		return false;
+	}
+
+	std::string dir = directory_of(path);
+	DiscSegment current = { 0, 0, -1, 0 };	// open segment of the current file
+	u64 file_sectors = 0;
+	u32 next_lba = 0;
+	u32 pending_pregap = 0;
+
+	auto close_current = [&](u64 end)
+	{
+		if (current.source >= 0 && end > current.offset)
+		{
+			current.n_sectors = static_cast<u32>(end - current.offset);
+			segments_.push_back(current);
+			next_lba += current.n_sectors;
+		}
+	};
+
+	std::string line;
+	while (std::getline(cue, line))
+	{
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+
+		if (keyword == "FILE")
+		{
+			usize first = line.find('"');
+			usize last = line.rfind('"');
+			if (first == std::string::npos || last == first)
+			{
+				std::cerr << "Bad FILE line in CUE sheet: " << line << std::endl;
+				return false;
+			}
+
+			close_current(file_sectors);
+
+			std::string name = line.substr(first + 1, last - first - 1);
+			std::unique_ptr<MappedFile> file(new MappedFile());
+			if (!file->open(dir + name))
+			{
+				std::cerr << "Error opening disc image " << dir + name << std::endl;
+				return false;
+			}
+			file_sectors = file->size() / CD_SECTOR_SIZE;
+			current = DiscSegment{ next_lba, 0, static_cast<s32>(files_.size()), 0 };
+			files_.push_back(std::move(file));
+		}
+		else if (keyword == "TRACK")
+		{
+			u32 number = 0;
+			std::string type;
+			tokens >> number >> type;
+			tracks_.push_back(DiscTrack{ number, type == "AUDIO", 0, 0 });
+		}
+		else if (keyword == "PREGAP")
+		{
+			std::string msf;
+			tokens >> msf;
+			pending_pregap = msf_to_sectors(msf);
+		}
+		else if (keyword == "INDEX")
+		{
+			u32 index = 0;
+			std::string msf;
+			tokens >> index >> msf;
+			if (index != 1 || tracks_.empty() || current.source < 0)
+			{
+				continue;
+			}
+
+			u64 position = msf_to_sectors(msf);
+			if (pending_pregap != 0)
+			{
+				// Pregap not stored in the file: split the file around silence
+				close_current(position);
+				segments_.push_back(DiscSegment{ next_lba, pending_pregap, -1, 0 });
+				next_lba += pending_pregap;
+				current = DiscSegment{ next_lba, 0, current.source, position };
+				pending_pregap = 0;
+			}
+			tracks_.back().start_lba = current.start_lba + static_cast<u32>(position - current.offset);
+		}
+	}
+	close_current(file_sectors);
+	n_sectors_ = next_lba;
+
+	if (tracks_.empty())
+	{
+		std::cerr << "No track in CUE sheet " << path << std::endl;
+		return false;
+	}
+	for (usize i = 0; i < tracks_.size(); i++)
+	{
+		u32 end = (i + 1 < tracks_.size()) ? tracks_[i + 1].start_lba : n_sectors_;
+		tracks_[i].n_sectors = end - tracks_[i].start_lba;
+	}
+	return true;
+}
+
+const u8* BinCueImage::sector_data(u32 lba)
+{
+	const DiscSegment* segment = find_segment_(lba);
+	if (segment == nullptr || segment->source < 0)
+	{
+		return nullptr;
+	}
+	const MappedFile& file = *files_[segment->source];
+	return file.data() + (segment->offset + (lba - segment->start_lba)) * CD_SECTOR_SIZE;
+}
+
+bool BinCueImage::read_sector(u32 lba, u8* out)
+{
+	const DiscSegment* segment = find_segment_(lba);
+	if (segment == nullptr)
+	{
+		return false;
+	}
+	if (segment->source < 0)
+	{
+		memset(out, 0, CD_SECTOR_SIZE);
+		return true;
+	}
+	memcpy(out, sector_data(lba), CD_SECTOR_SIZE);
+	return true;
+}
+
+#if defined(PSXEMU_ZLIB)
+CsoImage::CsoImage() :
+	block_size_(0),
+	align_(0),
+	total_bytes_(0),
+	block_number_(-1)
+{
+
+}
+
+bool CsoImage::open(const std::string& path)
+{
+	file_.reset(new MappedFile());
+	if (!file_->open(path))
+	{
+		std::cerr << "Error opening disc image " << path << std::endl;
+		return false;
+	}
+	const u8* data = file_->data();
+	if (file_->size() < CSO_HEADER_SIZE || memcmp(data, "CISO", 4) != 0)
+	{
+		std::cerr << "Not a CSO image: " << path << std::endl;
+		return false;
+	}
+	memcpy(&total_bytes_, data + 8, sizeof(total_bytes_));
+	memcpy(&block_size_, data + 16, sizeof(block_size_));
+	align_ = data[21];
+	if (data[20] > 1 || block_size_ == 0 || align_ >= 32)
+	{
+		std::cerr << "Unsupported CSO image " << path << ", version " << static_cast<u32>(data[20]) << std::endl;
+		return false;
+	}
+
+	u64 n_blocks = (total_bytes_ + block_size_ - 1) / block_size_;
+	if (file_->size() < CSO_HEADER_SIZE + (n_blocks + 1) * sizeof(u32))
+	{
+		std::cerr << "Truncated CSO index in " << path << std::endl;
+		return false;
+	}
+	index_.resize(static_cast<usize>(n_blocks + 1));
+	memcpy(index_.data(), data + CSO_HEADER_SIZE, index_.size() * sizeof(u32));
+	block_.resize(block_size_);
+
+	// A single data track, like a lone BIN
+	n_sectors_ = static_cast<u32>(total_bytes_ / CD_SECTOR_SIZE);
+	tracks_.push_back(DiscTrack{ 1, false, 0, n_sectors_ });
+	return true;
+}
+
+bool CsoImage::load_block_(u32 block)
+{
+	if (block_number_ == block)
+	{
+		return true;
+	}
+	u64 start = static_cast<u64>(index_[block] & ~CSO_BLOCK_PLAIN) << align_;
+	u64 end = static_cast<u64>(index_[block + 1] & ~CSO_BLOCK_PLAIN) << align_;
+	u64 size = std::min<u64>(block_size_, total_bytes_ - static_cast<u64>(block) * block_size_);
+	if (end < start || end > file_->size())
+	{
+		std::cerr << "Bad CSO block " << block << std::endl;
+		return false;
+	}
+
+	const u8* data = file_->data() + start;
+	if ((index_[block] & CSO_BLOCK_PLAIN) != 0)
+	{
+		if (end - start < size)
+		{
+			std::cerr << "Bad CSO block " << block << std::endl;
+			return false;
+		}
+		memcpy(block_.data(), data, static_cast<usize>(size));
+	}
+	else
+	{
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		stream.next_in = const_cast<Bytef*>(data);
+		stream.avail_in = static_cast<uInt>(end - start);
+		stream.next_out = block_.data();
+		stream.avail_out = block_size_;
+		// Raw deflate, without a zlib header
+		if (inflateInit2(&stream, -15) != Z_OK)
+		{
+			std::cerr << "Unable to start inflating CSO blocks" << std::endl;
+			return false;
+		}
+		inflate(&stream, Z_FINISH);
+		u64 produced = block_size_ - stream.avail_out;
+		inflateEnd(&stream);
+		if (produced < size)
+		{
+			std::cerr << "Bad compressed CSO block " << block << std::endl;
+			block_number_ = -1;
+			return false;
+		}
+	}
+	block_number_ = block;
+	return true;
+}
+
+bool CsoImage::read_sector(u32 lba, u8* out)
+{
+	if (lba >= n_sectors_)
+	{
+		return false;
+	}
+	// Sectors and blocks don't line up
+	u64 position = static_cast<u64>(lba) * CD_SECTOR_SIZE;
+	u32 done = 0;
+	while (done < CD_SECTOR_SIZE)
+	{
+		u32 offset = static_cast<u32>(position % block_size_);
+		if (!load_block_(static_cast<u32>(position / block_size_)))
+		{
+			return false;
+		}
+		u32 n = std::min<u32>(block_size_ - offset, CD_SECTOR_SIZE - done);
+		memcpy(out + done, block_.data() + offset, n);
+		done += n;
+		position += n;
+	}
+	return true;
+}
+#endif
+
+ReadAheadImage::ReadAheadImage(std::unique_ptr<DiscImage> inner) :
+	inner_(std::move(inner)),
+	cache_(CD_READ_AHEAD_SECTORS * 2),
+	next_lba_(0),
+	stop_(false)
+{
+	tracks_ = inner_->tracks();
+	n_sectors_ = inner_->n_sectors();
+	for (CachedSector& sector : cache_)
+	{
+		sector.lba = -1;
+	}
+	worker_ = std::thread(&ReadAheadImage::worker_main_, this);
+}
+
+ReadAheadImage::~ReadAheadImage()
+{
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex_);
+		stop_ = true;
+	}
+	wake_.notify_one();
+	worker_.join();
+}
+
+bool ReadAheadImage::read_sector(u32 lba, u8* out)
+{
+	bool hit = false;
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex_);
+		CachedSector& cached = cache_[lba % cache_.size()];
+		if (cached.lba == lba)
+		{
+			memcpy(out, cached.data, CD_SECTOR_SIZE);
+			hit = true;
+		}
+		next_lba_ = lba + 1;
+	}
+	wake_.notify_one();
+
+	if (hit)
+	{
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(inner_mutex_);
+	return inner_->read_sector(lba, out);
+}
+
+void ReadAheadImage::worker_main_()
+{
+	u8 buffer[CD_SECTOR_SIZE];
+	std::unique_lock<std::mutex> lock(cache_mutex_);
+
+	while (!stop_)
+	{
+		// First sector of the window still missing
+		s64 missing = -1;
+		for (u32 lba = next_lba_; lba < next_lba_ + CD_READ_AHEAD_SECTORS && lba < n_sectors_; lba++)
+		{
+			if (cache_[lba % cache_.size()].lba != lba)
+			{
+				missing = lba;
+				break;
+			}
+		}
+
+		if (missing < 0)
+		{
+			wake_.wait(lock);
+			continue;
+		}
+
+		lock.unlock();
+		bool ok;
+		{
+			std::lock_guard<std::mutex> inner_lock(inner_mutex_);
+			ok = inner_->read_sector(static_cast<u32>(missing), buffer);
+		}
+		lock.lock();
+
+		CachedSector& cached = cache_[missing % cache_.size()];
+		if (!ok)
+		{
+			// Unreadable sector: stop prefetching until the next request
+			wake_.wait(lock);
+			continue;
+		}
+		memcpy(cached.data, buffer, CD_SECTOR_SIZE);
+		cached.lba = missing;
+	}
+}
+
+std::shared_ptr<DiscImage> open_disc_image(const std::string& path)
+{
+	std::string ext = lower_extension(path);
+
+	if (ext == ".chd")
+	{
+		std::cerr << "CHD images aren't supported, convert them to BIN/CUE: " << path << std::endl;
+		return nullptr;
+	}
+
+	if (ext == ".cso")
+	{
+#if defined(PSXEMU_ZLIB)
+		std::unique_ptr<CsoImage> cso(new CsoImage());
+		if (!cso->open(path))
+		{
+			return nullptr;
+		}
+		// Inflating happens on the read-ahead thread
+		return std::make_shared<ReadAheadImage>(std::move(cso));
+#else
+		std::cerr << "CSO images need a build with zlib, convert them to BIN/CUE: " << path << std::endl;
+		return nullptr;
+#endif
+	}
+
+	std::shared_ptr<BinCueImage> image = std::make_shared<BinCueImage>();
+	if (!image->open(path))
+	{
+		return nullptr;
+	}
+	return image;
+}
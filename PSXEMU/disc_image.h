@@ -0,0 +1,128 @@
+#pragma once
+#include "types.h"
+#include "mapped_file.h"
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CD_SECTOR_SIZE 2352
+#define CD_SECTORS_PER_SECOND 75
+#define CD_LEAD_IN_SECTORS 150			// LBA 0 is at 00:02:00
+#define CD_READ_AHEAD_SECTORS 32
+#define CSO_HEADER_SIZE 24
+#define CSO_BLOCK_PLAIN 0x80000000		// index flag of blocks stored uncompressed
+
+struct DiscTrack
+{
+	u32 number;
+	bool audio;
+	u32 start_lba;						// INDEX 01
+	u32 n_sectors;
+};
+
+// Run of consecutive sectors stored in the same place
+struct DiscSegment
+{
+	u32 start_lba;
+	u32 n_sectors;
+	s32 source;							// index of the backing file / track, -1 for silence
+	u64 offset;							// first sector of the run inside the source
+};
+
+// Raw 2352 byte sector access to a CD image
+class DiscImage
+{
+protected:
+	std::vector<DiscTrack> tracks_;
+	std::vector<DiscSegment> segments_;
+	u32 n_sectors_;
+
+	const DiscSegment* find_segment_(u32 lba) const;
+
+public:
+	DiscImage();
+	virtual ~DiscImage() {}
+
+	// Copies a sector, false if it lies outside the disc
+	virtual bool read_sector(u32 lba, u8* out) = 0;
+	// Pointer to the sector inside the image when it is stored uncompressed,
+	// nullptr otherwise. Valid as long as the image is alive.
+	virtual const u8* sector_data(u32 lba);
+
+	const std::vector<DiscTrack>& tracks() const;
+	u32 n_sectors() const;
+};
+
+// BIN file, alone or described by a CUE sheet. The files are memory mapped.
+class BinCueImage : public DiscImage
+{
+private:
+	std::vector<std::unique_ptr<MappedFile>> files_;
+
+	bool open_bin_(const std::string& path);
+	bool open_cue_(const std::string& path);
+
+public:
+	bool open(const std::string& path);
+	bool read_sector(u32 lba, u8* out) override;
+	const u8* sector_data(u32 lba) override;
+};
+
+#if defined(PSXEMU_ZLIB)
+// CISO image (.cso, versions 0 and 1) of a lone BIN: the raw sectors cut into
+// blocks compressed with deflate, behind an index of block offsets. The file
+// is memory mapped and the last block inflated is kept.
+class CsoImage : public DiscImage
+{
+private:
+	std::unique_ptr<MappedFile> file_;
+	std::vector<u32> index_;			// one entry per block plus the end
+	u32 block_size_;
+	u32 align_;							// offsets in the index are shifted by it
+	u64 total_bytes_;
+	std::vector<u8> block_;
+	s64 block_number_;					// of block_, -1 for none
+
+	bool load_block_(u32 block);
+
+public:
+	CsoImage();
+	bool open(const std::string& path);
+	bool read_sector(u32 lba, u8* out) override;
+};
+#endif
+
+// Keeps a window of sectors ahead of the last read loaded by a worker
+// thread, so images on slow storage don't stall the emulation.
+class ReadAheadImage : public DiscImage
+{
+private:
+	struct CachedSector
+	{
+		s64 lba;
+		u8 data[CD_SECTOR_SIZE];
+	};
+
+	std::unique_ptr<DiscImage> inner_;
+	std::mutex inner_mutex_;					// serializes access to inner_
+
+	std::vector<CachedSector> cache_;			// direct mapped on lba
+	std::mutex cache_mutex_;
+	std::condition_variable wake_;
+	u32 next_lba_;								// first sector the worker should prepare
+	bool stop_;
+	std::thread worker_;
+
+	void worker_main_();
+
+public:
+	ReadAheadImage(std::unique_ptr<DiscImage> inner);
+	~ReadAheadImage();
+	bool read_sector(u32 lba, u8* out) override;
+};
+
+// Opens a .cue, .bin or, in builds with zlib, .cso image. nullptr on error.
+std::shared_ptr<DiscImage> open_disc_image(const std::string& path);
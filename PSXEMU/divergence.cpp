@@ -0,0 +1,128 @@
+#include "divergence.h"
+#include "hash.h"
+#include "replay.h"
+#include <memory>
+
+// Position dependent entry of a page in the RAM hash
+static u64 page_entry(u32 page, u64 hash)
+{
+	u64 entry = hash ^ (page * 0x9e3779b97f4a7c15ull);
+	entry ^= entry >> 31;
+	entry *= 0xbf58476d1ce4e5b9ull;
+	return entry ^ (entry >> 29);
+}
+
+StateHasher::StateHasher(CPU::Core& core) :
+	core_(core),
+	page_hashes_(RAM_N_PAGES + SPU_RAM_N_PAGES, 0),
+	changed_(RAM_N_PAGES),
+	ram_hash_(0)
+{
+	Interconnect& interconnect = core_.interconnect();
+	interconnect.ram().take_changed(changed_.data());
+	interconnect.spu().take_changed_sound_ram(changed_.data());
+	const u8* ram = static_cast<const Ram&>(interconnect.ram()).data();
+	const u8* sound_ram = interconnect.spu().sound_ram().data();
+	for (u32 page = 0; page < RAM_N_PAGES + SPU_RAM_N_PAGES; page++)
+	{
+		ram_hash_ ^= page_entry(page, 0);
+		update_page_(page, (page < RAM_N_PAGES) ? ram + (page << RAM_PAGE_SHIFT) :
+			sound_ram + ((page - RAM_N_PAGES) << RAM_PAGE_SHIFT));
+	}
+}
+
+void StateHasher::update_page_(u32 page, const u8* data)
+{
+	u64 hash = hash_page(data);
+	ram_hash_ ^= page_entry(page, page_hashes_[page]) ^ page_entry(page, hash);
+	page_hashes_[page] = hash;
+}
+
+void StateHasher::update_changed_()
+{
+	Interconnect& interconnect = core_.interconnect();
+	const u8* ram = static_cast<const Ram&>(interconnect.ram()).data();
+	u32 n_changed = interconnect.ram().take_changed(changed_.data());
+	for (u32 i = 0; i < n_changed; i++)
+	{
+		update_page_(changed_[i], ram + (changed_[i] << RAM_PAGE_SHIFT));
+	}
+	const u8* sound_ram = interconnect.spu().sound_ram().data();
+	n_changed = interconnect.spu().take_changed_sound_ram(changed_.data());
+	for (u32 i = 0; i < n_changed; i++)
+	{
+		update_page_(RAM_N_PAGES + changed_[i], sound_ram + (changed_[i] << RAM_PAGE_SHIFT));
+	}
+}
+
+u64 StateHasher::hash()
+{
+	update_changed_();
+	u64 hash = core_.hash(FNV1A_SEED);
+	hash = fnv1a_value(hash, ram_hash_);
+	return core_.interconnect().hash_devices(hash);
+}
+
+void step_interpreter(CPU::Core& core, u64 n_instructions)
+{
+	for (u64 i = 0; i < n_instructions; i++)
+	{
+		core.run_next_instruction();
+	}
+}
+
+static bool same_state(CoreSnapshot& a, CoreSnapshot& b)
+{
+	return StateHasher(a.core()).hash() == StateHasher(b.core()).hash();
+}
+
+Divergence find_divergence(const CPU::Core& a, const CPU::Core& b, u64 n_instructions,
+	const DivergenceStep& step_a, const DivergenceStep& step_b)
+{
+	// Copies at the last instruction count known to match, and the first known to differ
+	std::unique_ptr<CoreSnapshot> good_a(new CoreSnapshot(a));
+	std::unique_ptr<CoreSnapshot> good_b(new CoreSnapshot(b));
+	u64 good = 0;
+	u64 bad = n_instructions;
+
+	Divergence divergence;
+	if (!same_state(*good_a, *good_b))
+	{
+		divergence.found = true;
+		divergence.pc = good_a->core().current_pc();
+		divergence.cycles = good_a->cycles();
+		return divergence;
+	}
+
+	bool first = true;
+	while (bad - good > 1 || first)
+	{
+		// Tries the far end first, most runs never diverge
+		u64 probe = first ? n_instructions : good + (bad - good) / 2;
+		std::unique_ptr<CoreSnapshot> probe_a(new CoreSnapshot(good_a->core()));
+		std::unique_ptr<CoreSnapshot> probe_b(new CoreSnapshot(good_b->core()));
+		step_a(probe_a->core(), probe - good);
+		step_b(probe_b->core(), probe - good);
+		if (same_state(*probe_a, *probe_b))
+		{
+			if (first)
+			{
+				return divergence;
+			}
+			good_a = std::move(probe_a);
+			good_b = std::move(probe_b);
+			good = probe;
+		}
+		else
+		{
+			bad = probe;
+		}
+		first = false;
+	}
+
+	divergence.found = true;
+	divergence.instructions = bad;
+	divergence.pc = good_a->core().current_pc();
+	divergence.cycles = good_a->cycles();
+	return divergence;
+}
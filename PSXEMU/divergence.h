@@ -0,0 +1,47 @@
+#pragma once
+#include "cpu_core.h"
+#include <functional>
+#include <vector>
+
+// Hash of the whole machine: CPU and GTE registers, RAM and device state.
+// RAM and sound RAM pages are hashed again only once changed, so comparing
+// two runs every frame or every few thousand cycles costs the pages written
+// plus the device state. The hasher collects the changed pages of both
+// memories: use a single one per core.
+class StateHasher
+{
+private:
+	CPU::Core& core_;
+	std::vector<u64> page_hashes_;	// RAM pages, then sound RAM pages
+	std::vector<u32> changed_;
+	u64 ram_hash_;					// page hashes mixed with their index, XORed
+
+	void update_page_(u32 page, const u8* data);
+	void update_changed_();
+
+public:
+	explicit StateHasher(CPU::Core& core);
+	u64 hash();
+};
+
+// Advances a machine by n instructions, with one of the engines compared
+using DivergenceStep = std::function<void(CPU::Core& core, u64 n_instructions)>;
+
+// Plain interpreter steps
+void step_interpreter(CPU::Core& core, u64 n_instructions);
+
+struct Divergence
+{
+	bool found = false;
+	u64 instructions = 0;		// run from the starting states until they differ
+	u32 pc = 0;					// of the instruction that made them differ, in the first machine
+	u64 cycles = 0;				// of the first machine before that instruction
+};
+
+// Binary search for the first instruction after which two machines, run by
+// their own engines from the given states, stop hashing the same. Looks at
+// most n_instructions ahead and works on copies, so the cost is about two
+// runs of that length: each probe starts from the latest matching copies.
+// Not found when the states still match after n_instructions.
+Divergence find_divergence(const CPU::Core& a, const CPU::Core& b, u64 n_instructions,
+	const DivergenceStep& step_a, const DivergenceStep& step_b);
@@ -0,0 +1,124 @@
+#include "dma.h"
+#include "hash.h"
+
+Dma::Dma() :
+	control_(0x07654321),
+	interrupt_(0)
+{
+	for (DmaChannel& channel : channels_)
+	{
+		channel.base_address = 0;
+		channel.block_control = 0;
+		channel.channel_control = 0;
+	}
+}
+
+u32 Dma::load32(u32 offset) const
+{
+	u32 index = offset >> 4;
+	if (index < DMA_N_CHANNELS)
+	{
+		const DmaChannel& channel = channels_[index];
+		switch (offset & 0xf)
+		{
+		case 0x0:
+			return channel.base_address;
+		case 0x4:
+			return channel.block_control;
+		case 0x8:
+			return channel.channel_control;
+		default:
+			return 0;
+		}
+	}
+
+	switch (offset)
+	{
+	case 0x70:
+		return control_;
+	case 0x74:
+		return interrupt_ | (irq() ? (1u << 31) : 0);
+	default:
+		return 0;
+	}
+}
+
+void Dma::store32(u32 offset, u32 value)
+{
+	u32 index = offset >> 4;
+	if (index < DMA_N_CHANNELS)
+	{
+		DmaChannel& channel = channels_[index];
+		switch (offset & 0xf)
+		{
+		case 0x0:
+			channel.base_address = value & 0xffffff;
+			break;
+		case 0x4:
+			channel.block_control = value;
+			break;
+		case 0x8:
+			// OTC only goes backwards and only has the start/trigger bits writable
+			channel.channel_control = (index == static_cast<u32>(DmaPort::Otc)) ?
+				((value & 0x51000000) | 0x2) : value;
+			break;
+		default:
+			break;
+		}
+		return;
+	}
+
+	switch (offset)
+	{
+	case 0x70:
+		control_ = value;
+		break;
+	case 0x74:
+		// Flags (bits 24-30) are acknowledged by writing 1
+		interrupt_ = (interrupt_ & 0x7f000000 & ~(value & 0x7f000000)) | (value & 0x00ff803f);
+		break;
+	default:
+		break;
+	}
+}
+
+bool Dma::ready(DmaPort port) const
+{
+	u32 index = static_cast<u32>(port);
+	u32 control = channels_[index].channel_control;
+	bool enabled = (control_ & (0x8u << (index * 4))) != 0;
+	bool started = (control & (1u << 24)) != 0;
+	// Manual sync mode also waits for the trigger bit
+	bool triggered = ((control >> 9) & 0x3) != 0 || (control & (1u << 28)) != 0;
+	return enabled && started && triggered;
+}
+
+DmaChannel& Dma::channel(DmaPort port)
+{
+	return channels_[static_cast<u32>(port)];
+}
+
+void Dma::done(DmaPort port)
+{
+	u32 index = static_cast<u32>(port);
+	channels_[index].channel_control &= ~((1u << 24) | (1u << 28));
+	if (interrupt_ & (1u << (16 + index)))
+	{
+		interrupt_ |= 1u << (24 + index);
+	}
+}
+
+bool Dma::irq() const
+{
+	bool force = (interrupt_ & (1u << 15)) != 0;
+	bool master = (interrupt_ & (1u << 23)) != 0;
+	bool flags = ((interrupt_ >> 24) & (interrupt_ >> 16) & 0x7f) != 0;
+	return force || (master && flags);
+}
+
+u64 Dma::hash(u64 seed) const
+{
+	u64 hash = fnv1a(seed, channels_, sizeof(channels_));
+	hash = fnv1a_value(hash, control_);
+	return fnv1a_value(hash, interrupt_);
+}
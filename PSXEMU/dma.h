@@ -0,0 +1,46 @@
+#pragma once
+#include "types.h"
+
+#define DMA_N_CHANNELS 7
+
+enum class DmaPort
+{
+	MdecIn = 0,
+	MdecOut = 1,
+	Gpu = 2,
+	Cdrom = 3,
+	Spu = 4,
+	Pio = 5,
+	Otc = 6
+};
+
+struct DmaChannel
+{
+	u32 base_address;		// MADR
+	u32 block_control;		// BCR
+	u32 channel_control;	// CHCR
+};
+
+// DMA controller registers at 0x1f801080. The transfers themselves are
+// performed by the Interconnect, which owns RAM and the devices.
+class Dma
+{
+private:
+	DmaChannel channels_[DMA_N_CHANNELS];
+	u32 control_;			// DPCR
+	u32 interrupt_;			// DICR
+
+public:
+	Dma();
+	u32 load32(u32 offset) const;
+	void store32(u32 offset, u32 value);
+
+	// Channel enabled and started, waiting for its transfer
+	bool ready(DmaPort port) const;
+	DmaChannel& channel(DmaPort port);
+	// Transfer finished: clears the start bits and raises the channel interrupt
+	void done(DmaPort port);
+	bool irq() const;
+	// Chains the state of the device onto an FNV-1a hash
+	u64 hash(u64 seed) const;
+};
@@ -0,0 +1,186 @@
+#include "explore.h"
+#include "replay.h"
+#include "log.h"
+#include <cstdio>
+#include <deque>
+#include <iostream>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+std::vector<ExploreResult> explore(CPU::Core& core, u32 n_branches, const ExploreBranch& branch, u32)
+{
+	std::vector<ExploreResult> results(n_branches);
+	for (u32 i = 0; i < n_branches; i++)
+	{
+		CoreSnapshot copy(core);
+		try
+		{
+			results[i].data = branch(copy.core(), i);
+			results[i].ok = true;
+		}
+		catch (...)
+		{
+		}
+	}
+	return results;
+}
+
+#else
+
+struct ExploreChild
+{
+	pid_t pid;
+	int fd;			// read end of the result pipe
+	u32 branch;
+};
+
+static bool write_all(int fd, const u8* data, usize size)
+{
+	while (size > 0)
+	{
+		ssize_t written = write(fd, data, size);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (written <= 0)
+		{
+			return false;
+		}
+		data += written;
+		size -= static_cast<usize>(written);
+	}
+	return true;
+}
+
+static bool read_all(int fd, std::vector<u8>& data)
+{
+	u8 buffer[0x10000];
+	while (true)
+	{
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n < 0)
+		{
+			return false;
+		}
+		if (n == 0)
+		{
+			return true;
+		}
+		data.insert(data.end(), buffer, buffer + n);
+	}
+}
+
+// Child side, never returns. _exit skips the destructors and exit handlers
+// of the parent's objects, which the child only holds copies of.
+static void run_branch(int fd, CPU::Core& core, u32 index, const ExploreBranch& branch)
+{
+	int status = 1;
+	try
+	{
+		std::vector<u8> data = branch(core, index);
+		if (write_all(fd, data.data(), data.size()))
+		{
+			status = 0;
+		}
+	}
+	catch (...)
+	{
+	}
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
+	_exit(status);
+}
+
+static void finish_child(const ExploreChild& child, ExploreResult& result)
+{
+	bool complete = read_all(child.fd, result.data);
+	close(child.fd);
+	int status = 0;
+	while (waitpid(child.pid, &status, 0) < 0 && errno == EINTR)
+	{
+	}
+	result.ok = complete && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	if (!result.ok)
+	{
+		result.data.clear();
+	}
+}
+
+std::vector<ExploreResult> explore(CPU::Core& core, u32 n_branches, const ExploreBranch& branch,
+	u32 max_children)
+{
+	std::vector<ExploreResult> results(n_branches);
+	std::deque<ExploreChild> running;
+
+	// Output buffered so far would be written again by every child
+	std::cout.flush();
+	std::cerr.flush();
+	fflush(nullptr);
+
+	for (u32 i = 0; i < n_branches; i++)
+	{
+		if (max_children != 0 && running.size() >= max_children)
+		{
+			finish_child(running.front(), results[running.front().branch]);
+			running.pop_front();
+		}
+
+		int fds[2];
+		pid_t pid = -1;
+		if (pipe(fds) == 0)
+		{
+			pid = fork();
+			if (pid < 0)
+			{
+				close(fds[0]);
+				close(fds[1]);
+			}
+		}
+		if (pid < 0)
+		{
+			std::cerr << "Unable to start exploration branch " << i << ", errno " << errno << std::endl;
+			for (const ExploreChild& child : running)
+			{
+				finish_child(child, results[child.branch]);
+			}
+			throw - 1;
+		}
+
+		if (pid == 0)
+		{
+			close(fds[0]);
+			for (const ExploreChild& child : running)
+			{
+				close(child.fd);
+			}
+			// The log writer thread is not forked
+			log_set_synchronous(true);
+			run_branch(fds[1], core, i, branch);
+		}
+		close(fds[1]);
+		running.push_back({ pid, fds[0], i });
+	}
+
+	// Read in start order: a child blocked on a full pipe waits for its turn
+	while (!running.empty())
+	{
+		finish_child(running.front(), results[running.front().branch]);
+		running.pop_front();
+	}
+	return results;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include "cpu_core.h"
+#include <functional>
+#include <vector>
+
+// What one branch of an exploration passed back
+struct ExploreResult
+{
+	bool ok = false;			// the branch returned normally
+	std::vector<u8> data;
+};
+
+// Continues the machine on a private copy, typically after applying a
+// different input per branch. Returns the bytes passed back to the caller.
+using ExploreBranch = std::function<std::vector<u8>(CPU::Core& core, u32 branch)>;
+
+// Runs n_branches continuations of the current state of the core and leaves
+// the core itself unchanged.
+//
+// On POSIX systems each branch is a fork()ed child process. Guest RAM, BIOS
+// and device state are shared with the parent copy on write, so starting a
+// branch costs the pages it writes rather than a copy of the machine, and the
+// result comes back over a pipe. At most max_children run at once, 0 for no
+// limit. Only the calling thread exists in a child, so branches must not wait
+// on audio output or other threads. Elsewhere the branches run one after
+// another on CoreSnapshot copies.
+std::vector<ExploreResult> explore(CPU::Core& core, u32 n_branches, const ExploreBranch& branch,
+	u32 max_children = 0);
@@ -0,0 +1,298 @@
+#include "fuzz.h"
+#include <algorithm>
+
+// AFL hit count buckets: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+static u8 bucket(u8 count)
+{
+	if (count <= 3)
+	{
+		return static_cast<u8>(1 << (count - 1));
+	}
+	if (count < 32)
+	{
+		return (count < 8) ? 0x08 : (count < 16) ? 0x10 : 0x20;
+	}
+	return (count < 128) ? 0x40 : 0x80;
+}
+
+Fuzzer::Fuzzer(CPU::Core& core, const FuzzOptions& options) :
+	core_(core),
+	start_(core),
+	options_(options),
+	seen_(COVERAGE_MAP_SIZE, 0),
+	rng_(options.seed != 0 ? options.seed : 1),
+	iterations_(0),
+	edges_(0)
+{
+	u32 offset = options_.input_address & 0x1fffffff;
+	if (offset >= RAM_ADDR_SPACE_SIZE || options_.max_input_size > RAM_ADDR_SPACE_SIZE - offset)
+	{
+		std::cerr << "Fuzz input buffer outside RAM: " << std::hex << options_.input_address << std::endl;
+		throw - 1;
+	}
+}
+
+Fuzzer::~Fuzzer()
+{
+	start_.restore(core_);
+}
+
+void Fuzzer::set_injector(std::function<void(CPU::Core&, const std::vector<u8>&)> injector)
+{
+	injector_ = injector;
+}
+
+void Fuzzer::add_seed(const std::vector<u8>& input)
+{
+	corpus_.push_back(input);
+}
+
+// xorshift64*
+u32 Fuzzer::random_(u32 range)
+{
+	rng_ ^= rng_ >> 12;
+	rng_ ^= rng_ << 25;
+	rng_ ^= rng_ >> 27;
+	return static_cast<u32>((rng_ * 0x2545f4914f6cdd1dull) >> 32) % range;
+}
+
+std::vector<u8> Fuzzer::mutate_(const std::vector<u8>& input)
+{
+	static const u8 INTERESTING[] = { 0x00, 0x01, 0x10, 0x20, 0x40, 0x7f, 0x80, 0xff };
+
+	std::vector<u8> output = input;
+	u32 n_mutations = 1 + random_(4);
+	for (u32 i = 0; i < n_mutations; i++)
+	{
+		// Nothing to change in an empty input but its length
+		u32 mutation = output.empty() ? 0 : random_(7);
+		u32 at = output.empty() ? 0 : random_(static_cast<u32>(output.size()));
+		switch (mutation)
+		{
+		case 0:
+			output.insert(output.begin() + random_(static_cast<u32>(output.size()) + 1),
+				static_cast<u8>(random_(256)));
+			break;
+		case 1:
+			output[at] ^= static_cast<u8>(1 << random_(8));
+			break;
+		case 2:
+			output[at] = static_cast<u8>(random_(256));
+			break;
+		case 3:
+			output[at] = INTERESTING[random_(sizeof(INTERESTING))];
+			break;
+		case 4:
+			output[at] += static_cast<u8>(random_(33) - 16);
+			break;
+		case 5:
+			if (output.size() > 1)
+			{
+				output.erase(output.begin() + at);
+			}
+			break;
+		default:
+		{
+			// Splices in a piece of another input
+			const std::vector<u8>& other = corpus_[random_(static_cast<u32>(corpus_.size()))];
+			if (!other.empty())
+			{
+				u32 from = random_(static_cast<u32>(other.size()));
+				u32 length = 1 + random_(static_cast<u32>(std::min(other.size() - from, output.size() - at)));
+				std::copy(other.begin() + from, other.begin() + from + length, output.begin() + at);
+			}
+			break;
+		}
+		}
+	}
+	if (output.size() > options_.max_input_size)
+	{
+		output.resize(options_.max_input_size);
+	}
+	return output;
+}
+
+// Adds the hits of the last iteration to what was seen, true for anything new
+bool Fuzzer::merge_coverage_()
+{
+	bool found = false;
+	const u8* hits = coverage_.hits();
+	for (u32 i = 0; i < COVERAGE_MAP_SIZE; i += 8)
+	{
+		// The map is mostly zeros
+		u64 word;
+		memcpy(&word, hits + i, sizeof(word));
+		if (word == 0)
+		{
+			continue;
+		}
+		for (u32 j = i; j < i + 8; j++)
+		{
+			if (hits[j] == 0)
+			{
+				continue;
+			}
+			u8 seen = bucket(hits[j]);
+			if ((seen_[j] & seen) == 0)
+			{
+				edges_ += (seen_[j] == 0) ? 1 : 0;
+				seen_[j] |= seen;
+				found = true;
+			}
+		}
+	}
+	coverage_.clear();
+	return found;
+}
+
+// fetch_address is the word the failed step prefetched. A step that failed
+// before changing pc failed on the fetch.
+FuzzCrash Fuzzer::classify_(u32 fetch_address)
+{
+	Fault fault = core_.interconnect().fault();
+	if (core_.state().pc == fetch_address)
+	{
+		return (fault == Fault::Unmapped || fault == Fault::Unaligned) ? FuzzCrash::BadFetch : FuzzCrash::Other;
+	}
+	switch (fault)
+	{
+	case Fault::Unmapped:
+		return FuzzCrash::UnmappedAccess;
+	case Fault::Unaligned:
+		return FuzzCrash::UnalignedAccess;
+	case Fault::Reserved:
+		return FuzzCrash::ReservedInstruction;
+	case Fault::Overflow:
+		return FuzzCrash::Overflow;
+	case Fault::Coprocessor:
+		return FuzzCrash::Coprocessor;
+	case Fault::Break:
+		return FuzzCrash::Break;
+	default:
+		return FuzzCrash::Other;
+	}
+}
+
+FuzzResult Fuzzer::run_input(const std::vector<u8>& input)
+{
+	start_.restore(core_);
+	core_.interconnect().set_fault(Fault::None);
+	core_.set_coverage(&coverage_);
+	if (injector_)
+	{
+		injector_(core_, input);
+	}
+	else
+	{
+		usize size = std::min<usize>(input.size(), options_.max_input_size);
+		u8* buffer = core_.interconnect().ram().writable(options_.input_address & 0x1fffffff, size);
+		std::copy(input.begin(), input.begin() + size, buffer);
+		if (options_.size_address != 0)
+		{
+			core_.interconnect().store<u32>(options_.size_address, static_cast<u32>(size));
+		}
+	}
+
+	FuzzResult result;
+	u64 start = core_.state().cycles;
+	u64 end = start + options_.max_cycles;
+	u32 pc = 0;
+	u32 fetch_address = 0;
+	try
+	{
+		while (core_.state().cycles < end)
+		{
+			pc = core_.current_pc();
+			if (options_.stop_at_pc && pc == options_.stop_pc)
+			{
+				break;
+			}
+			fetch_address = core_.state().pc;
+			core_.run_next_instruction();
+		}
+	}
+	catch (int)
+	{
+		// Anything else, debugger traps included, isn't a crash of the guest
+		result.crash = classify_(fetch_address);
+		result.pc = pc;
+	}
+	result.cycles = core_.state().cycles - start;
+	result.new_coverage = merge_coverage_();
+	iterations_++;
+
+	if (result.crash != FuzzCrash::None)
+	{
+		bool known = std::any_of(findings_.begin(), findings_.end(), [&](const FuzzFinding& finding)
+		{
+			return finding.crash == result.crash && finding.pc == result.pc;
+		});
+		if (!known)
+		{
+			findings_.push_back({ result.crash, result.pc, input });
+		}
+	}
+	else if (result.new_coverage)
+	{
+		corpus_.push_back(input);
+	}
+	return result;
+}
+
+void Fuzzer::fuzz(u64 iterations)
+{
+	for (u64 i = 0; i < iterations; i++)
+	{
+		if (corpus_.empty())
+		{
+			run_input(std::vector<u8>());
+			continue;
+		}
+		run_input(mutate_(corpus_[random_(static_cast<u32>(corpus_.size()))]));
+	}
+}
+
+const std::vector<std::vector<u8>>& Fuzzer::corpus() const
+{
+	return corpus_;
+}
+
+const std::vector<FuzzFinding>& Fuzzer::findings() const
+{
+	return findings_;
+}
+
+u64 Fuzzer::iterations() const
+{
+	return iterations_;
+}
+
+u32 Fuzzer::edges() const
+{
+	return edges_;
+}
+
+const char* Fuzzer::name(FuzzCrash crash)
+{
+	switch (crash)
+	{
+	case FuzzCrash::None:
+		return "none";
+	case FuzzCrash::UnmappedAccess:
+		return "unmapped_access";
+	case FuzzCrash::UnalignedAccess:
+		return "unaligned_access";
+	case FuzzCrash::ReservedInstruction:
+		return "reserved_instruction";
+	case FuzzCrash::Overflow:
+		return "overflow";
+	case FuzzCrash::Coprocessor:
+		return "coprocessor";
+	case FuzzCrash::Break:
+		return "break";
+	case FuzzCrash::BadFetch:
+		return "bad_fetch";
+	default:
+		return "other";
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "cpu_core.h"
+#include "replay.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// Why an iteration ended early, from the fault recorded by the interconnect
+enum class FuzzCrash
+{
+	None,
+	UnmappedAccess,			// load or store outside every device
+	UnalignedAccess,		// host side access not aligned to its size
+	ReservedInstruction,	// an opcode the core doesn't implement
+	Overflow,				// add or addi
+	Coprocessor,			// COP0 or GTE instruction or register not emulated
+	Break,					// break without a debugger trap
+	BadFetch,				// pc outside RAM and BIOS
+	Other
+};
+
+struct FuzzOptions
+{
+	u32 input_address = 0;			// guest address the input is copied to
+	u32 size_address = 0;			// where its size is stored as a word, 0 for nowhere
+	u32 max_input_size = 256;
+	u64 max_cycles = 100000;		// budget of one iteration
+	bool stop_at_pc = false;		// iterations also end before the instruction at stop_pc
+	u32 stop_pc = 0;
+	u64 seed = 1;
+};
+
+struct FuzzResult
+{
+	FuzzCrash crash = FuzzCrash::None;
+	u32 pc = 0;						// instruction that crashed
+	bool new_coverage = false;
+	u64 cycles = 0;
+};
+
+// A crashing input, kept once per kind of crash and pc
+struct FuzzFinding
+{
+	FuzzCrash crash;
+	u32 pc;
+	std::vector<u8> input;
+};
+
+// Coverage guided fuzzer for guest code. Every iteration restores the core
+// to the state it had when the fuzzer was created, writes the input to guest
+// memory and runs until the cycle budget, the stop pc or a crash. Inputs
+// reaching new edges, or known edges a new number of times (AFL buckets),
+// join the corpus that later inputs are mutated from.
+//
+// Restoring reuses the core's buffers and copies back only the RAM pages the
+// iteration wrote, so short iterations stay cheap.
+class Fuzzer
+{
+private:
+	CPU::Core& core_;
+	CoreSnapshot start_;
+	FuzzOptions options_;
+	EdgeCoverage coverage_;
+	std::vector<u8> seen_;				// hit count buckets seen per map entry
+	std::function<void(CPU::Core&, const std::vector<u8>&)> injector_;
+	std::vector<std::vector<u8>> corpus_;
+	std::vector<FuzzFinding> findings_;
+	u64 rng_;
+	u64 iterations_;
+	u32 edges_;
+
+	u32 random_(u32 range);
+	std::vector<u8> mutate_(const std::vector<u8>& input);
+	bool merge_coverage_();
+	FuzzCrash classify_(u32 fetch_address);
+
+public:
+	Fuzzer(CPU::Core& core, const FuzzOptions& options);
+	// Puts the core back in the state the fuzzer started from
+	~Fuzzer();
+	Fuzzer(const Fuzzer&) = delete;
+	Fuzzer& operator=(const Fuzzer&) = delete;
+
+	// Replaces writing the input at input_address, e.g. to feed a device
+	void set_injector(std::function<void(CPU::Core&, const std::vector<u8>&)> injector);
+	void add_seed(const std::vector<u8>& input);
+	// One iteration with the given input, its coverage counts like any other
+	FuzzResult run_input(const std::vector<u8>& input);
+	// Iterations on mutations of the corpus, an empty input if it is empty
+	void fuzz(u64 iterations);
+
+	const std::vector<std::vector<u8>>& corpus() const;
+	const std::vector<FuzzFinding>& findings() const;
+	u64 iterations() const;
+	// Coverage map entries hit by any input so far
+	u32 edges() const;
+
+	static const char* name(FuzzCrash crash);
+};
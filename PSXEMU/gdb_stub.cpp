@@ -0,0 +1,684 @@
+#include "gdb_stub.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define GDB_INTERRUPT 0x03
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Registers go in target byte order, little endian
+static void append_word(std::string& out, u32 value)
+{
+	for (u32 i = 0; i < 4; i++)
+	{
+		u8 byte = static_cast<u8>(value >> (i * 8));
+		out.push_back(HEX_DIGITS[byte >> 4]);
+		out.push_back(HEX_DIGITS[byte & 0xf]);
+	}
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// Number at pos, which is moved past it
+static u32 parse_number(const std::string& text, usize& pos)
+{
+	u32 value = 0;
+	while (pos < text.size() && hex_digit(text[pos]) >= 0)
+	{
+		value = (value << 4) | static_cast<u32>(hex_digit(text[pos]));
+		pos++;
+	}
+	return value;
+}
+
+static bool parse_bytes(const std::string& text, usize pos, std::vector<u8>& bytes)
+{
+	for (; pos + 1 < text.size(); pos += 2)
+	{
+		int high = hex_digit(text[pos]);
+		int low = hex_digit(text[pos + 1]);
+		if (high < 0 || low < 0)
+		{
+			return false;
+		}
+		bytes.push_back(static_cast<u8>((high << 4) | low));
+	}
+	return pos == text.size();
+}
+
+static u32 parse_word(const std::string& text, usize pos)
+{
+	std::vector<u8> bytes;
+	if (!parse_bytes(text.substr(pos, 8), 0, bytes) || bytes.size() != 4)
+	{
+		return 0;
+	}
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<u32>(bytes[3]) << 24);
+}
+
+static std::string hex_number(u32 value)
+{
+	char text[9];
+	snprintf(text, sizeof(text), "%x", value);
+	return text;
+}
+
+GdbStub::GdbStub(CPU::Core& core, const RunOptions& options) :
+	core_(core),
+	traps_(core),
+	loop_(core),
+	options_(options),
+	listen_socket_(-1),
+	socket_(-1),
+	done_(false)
+{
+	loop_.set_slice_callback([this]()
+	{
+		poll_();
+	});
+}
+
+GdbStub::~GdbStub()
+{
+#if !defined(_WIN32)
+	if (socket_ >= 0)
+	{
+		::close(socket_);
+	}
+	if (listen_socket_ >= 0)
+	{
+		::close(listen_socket_);
+	}
+#endif
+}
+
+void GdbStub::set_slice_callback(std::function<void()> on_slice)
+{
+	on_slice_ = on_slice;
+}
+
+bool GdbStub::done() const
+{
+	return done_;
+}
+
+std::string GdbStub::frame(const std::string& payload)
+{
+	std::string framed = "$";
+	u8 checksum = 0;
+	for (char c : payload)
+	{
+		if (c == '$' || c == '#' || c == '}' || c == '*')
+		{
+			framed.push_back('}');
+			checksum += '}';
+			c ^= 0x20;
+		}
+		framed.push_back(c);
+		checksum += static_cast<u8>(c);
+	}
+	framed.push_back('#');
+	framed.push_back(HEX_DIGITS[checksum >> 4]);
+	framed.push_back(HEX_DIGITS[checksum & 0xf]);
+	return framed;
+}
+
+const std::string& GdbStub::target_xml()
+{
+	static const std::string xml = []()
+	{
+		std::ostringstream out;
+		out << "<?xml version=\"1.0\"?>"
+			"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+			"<target version=\"1.0\"><architecture>mips:3000</architecture>"
+			"<feature name=\"org.gnu.gdb.mips.cpu\">";
+		for (u32 i = 0; i < 32; i++)
+		{
+			out << "<reg name=\"r" << i << "\" bitsize=\"32\" regnum=\"" << i << "\"/>";
+		}
+		out << "<reg name=\"lo\" bitsize=\"32\" regnum=\"33\"/>"
+			"<reg name=\"hi\" bitsize=\"32\" regnum=\"34\"/>"
+			"<reg name=\"pc\" bitsize=\"32\" regnum=\"37\"/>"
+			"</feature><feature name=\"org.gnu.gdb.mips.cp0\">"
+			"<reg name=\"status\" bitsize=\"32\" regnum=\"32\"/>"
+			"<reg name=\"badvaddr\" bitsize=\"32\" regnum=\"35\"/>"
+			"<reg name=\"cause\" bitsize=\"32\" regnum=\"36\"/>"
+			"</feature><feature name=\"org.gnu.gdb.mips.fpu\">";
+		// No FPU, gdb requires the registers anyway: they read as 0
+		for (u32 i = 0; i < 32; i++)
+		{
+			out << "<reg name=\"f" << i << "\" bitsize=\"32\" type=\"ieee_single\" regnum=\"" << 38 + i << "\"/>";
+		}
+		out << "<reg name=\"fcsr\" bitsize=\"32\" group=\"float\" regnum=\"70\"/>"
+			"<reg name=\"fir\" bitsize=\"32\" group=\"float\" regnum=\"71\"/>"
+			"</feature></target>";
+		return out.str();
+	}();
+	return xml;
+}
+
+u32 GdbStub::register_(u32 index)
+{
+	const CPU::State& state = core_.state();
+	if (index < N_GP_REG)
+	{
+		return state.regs[index];
+	}
+	switch (index)
+	{
+	case 32:
+		return state.cop0regs.sr;
+	case 33:
+		return state.lo;
+	case 34:
+		return state.hi;
+	case 36:
+		return state.cop0regs.cause;
+	case GDB_STUB_PC_REGISTER:
+		return core_.current_pc();
+	default:
+		return 0;
+	}
+}
+
+void GdbStub::set_register_(u32 index, u32 value)
+{
+	CPU::State& state = core_.state();
+	if (index < N_GP_REG)
+	{
+		if (index != 0)
+		{
+			state.regs[index] = value;
+			state.out_regs[index] = value;
+		}
+		return;
+	}
+	switch (index)
+	{
+	case 32:
+		state.cop0regs.sr = value;
+		break;
+	case 33:
+		state.lo = value;
+		break;
+	case 34:
+		state.hi = value;
+		break;
+	case 36:
+		state.cop0regs.cause = value;
+		break;
+	case GDB_STUB_PC_REGISTER:
+		if (value != core_.current_pc())
+		{
+			core_.set_pc(value);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+std::string GdbStub::stop_reply_(StopReason reason)
+{
+	const DebugStop& stop = traps_.last_stop();
+	bool watch = (reason == StopReason::Trap && stop.watch) || traps_.take_watch_hit();
+	if (watch)
+	{
+		const char* kind = (stop.kind == WatchKind::Write) ? "watch" :
+			(stop.kind == WatchKind::Read) ? "rwatch" : "awatch";
+		return std::string("T05") + kind + ":" + hex_number(stop.address) + ";";
+	}
+	switch (reason)
+	{
+	case StopReason::Requested:
+		return "S02";			// SIGINT
+	case StopReason::Error:
+		return "S04";			// SIGILL, something not emulated
+	default:
+		return "S05";			// SIGTRAP
+	}
+}
+
+std::string GdbStub::resume_(const std::string& address, bool step)
+{
+	if (!address.empty())
+	{
+		usize pos = 0;
+		core_.set_pc(parse_number(address, pos));
+	}
+	if (!step)
+	{
+		return stop_reply_(loop_.run(options_).reason);
+	}
+	try
+	{
+		core_.run_next_instruction();
+	}
+	catch (const DebugTrap&)
+	{
+		return stop_reply_(StopReason::Trap);
+	}
+	catch (int)
+	{
+		return stop_reply_(StopReason::Error);
+	}
+	return stop_reply_(StopReason::PcHit);
+}
+
+// Z0/Z1 breakpoints, Z2 write, Z3 read and Z4 access watchpoints
+std::string GdbStub::breakpoint_(const std::string& args, bool insert)
+{
+	usize pos = 0;
+	u32 type = parse_number(args, pos);
+	if (pos >= args.size() || args[pos] != ',')
+	{
+		return "E01";
+	}
+	pos++;
+	u32 address = parse_number(args, pos);
+	if (pos >= args.size() || args[pos] != ',')
+	{
+		return "E01";
+	}
+	pos++;
+	u32 size = parse_number(args, pos);
+
+	bool ok;
+	if (type <= 1)
+	{
+		ok = insert ? traps_.add_breakpoint(address) : traps_.remove_breakpoint(address);
+	}
+	else if (type <= 4)
+	{
+		WatchKind kind = (type == 2) ? WatchKind::Write : (type == 3) ? WatchKind::Read : WatchKind::Access;
+		ok = insert ? traps_.add_watchpoint(address, size, kind) : traps_.remove_watchpoint(address, size, kind);
+	}
+	else
+	{
+		return "";
+	}
+	return ok ? "OK" : "E01";
+}
+
+std::string GdbStub::query_(const std::string& packet)
+{
+	if (packet.compare(0, 11, "qSupported:") == 0 || packet == "qSupported")
+	{
+		return "PacketSize=" + hex_number(GDB_STUB_PACKET_SIZE) + ";qXfer:features:read+";
+	}
+	if (packet.compare(0, 31, "qXfer:features:read:target.xml:") == 0)
+	{
+		usize pos = 31;
+		u32 offset = parse_number(packet, pos);
+		pos++;
+		u32 length = parse_number(packet, pos);
+		const std::string& xml = target_xml();
+		if (offset >= xml.size())
+		{
+			return "l";
+		}
+		std::string chunk = xml.substr(offset, length);
+		return ((offset + chunk.size() < xml.size()) ? "m" : "l") + chunk;
+	}
+	if (packet == "qAttached")
+	{
+		return "1";
+	}
+	if (packet == "qC")
+	{
+		return "QC1";
+	}
+	if (packet == "qfThreadInfo")
+	{
+		return "m1";
+	}
+	if (packet == "qsThreadInfo")
+	{
+		return "l";
+	}
+	return "";
+}
+
+std::string GdbStub::handle(const std::string& packet)
+{
+	if (packet.empty())
+	{
+		return "";
+	}
+	std::string args = packet.substr(1);
+	switch (packet[0])
+	{
+	case '?':
+		return "S05";
+	case 'g':
+	{
+		std::string out;
+		for (u32 i = 0; i < GDB_STUB_N_REGISTERS; i++)
+		{
+			append_word(out, register_(i));
+		}
+		return out;
+	}
+	case 'G':
+		for (u32 i = 0; i < GDB_STUB_N_REGISTERS && (i + 1) * 8 <= args.size(); i++)
+		{
+			set_register_(i, parse_word(args, i * 8));
+		}
+		return "OK";
+	case 'p':
+	{
+		usize pos = 0;
+		std::string out;
+		append_word(out, register_(parse_number(args, pos)));
+		return out;
+	}
+	case 'P':
+	{
+		usize pos = 0;
+		u32 index = parse_number(args, pos);
+		if (pos >= args.size() || args[pos] != '=')
+		{
+			return "E01";
+		}
+		set_register_(index, parse_word(args, pos + 1));
+		return "OK";
+	}
+	case 'm':
+	{
+		usize pos = 0;
+		u32 address = parse_number(args, pos);
+		pos++;
+		u32 length = parse_number(args, pos);
+		length = (length < GDB_STUB_PACKET_SIZE / 2) ? length : GDB_STUB_PACKET_SIZE / 2;
+		std::vector<u8> data(length);
+		if (!traps_.read(address, data.data(), length))
+		{
+			return "E01";
+		}
+		std::string out;
+		for (u8 byte : data)
+		{
+			out.push_back(HEX_DIGITS[byte >> 4]);
+			out.push_back(HEX_DIGITS[byte & 0xf]);
+		}
+		return out;
+	}
+	case 'M':
+	{
+		usize pos = 0;
+		u32 address = parse_number(args, pos);
+		pos++;
+		u32 length = parse_number(args, pos);
+		std::vector<u8> data;
+		if (pos >= args.size() || args[pos] != ':' || !parse_bytes(args, pos + 1, data) || data.size() != length)
+		{
+			return "E01";
+		}
+		return traps_.write(address, data.data(), length) ? "OK" : "E01";
+	}
+	case 'c':
+		return resume_(args, false);
+	case 's':
+		return resume_(args, true);
+	case 'Z':
+		return breakpoint_(args, true);
+	case 'z':
+		return breakpoint_(args, false);
+	case 'H':
+	case 'T':
+		return "OK";
+	case 'q':
+		return query_(packet);
+	case 'D':
+		traps_.clear();
+		done_ = true;
+		return "OK";
+	case 'k':
+		traps_.clear();
+		done_ = true;
+		return "";
+	default:
+		return "";
+	}
+}
+
+#if defined(_WIN32)
+
+bool GdbStub::listen(const std::string&)
+{
+	std::cerr << "GDB stub sockets are not supported on this platform" << std::endl;
+	return false;
+}
+
+void GdbStub::serve()
+{
+}
+
+bool GdbStub::receive_()
+{
+	return false;
+}
+
+bool GdbStub::read_packet_(std::string&)
+{
+	return false;
+}
+
+void GdbStub::send_(const std::string&)
+{
+}
+
+void GdbStub::poll_()
+{
+	if (on_slice_)
+	{
+		on_slice_();
+	}
+}
+
+#else
+
+bool GdbStub::listen(const std::string& target)
+{
+	if (target.compare(0, strlen(GDB_STUB_SOCKET_PREFIX), GDB_STUB_SOCKET_PREFIX) == 0)
+	{
+		std::string path = target.substr(strlen(GDB_STUB_SOCKET_PREFIX));
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			std::cerr << "GDB socket path too long: " << path << std::endl;
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size());
+		unlink(path.c_str());
+		listen_socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listen_socket_ < 0 || bind(listen_socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			std::cerr << "Unable to bind the GDB socket " << path << std::endl;
+			return false;
+		}
+	}
+	else
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(static_cast<u16>(strtoul(target.c_str(), nullptr, 10)));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+		int reuse = 1;
+		if (listen_socket_ < 0 ||
+			setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+			bind(listen_socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			std::cerr << "Unable to bind the GDB port " << target << std::endl;
+			return false;
+		}
+	}
+	if (::listen(listen_socket_, 1) != 0)
+	{
+		std::cerr << "Unable to listen for GDB on " << target << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void GdbStub::serve()
+{
+	socket_ = accept(listen_socket_, nullptr, nullptr);
+	if (socket_ < 0)
+	{
+		return;
+	}
+	std::string packet;
+	while (!done_ && read_packet_(packet))
+	{
+		send_("+");
+		std::string reply = handle(packet);
+		if (packet[0] != 'k')
+		{
+			send_(frame(reply));
+		}
+	}
+	traps_.clear();
+	::close(socket_);
+	socket_ = -1;
+}
+
+// Blocks for more bytes, false once the debugger is gone
+bool GdbStub::receive_()
+{
+	char buffer[4096];
+	ssize_t n = recv(socket_, buffer, sizeof(buffer), 0);
+	if (n <= 0)
+	{
+		return false;
+	}
+	received_.append(buffer, static_cast<usize>(n));
+	return true;
+}
+
+// Acknowledgements and interrupts while stopped are skipped, packets with a
+// bad checksum asked again
+bool GdbStub::read_packet_(std::string& packet)
+{
+	for (;;)
+	{
+		usize start = received_.find('$');
+		usize end = (start == std::string::npos) ? std::string::npos : received_.find('#', start);
+		if (end == std::string::npos || end + 2 >= received_.size())
+		{
+			if (!receive_())
+			{
+				return false;
+			}
+			continue;
+		}
+		packet.clear();
+		u8 checksum = 0;
+		for (usize i = start + 1; i < end; i++)
+		{
+			checksum += static_cast<u8>(received_[i]);
+			if (received_[i] == '}' && i + 1 < end)
+			{
+				checksum += static_cast<u8>(received_[++i]);
+				packet.push_back(received_[i] ^ 0x20);
+				continue;
+			}
+			packet.push_back(received_[i]);
+		}
+		int expected = (hex_digit(received_[end + 1]) << 4) | hex_digit(received_[end + 2]);
+		received_.erase(0, end + 3);
+		if (expected != checksum)
+		{
+			send_("-");
+			continue;
+		}
+		if (!packet.empty())
+		{
+			return true;
+		}
+	}
+}
+
+void GdbStub::send_(const std::string& data)
+{
+#if defined(MSG_NOSIGNAL)
+	int flags = MSG_NOSIGNAL;
+#else
+	int flags = 0;
+#endif
+	usize sent = 0;
+	while (socket_ >= 0 && sent < data.size())
+	{
+		ssize_t n = ::send(socket_, data.data() + sent, data.size() - sent, flags);
+		if (n <= 0)
+		{
+			return;
+		}
+		sent += static_cast<usize>(n);
+	}
+}
+
+// Between slices: the interrupt of the debugger, and watched accesses the
+// core couldn't trap on
+void GdbStub::poll_()
+{
+	if (socket_ >= 0)
+	{
+		char buffer[256];
+		ssize_t n = recv(socket_, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if (n == 0)
+		{
+			done_ = true;
+			loop_.request_stop();
+		}
+		for (ssize_t i = 0; i < n; i++)
+		{
+			if (buffer[i] == GDB_INTERRUPT)
+			{
+				loop_.request_stop();
+				continue;
+			}
+			received_.push_back(buffer[i]);
+		}
+	}
+	if (traps_.watch_pending())
+	{
+		loop_.request_stop();
+	}
+	if (on_slice_)
+	{
+		on_slice_();
+	}
+}
+
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+#include "debug_traps.h"
+#include "run_loop.h"
+#include <functional>
+#include <string>
+
+#define GDB_STUB_SOCKET_PREFIX "unix:"
+#define GDB_STUB_PACKET_SIZE 0x4000
+// gdb's MIPS numbering: r0-r31, sr, lo, hi, badvaddr, cause, pc, f0-f31, fcsr, fir
+#define GDB_STUB_N_REGISTERS 72
+#define GDB_STUB_PC_REGISTER 37
+
+// GDB remote serial protocol server for a core, on a Unix socket or a TCP
+// port of the loopback interface. Everything runs on the emulation thread:
+// while the core runs, the connection is polled between run loop slices for
+// the debugger's interrupt.
+//
+// Breakpoints and watchpoints are DebugTraps, the core runs at full speed
+// in between breakpoints and checks its RAM accesses only while watched.
+class GdbStub
+{
+private:
+	CPU::Core& core_;
+	DebugTraps traps_;
+	RunLoop loop_;
+	RunOptions options_;
+	std::function<void()> on_slice_;
+	int listen_socket_;
+	int socket_;
+	std::string received_;			// bytes read past the last packet
+	bool done_;						// detached or killed
+
+	bool receive_();
+	bool read_packet_(std::string& packet);
+	void send_(const std::string& data);
+	void poll_();
+
+	u32 register_(u32 index);
+	void set_register_(u32 index, u32 value);
+	std::string resume_(const std::string& address, bool step);
+	std::string stop_reply_(StopReason reason);
+	std::string breakpoint_(const std::string& args, bool insert);
+	std::string query_(const std::string& packet);
+
+public:
+	// Runs use the options, their stop conditions included
+	GdbStub(CPU::Core& core, const RunOptions& options);
+	~GdbStub();
+	GdbStub(const GdbStub&) = delete;
+	GdbStub& operator=(const GdbStub&) = delete;
+
+	// Called between slices of the runs, after the interrupt check
+	void set_slice_callback(std::function<void()> on_slice);
+	// "unix:path", or a TCP port on 127.0.0.1
+	bool listen(const std::string& target);
+	// Waits for a debugger and serves it until it detaches, kills the
+	// target or disconnects
+	void serve();
+	// Reply to a packet, without the framing. Empty for unsupported packets.
+	std::string handle(const std::string& packet);
+	bool done() const;
+
+	// "$payload#checksum", with the characters the protocol reserves escaped
+	static std::string frame(const std::string& payload);
+	static const std::string& target_xml();
+};
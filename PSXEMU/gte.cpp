@@ -0,0 +1,1189 @@
+#include "gte.h"
+#include "log.h"
+#include "gte_divide.h"
+#include "hash.h"
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+namespace CPU
+{
+	const u32 Gte::flag_mac_pos_overflow_[4] = { 1u << 16, 1u << 30, 1u << 29, 1u << 28 };
+	const u32 Gte::flag_mac_neg_overflow_[4] = { 1u << 15, 1u << 27, 1u << 26, 1u << 25 };
+	const u32 Gte::flag_ir_saturated_[4] = { 1u << 12, 1u << 24, 1u << 23, 1u << 22 };
+	const u32 Gte::flag_color_saturated_[3] = { 1u << 21, 1u << 20, 1u << 19 };
+
+	static u32 pack16(s16 low, s16 high)
+	{
+		return static_cast<u32>(static_cast<u16>(low)) |
+			(static_cast<u32>(static_cast<u16>(high)) << 16);
+	}
+
+	static u32 pack8(const u8 bytes[4])
+	{
+		return static_cast<u32>(bytes[0]) |
+			(static_cast<u32>(bytes[1]) << 8) |
+			(static_cast<u32>(bytes[2]) << 16) |
+			(static_cast<u32>(bytes[3]) << 24);
+	}
+
+	static void unpack8(u8 bytes[4], u32 value)
+	{
+		bytes[0] = static_cast<u8>(value >> 0);
+		bytes[1] = static_cast<u8>(value >> 8);
+		bytes[2] = static_cast<u8>(value >> 16);
+		bytes[3] = static_cast<u8>(value >> 24);
+	}
+
+	static u32 saturate_orgb(s16 ir)
+	{
+		s32 v = ir >> 7;
+		if (v < 0)
+		{
+			return 0;
+		}
+		return (v > 0x1f) ? 0x1f : static_cast<u32>(v);
+	}
+
+	Gte::Gte()
+	{
+		memset(&regs_, 0, sizeof(regs_));
+	}
+
+	u32 Gte::get_data(u32 reg) const
+	{
+		switch (reg)
+		{
+		case 0:
+		case 2:
+		case 4:
+			return pack16(regs_.v[reg / 2][0], regs_.v[reg / 2][1]);
+		case 1:
+		case 3:
+		case 5:
+			return static_cast<u32>(static_cast<s32>(regs_.v[reg / 2][2]));
+		case 6:
+			return pack8(regs_.rgbc);
+		case 7:
+			return regs_.otz;
+		case 8:
+		case 9:
+		case 10:
+		case 11:
+			return static_cast<u32>(static_cast<s32>(regs_.ir[reg - 8]));
+		case 12:
+		case 13:
+		case 14:
+			return pack16(regs_.sxy[reg - 12][0], regs_.sxy[reg - 12][1]);
+		case 15:
+			return pack16(regs_.sxy[2][0], regs_.sxy[2][1]);
+		case 16:
+		case 17:
+		case 18:
+		case 19:
+			return regs_.sz[reg - 16];
+		case 20:
+		case 21:
+		case 22:
+			return pack8(regs_.rgb[reg - 20]);
+		case 23:
+			return regs_.res1;
+		case 24:
+		case 25:
+		case 26:
+		case 27:
+			return static_cast<u32>(regs_.mac[reg - 24]);
+		case 28:
+		case 29:
+			return orgb_();
+		case 30:
+			return static_cast<u32>(regs_.lzcs);
+		case 31:
+			return regs_.lzcr;
+		default:
+			LOG_ERROR(Gte, "Unhandled GTE data register read: {d}", reg);
+			throw - 1;
+		}
+	}
+
+	void Gte::set_data(u32 reg, u32 value)
+	{
+		switch (reg)
+		{
+		case 0:
+		case 2:
+		case 4:
+			regs_.v[reg / 2][0] = static_cast<s16>(value);
+			regs_.v[reg / 2][1] = static_cast<s16>(value >> 16);
+			break;
+		case 1:
+		case 3:
+		case 5:
+			regs_.v[reg / 2][2] = static_cast<s16>(value);
+			break;
+		case 6:
+			unpack8(regs_.rgbc, value);
+			break;
+		case 7:
+			regs_.otz = static_cast<u16>(value);
+			break;
+		case 8:
+		case 9:
+		case 10:
+		case 11:
+			regs_.ir[reg - 8] = static_cast<s16>(value);
+			break;
+		case 12:
+		case 13:
+		case 14:
+			regs_.sxy[reg - 12][0] = static_cast<s16>(value);
+			regs_.sxy[reg - 12][1] = static_cast<s16>(value >> 16);
+			break;
+		case 15:
+			// Writing SXYP pushes the screen XY fifo
+			memmove(regs_.sxy[0], regs_.sxy[1], sizeof(regs_.sxy[0]) * 2);
+			regs_.sxy[2][0] = static_cast<s16>(value);
+			regs_.sxy[2][1] = static_cast<s16>(value >> 16);
+			break;
+		case 16:
+		case 17:
+		case 18:
+		case 19:
+			regs_.sz[reg - 16] = static_cast<u16>(value);
+			break;
+		case 20:
+		case 21:
+		case 22:
+			unpack8(regs_.rgb[reg - 20], value);
+			break;
+		case 23:
+			regs_.res1 = value;
+			break;
+		case 24:
+		case 25:
+		case 26:
+		case 27:
+			regs_.mac[reg - 24] = static_cast<s32>(value);
+			break;
+		case 28:
+			// IRGB expands 5:5:5 color into IR1..IR3
+			regs_.ir[1] = static_cast<s16>((value & 0x1f) << 7);
+			regs_.ir[2] = static_cast<s16>(((value >> 5) & 0x1f) << 7);
+			regs_.ir[3] = static_cast<s16>(((value >> 10) & 0x1f) << 7);
+			break;
+		case 29:
+		case 31:
+			// Read only
+			break;
+		case 30:
+		{
+			regs_.lzcs = static_cast<s32>(value);
+			u32 v = (value & 0x80000000) ? ~value : value;
+			u32 count = 0;
+			while ((count < 32) && ((v & (0x80000000 >> count)) == 0))
+			{
+				count++;
+			}
+			regs_.lzcr = count;
+		}break;
+		default:
+			LOG_ERROR(Gte, "Unhandled GTE data register write: {d}", reg);
+			throw - 1;
+		}
+	}
+
+	u32 Gte::get_control(u32 reg) const
+	{
+		if (reg < 24)
+		{
+			const s16* m;
+			const s32* t;
+			switch (reg / 8)
+			{
+			case 0:
+				m = &regs_.rt[0][0];
+				t = regs_.tr;
+				break;
+			case 1:
+				m = &regs_.llm[0][0];
+				t = regs_.bk;
+				break;
+			default:
+				m = &regs_.lcm[0][0];
+				t = regs_.fc;
+				break;
+			}
+
+			u32 idx = reg % 8;
+			if (idx < 4)
+			{
+				return pack16(m[idx * 2], m[idx * 2 + 1]);
+			}
+			else if (idx == 4)
+			{
+				return static_cast<u32>(static_cast<s32>(m[8]));
+			}
+			return static_cast<u32>(t[idx - 5]);
+		}
+
+		switch (reg)
+		{
+		case 24:
+			return static_cast<u32>(regs_.ofx);
+		case 25:
+			return static_cast<u32>(regs_.ofy);
+		case 26:
+			// H is unsigned but reads back sign extended
+			return static_cast<u32>(static_cast<s32>(static_cast<s16>(regs_.h)));
+		case 27:
+			return static_cast<u32>(static_cast<s32>(regs_.dqa));
+		case 28:
+			return static_cast<u32>(regs_.dqb);
+		case 29:
+			return static_cast<u32>(static_cast<s32>(regs_.zsf3));
+		case 30:
+			return static_cast<u32>(static_cast<s32>(regs_.zsf4));
+		case 31:
+			return regs_.flag;
+		default:
+			LOG_ERROR(Gte, "Unhandled GTE control register read: {d}", reg);
+			throw - 1;
+		}
+	}
+
+	u64 Gte::hash(u64 seed) const
+	{
+		u32 regs[64];
+		for (u32 reg = 0; reg < 32; reg++)
+		{
+			regs[reg] = get_data(reg);
+			regs[32 + reg] = get_control(reg);
+		}
+		return fnv1a(seed, regs, sizeof(regs));
+	}
+
+	void Gte::set_control(u32 reg, u32 value)
+	{
+		if (reg < 24)
+		{
+			s16* m;
+			s32* t;
+			switch (reg / 8)
+			{
+			case 0:
+				m = &regs_.rt[0][0];
+				t = regs_.tr;
+				break;
+			case 1:
+				m = &regs_.llm[0][0];
+				t = regs_.bk;
+				break;
+			default:
+				m = &regs_.lcm[0][0];
+				t = regs_.fc;
+				break;
+			}
+
+			u32 idx = reg % 8;
+			if (idx < 4)
+			{
+				m[idx * 2] = static_cast<s16>(value);
+				m[idx * 2 + 1] = static_cast<s16>(value >> 16);
+			}
+			else if (idx == 4)
+			{
+				m[8] = static_cast<s16>(value);
+			}
+			else
+			{
+				t[idx - 5] = static_cast<s32>(value);
+			}
+			return;
+		}
+
+		switch (reg)
+		{
+		case 24:
+			regs_.ofx = static_cast<s32>(value);
+			break;
+		case 25:
+			regs_.ofy = static_cast<s32>(value);
+			break;
+		case 26:
+			regs_.h = static_cast<u16>(value);
+			break;
+		case 27:
+			regs_.dqa = static_cast<s16>(value);
+			break;
+		case 28:
+			regs_.dqb = static_cast<s32>(value);
+			break;
+		case 29:
+			regs_.zsf3 = static_cast<s16>(value);
+			break;
+		case 30:
+			regs_.zsf4 = static_cast<s16>(value);
+			break;
+		case 31:
+			regs_.flag = value & flag_write_mask_;
+			if ((regs_.flag & flag_error_mask_) != 0)
+			{
+				regs_.flag |= flag_error_;
+			}
+			break;
+		default:
+			LOG_ERROR(Gte, "Unhandled GTE control register write: {d}", reg);
+			throw - 1;
+		}
+	}
+
+	void Gte::execute(u32 command)
+	{
+		GteCommand cmd = GteCommand(command);
+
+		regs_.flag = 0;
+
+		switch (cmd.opcode())
+		{
+		case cmd_rtps_:
+			exec_rtps_(cmd);
+			break;
+		case cmd_nclip_:
+			exec_nclip_(cmd);
+			break;
+		case cmd_op_:
+			exec_op_(cmd);
+			break;
+		case cmd_dpcs_:
+			exec_dpcs_(cmd);
+			break;
+		case cmd_intpl_:
+			exec_intpl_(cmd);
+			break;
+		case cmd_mvmva_:
+			exec_mvmva_(cmd);
+			break;
+		case cmd_ncds_:
+			exec_ncds_(cmd);
+			break;
+		case cmd_cdp_:
+			exec_cdp_(cmd);
+			break;
+		case cmd_ncdt_:
+			exec_ncdt_(cmd);
+			break;
+		case cmd_nccs_:
+			exec_nccs_(cmd);
+			break;
+		case cmd_cc_:
+			exec_cc_(cmd);
+			break;
+		case cmd_ncs_:
+			exec_ncs_(cmd);
+			break;
+		case cmd_nct_:
+			exec_nct_(cmd);
+			break;
+		case cmd_sqr_:
+			exec_sqr_(cmd);
+			break;
+		case cmd_dcpl_:
+			exec_dcpl_(cmd);
+			break;
+		case cmd_dpct_:
+			exec_dpct_(cmd);
+			break;
+		case cmd_avsz3_:
+			exec_avsz3_(cmd);
+			break;
+		case cmd_avsz4_:
+			exec_avsz4_(cmd);
+			break;
+		case cmd_rtpt_:
+			exec_rtpt_(cmd);
+			break;
+		case cmd_gpf_:
+			exec_gpf_(cmd);
+			break;
+		case cmd_gpl_:
+			exec_gpl_(cmd);
+			break;
+		case cmd_ncct_:
+			exec_ncct_(cmd);
+			break;
+		default:
+			LOG_ERROR(Gte, "Unhandled GTE command: {}", cmd.opcode());
+			throw - 1;
+		}
+
+		if ((regs_.flag & flag_error_mask_) != 0)
+		{
+			regs_.flag |= flag_error_;
+		}
+	}
+
+	void Gte::mac_lanes_reference(const GteMacLanes& lanes, GteMacResult& result)
+	{
+		result.pos_overflow = 0;
+		result.neg_overflow = 0;
+
+		for (u32 l = 0; l < 4; l++)
+		{
+			s64 acc = static_cast<s64>(lanes.t[l]) * 0x1000;
+			for (u32 i = 0; i < 3; i++)
+			{
+				acc += static_cast<s64>(lanes.a[i][l]) * static_cast<s64>(lanes.b[i][l]);
+				if (acc > mac_max_)
+				{
+					result.pos_overflow |= 1u << l;
+				}
+				else if (acc < mac_min_)
+				{
+					result.neg_overflow |= 1u << l;
+				}
+
+				// The last sum is handed over untruncated
+				if (i < 2)
+				{
+					acc = sign_extend_mac_(acc);
+				}
+			}
+			result.value[l] = acc;
+		}
+	}
+
+	void Gte::mac_lanes(const GteMacLanes& lanes, GteMacResult& result)
+	{
+#if defined(__AVX2__)
+		const __m256i mask = _mm256_set1_epi64x(0xfffffffffff);
+		const __m256i sign = _mm256_set1_epi64x(0x80000000000);
+		u32 pos = 0;
+		u32 neg = 0;
+
+		__m256i acc = _mm256_slli_epi64(_mm256_cvtepi32_epi64(
+			_mm_load_si128(reinterpret_cast<const __m128i*>(lanes.t))), 12);
+		for (u32 i = 0; i < 3; i++)
+		{
+			__m256i a = _mm256_cvtepi32_epi64(_mm_load_si128(reinterpret_cast<const __m128i*>(lanes.a[i])));
+			__m256i b = _mm256_cvtepi32_epi64(_mm_load_si128(reinterpret_cast<const __m128i*>(lanes.b[i])));
+			acc = _mm256_add_epi64(acc, _mm256_mul_epi32(a, b));
+
+			// A lane overflowed when it differs from its own 44 bit sign extension
+			__m256i ext = _mm256_sub_epi64(_mm256_xor_si256(_mm256_and_si256(acc, mask), sign), sign);
+			u32 overflow = ~static_cast<u32>(_mm256_movemask_pd(
+				_mm256_castsi256_pd(_mm256_cmpeq_epi64(acc, ext)))) & 0xf;
+			u32 negative = static_cast<u32>(_mm256_movemask_pd(_mm256_castsi256_pd(acc)));
+			pos |= overflow & ~negative;
+			neg |= overflow & negative;
+
+			if (i < 2)
+			{
+				acc = ext;
+			}
+		}
+
+		_mm256_store_si256(reinterpret_cast<__m256i*>(result.value), acc);
+		result.pos_overflow = pos;
+		result.neg_overflow = neg;
+#elif defined(__SSE4_1__)
+		const __m128i mask = _mm_set1_epi64x(0xfffffffffff);
+		const __m128i sign = _mm_set1_epi64x(0x80000000000);
+		u32 pos = 0;
+		u32 neg = 0;
+
+		// Two 64 bit lanes per register: lanes 0-1, then lanes 2-3
+		for (u32 h = 0; h < 4; h += 2)
+		{
+			__m128i acc = _mm_slli_epi64(_mm_cvtepi32_epi64(
+				_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lanes.t + h))), 12);
+			for (u32 i = 0; i < 3; i++)
+			{
+				__m128i a = _mm_cvtepi32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lanes.a[i] + h)));
+				__m128i b = _mm_cvtepi32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(lanes.b[i] + h)));
+				acc = _mm_add_epi64(acc, _mm_mul_epi32(a, b));
+
+				__m128i ext = _mm_sub_epi64(_mm_xor_si128(_mm_and_si128(acc, mask), sign), sign);
+				u32 overflow = ~static_cast<u32>(_mm_movemask_pd(
+					_mm_castsi128_pd(_mm_cmpeq_epi64(acc, ext)))) & 0x3;
+				u32 negative = static_cast<u32>(_mm_movemask_pd(_mm_castsi128_pd(acc)));
+				pos |= (overflow & ~negative) << h;
+				neg |= (overflow & negative) << h;
+
+				if (i < 2)
+				{
+					acc = ext;
+				}
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(result.value + h), acc);
+		}
+
+		result.pos_overflow = pos;
+		result.neg_overflow = neg;
+#else
+		mac_lanes_reference(lanes, result);
+#endif
+	}
+
+	s64 Gte::sign_extend_mac_(s64 value)
+	{
+		return ((value & 0xfffffffffff) ^ 0x80000000000) - 0x80000000000;
+	}
+
+	s64 Gte::check_mac_(u32 index, s64 value)
+	{
+		if (value > mac_max_)
+		{
+			regs_.flag |= flag_mac_pos_overflow_[index];
+		}
+		else if (value < mac_min_)
+		{
+			regs_.flag |= flag_mac_neg_overflow_[index];
+		}
+		return value;
+	}
+
+	void Gte::set_mac_(u32 index, s64 value, u8 shift)
+	{
+		check_mac_(index, value);
+		regs_.mac[index] = static_cast<s32>(value >> shift);
+	}
+
+	void Gte::set_ir_(u32 index, s32 value, bool lm)
+	{
+		s32 min = lm ? 0 : -0x8000;
+		if (value < min)
+		{
+			value = min;
+			regs_.flag |= flag_ir_saturated_[index];
+		}
+		else if (value > 0x7fff)
+		{
+			value = 0x7fff;
+			regs_.flag |= flag_ir_saturated_[index];
+		}
+		regs_.ir[index] = static_cast<s16>(value);
+	}
+
+	void Gte::set_mac_ir_(u32 index, s64 value, u8 shift, bool lm)
+	{
+		set_mac_(index, value, shift);
+		set_ir_(index, regs_.mac[index], lm);
+	}
+
+	void Gte::set_mac0_(s64 value)
+	{
+		if (value > 0x7fffffff)
+		{
+			regs_.flag |= flag_mac_pos_overflow_[0];
+		}
+		else if (value < -static_cast<s64>(0x80000000))
+		{
+			regs_.flag |= flag_mac_neg_overflow_[0];
+		}
+		regs_.mac[0] = static_cast<s32>(value);
+	}
+
+	void Gte::set_ir0_(s32 value)
+	{
+		if (value < 0)
+		{
+			value = 0;
+			regs_.flag |= flag_ir_saturated_[0];
+		}
+		else if (value > 0x1000)
+		{
+			value = 0x1000;
+			regs_.flag |= flag_ir_saturated_[0];
+		}
+		regs_.ir[0] = static_cast<s16>(value);
+	}
+
+	void Gte::set_otz_(s32 value)
+	{
+		if (value < 0)
+		{
+			value = 0;
+			regs_.flag |= flag_sz_otz_saturated_;
+		}
+		else if (value > 0xffff)
+		{
+			value = 0xffff;
+			regs_.flag |= flag_sz_otz_saturated_;
+		}
+		regs_.otz = static_cast<u16>(value);
+	}
+
+	void Gte::push_sz_(s32 value)
+	{
+		if (value < 0)
+		{
+			value = 0;
+			regs_.flag |= flag_sz_otz_saturated_;
+		}
+		else if (value > 0xffff)
+		{
+			value = 0xffff;
+			regs_.flag |= flag_sz_otz_saturated_;
+		}
+		regs_.sz[0] = regs_.sz[1];
+		regs_.sz[1] = regs_.sz[2];
+		regs_.sz[2] = regs_.sz[3];
+		regs_.sz[3] = static_cast<u16>(value);
+	}
+
+	void Gte::push_sxy_(s32 x, s32 y)
+	{
+		if (x < -0x400)
+		{
+			x = -0x400;
+			regs_.flag |= flag_sx2_saturated_;
+		}
+		else if (x > 0x3ff)
+		{
+			x = 0x3ff;
+			regs_.flag |= flag_sx2_saturated_;
+		}
+
+		if (y < -0x400)
+		{
+			y = -0x400;
+			regs_.flag |= flag_sy2_saturated_;
+		}
+		else if (y > 0x3ff)
+		{
+			y = 0x3ff;
+			regs_.flag |= flag_sy2_saturated_;
+		}
+
+		memmove(regs_.sxy[0], regs_.sxy[1], sizeof(regs_.sxy[0]) * 2);
+		regs_.sxy[2][0] = static_cast<s16>(x);
+		regs_.sxy[2][1] = static_cast<s16>(y);
+	}
+
+	void Gte::push_rgb_from_mac_()
+	{
+		memmove(regs_.rgb[0], regs_.rgb[1], sizeof(regs_.rgb[0]) * 2);
+
+		for (u32 i = 0; i < 3; i++)
+		{
+			s32 c = regs_.mac[i + 1] >> 4;
+			if (c < 0)
+			{
+				c = 0;
+				regs_.flag |= flag_color_saturated_[i];
+			}
+			else if (c > 0xff)
+			{
+				c = 0xff;
+				regs_.flag |= flag_color_saturated_[i];
+			}
+			regs_.rgb[2][i] = static_cast<u8>(c);
+		}
+		regs_.rgb[2][3] = regs_.rgbc[3];
+	}
+
+	void Gte::apply_mac_overflow_(const GteMacResult& result, u32 lane, u32 index)
+	{
+		if ((result.pos_overflow >> lane) & 0x1)
+		{
+			regs_.flag |= flag_mac_pos_overflow_[index];
+		}
+		if ((result.neg_overflow >> lane) & 0x1)
+		{
+			regs_.flag |= flag_mac_neg_overflow_[index];
+		}
+	}
+
+	u32 Gte::orgb_() const
+	{
+		return saturate_orgb(regs_.ir[1]) |
+			(saturate_orgb(regs_.ir[2]) << 5) |
+			(saturate_orgb(regs_.ir[3]) << 10);
+	}
+
+	void Gte::mul_mat_vec_(const s16 m[3][3], const s32 t[3], s16 vx, s16 vy, s16 vz, u8 shift, bool lm)
+	{
+		// One matrix row per lane
+		GteMacLanes lanes;
+		GteMacResult result;
+		for (u32 i = 0; i < 3; i++)
+		{
+			lanes.t[i] = (t != nullptr) ? t[i] : 0;
+			lanes.a[0][i] = m[i][0];
+			lanes.a[1][i] = m[i][1];
+			lanes.a[2][i] = m[i][2];
+			lanes.b[0][i] = vx;
+			lanes.b[1][i] = vy;
+			lanes.b[2][i] = vz;
+		}
+		lanes.t[3] = 0;
+		lanes.a[0][3] = lanes.a[1][3] = lanes.a[2][3] = 0;
+		lanes.b[0][3] = lanes.b[1][3] = lanes.b[2][3] = 0;
+
+		mac_lanes(lanes, result);
+
+		for (u32 i = 0; i < 3; i++)
+		{
+			apply_mac_overflow_(result, i, i + 1);
+			regs_.mac[i + 1] = static_cast<s32>(result.value[i] >> shift);
+			set_ir_(i + 1, regs_.mac[i + 1], lm);
+		}
+	}
+
+	void Gte::mul_mat_vec_far_color_(const s16 m[3][3], s16 vx, s16 vy, s16 vz, u8 shift, bool lm)
+	{
+		// Hardware bug: the far color and first column only reach the flags,
+		// the result is built from the two remaining columns
+		GteMacLanes lanes;
+		GteMacResult first;
+		GteMacResult rest;
+		memset(&lanes, 0, sizeof(lanes));
+		for (u32 i = 0; i < 3; i++)
+		{
+			lanes.t[i] = regs_.fc[i];
+			lanes.a[0][i] = m[i][0];
+			lanes.b[0][i] = vx;
+		}
+		mac_lanes(lanes, first);
+
+		memset(&lanes, 0, sizeof(lanes));
+		for (u32 i = 0; i < 3; i++)
+		{
+			lanes.a[1][i] = m[i][1];
+			lanes.a[2][i] = m[i][2];
+			lanes.b[1][i] = vy;
+			lanes.b[2][i] = vz;
+		}
+		mac_lanes(lanes, rest);
+
+		for (u32 i = 0; i < 3; i++)
+		{
+			apply_mac_overflow_(first, i, i + 1);
+			set_ir_(i + 1, static_cast<s32>(first.value[i] >> shift), false);
+
+			apply_mac_overflow_(rest, i, i + 1);
+			regs_.mac[i + 1] = static_cast<s32>(rest.value[i] >> shift);
+			set_ir_(i + 1, regs_.mac[i + 1], lm);
+		}
+	}
+
+	void Gte::interpolate_color_(s64 mac1, s64 mac2, s64 mac3, u8 shift, bool lm)
+	{
+		// [IR1,IR2,IR3] = (([RFC,GFC,BFC] SHL 12) - [MAC1,MAC2,MAC3]) SAR (sf*12)
+		set_mac_ir_(1, static_cast<s64>(regs_.fc[0]) * 0x1000 - mac1, shift, false);
+		set_mac_ir_(2, static_cast<s64>(regs_.fc[1]) * 0x1000 - mac2, shift, false);
+		set_mac_ir_(3, static_cast<s64>(regs_.fc[2]) * 0x1000 - mac3, shift, false);
+
+		// [MAC1,MAC2,MAC3] = (([IR1,IR2,IR3] * IR0) + [MAC1,MAC2,MAC3]) SAR (sf*12)
+		set_mac_ir_(1, static_cast<s64>(regs_.ir[1]) * regs_.ir[0] + mac1, shift, lm);
+		set_mac_ir_(2, static_cast<s64>(regs_.ir[2]) * regs_.ir[0] + mac2, shift, lm);
+		set_mac_ir_(3, static_cast<s64>(regs_.ir[3]) * regs_.ir[0] + mac3, shift, lm);
+
+		push_rgb_from_mac_();
+	}
+
+	void Gte::project_(s64 x, s64 y, s64 z, u8 shift, bool lm, bool last)
+	{
+		regs_.mac[1] = static_cast<s32>(x >> shift);
+		regs_.mac[2] = static_cast<s32>(y >> shift);
+		regs_.mac[3] = static_cast<s32>(z >> shift);
+		set_ir_(1, regs_.mac[1], lm);
+		set_ir_(2, regs_.mac[2], lm);
+
+		// IR3 saturation flag is computed on z >> 12 regardless of sf
+		s32 z_shifted = static_cast<s32>(z >> 12);
+		if ((z_shifted < -0x8000) || (z_shifted > 0x7fff))
+		{
+			regs_.flag |= flag_ir_saturated_[3];
+		}
+		s32 ir3 = regs_.mac[3];
+		s32 ir3_min = lm ? 0 : -0x8000;
+		ir3 = (ir3 < ir3_min) ? ir3_min : ((ir3 > 0x7fff) ? 0x7fff : ir3);
+		regs_.ir[3] = static_cast<s16>(ir3);
+
+		push_sz_(z_shifted);
+
+		bool overflow;
+		s64 q = unr_divide(regs_.h, regs_.sz[3], overflow);
+		regs_.flag |= overflow ? flag_divide_overflow_ : 0;
+
+		s64 sx = q * regs_.ir[1] + regs_.ofx;
+		s64 sy = q * regs_.ir[2] + regs_.ofy;
+		if ((sx > 0x7fffffff) || (sy > 0x7fffffff))
+		{
+			regs_.flag |= flag_mac_pos_overflow_[0];
+		}
+		if ((sx < -static_cast<s64>(0x80000000)) || (sy < -static_cast<s64>(0x80000000)))
+		{
+			regs_.flag |= flag_mac_neg_overflow_[0];
+		}
+		push_sxy_(static_cast<s32>(sx >> 16), static_cast<s32>(sy >> 16));
+
+		if (last)
+		{
+			s64 depth = q * regs_.dqa + regs_.dqb;
+			set_mac0_(depth);
+			set_ir0_(static_cast<s32>(depth >> 12));
+		}
+	}
+
+	void Gte::exec_rtps_(GteCommand command)
+	{
+		const s16* v = regs_.v[0];
+
+		GteMacLanes lanes;
+		GteMacResult result;
+		for (u32 i = 0; i < 3; i++)
+		{
+			lanes.t[i] = regs_.tr[i];
+			lanes.a[0][i] = regs_.rt[i][0];
+			lanes.a[1][i] = regs_.rt[i][1];
+			lanes.a[2][i] = regs_.rt[i][2];
+			lanes.b[0][i] = v[0];
+			lanes.b[1][i] = v[1];
+			lanes.b[2][i] = v[2];
+		}
+		lanes.t[3] = 0;
+		lanes.a[0][3] = lanes.a[1][3] = lanes.a[2][3] = 0;
+		lanes.b[0][3] = lanes.b[1][3] = lanes.b[2][3] = 0;
+
+		mac_lanes(lanes, result);
+		for (u32 i = 0; i < 3; i++)
+		{
+			apply_mac_overflow_(result, i, i + 1);
+		}
+
+		project_(result.value[0], result.value[1], result.value[2],
+			command.shift(), command.lm(), true);
+	}
+
+	void Gte::exec_rtpt_(GteCommand command)
+	{
+		// The three vertices are transformed side by side, one per lane,
+		// a matrix row at a time
+		GteMacResult rows[3];
+		for (u32 i = 0; i < 3; i++)
+		{
+			GteMacLanes lanes;
+			for (u32 k = 0; k < 3; k++)
+			{
+				lanes.t[k] = regs_.tr[i];
+				lanes.a[0][k] = regs_.rt[i][0];
+				lanes.a[1][k] = regs_.rt[i][1];
+				lanes.a[2][k] = regs_.rt[i][2];
+				lanes.b[0][k] = regs_.v[k][0];
+				lanes.b[1][k] = regs_.v[k][1];
+				lanes.b[2][k] = regs_.v[k][2];
+			}
+			lanes.t[3] = 0;
+			lanes.a[0][3] = lanes.a[1][3] = lanes.a[2][3] = 0;
+			lanes.b[0][3] = lanes.b[1][3] = lanes.b[2][3] = 0;
+
+			mac_lanes(lanes, rows[i]);
+		}
+
+		// Projection goes through the SZ / SXY fifos so it stays in vertex order
+		for (u32 k = 0; k < 3; k++)
+		{
+			for (u32 i = 0; i < 3; i++)
+			{
+				apply_mac_overflow_(rows[i], k, i + 1);
+			}
+			project_(rows[0].value[k], rows[1].value[k], rows[2].value[k],
+				command.shift(), command.lm(), k == 2);
+		}
+	}
+
+	void Gte::exec_nclip_(GteCommand command)
+	{
+		s64 x0 = regs_.sxy[0][0], y0 = regs_.sxy[0][1];
+		s64 x1 = regs_.sxy[1][0], y1 = regs_.sxy[1][1];
+		s64 x2 = regs_.sxy[2][0], y2 = regs_.sxy[2][1];
+
+		set_mac0_(x0 * y1 + x1 * y2 + x2 * y0 - x0 * y2 - x1 * y0 - x2 * y1);
+	}
+
+	void Gte::exec_op_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+
+		s64 d1 = regs_.rt[0][0];
+		s64 d2 = regs_.rt[1][1];
+		s64 d3 = regs_.rt[2][2];
+		s64 ir1 = regs_.ir[1];
+		s64 ir2 = regs_.ir[2];
+		s64 ir3 = regs_.ir[3];
+
+		set_mac_ir_(1, ir3 * d2 - ir2 * d3, shift, lm);
+		set_mac_ir_(2, ir1 * d3 - ir3 * d1, shift, lm);
+		set_mac_ir_(3, ir2 * d1 - ir1 * d2, shift, lm);
+	}
+
+	void Gte::dpcs_(const u8 color[4], u8 shift, bool lm)
+	{
+		interpolate_color_(
+			static_cast<s64>(color[0]) << 16,
+			static_cast<s64>(color[1]) << 16,
+			static_cast<s64>(color[2]) << 16,
+			shift, lm);
+	}
+
+	void Gte::exec_dpcs_(GteCommand command)
+	{
+		dpcs_(regs_.rgbc, command.shift(), command.lm());
+	}
+
+	void Gte::exec_dpct_(GteCommand command)
+	{
+		for (u32 k = 0; k < 3; k++)
+		{
+			// Always reads the bottom of the color fifo, which moves on every push
+			u8 color[4];
+			memcpy(color, regs_.rgb[0], sizeof(color));
+			dpcs_(color, command.shift(), command.lm());
+		}
+	}
+
+	void Gte::exec_intpl_(GteCommand command)
+	{
+		interpolate_color_(
+			static_cast<s64>(regs_.ir[1]) * 0x1000,
+			static_cast<s64>(regs_.ir[2]) * 0x1000,
+			static_cast<s64>(regs_.ir[3]) * 0x1000,
+			command.shift(), command.lm());
+	}
+
+	void Gte::exec_mvmva_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+
+		s16 garbage[3][3];
+		const s16 (*m)[3];
+		switch (command.mx())
+		{
+		case 0:
+			m = regs_.rt;
+			break;
+		case 1:
+			m = regs_.llm;
+			break;
+		case 2:
+			m = regs_.lcm;
+			break;
+		default:
+		{
+			// Reserved matrix selection reads a mix of unrelated registers
+			s16 r = static_cast<s16>(regs_.rgbc[0] << 4);
+			garbage[0][0] = static_cast<s16>(-r);
+			garbage[0][1] = r;
+			garbage[0][2] = regs_.ir[0];
+			garbage[1][0] = garbage[1][1] = garbage[1][2] = regs_.rt[0][2];
+			garbage[2][0] = garbage[2][1] = garbage[2][2] = regs_.rt[1][1];
+			m = garbage;
+		}break;
+		}
+
+		s16 vx, vy, vz;
+		if (command.mv() < 3)
+		{
+			vx = regs_.v[command.mv()][0];
+			vy = regs_.v[command.mv()][1];
+			vz = regs_.v[command.mv()][2];
+		}
+		else
+		{
+			vx = regs_.ir[1];
+			vy = regs_.ir[2];
+			vz = regs_.ir[3];
+		}
+
+		switch (command.cv())
+		{
+		case 0:
+			mul_mat_vec_(m, regs_.tr, vx, vy, vz, shift, lm);
+			break;
+		case 1:
+			mul_mat_vec_(m, regs_.bk, vx, vy, vz, shift, lm);
+			break;
+		case 2:
+			mul_mat_vec_far_color_(m, vx, vy, vz, shift, lm);
+			break;
+		default:
+			mul_mat_vec_(m, nullptr, vx, vy, vz, shift, lm);
+			break;
+		}
+	}
+
+	void Gte::ncs_(u32 vertex, u8 shift, bool lm)
+	{
+		const s16* v = regs_.v[vertex];
+
+		mul_mat_vec_(regs_.llm, nullptr, v[0], v[1], v[2], shift, lm);
+		mul_mat_vec_(regs_.lcm, regs_.bk, regs_.ir[1], regs_.ir[2], regs_.ir[3], shift, lm);
+		push_rgb_from_mac_();
+	}
+
+	void Gte::nccs_(u32 vertex, u8 shift, bool lm)
+	{
+		const s16* v = regs_.v[vertex];
+
+		mul_mat_vec_(regs_.llm, nullptr, v[0], v[1], v[2], shift, lm);
+		mul_mat_vec_(regs_.lcm, regs_.bk, regs_.ir[1], regs_.ir[2], regs_.ir[3], shift, lm);
+
+		// [MAC1,MAC2,MAC3] = [R*IR1,G*IR2,B*IR3] SHL 4
+		set_mac_ir_(1, static_cast<s64>(regs_.rgbc[0]) * regs_.ir[1] * 0x10, shift, lm);
+		set_mac_ir_(2, static_cast<s64>(regs_.rgbc[1]) * regs_.ir[2] * 0x10, shift, lm);
+		set_mac_ir_(3, static_cast<s64>(regs_.rgbc[2]) * regs_.ir[3] * 0x10, shift, lm);
+		push_rgb_from_mac_();
+	}
+
+	void Gte::ncds_(u32 vertex, u8 shift, bool lm)
+	{
+		const s16* v = regs_.v[vertex];
+
+		mul_mat_vec_(regs_.llm, nullptr, v[0], v[1], v[2], shift, lm);
+		mul_mat_vec_(regs_.lcm, regs_.bk, regs_.ir[1], regs_.ir[2], regs_.ir[3], shift, lm);
+
+		interpolate_color_(
+			static_cast<s64>(regs_.rgbc[0]) * regs_.ir[1] * 0x10,
+			static_cast<s64>(regs_.rgbc[1]) * regs_.ir[2] * 0x10,
+			static_cast<s64>(regs_.rgbc[2]) * regs_.ir[3] * 0x10,
+			shift, lm);
+	}
+
+	void Gte::exec_ncs_(GteCommand command)
+	{
+		ncs_(0, command.shift(), command.lm());
+	}
+
+	void Gte::exec_nct_(GteCommand command)
+	{
+		for (u32 k = 0; k < 3; k++)
+		{
+			ncs_(k, command.shift(), command.lm());
+		}
+	}
+
+	void Gte::exec_nccs_(GteCommand command)
+	{
+		nccs_(0, command.shift(), command.lm());
+	}
+
+	void Gte::exec_ncct_(GteCommand command)
+	{
+		for (u32 k = 0; k < 3; k++)
+		{
+			nccs_(k, command.shift(), command.lm());
+		}
+	}
+
+	void Gte::exec_ncds_(GteCommand command)
+	{
+		ncds_(0, command.shift(), command.lm());
+	}
+
+	void Gte::exec_ncdt_(GteCommand command)
+	{
+		for (u32 k = 0; k < 3; k++)
+		{
+			ncds_(k, command.shift(), command.lm());
+		}
+	}
+
+	void Gte::exec_cc_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+
+		mul_mat_vec_(regs_.lcm, regs_.bk, regs_.ir[1], regs_.ir[2], regs_.ir[3], shift, lm);
+
+		set_mac_ir_(1, static_cast<s64>(regs_.rgbc[0]) * regs_.ir[1] * 0x10, shift, lm);
+		set_mac_ir_(2, static_cast<s64>(regs_.rgbc[1]) * regs_.ir[2] * 0x10, shift, lm);
+		set_mac_ir_(3, static_cast<s64>(regs_.rgbc[2]) * regs_.ir[3] * 0x10, shift, lm);
+		push_rgb_from_mac_();
+	}
+
+	void Gte::exec_cdp_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+
+		mul_mat_vec_(regs_.lcm, regs_.bk, regs_.ir[1], regs_.ir[2], regs_.ir[3], shift, lm);
+
+		interpolate_color_(
+			static_cast<s64>(regs_.rgbc[0]) * regs_.ir[1] * 0x10,
+			static_cast<s64>(regs_.rgbc[1]) * regs_.ir[2] * 0x10,
+			static_cast<s64>(regs_.rgbc[2]) * regs_.ir[3] * 0x10,
+			shift, lm);
+	}
+
+	void Gte::exec_dcpl_(GteCommand command)
+	{
+		interpolate_color_(
+			static_cast<s64>(regs_.rgbc[0]) * regs_.ir[1] * 0x10,
+			static_cast<s64>(regs_.rgbc[1]) * regs_.ir[2] * 0x10,
+			static_cast<s64>(regs_.rgbc[2]) * regs_.ir[3] * 0x10,
+			command.shift(), command.lm());
+	}
+
+	void Gte::exec_sqr_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+
+		for (u32 i = 1; i < 4; i++)
+		{
+			s64 ir = regs_.ir[i];
+			set_mac_ir_(i, ir * ir, shift, lm);
+		}
+	}
+
+	void Gte::exec_avsz3_(GteCommand command)
+	{
+		u32 sum = static_cast<u32>(regs_.sz[1]) + regs_.sz[2] + regs_.sz[3];
+		s64 v = static_cast<s64>(regs_.zsf3) * sum;
+
+		set_mac0_(v);
+		set_otz_(static_cast<s32>(v >> 12));
+	}
+
+	void Gte::exec_avsz4_(GteCommand command)
+	{
+		u32 sum = static_cast<u32>(regs_.sz[0]) + regs_.sz[1] + regs_.sz[2] + regs_.sz[3];
+		s64 v = static_cast<s64>(regs_.zsf4) * sum;
+
+		set_mac0_(v);
+		set_otz_(static_cast<s32>(v >> 12));
+	}
+
+	void Gte::exec_gpf_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+		s64 ir0 = regs_.ir[0];
+
+		for (u32 i = 1; i < 4; i++)
+		{
+			set_mac_ir_(i, ir0 * regs_.ir[i], shift, lm);
+		}
+		push_rgb_from_mac_();
+	}
+
+	void Gte::exec_gpl_(GteCommand command)
+	{
+		auto shift = command.shift();
+		auto lm = command.lm();
+		s64 ir0 = regs_.ir[0];
+
+		for (u32 i = 1; i < 4; i++)
+		{
+			s64 base = sign_extend_mac_(check_mac_(i, static_cast<s64>(regs_.mac[i]) * (1ll << shift)));
+			set_mac_ir_(i, ir0 * regs_.ir[i] + base, shift, lm);
+		}
+		push_rgb_from_mac_();
+	}
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include "types.h"
+
+namespace CPU
+{
+	struct GteRegs
+	{
+		// Data registers (cop2r0 - cop2r31)
+		s16 v[3][3];			// 0-5: VX, VY, VZ of the three input vectors
+		u8 rgbc[4];				// 6: R, G, B, CODE
+		u16 otz;				// 7: average Z
+		s16 ir[4];				// 8-11: IR0..IR3
+		s16 sxy[3][2];			// 12-14: screen XY fifo (15: SXYP)
+		u16 sz[4];				// 16-19: screen Z fifo
+		u8 rgb[3][4];			// 20-22: color fifo
+		u32 res1;				// 23: prohibited
+		s32 mac[4];				// 24-27: MAC0..MAC3
+		s32 lzcs;				// 30: leading zeroes count source
+		u32 lzcr;				// 31: leading zeroes count result
+
+		// Control registers (cop2r32 - cop2r63)
+		s16 rt[3][3];			// 32-36: rotation matrix
+		s32 tr[3];				// 37-39: translation vector
+		s16 llm[3][3];			// 40-44: light source matrix
+		s32 bk[3];				// 45-47: background color
+		s16 lcm[3][3];			// 48-52: light color matrix
+		s32 fc[3];				// 53-55: far color
+		s32 ofx;				// 56: screen offset X
+		s32 ofy;				// 57: screen offset Y
+		u16 h;					// 58: projection plane distance
+		s16 dqa;				// 59: depth queuing coefficient
+		s32 dqb;				// 60: depth queuing offset
+		s16 zsf3;				// 61: average Z scale factor (3 values)
+		s16 zsf4;				// 62: average Z scale factor (4 values)
+		u32 flag;				// 63: saturation / overflow flags
+	};
+
+	// Four independent MAC accumulators evaluated as
+	// (t << 12) + a0 * b0 + a1 * b1 + a2 * b2
+	struct GteMacLanes
+	{
+		alignas(16) s32 t[4];
+		alignas(16) s32 a[3][4];
+		alignas(16) s32 b[3][4];
+	};
+
+	struct GteMacResult
+	{
+		alignas(32) s64 value[4];
+		u32 pos_overflow;		// lane bitmask
+		u32 neg_overflow;		// lane bitmask
+	};
+
+	struct GteCommand
+	{
+		u32 value;
+		GteCommand(u32 val) :
+			value(val) {}
+
+		// Returns the command opcode [5:0]
+		u8 opcode()
+		{
+			return value & 0x3f;
+		}
+
+		// Returns the IR saturation lower limit flag [10]
+		bool lm()
+		{
+			return ((value >> 10) & 0x1) != 0;
+		}
+
+		// Returns the fraction shift (0 or 12) selected by bit [19]
+		u8 shift()
+		{
+			return ((value >> 19) & 0x1) * 12;
+		}
+
+		// MVMVA translation vector [14:13]
+		u32 cv()
+		{
+			return (value >> 13) & 0x3;
+		}
+
+		// MVMVA multiply vector [16:15]
+		u32 mv()
+		{
+			return (value >> 15) & 0x3;
+		}
+
+		// MVMVA multiply matrix [18:17]
+		u32 mx()
+		{
+			return (value >> 17) & 0x3;
+		}
+	};
+
+	// Geometry Transformation Engine (Coprocessor 2)
+	class Gte
+	{
+	private:
+		GteRegs regs_;
+
+		static const u32
+			cmd_rtps_ = 0x01,
+			cmd_nclip_ = 0x06,
+			cmd_op_ = 0x0c,
+			cmd_dpcs_ = 0x10,
+			cmd_intpl_ = 0x11,
+			cmd_mvmva_ = 0x12,
+			cmd_ncds_ = 0x13,
+			cmd_cdp_ = 0x14,
+			cmd_ncdt_ = 0x16,
+			cmd_nccs_ = 0x1b,
+			cmd_cc_ = 0x1c,
+			cmd_ncs_ = 0x1e,
+			cmd_nct_ = 0x20,
+			cmd_sqr_ = 0x28,
+			cmd_dcpl_ = 0x29,
+			cmd_dpct_ = 0x2a,
+			cmd_avsz3_ = 0x2d,
+			cmd_avsz4_ = 0x2e,
+			cmd_rtpt_ = 0x30,
+			cmd_gpf_ = 0x3d,
+			cmd_gpl_ = 0x3e,
+			cmd_ncct_ = 0x3f;
+
+		static const u32
+			flag_error_ = 1u << 31,
+			flag_error_mask_ = 0x7f87e000,
+			flag_write_mask_ = 0x7ffff000,
+			flag_sz_otz_saturated_ = 1u << 18,
+			flag_divide_overflow_ = 1u << 17,
+			flag_sx2_saturated_ = 1u << 14,
+			flag_sy2_saturated_ = 1u << 13;
+
+		static const s64
+			mac_max_ = 0x7ffffffffff,		// 44 bit signed accumulators
+			mac_min_ = -0x80000000000;
+
+		static const u32 flag_mac_pos_overflow_[4];
+		static const u32 flag_mac_neg_overflow_[4];
+		static const u32 flag_ir_saturated_[4];
+		static const u32 flag_color_saturated_[3];
+
+		static s64 sign_extend_mac_(s64 value);
+		s64 check_mac_(u32 index, s64 value);
+		void set_mac_(u32 index, s64 value, u8 shift);
+		void set_ir_(u32 index, s32 value, bool lm);
+		void set_mac_ir_(u32 index, s64 value, u8 shift, bool lm);
+		void set_mac0_(s64 value);
+		void set_ir0_(s32 value);
+		void set_otz_(s32 value);
+		void push_sz_(s32 value);
+		void push_sxy_(s32 x, s32 y);
+		void push_rgb_from_mac_();
+		void apply_mac_overflow_(const GteMacResult& result, u32 lane, u32 index);
+		u32 orgb_() const;
+
+		void mul_mat_vec_(const s16 m[3][3], const s32 t[3], s16 vx, s16 vy, s16 vz, u8 shift, bool lm);
+		void mul_mat_vec_far_color_(const s16 m[3][3], s16 vx, s16 vy, s16 vz, u8 shift, bool lm);
+		void interpolate_color_(s64 mac1, s64 mac2, s64 mac3, u8 shift, bool lm);
+		void project_(s64 x, s64 y, s64 z, u8 shift, bool lm, bool last);
+
+		void exec_rtps_(GteCommand command);		// Perspective transformation (single)
+		void exec_rtpt_(GteCommand command);		// Perspective transformation (triple)
+		void exec_nclip_(GteCommand command);		// Normal clipping
+		void exec_op_(GteCommand command);			// Outer product of 2 vectors
+		void exec_dpcs_(GteCommand command);		// Depth cueing (single)
+		void exec_dpct_(GteCommand command);		// Depth cueing (triple)
+		void exec_intpl_(GteCommand command);		// Interpolation of a vector and far color
+		void exec_mvmva_(GteCommand command);		// Multiply vector by matrix and add vector
+		void exec_ncs_(GteCommand command);			// Normal color (single)
+		void exec_nct_(GteCommand command);			// Normal color (triple)
+		void exec_nccs_(GteCommand command);		// Normal color color (single)
+		void exec_ncct_(GteCommand command);		// Normal color color (triple)
+		void exec_ncds_(GteCommand command);		// Normal color depth cue (single)
+		void exec_ncdt_(GteCommand command);		// Normal color depth cue (triple)
+		void exec_cc_(GteCommand command);			// Color color
+		void exec_cdp_(GteCommand command);			// Color depth cue
+		void exec_dcpl_(GteCommand command);		// Depth cue color light
+		void exec_sqr_(GteCommand command);			// Square of vector IR
+		void exec_avsz3_(GteCommand command);		// Average of three Z values
+		void exec_avsz4_(GteCommand command);		// Average of four Z values
+		void exec_gpf_(GteCommand command);			// General purpose interpolation
+		void exec_gpl_(GteCommand command);			// General purpose interpolation with base
+
+		void ncs_(u32 vertex, u8 shift, bool lm);
+		void nccs_(u32 vertex, u8 shift, bool lm);
+		void ncds_(u32 vertex, u8 shift, bool lm);
+		void dpcs_(const u8 color[4], u8 shift, bool lm);
+
+	public:
+		Gte();
+		u32 get_data(u32 reg) const;				// MFC2 / SWC2
+		void set_data(u32 reg, u32 value);			// MTC2 / LWC2
+		u32 get_control(u32 reg) const;				// CFC2
+		void set_control(u32 reg, u32 value);		// CTC2
+		void execute(u32 command);					// COP2 imm25
+		// Chains every data and control register onto an FNV-1a hash
+		u64 hash(u64 seed) const;
+
+		// MAC lane kernel, vectorized when SSE4.1 / AVX2 is available.
+		static void mac_lanes(const GteMacLanes& lanes, GteMacResult& result);
+		// Scalar reference of mac_lanes
+		static void mac_lanes_reference(const GteMacLanes& lanes, GteMacResult& result);
+	};
+}
@@ -0,0 +1,39 @@
+#include "gte_divide.h"
+
+namespace CPU
+{
+	u32 unr_divide_reference(u32 h, u32 sz3, bool& overflow)
+	{
+		if (h >= sz3 * 2)
+		{
+			overflow = true;
+			return 0x1ffff;
+		}
+		overflow = false;
+
+		u32 z = 0;
+		while ((sz3 & (0x8000 >> z)) == 0)
+		{
+			z++;
+		}
+		u32 n = h << z;
+		u32 d = sz3 << z;
+
+		s32 seed = ((0x40000 / (static_cast<s32>((d - 0x7fc0) >> 7) + 0x100)) + 1) / 2 - 0x101;
+		if (seed < 0)
+		{
+			seed = 0;
+		}
+		u32 u = static_cast<u32>(seed) + 0x101;
+
+		d = (0x2000080 - (d * u)) >> 8;
+		d = (0x0000080 + (d * u)) >> 8;
+
+		u64 q = ((static_cast<u64>(n) * d) + 0x8000) >> 16;
+		if (q > 0x1ffff)
+		{
+			q = 0x1ffff;
+		}
+		return static_cast<u32>(q);
+	}
+}
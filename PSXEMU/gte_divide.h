@@ -0,0 +1,69 @@
+#pragma once
+#include "types.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace CPU
+{
+	// Unsigned Newton-Raphson reciprocal seeds used by the GTE perspective divide:
+	// unr_table[i] = max(0, (0x40000 / (i + 0x100) + 1) / 2 - 0x101)
+	struct UnrTable
+	{
+		u8 value[0x101];
+	};
+
+	constexpr UnrTable make_unr_table()
+	{
+		UnrTable table = {};
+		for (s32 i = 0; i < 0x101; i++)
+		{
+			s32 v = ((0x40000 / (i + 0x100)) + 1) / 2 - 0x101;
+			table.value[i] = static_cast<u8>((v < 0) ? 0 : v);
+		}
+		return table;
+	}
+
+	constexpr UnrTable unr_table = make_unr_table();
+
+	static_assert(unr_table.value[0x000] == 0xff, "UNR table start");
+	static_assert(unr_table.value[0x001] == 0xfd, "UNR table start");
+	static_assert(unr_table.value[0x0ff] == 0x00, "UNR table end");
+	static_assert(unr_table.value[0x100] == 0x00, "UNR table end");
+
+	// Leading zeroes of a 16 bit value, value must not be 0
+	inline u32 count_leading_zeros16(u32 value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return 15 - index;
+#else
+		return static_cast<u32>(__builtin_clz(value)) - 16;
+#endif
+	}
+
+	// h / sz3 as a 1.16 fixed point value, as computed by the GTE for RTPS / RTPT.
+	// Branch free: the overflowing case is computed anyway and masked out.
+	inline u32 unr_divide(u32 h, u32 sz3, bool& overflow)
+	{
+		u32 z = count_leading_zeros16(sz3 | 1);
+		u32 n = h << z;
+		u32 d = (sz3 << z) | 0x8000;
+
+		u32 u = unr_table.value[((d & 0x7fff) + 0x40) >> 7] + 0x101;
+		d = (0x2000080 - (d * u)) >> 8;
+		d = (0x0000080 + (d * u)) >> 8;
+
+		u32 q = static_cast<u32>(((static_cast<u64>(n) * d) + 0x8000) >> 16);
+		q = (q > 0x1ffff) ? 0x1ffff : q;
+
+		overflow = h >= sz3 * 2;
+		u32 mask = static_cast<u32>(overflow) - 1;
+		return (q & mask) | (0x1ffff & ~mask);
+	}
+
+	// Straightforward transcription of the hardware algorithm, the baseline of the benchmarks
+	u32 unr_divide_reference(u32 h, u32 sz3, bool& overflow);
+}
@@ -0,0 +1,60 @@
+#include "hash.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#define PAGE_HASH_STEP 0x9e3779b97f4a7c15ull
+
+static const u64 PAGE_HASH_KEYS[4] = {
+	0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull
+};
+
+// Four lanes of 64 bit words, each 32 byte stripe of the page feeding one
+// word per lane: acc += lo(k) * hi(k) + word with k = word ^ key, where the
+// keys change every stripe so that moving data around changes the hash.
+u64 hash_page(const u8* data)
+{
+	u64 acc[4];
+#if defined(__AVX2__)
+	__m256i acc_v = _mm256_setzero_si256();
+	__m256i key_v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(PAGE_HASH_KEYS));
+	const __m256i step = _mm256_set1_epi64x(static_cast<long long>(PAGE_HASH_STEP));
+	for (u32 offset = 0; offset < (1 << RAM_PAGE_SHIFT); offset += 32)
+	{
+		__m256i word = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+		__m256i k = _mm256_xor_si256(word, key_v);
+		__m256i product = _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+		acc_v = _mm256_add_epi64(acc_v, _mm256_add_epi64(product, word));
+		key_v = _mm256_add_epi64(key_v, step);
+	}
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), acc_v);
+#else
+	u64 key[4];
+	for (u32 lane = 0; lane < 4; lane++)
+	{
+		acc[lane] = 0;
+		key[lane] = PAGE_HASH_KEYS[lane];
+	}
+	for (u32 offset = 0; offset < (1 << RAM_PAGE_SHIFT); offset += 32)
+	{
+		for (u32 lane = 0; lane < 4; lane++)
+		{
+			u64 word;
+			memcpy(&word, data + offset + lane * 8, sizeof(word));
+			u64 k = word ^ key[lane];
+			acc[lane] += (k & 0xffffffffull) * (k >> 32) + word;
+			key[lane] += PAGE_HASH_STEP;
+		}
+	}
+#endif
+	u64 hash = 0;
+	for (u32 lane = 0; lane < 4; lane++)
+	{
+		hash = (hash ^ acc[lane]) * PAGE_HASH_STEP;
+		hash ^= hash >> 29;
+	}
+	hash *= 0xbf58476d1ce4e5b9ull;
+	return hash ^ (hash >> 32);
+}
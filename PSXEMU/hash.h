@@ -0,0 +1,27 @@
+#pragma once
+#include "types.h"
+#include "ram.h"
+
+#define FNV1A_SEED 0xcbf29ce484222325ull
+
+// FNV-1a of size bytes, chained from hash
+inline u64 fnv1a(u64 hash, const void* data, usize size)
+{
+	const u8* bytes = static_cast<const u8*>(data);
+	for (usize i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+// FNV-1a of a trivially copyable value
+template <typename T>
+u64 fnv1a_value(u64 hash, const T& value)
+{
+	return fnv1a(hash, &value, sizeof(value));
+}
+
+// 64 bit hash of one RAM sized page, 1 << RAM_PAGE_SHIFT bytes, vectorized
+// when AVX2 is available. Both versions give the same result.
+u64 hash_page(const u8* data);
@@ -1,193 +1,412 @@
 #include "interconnect.h"
+#include "log.h"
+
+const u32 Interconnect::REGION_MASK[8] =
+{
+	// KUSEG: 2048 MB
+	0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+	// KSEG0 : 512 MB
+	0x7fffffff,
+	// KSEG1 : 512 MB
+	0x1fffffff,
+	// KSEG2: 1024 MB
+	0xffffffff, 0xffffffff
+};
 
 Interconnect::Interconnect(Bios bios) :
-	bios_{ bios }
+	bios_{ bios },
+	fault_(Fault::None)
 {
-	
+	scheduler_.schedule(SchedulerEvent::Spu, spu_.next_deadline());
 }
 
-u32 Interconnect::load32(u32 address)
+// Checked in order, the busiest ranges first
+const Interconnect::DeviceRange Interconnect::DEVICE_RANGES[] =
 {
-	address = mask_region(address);
+	{ SPU_START_ADDRESS, SPU_END_ADDRESS, StatsRegion::Spu,
+		{ nullptr, &Interconnect::spu_load16_, &Interconnect::spu_load32_ },
+		{ nullptr, &Interconnect::spu_store16_, &Interconnect::spu_store32_ } },
+	{ DMA_START_ADDRESS, DMA_END_ADDRESS, StatsRegion::Dma,
+		{ nullptr, nullptr, &Interconnect::dma_load32_ },
+		{ nullptr, nullptr, &Interconnect::dma_store32_ } },
+	{ CDROM_START_ADDRESS, CDROM_END_ADDRESS, StatsRegion::Cdrom,
+		{ &Interconnect::cdrom_load8_, nullptr, nullptr },
+		{ &Interconnect::cdrom_store8_, nullptr, nullptr } },
+	{ MDEC_START_ADDRESS, MDEC_END_ADDRESS, StatsRegion::Mdec,
+		{ nullptr, nullptr, &Interconnect::mdec_load32_ },
+		{ nullptr, nullptr, &Interconnect::mdec_store32_ } },
+	{ IRQ_CONTROL_START_ADDRESS, IRQ_CONTROL_END_ADDRESS, StatsRegion::IrqControl,
+		{ nullptr, nullptr, &Interconnect::irq_control_load32_ },
+		{ nullptr, nullptr, &Interconnect::irq_control_store32_ } },
+	{ TIMERS_START_ADDRESS, TIMERS_END_ADDRESS, StatsRegion::Timers,
+		{ nullptr, nullptr, nullptr },
+		{ nullptr, &Interconnect::timers_store16_, nullptr } },
+	{ MEMCONTROL_START_ADDRESS, MEMCONTROL_END_ADDRESS, StatsRegion::MemControl,
+		{ nullptr, nullptr, nullptr },
+		{ nullptr, nullptr, &Interconnect::mem_control_store32_ } },
+	{ EXPANSION2_START_ADDRESS, EXPANSION2_END_ADDRESS, StatsRegion::Expansion2,
+		{ &Interconnect::expansion2_load8_, nullptr, nullptr },
+		{ &Interconnect::expansion2_store8_, nullptr, nullptr } },
+	{ EXPANSION1_START_ADDRESS, EXPANSION1_END_ADDRESS, StatsRegion::Expansion1,
+		{ &Interconnect::expansion1_load8_, nullptr, nullptr },
+		{ nullptr, nullptr, nullptr } },
+	{ RAM2_START_ADDRESS, RAM2_END_ADDRESS, StatsRegion::Other,
+		{ &Interconnect::ram_mirror_load8_, nullptr, nullptr },
+		{ nullptr, nullptr, nullptr } },
+	{ RAM_SIZE_LOCATION, RAM_SIZE_LOCATION + 4, StatsRegion::Other,
+		{ nullptr, nullptr, nullptr },
+		{ nullptr, nullptr, &Interconnect::ram_size_store32_ } },
+	{ CACHE_CONTROL, CACHE_CONTROL + 4, StatsRegion::Other,
+		{ nullptr, nullptr, nullptr },
+		{ nullptr, nullptr, &Interconnect::cache_control_store32_ } },
+};
 
-	if (address % 4 != 0)
-	{
-		std::cerr << "Unaligned load32 memory address: " <<
-			std::hex << address << std::endl;
-	}
+// The access never reaches the device. The core raises the guest address
+// error before accessing, this is only reached by host side accesses.
+void Interconnect::unaligned_(const char* access, usize size, u32 address)
+{
+	LOG_ERROR(Bus, "Unaligned {}{d} memory address: {}", access, size * 8, address);
+	stats_.exceptions++;
+	fault_ = Fault::Unaligned;
+	throw - 1;
+}
 
-	if (DEVICE_MAP(address, BIOS_START_ADDRESS, BIOS_END_ADDRESS))
-	{
-		return bios_.load32(address - BIOS_START_ADDRESS);
-	}
-	else if (DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
-	{
-		return ram_.load32(address - RAM_START_ADDRESS);
-	}
-	else if (DEVICE_MAP(address, IRQ_CONTROL_START_ADDRESS, IRQ_CONTROL_END_ADDRESS))
-	{
-		std::cout << "IRQ CONTROL load32: " <<
-			std::hex << (address - IRQ_CONTROL_START_ADDRESS) << std::endl;
-		return 0x0;
-	}
-	else
+void Interconnect::unmapped_(const char* access, usize width, u32 address)
+{
+	LOG_ERROR(Bus, "Unable to map memory address for {}{d}, Address: {}", access, 8 << width, address);
+	fault_ = Fault::Unmapped;
+	throw - 1;
+}
+
+void Interconnect::watched_(u32 address, usize size, bool write)
+{
+	if (address % size == 0 && DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
 	{
-		std::cerr << "Unable to map memory address for load32" << std::endl;
-		throw - 1;
+		ram_watch_.watcher->ram_access(address - RAM_START_ADDRESS, static_cast<u32>(size), write);
 	}
 }
 
-u8 Interconnect::load8(u32 address)
+void Interconnect::set_ram_watcher(RamWatcher* watcher)
 {
-	address = mask_region(address);
+	ram_watch_.watcher = watcher;
+}
 
-	if (DEVICE_MAP(address, BIOS_START_ADDRESS, BIOS_END_ADDRESS))
-	{
-		return bios_.load8(address - BIOS_START_ADDRESS);
-	}
-	else if (DEVICE_MAP(address, EXPANSION1_START_ADDRESS, EXPANSION1_END_ADDRESS))
-	{
-		std::cout << "No Expantion 1 implementation" << std::endl;
-		return 0xff;
-	}
-	else if (DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
-	{
-		return ram_.load8(address - RAM_START_ADDRESS);
-	}
-	else if (DEVICE_MAP(address, RAM2_START_ADDRESS, RAM2_END_ADDRESS))
+u32 Interconnect::load_device_(u32 address, usize width)
+{
+	for (const DeviceRange& range : DEVICE_RANGES)
 	{
-		//return ram_.load8(address - RAM2_START_ADDRESS);
-		return 0x0;
+		if (DEVICE_MAP(address, range.start, range.end) && range.load[width] != nullptr)
+		{
+			stats_.count(range.region);
+			return (this->*range.load[width])(address - range.start);
+		}
 	}
-	else
+	unmapped_("load", width, address);
+	return 0;
+}
+
+void Interconnect::store_device_(u32 address, usize width, u32 value)
+{
+	for (const DeviceRange& range : DEVICE_RANGES)
 	{
-		std::cerr << "Unable to map memory address for load8, " << 
-			"Address : " << std::hex << address <<std::endl;
-		throw - 1;
+		if (DEVICE_MAP(address, range.start, range.end) && range.store[width] != nullptr)
+		{
+			stats_.count(range.region);
+			(this->*range.store[width])(address - range.start, value);
+			return;
+		}
 	}
+	unmapped_("store", width, address);
+}
+
+u32 Interconnect::cdrom_load8_(u32 offset)
+{
+	return cdrom_.load8(offset);
+}
+
+void Interconnect::cdrom_store8_(u32 offset, u32 value)
+{
+	StatsTimer timer(stats_, StatsDevice::Cdrom);
+	cdrom_.store8(offset, static_cast<u8>(value), scheduler_);
+}
 
+u32 Interconnect::spu_load16_(u32 offset)
+{
+	sync_spu_();
+	return spu_.load16(offset);
+}
+
+u32 Interconnect::spu_load32_(u32 offset)
+{
+	sync_spu_();
+	return spu_.load16(offset) | (static_cast<u32>(spu_.load16(offset + 2)) << 16);
+}
+
+void Interconnect::spu_store16_(u32 offset, u32 value)
+{
+	sync_spu_();
+	spu_.store16(offset, static_cast<u16>(value));
+}
+
+void Interconnect::spu_store32_(u32 offset, u32 value)
+{
+	sync_spu_();
+	spu_.store16(offset, static_cast<u16>(value));
+	spu_.store16(offset + 2, static_cast<u16>(value >> 16));
 }
 
-void Interconnect::store32(u32 address, u32 value)
+u32 Interconnect::mdec_load32_(u32 offset)
 {
-	address = mask_region(address);
+	return mdec_.load32(offset);
+}
+
+void Interconnect::mdec_store32_(u32 offset, u32 value)
+{
+	mdec_.store32(offset, value);
+}
+
+u32 Interconnect::dma_load32_(u32 offset)
+{
+	return dma_.load32(offset);
+}
 
-	if (address % 4 != 0)
+void Interconnect::dma_store32_(u32 offset, u32 value)
+{
+	dma_.store32(offset, value);
+	u32 index = offset >> 4;
+	if (index < DMA_N_CHANNELS && dma_.ready(static_cast<DmaPort>(index)))
 	{
-		std::cerr << "Unaligned store32 memory address: " <<
-			std::hex << address << std::endl;
+		run_dma_(static_cast<DmaPort>(index));
 	}
+}
+
+u32 Interconnect::irq_control_load32_(u32 offset)
+{
+	LOG_WARN(Bus, "IRQ CONTROL load32: {}", offset);
+	return 0x0;
+}
+
+void Interconnect::irq_control_store32_(u32 offset, u32 value)
+{
+	LOG_WARN(Bus, "IRQ CONTROL store32: {} <- {}", offset, value);
+}
 
-	if (DEVICE_MAP(address, MEMCONTROL_START_ADDRESS, MEMCONTROL_END_ADDRESS)) 
+void Interconnect::timers_store16_(u32 offset, u32 value)
+{
+	LOG_WARN(Bus, "Unhandled store16 into address (TIMERS REGISTER): {}", TIMERS_START_ADDRESS + offset);
+}
+
+void Interconnect::mem_control_store32_(u32 offset, u32 value)
+{
+	switch (offset)
 	{
-		switch (address - MEMCONTROL_START_ADDRESS)
+	case 0:
+		if (value != 0x1f000000)
 		{
-		case 0:
-			if (value != 0x1f000000)
-			{
-				std::cerr << "Bad expansion 1 base address: " <<
-					std::hex << address << std::endl;
-				return;
-			}
-		case 4:
-			if (value != 0x1f802000)
-			{
-				std::cerr << "Bad expansion 2 base address: " <<
-					std::hex << address << std::endl;
-				return;
-			}
-		default:
-			std::cerr << "Unable to write to MEMCONTROL register: " << std::hex << address << std::endl;
-			break;
+			LOG_WARN(Bus, "Bad expansion 1 base address: {}", value);
+			return;
 		}
-		return;
-	}
-	else if (DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
-	{
-		ram_.store32(address - RAM_START_ADDRESS, value);
-		return;
-	}
-	else if (DEVICE_MAP(address, IRQ_CONTROL_START_ADDRESS, IRQ_CONTROL_END_ADDRESS))
-	{
-		std::cout << "IRQ CONTROL store32: " <<
-			std::hex << (address - IRQ_CONTROL_START_ADDRESS) <<
-			" <- " << std::hex << value;
-		return;
+	case 4:
+		if (value != 0x1f802000)
+		{
+			LOG_WARN(Bus, "Bad expansion 2 base address: {}", value);
+			return;
+		}
+	default:
+		LOG_WARN(Bus, "Unable to write to MEMCONTROL register: {}", MEMCONTROL_START_ADDRESS + offset);
+		break;
 	}
+}
 
-	if (address == RAM_SIZE_LOCATION)
-	{
-		std::cout << "Unable to write in the RAM_SIZE_LOCATION" << std::endl;
-		return;
-	}
+u32 Interconnect::expansion1_load8_(u32 offset)
+{
+	LOG_WARN(Bus, "No Expansion 1 implementation");
+	return 0xff;
+}
 
-	if (address == CACHE_CONTROL)
-	{
-		std::cout << "Unable to write in the CACHE_CONTROL Register" << std::endl;
-		return;
-	}
+u32 Interconnect::expansion2_load8_(u32 offset)
+{
+	return tty_.load8(offset);
+}
 
+void Interconnect::expansion2_store8_(u32 offset, u32 value)
+{
+	tty_.store8(offset, static_cast<u8>(value));
+}
 
-	std::cerr << "Unable to store in address: " <<
-		std::hex << address << std::endl;
-	throw - 1;
+u32 Interconnect::ram_mirror_load8_(u32 offset)
+{
+	return 0x0;
 }
 
-void Interconnect::store16(u32 address, u16 value)
+void Interconnect::ram_size_store32_(u32 offset, u32 value)
 {
-	address = mask_region(address);
+	LOG_WARN(Bus, "Unable to write in the RAM_SIZE_LOCATION");
+}
 
-	if ((address % 2) != 0)
-	{
-		std::cerr << "UNALIGNED STORE16 ADDRESS : " << 
-			std::hex << address << std::endl;
-		return;
-	}
+void Interconnect::cache_control_store32_(u32 offset, u32 value)
+{
+	LOG_WARN(Bus, "Unable to write in the CACHE_CONTROL Register");
+}
 
-	if (DEVICE_MAP(address, SPU_START_ADDRESS, SPU_END_ADDRESS))
-	{
-		ram_.store32(address - SPU_START_ADDRESS, value);
-		return;
-	}
-	else if (DEVICE_MAP(address, TIMERS_START_ADDRESS, TIMERS_END_ADDRESS))
+bool Interconnect::run_events_()
+{
+	bool cpu_event = false;
+	SchedulerEvent event;
+	while (scheduler_.pop_due(event))
 	{
-		std::cout << "Unhandles store16 into address (TIMERS REGISTER) : " <<
-			std::hex << address << std::endl;
-		return;
+		switch (event)
+		{
+		case SchedulerEvent::Profiler:
+			cpu_event = true;
+			break;
+		case SchedulerEvent::Spu:
+			sync_spu_();
+			break;
+		case SchedulerEvent::CdromAck:
+		case SchedulerEvent::CdromResponse:
+		case SchedulerEvent::CdromSector:
+		{
+			StatsTimer timer(stats_, StatsDevice::Cdrom);
+			cdrom_.run_event(event, scheduler_);
+			break;
+		}
+		default:
+			break;
+		}
 	}
+	return cpu_event;
+}
 
+// Catches the SPU up before its registers are observed or changed
+void Interconnect::sync_spu_()
+{
+	StatsTimer timer(stats_, StatsDevice::Spu);
+	spu_.sync(scheduler_.now());
+	scheduler_.schedule(SchedulerEvent::Spu, spu_.next_deadline());
+}
 
-	std::cerr << "Unhandles store16 into address : " <<
-		std::hex << address << std::endl;
-	throw - 1;
+Scheduler& Interconnect::scheduler()
+{
+	return scheduler_;
+}
+
+Bios& Interconnect::bios()
+{
+	return bios_;
+}
+
+Ram& Interconnect::ram()
+{
+	return ram_;
+}
+
+const Ram& Interconnect::ram() const
+{
+	return ram_;
+}
+
+Spu& Interconnect::spu()
+{
+	return spu_;
+}
 
+const Spu& Interconnect::spu() const
+{
+	return spu_;
 }
 
-void Interconnect::store8(u32 address, u8 value)
+Cdrom& Interconnect::cdrom()
 {
-	address = mask_region(address);
+	return cdrom_;
+}
 
-	if (DEVICE_MAP(address, EXPANSION2_START_ADDRESS, EXPANSION2_END_ADDRESS))
+// Transfers complete instantly
+void Interconnect::run_dma_(DmaPort port)
+{
+	StatsTimer timer(stats_, StatsDevice::Dma);
+	DmaChannel& channel = dma_.channel(port);
+	u32 control = channel.channel_control;
+	bool from_ram = (control & 0x1) != 0;
+	u32 step = (control & 0x2) ? static_cast<u32>(-4) : 4;
+	u32 sync = (control >> 9) & 0x3;
+	u32 address = channel.base_address & 0x1ffffc;
+
+	u32 n_words;
+	switch (sync)
 	{
-		std::cout << "Unhandled write to Expansion 2 register: " <<
-			std::hex << address << std::endl;
+	case 0:
+		n_words = channel.block_control & 0xffff;
+		n_words = (n_words == 0) ? 0x10000 : n_words;
+		break;
+	case 1:
+		n_words = (channel.block_control & 0xffff) * (channel.block_control >> 16);
+		break;
+	default:
+		LOG_WARN(Dma, "Unhandled DMA linked list transfer on channel {d}", port);
+		dma_.done(port);
 		return;
 	}
 
-	else if (DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
+	bool supported = from_ram ? (port == DmaPort::MdecIn) :
+		(port == DmaPort::MdecOut || port == DmaPort::Cdrom || port == DmaPort::Otc);
+	if (!supported)
 	{
-		ram_.store8(address - RAM_START_ADDRESS, value);
+		LOG_WARN(Dma, "Unhandled DMA transfer on channel {d}", port);
+		dma_.done(port);
 		return;
 	}
 
+	for (u32 i = 0; i < n_words; i++)
+	{
+		if (from_ram)
+		{
+			mdec_.dma_write(ram_.load<u32>(address));
+		}
+		else
+		{
+			u32 value;
+			switch (port)
+			{
+			case DmaPort::MdecOut:
+				value = mdec_.dma_read();
+				break;
+			case DmaPort::Cdrom:
+				value = cdrom_.read_data_word();
+				break;
+			default:
+				// Ordering table: every entry links to the previous one
+				value = (i == n_words - 1) ? 0xffffff : ((address - 4) & 0x1fffff);
+				break;
+			}
+			ram_.store<u32>(address, value);
+		}
+		address = (address + step) & 0x1ffffc;
+	}
 
-	std::cerr << "Unhandles store8 into address : " <<
-		std::hex << address << std::endl;
-	throw - 1;
+	if (sync == 1)
+	{
+		channel.base_address = address;
+	}
+	dma_.done(port);
+}
+
+Mdec& Interconnect::mdec()
+{
+	return mdec_;
 }
 
-u32 Interconnect::mask_region(u32 address)
+Tty& Interconnect::tty()
 {
-	usize index = (address >> 29);
-	return address & REGION_MASK[index];
-}
\ No newline at end of file
+	return tty_;
+}
+
+u64 Interconnect::hash_devices(u64 seed) const
+{
+	u64 hash = spu_.hash(seed);
+	hash = cdrom_.hash(hash);
+	hash = mdec_.hash(hash);
+	hash = dma_.hash(hash);
+	hash = tty_.hash(hash);
+	return scheduler_.hash(hash);
+}
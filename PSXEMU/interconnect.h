@@ -1,32 +1,251 @@
 #pragma once
 #include "bios.h"
 #include "ram.h"
+#include "spu.h"
+#include "scheduler.h"
+#include "cdrom.h"
+#include "mdec.h"
+#include "dma.h"
+#include "tty.h"
+#include "stats.h"
+
+// Address segments, the top three bits of a virtual address
+enum class Segment : u32
+{
+	Kuseg = 0,
+	Kseg0 = 4,
+	Kseg1 = 5,
+	Kseg2 = 6
+};
+
+// What the core or the bus gave up on when it threw, for tools reporting crashes
+enum class Fault : u32
+{
+	None,
+	Unmapped,			// load or store outside every device
+	Unaligned,			// host side access not aligned to its size
+	Reserved,			// opcode the core doesn't implement
+	Overflow,			// add or addi
+	Coprocessor,		// COP0 or GTE instruction or register not emulated
+	Break,				// break without a debugger trap
+	Other
+};
+
+// Told of the loads and stores to RAM that go through Interconnect::load
+// and store, before they happen: for debugger watchpoints
+class RamWatcher
+{
+public:
+	virtual ~RamWatcher() {}
+	virtual void ram_access(u32 offset, u32 size, bool write) = 0;
+};
+
+// The watcher of an interconnect, which copies don't share: they start
+// unwatched, and assignments keep the watcher of the target
+struct RamWatch
+{
+	RamWatcher* watcher;
+
+	RamWatch() :
+		watcher(nullptr) {}
+	RamWatch(const RamWatch&) :
+		watcher(nullptr) {}
+	RamWatch& operator=(const RamWatch&)
+	{
+		return *this;
+	}
+};
 
 class Interconnect
 {
 private:
-	const u32 REGION_MASK[8] =
-	{
-		// KUSEG: 2048 MB
-		0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
-		// KSEG0 : 512 MB
-		0x7fffffff,
-		// KSEG1 : 512 MB
-		0x1fffffff,
-		// KSEG2: 1024 MB
-		0xffffffff, 0xffffffff
+	static const u32 REGION_MASK[8];
+
+	// Registers of one device. Handlers are indexed by access width (8, 16
+	// and 32 bits) and get the offset in the range, a null handler leaves
+	// that width unmapped.
+	struct DeviceRange
+	{
+		u32 start;
+		u32 end;
+		StatsRegion region;
+		u32 (Interconnect::*load[3])(u32 offset);
+		void (Interconnect::*store[3])(u32 offset, u32 value);
 	};
+	static const DeviceRange DEVICE_RANGES[];
 
 	Bios bios_;
+	RamWatch ram_watch_;			// next to the RAM pointer, checked as often
 	Ram ram_;
+	Spu spu_;
+	Cdrom cdrom_;
+	Mdec mdec_;
+	Dma dma_;
+	Tty tty_;
+	Scheduler scheduler_;
+	Stats stats_;
+	Fault fault_;
+
+	static constexpr usize width_index_(usize size)
+	{
+		return (size == 4) ? 2 : size - 1;
+	}
+	static constexpr u32 segment_mask_(Segment segment)
+	{
+		return (segment == Segment::Kseg0) ? 0x7fffffff :
+			(segment == Segment::Kseg1) ? 0x1fffffff : 0xffffffff;
+	}
+
+	void unaligned_(const char* access, usize size, u32 address);
+	void unmapped_(const char* access, usize width, u32 address);
+	void watched_(u32 address, usize size, bool write);
+	u32 load_device_(u32 address, usize width);
+	void store_device_(u32 address, usize width, u32 value);
+
+	u32 cdrom_load8_(u32 offset);
+	void cdrom_store8_(u32 offset, u32 value);
+	u32 spu_load16_(u32 offset);
+	u32 spu_load32_(u32 offset);
+	void spu_store16_(u32 offset, u32 value);
+	void spu_store32_(u32 offset, u32 value);
+	u32 mdec_load32_(u32 offset);
+	void mdec_store32_(u32 offset, u32 value);
+	u32 dma_load32_(u32 offset);
+	void dma_store32_(u32 offset, u32 value);
+	u32 irq_control_load32_(u32 offset);
+	void irq_control_store32_(u32 offset, u32 value);
+	void timers_store16_(u32 offset, u32 value);
+	void mem_control_store32_(u32 offset, u32 value);
+	u32 expansion1_load8_(u32 offset);
+	u32 expansion2_load8_(u32 offset);
+	void expansion2_store8_(u32 offset, u32 value);
+	u32 ram_mirror_load8_(u32 offset);
+	void ram_size_store32_(u32 offset, u32 value);
+	void cache_control_store32_(u32 offset, u32 value);
+
+	bool run_events_();
+	void sync_spu_();
+	void run_dma_(DmaPort port);
 
 public:
 	Interconnect(Bios bios);
-	u32 load32(u32 address);
-	u8 load8(u32 address);
-	void store32(u32 address, u32 value);
-	void store16(u32 address, u16 value);
-	void store8(u32 address, u8 value);
-	u32 mask_region(u32 address);
-};
 
+	// Bus accesses of T = u8, u16 or u32 at a virtual address. RAM and BIOS
+	// are handled inline, device registers through DEVICE_RANGES. The data
+	// accesses of the CPU, the only ones a RamWatcher sees.
+	template <typename T>
+	T load(u32 address)
+	{
+		u32 physical = mask_region(address);
+		if (ram_watch_.watcher != nullptr)
+		{
+			watched_(physical, sizeof(T), false);
+		}
+		return load_physical<T>(physical);
+	}
+	template <typename T>
+	void store(u32 address, T value)
+	{
+		u32 physical = mask_region(address);
+		if (ram_watch_.watcher != nullptr)
+		{
+			watched_(physical, sizeof(T), true);
+		}
+		store_physical<T>(physical, value);
+	}
+	// Same as load and store for an address known to be in the segment,
+	// which saves the mask lookup, unwatched
+	template <typename T, Segment SEGMENT>
+	T load_segment(u32 address)
+	{
+		return load_physical<T>(address & segment_mask_(SEGMENT));
+	}
+	template <typename T, Segment SEGMENT>
+	void store_segment(u32 address, T value)
+	{
+		store_physical<T>(address & segment_mask_(SEGMENT), value);
+	}
+
+	template <typename T>
+	T load_physical(u32 address)
+	{
+		if (address % sizeof(T) != 0)
+		{
+			unaligned_("load", sizeof(T), address);
+		}
+		if (DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
+		{
+			stats_.count(StatsRegion::Ram);
+			return ram_.load<T>(address - RAM_START_ADDRESS);
+		}
+		if (DEVICE_MAP(address, BIOS_START_ADDRESS, BIOS_END_ADDRESS))
+		{
+			stats_.count(StatsRegion::Bios);
+			return bios_.load<T>(address - BIOS_START_ADDRESS);
+		}
+		return static_cast<T>(load_device_(address, width_index_(sizeof(T))));
+	}
+	template <typename T>
+	void store_physical(u32 address, T value)
+	{
+		if (address % sizeof(T) != 0)
+		{
+			unaligned_("store", sizeof(T), address);
+		}
+		if (DEVICE_MAP(address, RAM_START_ADDRESS, RAM_END_ADDRESS))
+		{
+			stats_.count(StatsRegion::Ram);
+			ram_.store<T>(address - RAM_START_ADDRESS, value);
+			return;
+		}
+		store_device_(address, width_index_(sizeof(T)), value);
+	}
+
+	u32 mask_region(u32 address)
+	{
+		return address & REGION_MASK[address >> 29];
+	}
+	// Moves the system clock to the CPU cycle count, running any expired device
+	// event. Returns true when an event for the CPU itself is due.
+	bool advance(u64 cycles)
+	{
+		scheduler_.set_now(cycles);
+		if (scheduler_.pending())
+		{
+			return run_events_();
+		}
+		return false;
+	}
+	Scheduler& scheduler();
+	Bios& bios();
+	Ram& ram();
+	const Ram& ram() const;
+	Spu& spu();
+	const Spu& spu() const;
+	Cdrom& cdrom();
+	Mdec& mdec();
+	Tty& tty();
+	// Chains the state of every device but RAM, sound RAM and BIOS onto an
+	// FNV-1a hash
+	u64 hash_devices(u64 seed) const;
+
+	Stats& stats()
+	{
+		return stats_;
+	}
+	// Set before throwing, None until then. Never cleared by the emulator.
+	Fault fault() const
+	{
+		return fault_;
+	}
+	void set_fault(Fault fault)
+	{
+		fault_ = fault;
+	}
+	// nullptr stops watching
+	void set_ram_watcher(RamWatcher* watcher);
+	bool ram_watched() const
+	{
+		return ram_watch_.watcher != nullptr;
+	}
+};
@@ -0,0 +1,733 @@
+#include "lockstep.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace CPU
+{
+	// Lane operations, on one value and on eight
+	struct LaneOr
+	{
+		static u32 scalar(u32 a, u32 b) { return a | b; }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_or_si256(a, b); }
+#endif
+	};
+
+	struct LaneAnd
+	{
+		static u32 scalar(u32 a, u32 b) { return a & b; }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_and_si256(a, b); }
+#endif
+	};
+
+	struct LaneAdd
+	{
+		static u32 scalar(u32 a, u32 b) { return a + b; }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+#endif
+	};
+
+	struct LaneSub
+	{
+		static u32 scalar(u32 a, u32 b) { return a - b; }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_sub_epi32(a, b); }
+#endif
+	};
+
+	struct LaneSlt
+	{
+		static u32 scalar(u32 a, u32 b) { return static_cast<u32>(static_cast<s32>(a) < static_cast<s32>(b)); }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b)
+		{
+			return _mm256_and_si256(_mm256_cmpgt_epi32(b, a), _mm256_set1_epi32(1));
+		}
+#endif
+	};
+
+	struct LaneSltu
+	{
+		static u32 scalar(u32 a, u32 b) { return static_cast<u32>(a < b); }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b)
+		{
+			const __m256i sign = _mm256_set1_epi32(static_cast<int>(0x80000000));
+			return LaneSlt::vector(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+		}
+#endif
+	};
+
+	struct LaneSll
+	{
+		static u32 scalar(u32 a, u32 b) { return a << b; }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_sllv_epi32(a, b); }
+#endif
+	};
+
+	struct LaneSrl
+	{
+		static u32 scalar(u32 a, u32 b) { return a >> b; }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_srlv_epi32(a, b); }
+#endif
+	};
+
+	struct LaneSra
+	{
+		static u32 scalar(u32 a, u32 b) { return static_cast<u32>(static_cast<s32>(a) >> b); }
+#if defined(__AVX2__)
+		static __m256i vector(__m256i a, __m256i b) { return _mm256_srav_epi32(a, b); }
+#endif
+	};
+
+	LockstepBatch::LockstepBatch(const std::vector<Core*>& lanes) :
+		lanes_(lanes),
+		n_lanes_(lanes.size()),
+		n_groups_(0)
+	{
+		if (n_lanes_ == 0 || n_lanes_ > LOCKSTEP_MAX_LANES)
+		{
+			std::cerr << "A lockstep batch runs 1 to " << LOCKSTEP_MAX_LANES << " lanes" << std::endl;
+			throw - 1;
+		}
+		memset(&states_, 0, sizeof(states_));
+		memset(operand_, 0, sizeof(operand_));
+		memset(result_, 0, sizeof(result_));
+		memset(mask_, 0, sizeof(mask_));
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			rams_[lane] = &lanes_[lane]->interconnect_.ram();
+			stats_[lane] = &lanes_[lane]->interconnect_.stats();
+			rams_[lane]->share_base(*rams_[0]);
+		}
+	}
+
+	void LockstepBatch::load_lane_(usize lane)
+	{
+		Core& core = *lanes_[lane];
+		for (u32 i = 0; i < N_GP_REG; i++)
+		{
+			states_.regs[i][lane] = core.state_.regs[i];
+		}
+		states_.hi[lane] = core.state_.hi;
+		states_.lo[lane] = core.state_.lo;
+		states_.pc[lane] = core.state_.pc;
+		states_.next_pc[lane] = core.next_instruction_pc_;
+		states_.next_word[lane] = core.next_instruction_.value;
+		states_.load_reg[lane] = core.state_.load.first.value;
+		states_.load_value[lane] = core.state_.load.second;
+		states_.cycles[lane] = core.state_.cycles;
+		states_.deadline[lane] = core.interconnect_.scheduler().next();
+		states_.instructions[lane] = 0;
+		states_.flags[lane] = ((core.pending_exe_ || core.hle_.mode() != HleMode::Off) ? LANE_INTERCEPTS : 0) |
+			(((core.state_.cop0regs.sr & 0x10000) != 0) ? LANE_ISOLATED : 0) |
+			(core.interconnect_.ram_watched() ? LANE_WATCHED : 0);
+	}
+
+	void LockstepBatch::store_lane_(usize lane)
+	{
+		Core& core = *lanes_[lane];
+		for (u32 i = 0; i < N_GP_REG; i++)
+		{
+			core.state_.regs[i] = states_.regs[i][lane];
+			core.state_.out_regs[i] = states_.regs[i][lane];
+		}
+		core.state_.hi = states_.hi[lane];
+		core.state_.lo = states_.lo[lane];
+		core.state_.pc = states_.pc[lane];
+		core.next_instruction_pc_ = states_.next_pc[lane];
+		core.next_instruction_ = Instruction(states_.next_word[lane]);
+		core.state_.load.first = RegisterIdx(states_.load_reg[lane]);
+		core.state_.load.second = states_.load_value[lane];
+		sync_clock_(lane);
+		stats_[lane]->instructions += states_.instructions[lane];
+		states_.instructions[lane] = 0;
+	}
+
+	// Brings the clock of the core and its devices up to the lane's
+	void LockstepBatch::sync_clock_(usize lane)
+	{
+		Core& core = *lanes_[lane];
+		core.state_.cycles = states_.cycles[lane];
+		core.interconnect_.scheduler().set_now(states_.cycles[lane]);
+	}
+
+	// Same checks as Core::intercept_, and watched RAM
+	bool LockstepBatch::needs_core_(usize lane) const
+	{
+		if ((states_.flags[lane] & LANE_WATCHED) != 0)
+		{
+			return true;
+		}
+		if ((states_.flags[lane] & LANE_INTERCEPTS) == 0)
+		{
+			return false;
+		}
+		const Core& core = *lanes_[lane];
+		if (core.pending_exe_ && states_.pc[lane] == PSX_EXE_SHELL_ENTRY)
+		{
+			return true;
+		}
+		if (core.hle_.mode() != HleMode::Off)
+		{
+			u32 address = states_.next_pc[lane] & 0x1fffffff;
+			return address == 0xa0 || address == 0xb0 || address == 0xc0;
+		}
+		return false;
+	}
+
+	void LockstepBatch::run_on_core_(usize lane)
+	{
+		store_lane_(lane);
+		try
+		{
+			lanes_[lane]->run_next_instruction();
+		}
+		catch (...)
+		{
+			load_lane_(lane);
+			throw;
+		}
+		load_lane_(lane);
+	}
+
+	void LockstepBatch::run(u32 steps)
+	{
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			load_lane_(lane);
+		}
+
+		u32 all = (1u << n_lanes_) - 1;
+		try
+		{
+			for (u32 step = 0; step < steps; step++)
+			{
+				u32 pending = all;
+				n_groups_ = 0;
+				while (pending != 0)
+				{
+					usize first = 0;
+					while ((pending & (1u << first)) == 0)
+					{
+						first++;
+					}
+					n_groups_++;
+					if (needs_core_(first))
+					{
+						run_on_core_(first);
+						pending &= ~(1u << first);
+						continue;
+					}
+
+					u32 pc = states_.next_pc[first];
+					u32 word = states_.next_word[first];
+					u32 group = 0;
+					for (usize lane = first; lane < n_lanes_; lane++)
+					{
+						if ((pending & (1u << lane)) != 0 && states_.next_pc[lane] == pc &&
+							states_.next_word[lane] == word && !needs_core_(lane))
+						{
+							group |= 1u << lane;
+						}
+					}
+					pending &= ~group;
+
+					if (parallel_(group, Instruction(word)))
+					{
+						step_group_(group, first, pc, Instruction(word));
+						continue;
+					}
+					for (usize lane = first; lane < n_lanes_; lane++)
+					{
+						if ((group & (1u << lane)) != 0)
+						{
+							run_on_core_(lane);
+						}
+					}
+				}
+			}
+		}
+		catch (...)
+		{
+			for (usize lane = 0; lane < n_lanes_; lane++)
+			{
+				store_lane_(lane);
+			}
+			throw;
+		}
+
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			store_lane_(lane);
+		}
+	}
+
+	// Instructions step_group_ implements, anything else runs on the lane cores
+	bool LockstepBatch::parallel_(u32 group, Instruction instruction) const
+	{
+		switch (instruction.function())
+		{
+		case Core::ins_lui_:
+		case Core::ins_ori_:
+		case Core::ins_andi_:
+		case Core::ins_addiu_:
+		case Core::ins_slti_:
+		case Core::ins_sltiu_:
+		case Core::ins_j_:
+		case Core::ins_jal_:
+		case Core::ins_beq_:
+		case Core::ins_bne_:
+		case Core::ins_bgtz_:
+		case Core::ins_blez_:
+		case Core::ins_lb_:
+		case Core::ins_lbu_:
+			return true;
+		case Core::ins_lw_:
+		case Core::ins_sw_:
+		case Core::ins_sh_:
+		case Core::ins_sb_:
+		{
+			// The core reports the accesses it ignores while the cache is
+			// isolated, and raises the address errors
+			u32 align = (instruction.function() == Core::ins_sh_) ? 1 : (instruction.function() == Core::ins_sb_) ? 0 : 3;
+			const u32* rs = states_.regs[instruction.s().value];
+			for (usize lane = 0; lane < n_lanes_; lane++)
+			{
+				if ((group & (1u << lane)) != 0 && ((states_.flags[lane] & LANE_ISOLATED) != 0 ||
+					((rs[lane] + instruction.signed_immediate()) & align) != 0))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+		case Core::ins_spec_:
+			switch (instruction.subfuction())
+			{
+			case Core::ins_sll_:
+			case Core::ins_srl_:
+			case Core::ins_sra_:
+			case Core::ins_jr_:
+			case Core::ins_jalr_:
+			case Core::ins_mfhi_:
+			case Core::ins_mflo_:
+			case Core::ins_addu_:
+			case Core::ins_subu_:
+			case Core::ins_and_:
+			case Core::ins_or_:
+			case Core::ins_slt_:
+			case Core::ins_sltu_:
+				return true;
+			default:
+				return false;
+			}
+		default:
+			return false;
+		}
+	}
+
+	void LockstepBatch::broadcast_(u32 value)
+	{
+		for (usize i = 0; i < LOCKSTEP_MAX_LANES; i++)
+		{
+			operand_[i] = value;
+		}
+	}
+
+	template <typename Op>
+	void LockstepBatch::alu_(const u32* a, const u32* b)
+	{
+#if defined(__AVX2__)
+		for (usize i = 0; i < n_lanes_; i += LOCKSTEP_VECTOR_LANES)
+		{
+			__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(result_ + i), Op::vector(va, vb));
+		}
+#else
+		for (usize i = 0; i < n_lanes_; i++)
+		{
+			result_[i] = Op::scalar(a[i], b[i]);
+		}
+#endif
+	}
+
+	// Register dst of the lanes in the group takes their value
+	void LockstepBatch::write_(u32 group, u32 dst, const u32* values)
+	{
+		u32* row = states_.regs[dst];
+#if defined(__AVX2__)
+		for (usize i = 0; i < n_lanes_; i += LOCKSTEP_VECTOR_LANES)
+		{
+			__m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+			__m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+			__m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask_ + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(row + i), _mm256_blendv_epi8(old, value, mask));
+		}
+#else
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			if ((group & (1u << lane)) != 0)
+			{
+				row[lane] = values[lane];
+			}
+		}
+#endif
+	}
+
+	// Aligned RAM accesses go straight to the lane's RAM, anything else may
+	// reach devices, which need the lane's clock
+	template <typename T>
+	T LockstepBatch::load_(usize lane, u32 address)
+	{
+		Interconnect& interconnect = lanes_[lane]->interconnect_;
+		u32 physical = interconnect.mask_region(address);
+		if (physical % sizeof(T) == 0 && DEVICE_MAP(physical, RAM_START_ADDRESS, RAM_END_ADDRESS))
+		{
+			stats_[lane]->count(StatsRegion::Ram);
+			return rams_[lane]->load<T>(physical - RAM_START_ADDRESS);
+		}
+		sync_clock_(lane);
+		T value = lanes_[lane]->load_<T>(address);
+		states_.deadline[lane] = interconnect.scheduler().next();
+		return value;
+	}
+
+	template <typename T>
+	void LockstepBatch::store_(usize lane, u32 address, T value)
+	{
+		Interconnect& interconnect = lanes_[lane]->interconnect_;
+		u32 physical = interconnect.mask_region(address);
+		if (physical % sizeof(T) == 0 && DEVICE_MAP(physical, RAM_START_ADDRESS, RAM_END_ADDRESS))
+		{
+			stats_[lane]->count(StatsRegion::Ram);
+			rams_[lane]->store<T>(physical - RAM_START_ADDRESS, value);
+			return;
+		}
+		sync_clock_(lane);
+		lanes_[lane]->store_<T>(address, value);
+		states_.deadline[lane] = interconnect.scheduler().next();
+	}
+
+	// Prefetch of the group, from the first lane for lanes at the same
+	// address of code they share
+	void LockstepBatch::fetch_group_(u32 group, usize first)
+	{
+		Core& leader = *lanes_[first];
+		u32 pc = states_.pc[first];
+		u32 word = leader.fetch_(pc);
+		u32 physical = leader.interconnect_.mask_region(pc);
+		bool ram = DEVICE_MAP(physical, RAM_START_ADDRESS, RAM_END_ADDRESS);
+		bool bios = DEVICE_MAP(physical, BIOS_START_ADDRESS, BIOS_END_ADDRESS);
+		u32 page = (physical - RAM_START_ADDRESS) >> RAM_PAGE_SHIFT;
+
+		for (usize lane = first; lane < n_lanes_; lane++)
+		{
+			if ((group & (1u << lane)) == 0)
+			{
+				continue;
+			}
+			states_.next_pc[lane] = states_.pc[lane];
+			if (lane == first)
+			{
+				states_.next_word[lane] = word;
+			}
+			else if (states_.pc[lane] == pc && ram && rams_[lane]->shares_page(*rams_[first], page))
+			{
+				states_.next_word[lane] = word;
+				stats_[lane]->count(StatsRegion::Ram);
+			}
+			else if (states_.pc[lane] == pc && bios && lanes_[lane]->interconnect_.bios().shares_image(leader.interconnect_.bios()))
+			{
+				states_.next_word[lane] = word;
+				stats_[lane]->count(StatsRegion::Bios);
+			}
+			else
+			{
+				states_.next_word[lane] = lanes_[lane]->fetch_(states_.pc[lane]);
+			}
+			states_.pc[lane] += INSTR_LENGTH;
+		}
+	}
+
+	// Core::step_ for every lane of the group, which all run the same instruction at pc
+	void LockstepBatch::step_group_(u32 group, usize first, u32 pc, Instruction instruction)
+	{
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			mask_[lane] = ((group & (1u << lane)) != 0) ? 0xffffffff : 0;
+		}
+		// Prefetch first, a store of the instruction can't change it
+		fetch_group_(group, first);
+
+		u32 s = instruction.s().value;
+		u32 t = instruction.t().value;
+		u32 d = instruction.d().value;
+		u32 immediate = instruction.immediate();
+		u32 signed_immediate = instruction.signed_immediate();
+		const u32* rs = states_.regs[s];
+		const u32* rt = states_.regs[t];
+		u32 dst = 0;
+		u32 load_reg = 0;
+		u32 loaded[LOCKSTEP_MAX_LANES] = {};
+
+		// Every operand is read before any register changes
+		switch (instruction.function())
+		{
+		case Core::ins_lui_:
+			// x | x copies a row
+			broadcast_(immediate << 16);
+			alu_<LaneOr>(operand_, operand_);
+			dst = t;
+			break;
+		case Core::ins_ori_:
+			broadcast_(immediate);
+			alu_<LaneOr>(rs, operand_);
+			dst = t;
+			break;
+		case Core::ins_andi_:
+			broadcast_(immediate);
+			alu_<LaneAnd>(rs, operand_);
+			dst = t;
+			break;
+		case Core::ins_addiu_:
+			broadcast_(signed_immediate);
+			alu_<LaneAdd>(rs, operand_);
+			dst = t;
+			break;
+		case Core::ins_slti_:
+			broadcast_(signed_immediate);
+			alu_<LaneSlt>(rs, operand_);
+			dst = t;
+			break;
+		case Core::ins_sltiu_:
+			broadcast_(signed_immediate);
+			alu_<LaneSltu>(rs, operand_);
+			dst = t;
+			break;
+		case Core::ins_j_:
+		case Core::ins_jal_:
+			for (usize lane = 0; lane < n_lanes_; lane++)
+			{
+				if (mask_[lane] != 0)
+				{
+					result_[lane] = states_.pc[lane];
+					jump_(lane, (states_.pc[lane] & 0xf0000000) | (instruction.imm_jump() << 2));
+				}
+			}
+			dst = (instruction.function() == Core::ins_jal_) ? 31 : 0;
+			break;
+		case Core::ins_beq_:
+		case Core::ins_bne_:
+		case Core::ins_bgtz_:
+		case Core::ins_blez_:
+			for (usize lane = 0; lane < n_lanes_; lane++)
+			{
+				if (mask_[lane] == 0)
+				{
+					continue;
+				}
+				bool taken;
+				switch (instruction.function())
+				{
+				case Core::ins_beq_:
+					taken = rs[lane] == rt[lane];
+					break;
+				case Core::ins_bne_:
+					taken = rs[lane] != rt[lane];
+					break;
+				case Core::ins_bgtz_:
+					taken = static_cast<s32>(rs[lane]) > 0;
+					break;
+				default:
+					taken = static_cast<s32>(rs[lane]) <= 0;
+					break;
+				}
+				if (taken)
+				{
+					jump_(lane, states_.pc[lane] + (signed_immediate << 2) - INSTR_LENGTH);
+				}
+			}
+			break;
+		case Core::ins_lw_:
+		case Core::ins_lb_:
+		case Core::ins_lbu_:
+			for (usize lane = 0; lane < n_lanes_; lane++)
+			{
+				if (mask_[lane] == 0)
+				{
+					continue;
+				}
+				u32 address = rs[lane] + signed_immediate;
+				switch (instruction.function())
+				{
+				case Core::ins_lw_:
+					loaded[lane] = load_<u32>(lane, address);
+					break;
+				case Core::ins_lb_:
+					loaded[lane] = static_cast<u32>(static_cast<s8>(load_<u8>(lane, address)));
+					break;
+				default:
+					loaded[lane] = load_<u8>(lane, address);
+					break;
+				}
+			}
+			load_reg = t;
+			break;
+		case Core::ins_sw_:
+		case Core::ins_sh_:
+		case Core::ins_sb_:
+			for (usize lane = 0; lane < n_lanes_; lane++)
+			{
+				if (mask_[lane] == 0)
+				{
+					continue;
+				}
+				u32 address = rs[lane] + signed_immediate;
+				switch (instruction.function())
+				{
+				case Core::ins_sw_:
+					store_<u32>(lane, address, rt[lane]);
+					break;
+				case Core::ins_sh_:
+					store_<u16>(lane, address, static_cast<u16>(rt[lane]));
+					break;
+				default:
+					store_<u8>(lane, address, static_cast<u8>(rt[lane]));
+					break;
+				}
+			}
+			break;
+		default:
+			switch (instruction.subfuction())
+			{
+			case Core::ins_sll_:
+				broadcast_(instruction.shift());
+				alu_<LaneSll>(rt, operand_);
+				break;
+			case Core::ins_srl_:
+				broadcast_(instruction.shift());
+				alu_<LaneSrl>(rt, operand_);
+				break;
+			case Core::ins_sra_:
+				broadcast_(instruction.shift());
+				alu_<LaneSra>(rt, operand_);
+				break;
+			case Core::ins_jr_:
+			case Core::ins_jalr_:
+				for (usize lane = 0; lane < n_lanes_; lane++)
+				{
+					if (mask_[lane] != 0)
+					{
+						result_[lane] = states_.pc[lane];
+						jump_(lane, rs[lane]);
+					}
+				}
+				break;
+			case Core::ins_mfhi_:
+				alu_<LaneOr>(states_.hi, states_.hi);
+				break;
+			case Core::ins_mflo_:
+				alu_<LaneOr>(states_.lo, states_.lo);
+				break;
+			case Core::ins_addu_:
+				alu_<LaneAdd>(rs, rt);
+				break;
+			case Core::ins_subu_:
+				alu_<LaneSub>(rs, rt);
+				break;
+			case Core::ins_and_:
+				alu_<LaneAnd>(rs, rt);
+				break;
+			case Core::ins_or_:
+				alu_<LaneOr>(rs, rt);
+				break;
+			case Core::ins_slt_:
+				alu_<LaneSlt>(rs, rt);
+				break;
+			default:
+				alu_<LaneSltu>(rs, rt);
+				break;
+			}
+			dst = (instruction.subfuction() == Core::ins_jr_) ? 0 : d;
+			break;
+		}
+
+		// Then the pending loads land, the result of the instruction and
+		// its own load a step later
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			if (mask_[lane] == 0)
+			{
+				continue;
+			}
+			if (states_.load_reg[lane] != 0)
+			{
+				states_.regs[states_.load_reg[lane]][lane] = states_.load_value[lane];
+			}
+			states_.load_reg[lane] = load_reg;
+			states_.load_value[lane] = loaded[lane];
+		}
+		if (dst != 0)
+		{
+			write_(group, dst, result_);
+		}
+
+		for (usize lane = 0; lane < n_lanes_; lane++)
+		{
+			if (mask_[lane] == 0)
+			{
+				continue;
+			}
+			states_.cycles[lane] += CYCLES_PER_INSTRUCTION;
+			states_.instructions[lane]++;
+			if (states_.cycles[lane] >= states_.deadline[lane])
+			{
+				run_events_(lane, pc);
+			}
+		}
+	}
+
+	// Core::jump_, the edge goes to the coverage of the lane
+	void LockstepBatch::jump_(usize lane, u32 target)
+	{
+		EdgeCoverage* coverage = lanes_[lane]->coverage_;
+		if (coverage != nullptr)
+		{
+			coverage->record(states_.pc[lane], target);
+		}
+		states_.pc[lane] = target;
+	}
+
+	// The end of Core::step_, for a lane with an event due
+	void LockstepBatch::run_events_(usize lane, u32 pc)
+	{
+		Core& core = *lanes_[lane];
+		core.state_.cycles = states_.cycles[lane];
+		if (core.interconnect_.advance(states_.cycles[lane]))
+		{
+			// The profiler samples the registers of the core
+			store_lane_(lane);
+			core.run_cpu_events_(pc);
+		}
+		states_.deadline[lane] = core.interconnect_.scheduler().next();
+	}
+
+	usize LockstepBatch::n_lanes() const
+	{
+		return n_lanes_;
+	}
+
+	u32 LockstepBatch::n_groups() const
+	{
+		return n_groups_;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "cpu_core.h"
+#include <vector>
+
+#define LOCKSTEP_MAX_LANES 16
+#define LOCKSTEP_VECTOR_LANES 8		// 32 bit lanes of an AVX2 register
+
+#define LANE_INTERCEPTS 0x1			// pending sideloaded EXE or HLE calls
+#define LANE_ISOLATED 0x2			// cache isolated, memory accesses run on the core
+#define LANE_WATCHED 0x4			// RAM watched by a debugger, every step runs on the core
+
+namespace CPU
+{
+	// CPU::State of every lane as structure of arrays: one row per register,
+	// one column per lane, so an instruction runs on a whole row at once
+	struct LaneStates
+	{
+		alignas(32) u32 regs[N_GP_REG][LOCKSTEP_MAX_LANES];
+		alignas(32) u32 hi[LOCKSTEP_MAX_LANES];
+		alignas(32) u32 lo[LOCKSTEP_MAX_LANES];
+		u32 pc[LOCKSTEP_MAX_LANES];				// fetch address
+		u32 next_pc[LOCKSTEP_MAX_LANES];		// address of the prefetched instruction
+		u32 next_word[LOCKSTEP_MAX_LANES];		// prefetched instruction
+		u32 load_reg[LOCKSTEP_MAX_LANES];		// pending load delay slot
+		u32 load_value[LOCKSTEP_MAX_LANES];
+		u64 cycles[LOCKSTEP_MAX_LANES];			// ahead of the core's until written back
+		u64 deadline[LOCKSTEP_MAX_LANES];		// earliest event of the lane's scheduler
+		u32 instructions[LOCKSTEP_MAX_LANES];	// run since the last write back
+		u32 flags[LOCKSTEP_MAX_LANES];			// LANE_ flags
+	};
+
+	// Runs several guests that execute the same code, typically one BIOS or
+	// EXE with different inputs. Every step, lanes about to run the same
+	// instruction are grouped and ALU ops and branches of a group run on all
+	// its lanes at once, with a lane mask. Loads and stores go to the memory
+	// of each lane. Lanes leave a group when their branches or loaded values
+	// take them elsewhere, and join again when their pcs meet.
+	//
+	// Each lane is a full Core that keeps its devices, cycle count and
+	// counters. Instructions without a lane parallel implementation (COP0,
+	// GTE, trapping arithmetic, divisions) and HLE calls run a normal step on
+	// the lane's core, so every lane ends in the state the interpreter would
+	// have reached. So do all the steps of lanes whose RAM is watched.
+	//
+	// A group fetches its next instruction once when its lanes share the code
+	// page: the BIOS image, or a RAM page none of them wrote since their
+	// common base. The batch gives lanes of identical RAM one base when it is
+	// created. Cycles are counted by the batch and the scheduler of a lane
+	// only runs when its earliest event is due or a load or store reaches
+	// the lane's devices.
+	class LockstepBatch
+	{
+	private:
+		std::vector<Core*> lanes_;
+		usize n_lanes_;
+		Ram* rams_[LOCKSTEP_MAX_LANES];
+		Stats* stats_[LOCKSTEP_MAX_LANES];
+		LaneStates states_;
+		alignas(32) u32 operand_[LOCKSTEP_MAX_LANES];		// broadcast immediates
+		alignas(32) u32 result_[LOCKSTEP_MAX_LANES];
+		alignas(32) u32 mask_[LOCKSTEP_MAX_LANES];			// all ones for lanes of the group
+		u32 n_groups_;
+
+		void load_lane_(usize lane);
+		void store_lane_(usize lane);
+		bool needs_core_(usize lane) const;
+		void run_on_core_(usize lane);
+		bool parallel_(u32 group, Instruction instruction) const;
+		void step_group_(u32 group, usize first, u32 pc, Instruction instruction);
+		template <typename Op>
+		void alu_(const u32* a, const u32* b);
+		void broadcast_(u32 value);
+		void write_(u32 group, u32 dst, const u32* values);
+		template <typename T>
+		T load_(usize lane, u32 address);
+		template <typename T>
+		void store_(usize lane, u32 address, T value);
+		void fetch_group_(u32 group, usize first);
+		void jump_(usize lane, u32 target);
+		void sync_clock_(usize lane);
+		void run_events_(usize lane, u32 pc);
+
+	public:
+		// The cores must outlive the batch. Cores whose RAM matches the
+		// first lane's take its base, see Ram::share_base().
+		explicit LockstepBatch(const std::vector<Core*>& lanes);
+		LockstepBatch(const LockstepBatch&) = delete;
+		LockstepBatch& operator=(const LockstepBatch&) = delete;
+
+		// Runs steps instructions on every lane
+		void run(u32 steps);
+		usize n_lanes() const;
+		// Groups of the last step, 1 while every lane runs the same code
+		u32 n_groups() const;
+	};
+}
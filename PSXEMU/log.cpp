@@ -0,0 +1,395 @@
+#include "log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#define LOG_WRITER_IDLE std::chrono::milliseconds(1)
+
+std::atomic<u8> log_levels[static_cast<u32>(LogSubsystem::Count)] = {
+	{ 2 }, { 2 }, { 2 }, { 2 }, { 2 }, { 2 }, { 2 }, { 2 }
+};
+static_assert(static_cast<u32>(LogSubsystem::Count) == 8, "initialize log_levels for every subsystem");
+
+static void write_stderr(const LogRecord& record, const std::string& text)
+{
+	std::string line = std::string("[") + log_name(record.level) + "] " + log_name(record.subsystem) + ": " + text + "\n";
+	fwrite(line.data(), 1, line.size(), stderr);
+}
+
+// Bounded multi producer queue after Dmitry Vyukov's: a cell is free for
+// the producer at position p when its sequence is p, and holds a record
+// for the consumer when it is p + 1. The writer thread is the only consumer.
+class Logger
+{
+private:
+	struct Cell
+	{
+		std::atomic<u64> sequence;
+		LogRecord record;
+	};
+	Cell cells_[LOG_QUEUE_SIZE];
+	std::atomic<u64> enqueue_pos_;
+	std::atomic<u64> dequeue_pos_;
+	std::atomic<u64> written_;			// records dequeued and through the sink
+	std::atomic<u64> dropped_;
+	std::atomic<bool> synchronous_;
+	std::mutex sink_mutex_;				// held while writing a record
+	LogSink sink_;
+	std::thread writer_;
+
+	bool pop_(LogRecord& record)
+	{
+		u64 pos = dequeue_pos_.load(std::memory_order_relaxed);
+		Cell& cell = cells_[pos & (LOG_QUEUE_SIZE - 1)];
+		if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+		{
+			return false;
+		}
+		record = cell.record;
+		cell.sequence.store(pos + LOG_QUEUE_SIZE, std::memory_order_release);
+		dequeue_pos_.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	void run_writer_()
+	{
+		u64 reported_drops = 0;
+		while (true)
+		{
+			LogRecord record;
+			bool idle = true;
+			while (pop_(record))
+			{
+				write(record);
+				written_.fetch_add(1, std::memory_order_release);
+				idle = false;
+			}
+			u64 drops = dropped_.load(std::memory_order_relaxed);
+			if (drops != reported_drops)
+			{
+				LogRecord note = {};
+				note.level = LogLevel::Warn;
+				note.subsystem = LogSubsystem::Host;
+				note.format = "{d} log messages dropped, queue full";
+				note.args[0] = LogArg(drops - reported_drops);
+				note.n_args = 1;
+				write(note);
+				reported_drops = drops;
+			}
+			if (idle)
+			{
+				std::this_thread::sleep_for(LOG_WRITER_IDLE);
+			}
+		}
+	}
+
+public:
+	Logger() :
+		enqueue_pos_(0),
+		dequeue_pos_(0),
+		written_(0),
+		dropped_(0),
+		synchronous_(false),
+		sink_(write_stderr)
+	{
+		for (u64 i = 0; i < LOG_QUEUE_SIZE; i++)
+		{
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		writer_ = std::thread(&Logger::run_writer_, this);
+		writer_.detach();
+	}
+
+	void push(const LogRecord& record)
+	{
+		if (synchronous_.load(std::memory_order_relaxed))
+		{
+			sink_(record, log_format(record));
+			return;
+		}
+		u64 pos = enqueue_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true)
+		{
+			cell = &cells_[pos & (LOG_QUEUE_SIZE - 1)];
+			u64 sequence = cell->sequence.load(std::memory_order_acquire);
+			s64 diff = static_cast<s64>(sequence - pos);
+			if (diff == 0)
+			{
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			else
+			{
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+		cell->record = record;
+		cell->sequence.store(pos + 1, std::memory_order_release);
+	}
+
+	void write(const LogRecord& record)
+	{
+		std::string text = log_format(record);
+		std::lock_guard<std::mutex> lock(sink_mutex_);
+		sink_(record, text);
+	}
+
+	void flush()
+	{
+		if (synchronous_.load(std::memory_order_relaxed))
+		{
+			return;
+		}
+		u64 end = enqueue_pos_.load(std::memory_order_acquire);
+		while (written_.load(std::memory_order_acquire) < end)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void set_sink(LogSink sink)
+	{
+		std::lock_guard<std::mutex> lock(sink_mutex_);
+		sink_ = sink ? sink : LogSink(write_stderr);
+	}
+
+	void set_synchronous(bool synchronous)
+	{
+		synchronous_.store(synchronous, std::memory_order_relaxed);
+	}
+
+	u64 dropped() const
+	{
+		return dropped_.load(std::memory_order_relaxed);
+	}
+};
+
+static std::terminate_handler previous_terminate = nullptr;
+
+static void flush_and_terminate()
+{
+	log_flush();
+	if (previous_terminate != nullptr)
+	{
+		previous_terminate();
+	}
+	std::abort();
+}
+
+static void flush_at_exit()
+{
+	log_flush();
+}
+
+// Never destroyed: code running at exit may still log. Queued records are
+// written before the process ends normally or through std::terminate.
+static Logger& logger()
+{
+	static Logger* instance = []()
+	{
+		Logger* logger = new Logger();
+		previous_terminate = std::set_terminate(flush_and_terminate);
+		std::atexit(flush_at_exit);
+		return logger;
+	}();
+	return *instance;
+}
+
+void log_push(LogSite& site, LogLevel level, LogSubsystem subsystem, const char* format,
+	const LogArg* args, u32 n_args)
+{
+	u64 count = site.count.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (count > LOG_BURST && (count & (count - 1)) != 0)
+	{
+		return;
+	}
+	LogRecord record;
+	record.level = level;
+	record.subsystem = subsystem;
+	record.format = format;
+	record.n_args = n_args;
+	for (u32 i = 0; i < n_args; i++)
+	{
+		record.args[i] = args[i];
+	}
+	record.suppressed = (count > LOG_BURST) ? count / 2 - 1 : 0;
+	logger().push(record);
+}
+
+void log_set_level(LogLevel level)
+{
+	for (std::atomic<u8>& subsystem_level : log_levels)
+	{
+		subsystem_level.store(static_cast<u8>(level), std::memory_order_relaxed);
+	}
+}
+
+void log_set_level(LogSubsystem subsystem, LogLevel level)
+{
+	log_levels[static_cast<u32>(subsystem)].store(static_cast<u8>(level), std::memory_order_relaxed);
+}
+
+static bool parse_level(const std::string& name, LogLevel& level)
+{
+	for (u32 i = 0; i <= static_cast<u32>(LogLevel::Off); i++)
+	{
+		if (name == log_name(static_cast<LogLevel>(i)))
+		{
+			level = static_cast<LogLevel>(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool log_configure(const std::string& spec)
+{
+	std::istringstream items(spec);
+	std::string item;
+	while (std::getline(items, item, ','))
+	{
+		usize equals = item.find('=');
+		LogLevel level;
+		if (equals == std::string::npos)
+		{
+			if (!parse_level(item, level))
+			{
+				return false;
+			}
+			log_set_level(level);
+			continue;
+		}
+		std::string name = item.substr(0, equals);
+		if (!parse_level(item.substr(equals + 1), level))
+		{
+			return false;
+		}
+		bool found = false;
+		for (u32 i = 0; i < static_cast<u32>(LogSubsystem::Count); i++)
+		{
+			if (name == log_name(static_cast<LogSubsystem>(i)))
+			{
+				log_set_level(static_cast<LogSubsystem>(i), level);
+				found = true;
+			}
+		}
+		if (!found)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void log_set_sink(LogSink sink)
+{
+	logger().set_sink(sink);
+}
+
+void log_set_synchronous(bool synchronous)
+{
+	logger().set_synchronous(synchronous);
+}
+
+void log_flush()
+{
+	logger().flush();
+}
+
+u64 log_dropped()
+{
+	return logger().dropped();
+}
+
+std::string log_format(const LogRecord& record)
+{
+	std::ostringstream text;
+	u32 arg = 0;
+	for (const char* c = record.format; *c != '\0'; c++)
+	{
+		bool hex = (c[0] == '{' && c[1] == '}');
+		bool dec = (c[0] == '{' && c[1] == 'd' && c[2] == '}');
+		if ((!hex && !dec) || arg >= record.n_args)
+		{
+			text << *c;
+			continue;
+		}
+		const LogArg& value = record.args[arg++];
+		if (value.text != nullptr)
+		{
+			text << value.text;
+		}
+		else if (hex)
+		{
+			text << std::hex << value.value;
+		}
+		else if (value.is_signed)
+		{
+			text << std::dec << static_cast<s64>(value.value);
+		}
+		else
+		{
+			text << std::dec << value.value;
+		}
+		c += hex ? 1 : 2;
+	}
+	if (record.suppressed != 0)
+	{
+		text << std::dec << " (" << record.suppressed << " more not shown)";
+	}
+	return text.str();
+}
+
+const char* log_name(LogLevel level)
+{
+	switch (level)
+	{
+	case LogLevel::Trace:
+		return "trace";
+	case LogLevel::Debug:
+		return "debug";
+	case LogLevel::Info:
+		return "info";
+	case LogLevel::Warn:
+		return "warn";
+	case LogLevel::Error:
+		return "error";
+	default:
+		return "off";
+	}
+}
+
+const char* log_name(LogSubsystem subsystem)
+{
+	switch (subsystem)
+	{
+	case LogSubsystem::Cpu:
+		return "cpu";
+	case LogSubsystem::Gte:
+		return "gte";
+	case LogSubsystem::Bus:
+		return "bus";
+	case LogSubsystem::Dma:
+		return "dma";
+	case LogSubsystem::Spu:
+		return "spu";
+	case LogSubsystem::Cdrom:
+		return "cdrom";
+	case LogSubsystem::Mdec:
+		return "mdec";
+	default:
+		return "host";
+	}
+}
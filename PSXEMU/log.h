@@ -0,0 +1,132 @@
+#pragma once
+#include "types.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+// Messages below this level are compiled out, 0 keeps LogLevel::Trace
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 1
+#endif
+#define LOG_MAX_ARGS 4
+#define LOG_QUEUE_SIZE 4096			// records, a power of two
+#define LOG_BURST 8					// messages of a call site always written, then 16, 32, 64...
+
+enum class LogLevel : u8
+{
+	Trace,
+	Debug,
+	Info,
+	Warn,
+	Error,
+	Off
+};
+
+enum class LogSubsystem : u8
+{
+	Cpu,
+	Gte,
+	Bus,			// interconnect and the registers it handles itself
+	Dma,
+	Spu,
+	Cdrom,
+	Mdec,
+	Host,			// tools and loaders
+	Count
+};
+
+// Message argument. Numbers are printed in hex for {} and in decimal for
+// {d}. Strings are kept as pointers until written: pass literals.
+struct LogArg
+{
+	u64 value;
+	const char* text;
+	bool is_signed;
+
+	LogArg() :
+		value(0), text(nullptr), is_signed(false) {}
+	LogArg(const char* text) :
+		value(0), text(text), is_signed(false) {}
+	template <typename T, typename = typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type>
+	LogArg(T value) :
+		value(static_cast<u64>(value)), text(nullptr), is_signed(std::is_signed<T>::value) {}
+};
+
+struct LogRecord
+{
+	LogLevel level;
+	LogSubsystem subsystem;
+	u32 n_args;
+	const char* format;				// literal with {} / {d} placeholders
+	LogArg args[LOG_MAX_ARGS];
+	u64 suppressed;					// messages of the call site not written since the last one
+};
+
+// Rate limit state of one call site
+struct LogSite
+{
+	std::atomic<u64> count{ 0 };
+};
+
+extern std::atomic<u8> log_levels[static_cast<u32>(LogSubsystem::Count)];
+
+inline bool log_enabled(LogLevel level, LogSubsystem subsystem)
+{
+	return static_cast<u8>(level) >= log_levels[static_cast<u32>(subsystem)].load(std::memory_order_relaxed);
+}
+
+// Queues the record for the writer thread, or drops it when the queue is full
+void log_push(LogSite& site, LogLevel level, LogSubsystem subsystem, const char* format,
+	const LogArg* args, u32 n_args);
+
+inline void log_write(LogSite& site, LogLevel level, LogSubsystem subsystem, const char* format)
+{
+	log_push(site, level, subsystem, format, nullptr, 0);
+}
+
+template <typename... Args>
+void log_write(LogSite& site, LogLevel level, LogSubsystem subsystem, const char* format, Args... args)
+{
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+	const LogArg packed[] = { LogArg(args)... };
+	log_push(site, level, subsystem, format, packed, sizeof...(Args));
+}
+
+// Formatting happens on the writer thread: a message costs a filter check
+// and, unless rate limited, a copy into a lock-free queue
+#define LOG_AT(level, subsystem, ...) \
+	do \
+	{ \
+		if (static_cast<int>(level) >= LOG_COMPILED_LEVEL && log_enabled(level, subsystem)) \
+		{ \
+			static LogSite log_site_; \
+			log_write(log_site_, level, subsystem, __VA_ARGS__); \
+		} \
+	} while (0)
+#define LOG_TRACE(subsystem, ...) LOG_AT(LogLevel::Trace, LogSubsystem::subsystem, __VA_ARGS__)
+#define LOG_DEBUG(subsystem, ...) LOG_AT(LogLevel::Debug, LogSubsystem::subsystem, __VA_ARGS__)
+#define LOG_INFO(subsystem, ...) LOG_AT(LogLevel::Info, LogSubsystem::subsystem, __VA_ARGS__)
+#define LOG_WARN(subsystem, ...) LOG_AT(LogLevel::Warn, LogSubsystem::subsystem, __VA_ARGS__)
+#define LOG_ERROR(subsystem, ...) LOG_AT(LogLevel::Error, LogSubsystem::subsystem, __VA_ARGS__)
+
+// Receives every written record with its text, on the writer thread
+using LogSink = std::function<void(const LogRecord& record, const std::string& text)>;
+
+// Minimum level written, for every subsystem or a single one
+void log_set_level(LogLevel level);
+void log_set_level(LogSubsystem subsystem, LogLevel level);
+// "warn", or "cpu=debug,bus=off" style lists; false on unknown names
+bool log_configure(const std::string& spec);
+// nullptr restores the default: "[warn] bus: text" lines on stderr
+void log_set_sink(LogSink sink);
+// Writes records on the calling thread instead, without locking: for a
+// fork()ed child, where only the forking thread exists
+void log_set_synchronous(bool synchronous);
+// Waits until everything queued so far is written
+void log_flush();
+// Records lost to a full queue
+u64 log_dropped();
+std::string log_format(const LogRecord& record);
+const char* log_name(LogLevel level);
+const char* log_name(LogSubsystem subsystem);
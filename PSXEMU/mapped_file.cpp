@@ -0,0 +1,120 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() :
+	data_(nullptr),
+	size_(0)
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL)
+	{
+		return false;
+	}
+
+	// The view keeps the mapping alive
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data == NULL)
+	{
+		return false;
+	}
+
+	data_ = static_cast<const u8*>(data);
+	size_ = static_cast<usize>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_ != nullptr)
+	{
+		UnmapViewOfFile(data_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	// The mapping keeps the file alive
+	void* data = mmap(nullptr, static_cast<usize>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	// Discs are mostly read front to back
+	madvise(data, static_cast<usize>(st.st_size), MADV_SEQUENTIAL);
+
+	data_ = static_cast<const u8*>(data);
+	size_ = static_cast<usize>(st.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_ != nullptr)
+	{
+		munmap(const_cast<u8*>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+
+#endif
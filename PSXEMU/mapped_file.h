@@ -0,0 +1,32 @@
+#pragma once
+#include "types.h"
+#include <string>
+
+// Read only view of a whole file. Pages are loaded on demand and shared
+// through the OS page cache between every emulator instance mapping the
+// same file.
+class MappedFile
+{
+private:
+	const u8* data_;
+	usize size_;
+
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	const u8* data() const
+	{
+		return data_;
+	}
+
+	usize size() const
+	{
+		return size_;
+	}
+};
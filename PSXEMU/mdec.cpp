@@ -0,0 +1,513 @@
+#include "mdec.h"
+#include "log.h"
+#include "hash.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Raster position of the k-th coefficient of the zigzag scan
+static const u8 ZIGZAG_TO_RASTER[MDEC_BLOCK_SIZE] =
+{
+	0, 1, 8, 16, 9, 2, 3, 10,
+	17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// YUV to RGB factors in 1/1024 units: 1.402, -0.3437, -0.7143, 1.772
+static const s32
+	CR_TO_R = 1436,
+	CB_TO_G = -352,
+	CR_TO_G = -731,
+	CB_TO_B = 1815;
+
+static s32 signed10(u16 value)
+{
+	return static_cast<s32>(static_cast<u32>(value) << 22) >> 22;
+}
+
+static s32 clamp(s32 value, s32 min, s32 max)
+{
+	return (value < min) ? min : ((value > max) ? max : value);
+}
+
+Mdec::Mdec() :
+	command_(0),
+	remaining_(0),
+	depth_(MdecDepth::Bits4),
+	signed_(false),
+	set_bit15_(false),
+	output_index_(0),
+	dma_in_enable_(false),
+	dma_out_enable_(false)
+{
+	memset(luma_quant_, 0, sizeof(luma_quant_));
+	memset(color_quant_, 0, sizeof(color_quant_));
+	memset(scale_table_, 0, sizeof(scale_table_));
+}
+
+u32 Mdec::load32(u32 offset)
+{
+	if (offset == 0)
+	{
+		return dma_read();
+	}
+
+	// Status register
+	bool output_empty = output_index_ >= output_.size();
+	u32 status = 0;
+	status |= output_empty ? (1u << 31) : 0;
+	status |= (remaining_ > 0 || !output_empty) ? (1u << 29) : 0;
+	status |= (dma_in_enable_ && remaining_ > 0) ? (1u << 28) : 0;
+	status |= (dma_out_enable_ && !output_empty) ? (1u << 27) : 0;
+	status |= static_cast<u32>(depth_) << 25;
+	status |= signed_ ? (1u << 24) : 0;
+	status |= set_bit15_ ? (1u << 23) : 0;
+	status |= 4u << 16;					// current block: the whole macroblock is decoded at once
+	status |= (remaining_ - 1) & 0xffff;
+	return status;
+}
+
+void Mdec::store32(u32 offset, u32 value)
+{
+	if (offset == 0)
+	{
+		dma_write(value);
+		return;
+	}
+
+	// Control register
+	if (value & (1u << 31))
+	{
+		command_ = 0;
+		remaining_ = 0;
+		input_.clear();
+		output_.clear();
+		output_index_ = 0;
+		depth_ = MdecDepth::Bits4;
+		signed_ = false;
+		set_bit15_ = false;
+	}
+	dma_in_enable_ = (value & (1u << 30)) != 0;
+	dma_out_enable_ = (value & (1u << 29)) != 0;
+}
+
+void Mdec::dma_write(u32 value)
+{
+	if (remaining_ > 0)
+	{
+		input_.push_back(value);
+		remaining_--;
+		if (remaining_ == 0)
+		{
+			finish_command_();
+		}
+		return;
+	}
+
+	command_ = value >> 29;
+	input_.clear();
+	switch (command_)
+	{
+	case 1:
+		// Decode macroblocks
+		depth_ = static_cast<MdecDepth>((value >> 27) & 0x3);
+		signed_ = (value & (1u << 26)) != 0;
+		set_bit15_ = (value & (1u << 25)) != 0;
+		remaining_ = value & 0xffff;
+		output_.clear();
+		output_index_ = 0;
+		break;
+	case 2:
+		// Quantization tables: luma, and color when bit 0 is set
+		remaining_ = (value & 0x1) ? 32 : 16;
+		break;
+	case 3:
+		// IDCT scale table
+		remaining_ = 32;
+		break;
+	default:
+		LOG_WARN(Mdec, "Unhandled MDEC command: {}", value);
+		remaining_ = 0;
+		break;
+	}
+}
+
+u32 Mdec::dma_read()
+{
+	if (output_index_ >= output_.size())
+	{
+		return 0;
+	}
+	return output_[output_index_++];
+}
+
+usize Mdec::output_available() const
+{
+	return output_.size() - output_index_;
+}
+
+u64 Mdec::hash(u64 seed) const
+{
+	u64 hash = fnv1a_value(seed, command_);
+	hash = fnv1a_value(hash, remaining_);
+	hash = fnv1a(hash, input_.data(), input_.size() * sizeof(u32));
+	hash = fnv1a_value(hash, depth_);
+	hash = fnv1a_value(hash, signed_);
+	hash = fnv1a_value(hash, set_bit15_);
+	// Only the output not read yet
+	hash = fnv1a(hash, output_.data() + output_index_, (output_.size() - output_index_) * sizeof(u32));
+	hash = fnv1a_value(hash, dma_in_enable_);
+	hash = fnv1a_value(hash, dma_out_enable_);
+	hash = fnv1a(hash, luma_quant_, sizeof(luma_quant_));
+	return fnv1a(hash, color_quant_, sizeof(color_quant_));
+}
+
+void Mdec::finish_command_()
+{
+	switch (command_)
+	{
+	case 1:
+		decode_();
+		break;
+	case 2:
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			luma_quant_[i] = static_cast<u8>(input_[i / 4] >> ((i % 4) * 8));
+			if (input_.size() == 32)
+			{
+				color_quant_[i] = static_cast<u8>(input_[16 + i / 4] >> ((i % 4) * 8));
+			}
+		}
+		break;
+	case 3:
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			scale_table_[i] = static_cast<s16>(input_[i / 2] >> ((i % 2) * 16));
+		}
+		break;
+	default:
+		break;
+	}
+	input_.clear();
+}
+
+// Decodes the parameters of a decode command, whole macroblocks at a time
+void Mdec::decode_()
+{
+	std::vector<u16> stream(input_.size() * 2);
+	for (usize i = 0; i < input_.size(); i++)
+	{
+		stream[2 * i + 0] = static_cast<u16>(input_[i]);
+		stream[2 * i + 1] = static_cast<u16>(input_[i] >> 16);
+	}
+
+	const u16* src = stream.data();
+	const u16* end = src + stream.size();
+	bool colored = (depth_ == MdecDepth::Bits24) || (depth_ == MdecDepth::Bits15);
+
+	while (src != nullptr && src < end)
+	{
+		if (colored)
+		{
+			MdecBlock cr;
+			MdecBlock cb;
+			MdecBlock y[4];
+			src = decode_block_(src, end, color_quant_, cr);
+			src = decode_block_(src, end, color_quant_, cb);
+			for (u32 i = 0; i < 4; i++)
+			{
+				src = decode_block_(src, end, luma_quant_, y[i]);
+			}
+			if (src != nullptr)
+			{
+				output_colored_(cr, cb, y);
+			}
+		}
+		else
+		{
+			MdecBlock y;
+			src = decode_block_(src, end, luma_quant_, y);
+			if (src != nullptr)
+			{
+				output_monochrome_(y);
+			}
+		}
+	}
+}
+
+// Run length decoding and dequantization of one block, followed by the IDCT.
+// Returns the position after the block, nullptr if the stream ends first.
+const u16* Mdec::decode_block_(const u16* src, const u16* end, const u8* quant, MdecBlock& block)
+{
+	if (src == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Padding between blocks
+	while (src < end && *src == 0xfe00)
+	{
+		src++;
+	}
+	if (src >= end)
+	{
+		return nullptr;
+	}
+
+	MdecBlock coefficients;
+	memset(coefficients.value, 0, sizeof(coefficients.value));
+
+	u16 n = *src++;
+	u32 k = 0;
+	s32 q_scale = (n >> 10) & 0x3f;
+	s32 value = signed10(n) * quant[0];
+	for (;;)
+	{
+		if (q_scale == 0)
+		{
+			value = signed10(n) * 2;
+		}
+		value = clamp(value, -0x400, 0x3ff);
+		coefficients.value[(q_scale > 0) ? ZIGZAG_TO_RASTER[k] : k] = value;
+
+		if (src >= end)
+		{
+			return nullptr;
+		}
+		n = *src++;
+		k += ((n >> 10) & 0x3f) + 1;
+		if (k > 63)
+		{
+			break;
+		}
+		value = (signed10(n) * quant[k] * q_scale + 4) / 8;
+	}
+
+	idct(coefficients, scale_table_, block);
+	return src;
+}
+
+void Mdec::output_colored_(const MdecBlock& cr, const MdecBlock& cb, const MdecBlock y[4])
+{
+	u32 rgb[MDEC_MACROBLOCK_PIXELS];
+	yuv_to_rgb(cr, cb, y, signed_, rgb);
+
+	if (depth_ == MdecDepth::Bits15)
+	{
+		u32 bit15 = set_bit15_ ? 0x8000 : 0;
+		for (u32 i = 0; i < MDEC_MACROBLOCK_PIXELS; i += 2)
+		{
+			u32 pixel[2];
+			for (u32 j = 0; j < 2; j++)
+			{
+				u32 c = rgb[i + j];
+				pixel[j] = ((c >> 3) & 0x1f) | (((c >> 11) & 0x1f) << 5) | (((c >> 19) & 0x1f) << 10) | bit15;
+			}
+			output_.push_back(pixel[0] | (pixel[1] << 16));
+		}
+		return;
+	}
+
+	// 24 bit: R, G, B bytes back to back
+	u8 bytes[MDEC_MACROBLOCK_PIXELS * 3];
+	for (u32 i = 0; i < MDEC_MACROBLOCK_PIXELS; i++)
+	{
+		bytes[3 * i + 0] = static_cast<u8>(rgb[i]);
+		bytes[3 * i + 1] = static_cast<u8>(rgb[i] >> 8);
+		bytes[3 * i + 2] = static_cast<u8>(rgb[i] >> 16);
+	}
+	for (u32 i = 0; i < sizeof(bytes); i += 4)
+	{
+		output_.push_back(bytes[i] | (bytes[i + 1] << 8) | (bytes[i + 2] << 16) | (static_cast<u32>(bytes[i + 3]) << 24));
+	}
+}
+
+void Mdec::output_monochrome_(const MdecBlock& y)
+{
+	u8 bias = signed_ ? 0 : 0x80;
+	u8 pixels[MDEC_BLOCK_SIZE];
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+	{
+		pixels[i] = static_cast<u8>(y.value[i]) ^ bias;
+	}
+
+	if (depth_ == MdecDepth::Bits8)
+	{
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i += 4)
+		{
+			output_.push_back(pixels[i] | (pixels[i + 1] << 8) | (pixels[i + 2] << 16) | (static_cast<u32>(pixels[i + 3]) << 24));
+		}
+		return;
+	}
+
+	// 4 bit: first pixel in the low nibble
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i += 8)
+	{
+		u32 word = 0;
+		for (u32 j = 0; j < 8; j++)
+		{
+			word |= static_cast<u32>(pixels[i + j] >> 4) << (j * 4);
+		}
+		output_.push_back(word);
+	}
+}
+
+// out = S^T * in * S, one 1D pass per direction, 16 fractional bits dropped per pass
+void Mdec::idct_reference(const MdecBlock& in, const s32 scale[MDEC_BLOCK_SIZE], MdecBlock& out)
+{
+	s32 tmp[MDEC_BLOCK_SIZE];
+	for (u32 y = 0; y < 8; y++)
+	{
+		for (u32 v = 0; v < 8; v++)
+		{
+			s32 sum = 0;
+			for (u32 u = 0; u < 8; u++)
+			{
+				sum += scale[u * 8 + y] * in.value[u * 8 + v];
+			}
+			tmp[y * 8 + v] = (sum + 0x8000) >> 16;
+		}
+	}
+
+	for (u32 y = 0; y < 8; y++)
+	{
+		for (u32 x = 0; x < 8; x++)
+		{
+			s32 sum = 0;
+			for (u32 v = 0; v < 8; v++)
+			{
+				sum += tmp[y * 8 + v] * scale[v * 8 + x];
+			}
+			out.value[y * 8 + x] = clamp((sum + 0x8000) >> 16, -128, 127);
+		}
+	}
+}
+
+void Mdec::idct(const MdecBlock& in, const s32 scale[MDEC_BLOCK_SIZE], MdecBlock& out)
+{
+#if defined(__AVX2__)
+	// Coefficients, scale factors and the intermediate rows all fit in 16 bits, so
+	// pairs of rows are interleaved and multiplied and summed with one vpmaddwd
+	const __m256i round = _mm256_set1_epi32(0x8000);
+	const __m256i low = _mm256_set1_epi32(0xffff);
+
+	// Row y of the first pass is the sum of the input rows weighted by column y of S
+	alignas(16) u32 tmp[MDEC_BLOCK_SIZE / 2];
+	__m256i in_pairs[4];
+	for (u32 u = 0; u < 8; u += 2)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.value + u * 8));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.value + u * 8 + 8));
+		in_pairs[u / 2] = _mm256_or_si256(_mm256_and_si256(a, low), _mm256_slli_epi32(b, 16));
+	}
+	for (u32 y = 0; y < 8; y++)
+	{
+		__m256i sum = round;
+		for (u32 u = 0; u < 8; u += 2)
+		{
+			u32 weights = (scale[u * 8 + y] & 0xffff) | (static_cast<u32>(scale[u * 8 + 8 + y]) << 16);
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_set1_epi32(weights), in_pairs[u / 2]));
+		}
+		sum = _mm256_srai_epi32(sum, 16);
+		// Eight 16 bit values in order, read back below as four pairs
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, sum), 0x08);
+		_mm_store_si128(reinterpret_cast<__m128i*>(tmp + y * 4), _mm256_castsi256_si128(packed));
+	}
+
+	// Row y of the output is the sum of the rows of S weighted by row y of tmp
+	const __m256i min = _mm256_set1_epi32(-128);
+	const __m256i max = _mm256_set1_epi32(127);
+	__m256i scale_pairs[4];
+	for (u32 v = 0; v < 8; v += 2)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(scale + v * 8));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(scale + v * 8 + 8));
+		scale_pairs[v / 2] = _mm256_or_si256(_mm256_and_si256(a, low), _mm256_slli_epi32(b, 16));
+	}
+	for (u32 y = 0; y < 8; y++)
+	{
+		__m256i sum = round;
+		for (u32 v = 0; v < 4; v++)
+		{
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_set1_epi32(tmp[y * 4 + v]), scale_pairs[v]));
+		}
+		sum = _mm256_srai_epi32(sum, 16);
+		sum = _mm256_max_epi32(_mm256_min_epi32(sum, max), min);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out.value + y * 8), sum);
+	}
+#else
+	idct_reference(in, scale, out);
+#endif
+}
+
+void Mdec::yuv_to_rgb_reference(const MdecBlock& cr, const MdecBlock& cb, const MdecBlock y[4],
+	bool is_signed, u32 rgb[MDEC_MACROBLOCK_PIXELS])
+{
+	s32 bias = is_signed ? 0 : 128;
+	for (u32 py = 0; py < 16; py++)
+	{
+		for (u32 px = 0; px < 16; px++)
+		{
+			s32 luma = y[(py / 8) * 2 + px / 8].value[(py % 8) * 8 + px % 8];
+			s32 red = cr.value[(py / 2) * 8 + px / 2];
+			s32 blue = cb.value[(py / 2) * 8 + px / 2];
+
+			s32 r = clamp(luma + ((CR_TO_R * red) >> 10), -128, 127) + bias;
+			s32 g = clamp(luma + ((CB_TO_G * blue + CR_TO_G * red) >> 10), -128, 127) + bias;
+			s32 b = clamp(luma + ((CB_TO_B * blue) >> 10), -128, 127) + bias;
+			rgb[py * 16 + px] = (r & 0xff) | ((g & 0xff) << 8) | ((b & 0xff) << 16);
+		}
+	}
+}
+
+void Mdec::yuv_to_rgb(const MdecBlock& cr, const MdecBlock& cb, const MdecBlock y[4],
+	bool is_signed, u32 rgb[MDEC_MACROBLOCK_PIXELS])
+{
+#if defined(__AVX2__)
+	const __m256i widen = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	const __m256i min = _mm256_set1_epi32(-128);
+	const __m256i max = _mm256_set1_epi32(127);
+	const __m256i bias = _mm256_set1_epi32(is_signed ? 0 : 128);
+	const __m256i byte = _mm256_set1_epi32(0xff);
+	const __m256i cr_to_r = _mm256_set1_epi32(CR_TO_R);
+	const __m256i cb_to_g = _mm256_set1_epi32(CB_TO_G);
+	const __m256i cr_to_g = _mm256_set1_epi32(CR_TO_G);
+	const __m256i cb_to_b = _mm256_set1_epi32(CB_TO_B);
+
+	for (u32 py = 0; py < 16; py++)
+	{
+		for (u32 hx = 0; hx < 2; hx++)
+		{
+			// 8 pixels share 4 chroma samples
+			u32 c = (py / 2) * 8 + hx * 4;
+			__m256i red = _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(cr.value + c))), widen);
+			__m256i blue = _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(cb.value + c))), widen);
+			__m256i luma = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+				y[(py / 8) * 2 + hx].value + (py % 8) * 8));
+
+			__m256i r = _mm256_add_epi32(luma, _mm256_srai_epi32(_mm256_mullo_epi32(red, cr_to_r), 10));
+			__m256i g = _mm256_add_epi32(luma, _mm256_srai_epi32(_mm256_add_epi32(
+				_mm256_mullo_epi32(blue, cb_to_g), _mm256_mullo_epi32(red, cr_to_g)), 10));
+			__m256i b = _mm256_add_epi32(luma, _mm256_srai_epi32(_mm256_mullo_epi32(blue, cb_to_b), 10));
+
+			r = _mm256_and_si256(_mm256_add_epi32(_mm256_max_epi32(_mm256_min_epi32(r, max), min), bias), byte);
+			g = _mm256_and_si256(_mm256_add_epi32(_mm256_max_epi32(_mm256_min_epi32(g, max), min), bias), byte);
+			b = _mm256_and_si256(_mm256_add_epi32(_mm256_max_epi32(_mm256_min_epi32(b, max), min), bias), byte);
+
+			__m256i pixels = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(rgb + py * 16 + hx * 8), pixels);
+		}
+	}
+#else
+	yuv_to_rgb_reference(cr, cb, y, is_signed, rgb);
+#endif
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "types.h"
+#include <vector>
+
+#define MDEC_BLOCK_SIZE 64
+#define MDEC_MACROBLOCK_PIXELS 256			// 16x16
+
+enum class MdecDepth
+{
+	Bits4 = 0,
+	Bits8 = 1,
+	Bits24 = 2,
+	Bits15 = 3
+};
+
+// One 8x8 block of coefficients or samples
+struct MdecBlock
+{
+	alignas(32) s32 value[MDEC_BLOCK_SIZE];
+};
+
+// Motion decoder at 0x1f801820: RLE decoding, dequantization, IDCT and
+// YUV to RGB conversion of the compressed frames of FMVs
+class Mdec
+{
+private:
+	// Command state
+	u32 command_;
+	u32 remaining_;							// parameter words still expected
+	std::vector<u32> input_;
+	MdecDepth depth_;
+	bool signed_;
+	bool set_bit15_;
+
+	std::vector<u32> output_;
+	usize output_index_;
+
+	bool dma_in_enable_;
+	bool dma_out_enable_;
+
+	u8 luma_quant_[MDEC_BLOCK_SIZE];
+	u8 color_quant_[MDEC_BLOCK_SIZE];
+	alignas(32) s32 scale_table_[MDEC_BLOCK_SIZE];
+
+	void finish_command_();
+	void decode_();
+	const u16* decode_block_(const u16* src, const u16* end, const u8* quant, MdecBlock& block);
+	void output_colored_(const MdecBlock& cr, const MdecBlock& cb, const MdecBlock y[4]);
+	void output_monochrome_(const MdecBlock& y);
+
+public:
+	Mdec();
+	u32 load32(u32 offset);
+	void store32(u32 offset, u32 value);
+	// DMA channel 0 (in) and 1 (out)
+	void dma_write(u32 value);
+	u32 dma_read();
+	usize output_available() const;
+	// Chains the state of the device onto an FNV-1a hash
+	u64 hash(u64 seed) const;
+
+	// 2D IDCT of dequantized coefficients (-0x400..0x3ff), samples clamped to signed 8 bit.
+	// Vectorized when AVX2 is available.
+	static void idct(const MdecBlock& in, const s32 scale[MDEC_BLOCK_SIZE], MdecBlock& out);
+	// Scalar reference of idct
+	static void idct_reference(const MdecBlock& in, const s32 scale[MDEC_BLOCK_SIZE], MdecBlock& out);
+	// 16x16 pixels as 0x00bbggrr from a macroblock (Y1 Y2 / Y3 Y4).
+	// Vectorized when AVX2 is available.
+	static void yuv_to_rgb(const MdecBlock& cr, const MdecBlock& cb, const MdecBlock y[4],
+		bool is_signed, u32 rgb[MDEC_MACROBLOCK_PIXELS]);
+	// Scalar reference of yuv_to_rgb
+	static void yuv_to_rgb_reference(const MdecBlock& cr, const MdecBlock& cb, const MdecBlock y[4],
+		bool is_signed, u32 rgb[MDEC_MACROBLOCK_PIXELS]);
+};
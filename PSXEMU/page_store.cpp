@@ -0,0 +1,145 @@
+#include "page_store.h"
+#include <cstring>
+#include <iostream>
+
+PageStore::PageStore() :
+	refs_(0)
+{
+}
+
+void PageStore::add(const u8* data, u32 n_pages, u64* keys)
+{
+	for (u32 i = 0; i < n_pages; i++)
+	{
+		keys[i] = hash_page(data + i * PAGE_STORE_PAGE_SIZE);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (u32 i = 0; i < n_pages; i++)
+	{
+		const u8* page = data + i * PAGE_STORE_PAGE_SIZE;
+		while (true)
+		{
+			auto found = pages_.find(keys[i]);
+			if (found == pages_.end())
+			{
+				Page& added = pages_[keys[i]];
+				added.data.assign(page, page + PAGE_STORE_PAGE_SIZE);
+				added.refs = 1;
+				break;
+			}
+			if (memcmp(found->second.data.data(), page, PAGE_STORE_PAGE_SIZE) == 0)
+			{
+				found->second.refs++;
+				break;
+			}
+			keys[i]++;			// collision
+		}
+	}
+	refs_ += n_pages;
+}
+
+void PageStore::release(const u64* keys, u32 n_pages)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (u32 i = 0; i < n_pages; i++)
+	{
+		auto found = pages_.find(keys[i]);
+		if (found == pages_.end())
+		{
+			std::cerr << "Releasing unknown page " << std::hex << keys[i] << std::endl;
+			throw - 1;
+		}
+		if (--found->second.refs == 0)
+		{
+			pages_.erase(found);
+		}
+	}
+	refs_ -= n_pages;
+}
+
+void PageStore::read(const u64* keys, u32 n_pages, u8* data) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (u32 i = 0; i < n_pages; i++)
+	{
+		auto found = pages_.find(keys[i]);
+		if (found == pages_.end())
+		{
+			std::cerr << "Reading unknown page " << std::hex << keys[i] << std::endl;
+			throw - 1;
+		}
+		memcpy(data + i * PAGE_STORE_PAGE_SIZE, found->second.data.data(), PAGE_STORE_PAGE_SIZE);
+	}
+}
+
+usize PageStore::n_pages() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return pages_.size();
+}
+
+u64 PageStore::n_refs() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return refs_;
+}
+
+PagedSnapshot::PagedSnapshot(PageStore& store, const CPU::Core& core) :
+	store_(store),
+	shell_(core, false),
+	ram_pages_(RAM_N_PAGES),
+	sound_ram_pages_(SPU_RAM_N_PAGES)
+{
+	const Interconnect& interconnect = core.interconnect();
+	store_.add(interconnect.ram().data(), RAM_N_PAGES, ram_pages_.data());
+	store_.add(interconnect.spu().sound_ram().data(), SPU_RAM_N_PAGES, sound_ram_pages_.data());
+}
+
+PagedSnapshot::~PagedSnapshot()
+{
+	store_.release(ram_pages_.data(), RAM_N_PAGES);
+	store_.release(sound_ram_pages_.data(), SPU_RAM_N_PAGES);
+}
+
+u64 PagedSnapshot::cycles() const
+{
+	return shell_.cycles();
+}
+
+const std::vector<u64>& PagedSnapshot::ram_pages() const
+{
+	return ram_pages_;
+}
+
+const std::vector<u64>& PagedSnapshot::sound_ram_pages() const
+{
+	return sound_ram_pages_;
+}
+
+void PagedSnapshot::restore(CPU::Core& core) const
+{
+	shell_.restore(core);
+	Interconnect& interconnect = core.interconnect();
+	Ram& ram = interconnect.ram();
+	for (u32 page = 0; page < RAM_N_PAGES; page++)
+	{
+		u32 offset = page << RAM_PAGE_SHIFT;
+		if (hash_page(static_cast<const Ram&>(ram).data() + offset) != ram_pages_[page])
+		{
+			store_.read(&ram_pages_[page], 1, ram.writable(offset, PAGE_STORE_PAGE_SIZE));
+		}
+	}
+	Spu& spu = interconnect.spu();
+	u8 data[PAGE_STORE_PAGE_SIZE];
+	for (u32 page = 0; page < SPU_RAM_N_PAGES; page++)
+	{
+		u32 offset = page << RAM_PAGE_SHIFT;
+		const std::vector<u8>& sound_ram = spu.sound_ram();
+		if (sound_ram.empty() || hash_page(sound_ram.data() + offset) != sound_ram_pages_[page])
+		{
+			store_.read(&sound_ram_pages_[page], 1, data);
+			spu.load_sound_ram(offset, data, PAGE_STORE_PAGE_SIZE);
+		}
+	}
+}
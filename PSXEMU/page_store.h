@@ -0,0 +1,67 @@
+#pragma once
+#include "cpu_core.h"
+#include "hash.h"
+#include "replay.h"
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define PAGE_STORE_PAGE_SIZE (1 << RAM_PAGE_SHIFT)
+
+// Content addressed store of memory pages shared by any number of snapshots,
+// and cores on any thread. Each distinct page is kept once, with a count of
+// the references to it, under its hash. Pages are compared on insertion, so
+// a hash collision only moves the newer page to the next free key.
+class PageStore
+{
+private:
+	struct Page
+	{
+		std::vector<u8> data;
+		u32 refs;
+	};
+	mutable std::mutex mutex_;
+	std::unordered_map<u64, Page> pages_;
+	u64 refs_;
+
+public:
+	PageStore();
+	PageStore(const PageStore&) = delete;
+	PageStore& operator=(const PageStore&) = delete;
+
+	// Adds a reference to each of n_pages consecutive pages, storing the
+	// ones not present yet, and writes their keys
+	void add(const u8* data, u32 n_pages, u64* keys);
+	void release(const u64* keys, u32 n_pages);
+	// Copies the pages out, consecutively
+	void read(const u64* keys, u32 n_pages, u8* data) const;
+
+	// Distinct pages held, and references to them
+	usize n_pages() const;
+	u64 n_refs() const;
+};
+
+// Snapshot of a whole machine whose RAM and sound RAM live in a page store,
+// as lists of page keys. The rest of the machine is kept as a CoreSnapshot
+// without that memory.
+class PagedSnapshot
+{
+private:
+	PageStore& store_;
+	CoreSnapshot shell_;
+	std::vector<u64> ram_pages_;
+	std::vector<u64> sound_ram_pages_;
+
+public:
+	PagedSnapshot(PageStore& store, const CPU::Core& core);
+	~PagedSnapshot();
+	PagedSnapshot(const PagedSnapshot&) = delete;
+	PagedSnapshot& operator=(const PagedSnapshot&) = delete;
+
+	u64 cycles() const;
+	const std::vector<u64>& ram_pages() const;
+	const std::vector<u64>& sound_ram_pages() const;
+	// Overwrites the core like CoreSnapshot::restore. Only the pages whose
+	// hash differs from their key are written.
+	void restore(CPU::Core& core) const;
+};
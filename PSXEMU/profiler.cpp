@@ -0,0 +1,181 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+// Map files use KSEG0 addresses while the BIOS runs from KSEG1
+static u32 physical(u32 address)
+{
+	return address & 0x1fffffff;
+}
+
+template <typename Key>
+static std::vector<std::pair<Key, u64>> by_count(const std::map<Key, u64>& counts)
+{
+	std::vector<std::pair<Key, u64>> sorted(counts.begin(), counts.end());
+	std::stable_sort(sorted.begin(), sorted.end(), [](const std::pair<Key, u64>& a, const std::pair<Key, u64>& b)
+	{
+		return a.second > b.second;
+	});
+	return sorted;
+}
+
+GuestProfiler::GuestProfiler(u64 interval, usize capacity) :
+	interval_(interval),
+	samples_(capacity),
+	n_samples_(0),
+	dropped_(0)
+{
+}
+
+u64 GuestProfiler::interval() const
+{
+	return interval_;
+}
+
+usize GuestProfiler::n_samples() const
+{
+	return n_samples_;
+}
+
+u64 GuestProfiler::dropped() const
+{
+	return dropped_;
+}
+
+const ProfileSample& GuestProfiler::sample(usize index) const
+{
+	return samples_[index];
+}
+
+void GuestProfiler::clear()
+{
+	n_samples_ = 0;
+	dropped_ = 0;
+}
+
+bool GuestProfiler::load_map(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cerr << "Error opening map file " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string address;
+		std::string name;
+		fields >> address >> name;
+		// nm puts the symbol type between address and name
+		if (name.size() == 1)
+		{
+			fields >> name;
+		}
+
+		char* end = nullptr;
+		unsigned long value = strtoul(address.c_str(), &end, 16);
+		if (address.empty() || *end != '\0' || name.empty())
+		{
+			continue;
+		}
+		add_symbol(static_cast<u32>(value), name);
+	}
+	return true;
+}
+
+void GuestProfiler::add_symbol(u32 address, const std::string& name)
+{
+	ProfileSymbol symbol = { physical(address), name };
+	auto position = std::upper_bound(symbols_.begin(), symbols_.end(), symbol,
+		[](const ProfileSymbol& a, const ProfileSymbol& b)
+	{
+		return a.address < b.address;
+	});
+	symbols_.insert(position, symbol);
+}
+
+std::string GuestProfiler::symbolize_(u32 address) const
+{
+	u32 target = physical(address);
+	auto next = std::upper_bound(symbols_.begin(), symbols_.end(), target,
+		[](u32 value, const ProfileSymbol& symbol)
+	{
+		return value < symbol.address;
+	});
+	if (next == symbols_.begin())
+	{
+		std::ostringstream hex;
+		hex << std::hex << std::setw(8) << std::setfill('0') << address;
+		return hex.str();
+	}
+	return (next - 1)->name;
+}
+
+std::string GuestProfiler::symbol(u32 address) const
+{
+	return symbolize_(address);
+}
+
+void GuestProfiler::flat_report(std::ostream& out, usize max_lines) const
+{
+	std::map<std::string, u64> counts;
+	for (usize i = 0; i < n_samples_; i++)
+	{
+		counts[symbolize_(samples_[i].pc)]++;
+	}
+
+	out << "Flat profile: " << n_samples_ << " samples every " << interval_ << " cycles";
+	if (dropped_ > 0)
+	{
+		out << ", " << dropped_ << " dropped (buffer full)";
+	}
+	out << std::endl;
+
+	auto sorted = by_count(counts);
+	for (usize i = 0; i < sorted.size() && i < max_lines; i++)
+	{
+		double percent = 100.0 * sorted[i].second / std::max<usize>(n_samples_, 1);
+		out << std::fixed << std::setprecision(2) << std::setw(7) << percent << "% "
+			<< std::setw(10) << sorted[i].second << "  " << sorted[i].first << std::endl;
+	}
+}
+
+void GuestProfiler::call_graph_report(std::ostream& out, usize max_lines) const
+{
+	std::map<std::pair<std::string, std::string>, u64> edges;
+	for (usize i = 0; i < n_samples_; i++)
+	{
+		edges[std::make_pair(symbolize_(samples_[i].ra), symbolize_(samples_[i].pc))]++;
+	}
+
+	out << "Call graph (caller from ra, exact for leaf functions)" << std::endl;
+	auto sorted = by_count(edges);
+	for (usize i = 0; i < sorted.size() && i < max_lines; i++)
+	{
+		out << std::setw(10) << sorted[i].second << "  " << sorted[i].first.first
+			<< " -> " << sorted[i].first.second << std::endl;
+	}
+}
+
+void GuestProfiler::write_folded(std::ostream& out) const
+{
+	std::map<std::string, u64> stacks;
+	for (usize i = 0; i < n_samples_; i++)
+	{
+		std::string caller = symbolize_(samples_[i].ra);
+		std::string callee = symbolize_(samples_[i].pc);
+		stacks[(caller == callee) ? callee : caller + ";" + callee]++;
+	}
+	for (const auto& stack : stacks)
+	{
+		out << stack.first << " " << stack.second << "\n";
+	}
+}
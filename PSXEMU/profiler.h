@@ -0,0 +1,69 @@
+#pragma once
+#include "types.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+#define PROFILER_DEFAULT_INTERVAL 33868		// cycles, about 1 ms of guest time
+#define PROFILER_DEFAULT_CAPACITY (1 << 20)	// samples
+
+struct ProfileSample
+{
+	u32 pc;
+	u32 ra;							// r31: the caller for leaf functions
+};
+
+struct ProfileSymbol
+{
+	u32 address;
+	std::string name;
+};
+
+// Sampling profiler of guest code. The CPU records pc and ra every
+// interval cycles, through the scheduler, into a buffer of fixed size.
+class GuestProfiler
+{
+private:
+	u64 interval_;
+	std::vector<ProfileSample> samples_;
+	usize n_samples_;
+	u64 dropped_;
+	std::vector<ProfileSymbol> symbols_;	// sorted by physical address
+
+	std::string symbolize_(u32 address) const;
+
+public:
+	GuestProfiler(u64 interval = PROFILER_DEFAULT_INTERVAL, usize capacity = PROFILER_DEFAULT_CAPACITY);
+	u64 interval() const;
+
+	void record(u32 pc, u32 ra)
+	{
+		if (n_samples_ == samples_.size())
+		{
+			dropped_++;
+			return;
+		}
+		samples_[n_samples_].pc = pc;
+		samples_[n_samples_].ra = ra;
+		n_samples_++;
+	}
+
+	usize n_samples() const;
+	u64 dropped() const;
+	const ProfileSample& sample(usize index) const;
+	void clear();
+
+	// Map file with one "address name" pair per line (psyq .MAP, nm output...).
+	// Lines without a hex address followed by a name are skipped.
+	bool load_map(const std::string& path);
+	void add_symbol(u32 address, const std::string& name);
+	// Function containing the address, hex address when there's no symbol
+	std::string symbol(u32 address) const;
+
+	// Samples per function, most sampled first
+	void flat_report(std::ostream& out, usize max_lines = 50) const;
+	// Samples per caller -> callee edge, the caller taken from ra
+	void call_graph_report(std::ostream& out, usize max_lines = 50) const;
+	// "caller;callee count" lines, as read by flamegraph.pl and speedscope
+	void write_folded(std::ostream& out) const;
+};
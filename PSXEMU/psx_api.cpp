@@ -0,0 +1,251 @@
+#define PSX_API_EXPORTS
+#include "psx_api.h"
+#include "replay.h"
+#include "run_loop.h"
+#include <iostream>
+
+// The running core lives in a snapshot, which keeps it aligned on the heap
+struct PsxMachine
+{
+	CoreSnapshot storage;
+	RunLoop loop;
+
+	explicit PsxMachine(const CPU::Core& core) :
+		storage(core),
+		loop(storage.core())
+	{
+	}
+
+	CPU::Core& core()
+	{
+		return storage.core();
+	}
+};
+
+struct PsxSnapshot
+{
+	CoreSnapshot copy;
+
+	explicit PsxSnapshot(const CPU::Core& core) :
+		copy(core)
+	{
+	}
+};
+
+int psx_api_version(void)
+{
+	return PSX_API_VERSION;
+}
+
+PsxMachine* psx_create(const uint8_t* bios, size_t size)
+{
+	if (bios == nullptr || size > BIOS_ADDR_SPACE_SIZE)
+	{
+		std::cerr << "Invalid BIOS image of " << size << " bytes" << std::endl;
+		return nullptr;
+	}
+	try
+	{
+		CPU::Core core = CPU::Core(Interconnect(Bios(std::vector<u8>(bios, bios + size))));
+		return new PsxMachine(core);
+	}
+	catch (...)
+	{
+		std::cerr << "Unable to create a machine" << std::endl;
+		return nullptr;
+	}
+}
+
+void psx_destroy(PsxMachine* machine)
+{
+	delete machine;
+}
+
+void psx_set_hle(PsxMachine* machine, int mode)
+{
+	machine->core().bios_hle().set_mode(static_cast<HleMode>(mode));
+}
+
+int psx_load_exe(PsxMachine* machine, const uint8_t* exe, size_t size, int fast_boot)
+{
+	try
+	{
+		std::shared_ptr<PsxExe> parsed = parse_psx_exe(std::vector<u8>(exe, exe + size));
+		if (!parsed)
+		{
+			std::cerr << "Invalid PS-X EXE" << std::endl;
+			return -1;
+		}
+		if (fast_boot != 0)
+		{
+			// Without a kernel in RAM, only HLE answers the kernel calls
+			if (machine->core().bios_hle().mode() != HleMode::On)
+			{
+				std::cerr << "Fast boot needs HLE" << std::endl;
+				return -1;
+			}
+			machine->core().fast_boot(*parsed, nullptr);
+		}
+		else
+		{
+			machine->core().sideload_exe(parsed);
+		}
+	}
+	catch (...)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+int psx_insert_disc(PsxMachine* machine, const char* path)
+{
+	try
+	{
+		std::shared_ptr<DiscImage> disc = open_disc_image(path);
+		if (!disc)
+		{
+			return -1;
+		}
+		machine->core().interconnect().cdrom().insert_disc(disc);
+	}
+	catch (...)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static int run(PsxMachine* machine, const RunOptions& options)
+{
+	if (options.max_cycles == 0)
+	{
+		return PSX_STOP_CYCLES;
+	}
+	try
+	{
+		switch (machine->loop.run(options).reason)
+		{
+		case StopReason::PcHit:
+			return PSX_STOP_PC;
+		case StopReason::Error:
+			return PSX_STOP_ERROR;
+		default:
+			return PSX_STOP_CYCLES;
+		}
+	}
+	catch (...)
+	{
+		return PSX_STOP_ERROR;
+	}
+}
+
+int psx_run(PsxMachine* machine, uint64_t cycles)
+{
+	RunOptions options;
+	options.max_cycles = cycles;
+	return run(machine, options);
+}
+
+int psx_run_until(PsxMachine* machine, uint64_t cycles, uint32_t pc)
+{
+	RunOptions options;
+	options.max_cycles = cycles;
+	options.stop_at_pc = true;
+	options.stop_pc = pc;
+	return run(machine, options);
+}
+
+uint64_t psx_cycles(PsxMachine* machine)
+{
+	return machine->core().state().cycles;
+}
+
+uint32_t psx_reg(PsxMachine* machine, unsigned index)
+{
+	return (index < N_GP_REG) ? machine->core().state().regs[index] : 0;
+}
+
+uint32_t psx_pc(PsxMachine* machine)
+{
+	return machine->core().current_pc();
+}
+
+uint64_t psx_hash(PsxMachine* machine)
+{
+	return state_hash(machine->core());
+}
+
+const uint8_t* psx_memory(PsxMachine* machine, int memory, size_t* size)
+{
+	Interconnect& interconnect = machine->core().interconnect();
+	switch (memory)
+	{
+	case PSX_MEMORY_RAM:
+		*size = RAM_ADDR_SPACE_SIZE;
+		// The const overload, which leaves the written pages alone
+		return static_cast<const Ram&>(interconnect.ram()).data();
+	case PSX_MEMORY_SOUND_RAM:
+		*size = interconnect.spu().sound_ram().size();
+		return interconnect.spu().sound_ram().data();
+	default:
+		*size = 0;
+		return nullptr;
+	}
+}
+
+int psx_write(PsxMachine* machine, uint32_t address, const void* data, size_t size)
+{
+	u32 physical = machine->core().interconnect().mask_region(address);
+	if (physical >= RAM_END_ADDRESS || size > RAM_END_ADDRESS - physical)
+	{
+		std::cerr << "Write outside of RAM at " << std::hex << address << std::dec << std::endl;
+		return -1;
+	}
+	machine->core().interconnect().ram().store_block(physical - RAM_START_ADDRESS, static_cast<const u8*>(data), size);
+	return 0;
+}
+
+const char* psx_tty_output(PsxMachine* machine, size_t* size)
+{
+	const std::string& output = machine->core().interconnect().tty().output();
+	*size = output.size();
+	return output.c_str();
+}
+
+PsxSnapshot* psx_snapshot(PsxMachine* machine)
+{
+	try
+	{
+		return new PsxSnapshot(machine->core());
+	}
+	catch (...)
+	{
+		std::cerr << "Unable to snapshot the machine" << std::endl;
+		return nullptr;
+	}
+}
+
+int psx_restore(PsxMachine* machine, const PsxSnapshot* snapshot)
+{
+	try
+	{
+		snapshot->copy.restore(machine->core());
+	}
+	catch (...)
+	{
+		std::cerr << "Unable to restore the snapshot" << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+void psx_snapshot_free(PsxSnapshot* snapshot)
+{
+	delete snapshot;
+}
+
+uint64_t psx_snapshot_cycles(const PsxSnapshot* snapshot)
+{
+	return snapshot->copy.cycles();
+}
@@ -0,0 +1,97 @@
+#ifndef PSX_API_H
+#define PSX_API_H
+// C API around a whole machine, for embedding the emulator in other
+// languages. Handles are independent: each can run on its own thread.
+//
+// Functions report failures with a negative value or a null pointer, after
+// printing the reason on stderr.
+#include <stddef.h>
+#include <stdint.h>
+
+// Callers of the DLL link through its import library, no dllimport needed
+#if defined(_WIN32) && defined(PSX_API_EXPORTS)
+#define PSX_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define PSX_API
+#else
+#define PSX_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped whenever a signature or a meaning changes
+#define PSX_API_VERSION 2
+
+typedef struct PsxMachine PsxMachine;
+typedef struct PsxSnapshot PsxSnapshot;
+
+enum PsxHleMode
+{
+	PSX_HLE_OFF = 0,
+	PSX_HLE_COUNT_ONLY = 1,			// BIOS calls are counted and run by the BIOS
+	PSX_HLE_ON = 2
+};
+
+enum PsxStop
+{
+	PSX_STOP_CYCLES = 0,			// the cycle budget was used up
+	PSX_STOP_PC = 1,				// before the instruction at the stop pc
+	PSX_STOP_ERROR = 2				// the core hit something it doesn't emulate
+};
+
+// Memory of the machine viewable in place
+enum PsxMemory
+{
+	PSX_MEMORY_RAM = 0,
+	PSX_MEMORY_SOUND_RAM = 1
+};
+
+PSX_API int psx_api_version(void);
+
+// A machine at reset, with a BIOS image of up to 512 KiB
+PSX_API PsxMachine* psx_create(const uint8_t* bios, size_t size);
+PSX_API void psx_destroy(PsxMachine* machine);
+
+// Boot setup, before the first run. Without fast boot, the EXE is loaded
+// once the BIOS reaches the shell. With it, the EXE starts right away and
+// kernel calls need HLE: psx_load_exe fails unless it is on.
+PSX_API void psx_set_hle(PsxMachine* machine, int mode);
+PSX_API int psx_load_exe(PsxMachine* machine, const uint8_t* exe, size_t size, int fast_boot);
+PSX_API int psx_insert_disc(PsxMachine* machine, const char* path);
+
+// Runs unthrottled for up to cycles CPU cycles, returns a PsxStop
+PSX_API int psx_run(PsxMachine* machine, uint64_t cycles);
+// Also stops before the instruction at pc runs, checking every instruction
+PSX_API int psx_run_until(PsxMachine* machine, uint64_t cycles, uint32_t pc);
+PSX_API uint64_t psx_cycles(PsxMachine* machine);
+// General purpose registers 0-31
+PSX_API uint32_t psx_reg(PsxMachine* machine, unsigned index);
+// Address of the instruction the next step runs
+PSX_API uint32_t psx_pc(PsxMachine* machine);
+// FNV-1a of the CPU state and RAM, equal for machines in the same state
+PSX_API uint64_t psx_hash(PsxMachine* machine);
+
+// Read only view of a memory in place, valid until the machine is
+// destroyed. Restoring a snapshot updates the contents behind it.
+PSX_API const uint8_t* psx_memory(PsxMachine* machine, int memory, size_t* size);
+// Writes RAM at a guest address, for inputs of the guest or patches. Fails
+// outside of RAM.
+PSX_API int psx_write(PsxMachine* machine, uint32_t address, const void* data, size_t size);
+// The latest output of the TTY, at least its last 64 KiB, valid until the
+// machine runs again. Restores don't rewind it.
+PSX_API const char* psx_tty_output(PsxMachine* machine, size_t* size);
+
+// Copies of the whole machine. A restore only copies the RAM pages written
+// since, by either side.
+PSX_API PsxSnapshot* psx_snapshot(PsxMachine* machine);
+PSX_API int psx_restore(PsxMachine* machine, const PsxSnapshot* snapshot);
+PSX_API void psx_snapshot_free(PsxSnapshot* snapshot);
+PSX_API uint64_t psx_snapshot_cycles(const PsxSnapshot* snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
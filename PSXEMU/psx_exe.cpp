@@ -0,0 +1,90 @@
+#include "psx_exe.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+static u32 read32(const std::vector<u8>& data, usize offset)
+{
+	return
+		(static_cast<u32>(data[offset + 0])) |
+		(static_cast<u32>(data[offset + 1]) << 8) |
+		(static_cast<u32>(data[offset + 2]) << 16) |
+		(static_cast<u32>(data[offset + 3]) << 24);
+}
+
+bool read_file(const std::string& path, std::vector<u8>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Error opening file " << path << std::endl;
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+std::shared_ptr<PsxExe> parse_psx_exe(const std::vector<u8>& file)
+{
+	if (file.size() < PSX_EXE_HEADER_SIZE || memcmp(file.data(), "PS-X EXE", 8) != 0)
+	{
+		std::cerr << "Not a PS-X EXE file" << std::endl;
+		return nullptr;
+	}
+
+	std::shared_ptr<PsxExe> exe = std::make_shared<PsxExe>();
+	exe->pc = read32(file, 0x10);
+	exe->gp = read32(file, 0x14);
+	exe->text_address = read32(file, 0x18);
+	u32 text_size = read32(file, 0x1c);
+	exe->bss_address = read32(file, 0x28);
+	exe->bss_size = read32(file, 0x2c);
+	exe->stack_address = read32(file, 0x30) + read32(file, 0x34);
+
+	// Some tools leave padding after the text, others truncate the last page
+	usize available = file.size() - PSX_EXE_HEADER_SIZE;
+	if (text_size > available)
+	{
+		std::cerr << "PS-X EXE text truncated: " << available << " of " << text_size << " bytes" << std::endl;
+		text_size = static_cast<u32>(available);
+	}
+	exe->text.assign(file.begin() + PSX_EXE_HEADER_SIZE, file.begin() + PSX_EXE_HEADER_SIZE + text_size);
+	return exe;
+}
+
+std::shared_ptr<PsxExe> load_psx_exe(const std::string& path)
+{
+	std::vector<u8> file;
+	if (!read_file(path, file))
+	{
+		return nullptr;
+	}
+	return parse_psx_exe(file);
+}
+
+bool load_kernel_snapshot(const std::string& path, std::vector<u8>& kernel)
+{
+	if (!read_file(path, kernel))
+	{
+		return false;
+	}
+	if (kernel.size() < PSX_KERNEL_SIZE)
+	{
+		std::cerr << "Kernel snapshot too small: " << kernel.size() << " bytes" << std::endl;
+		return false;
+	}
+	kernel.resize(PSX_KERNEL_SIZE);
+	return true;
+}
+
+bool save_kernel_snapshot(const std::string& path, const u8* ram)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file || !file.write(reinterpret_cast<const char*>(ram), PSX_KERNEL_SIZE))
+	{
+		std::cerr << "Error writing kernel snapshot " << path << std::endl;
+		return false;
+	}
+	return true;
+}
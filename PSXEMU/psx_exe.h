@@ -0,0 +1,33 @@
+#pragma once
+#include "types.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#define PSX_EXE_HEADER_SIZE 0x800
+#define PSX_EXE_SHELL_ENTRY 0x80030000		// the BIOS jumps here once the kernel is initialized
+#define PSX_KERNEL_SIZE (64*1024)			// RAM used by the kernel
+
+// PS-X EXE executable: a 2 KB header followed by the text segment
+struct PsxExe
+{
+	u32 pc;
+	u32 gp;
+	u32 text_address;
+	u32 bss_address;						// zero filled before starting
+	u32 bss_size;
+	u32 stack_address;						// sp and fp, left to the BIOS when 0
+	std::vector<u8> text;
+};
+
+// Whole contents of a file, false if it can't be opened
+bool read_file(const std::string& path, std::vector<u8>& data);
+
+// Parses the contents of an EXE file, nullptr if it isn't a valid one
+std::shared_ptr<PsxExe> parse_psx_exe(const std::vector<u8>& file);
+std::shared_ptr<PsxExe> load_psx_exe(const std::string& path);
+
+// First 64 KB of RAM dumped after a BIOS boot, used to fast boot with an initialized kernel
+bool load_kernel_snapshot(const std::string& path, std::vector<u8>& kernel);
+// Writes the kernel area of ram, once the BIOS reached PSX_EXE_SHELL_ENTRY
+bool save_kernel_snapshot(const std::string& path, const u8* ram);
@@ -1,53 +1,216 @@
 #include "ram.h"
+#include <atomic>
+#include <cstring>
+#include <iostream>
 #include <string>
 
-Ram::Ram()
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Whole host pages, mapped and unmapped with the RAM
+static u8* allocate_ram()
+{
+#if defined(_WIN32)
+	void* data = VirtualAlloc(nullptr, RAM_ADDR_SPACE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (data == nullptr)
+#else
+	void* data = mmap(nullptr, RAM_ADDR_SPACE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED)
+#endif
+	{
+		std::cerr << "Unable to allocate RAM" << std::endl;
+		throw - 1;
+	}
+	return static_cast<u8*>(data);
+}
+
+static void free_ram(u8* data)
+{
+	if (data == nullptr)
+	{
+		return;
+	}
+#if defined(_WIN32)
+	VirtualFree(data, 0, MEM_RELEASE);
+#else
+	munmap(data, RAM_ADDR_SPACE_SIZE);
+#endif
+}
+
+static thread_local u32 released_copies = 0;
+
+ReleasedMemoryCopies::ReleasedMemoryCopies()
+{
+	released_copies++;
+}
+
+ReleasedMemoryCopies::~ReleasedMemoryCopies()
 {
-	ram_data_ = new u8[RAM_ADDR_SPACE_SIZE];
+	released_copies--;
+}
+
+bool ReleasedMemoryCopies::active()
+{
+	return released_copies != 0;
+}
+
+static u64 new_base()
+{
+	static std::atomic<u64> next_base(1);
+	return next_base++;
+}
+
+Ram::Ram() :
+	base_(new_base())
+{
+	ram_data_ = allocate_ram();
 	memset(ram_data_, 0xca, RAM_ADDR_SPACE_SIZE);
+	memset(dirty_, 0, sizeof(dirty_));
 }
 
 Ram::~Ram()
 {
-	delete ram_data_;
+	free_ram(ram_data_);
 	ram_data_ = nullptr;
 }
 
-Ram::Ram(const Ram& ram)
+Ram::Ram(const Ram& ram) :
+	ram_data_(nullptr),
+	base_(new_base())
 {
-	ram_data_ = new u8[RAM_ADDR_SPACE_SIZE];
+	memset(dirty_, 0, sizeof(dirty_));
+	if (ReleasedMemoryCopies::active())
+	{
+		return;
+	}
+	ram_data_ = allocate_ram();
 	memcpy(ram_data_, ram.ram_data_, RAM_ADDR_SPACE_SIZE * sizeof(u8));
 }
 
-u32 Ram::load32(u32 offset)
+// Both RAMs match the base outside their written pages. Adopts the base and
+// written pages of the source, pages copied over count as changed.
+void Ram::copy_from_(const Ram& ram)
 {
-	u32 data =
-		(static_cast<u32>(ram_data_[offset + 0])) |
-		(static_cast<u32>(ram_data_[offset + 1]) << 8) |
-		(static_cast<u32>(ram_data_[offset + 2]) << 16) |
-		(static_cast<u32>(ram_data_[offset + 3]) << 24);
-	return data;
+	if (base_ != ram.base_)
+	{
+		memcpy(ram_data_, ram.ram_data_, RAM_ADDR_SPACE_SIZE * sizeof(u8));
+		for (u32 page = 0; page < RAM_N_PAGES; page++)
+		{
+			dirty_[page] = (ram.dirty_[page] & RAM_PAGE_WRITTEN) | RAM_PAGE_CHANGED;
+		}
+		base_ = ram.base_;
+		return;
+	}
+	for (u32 page = 0; page < RAM_N_PAGES; page++)
+	{
+		u8 changed = dirty_[page] & RAM_PAGE_CHANGED;
+		if (((dirty_[page] | ram.dirty_[page]) & RAM_PAGE_WRITTEN) != 0)
+		{
+			u32 offset = page << RAM_PAGE_SHIFT;
+			memcpy(ram_data_ + offset, ram.ram_data_ + offset, 1 << RAM_PAGE_SHIFT);
+			changed = RAM_PAGE_CHANGED;
+		}
+		dirty_[page] = (ram.dirty_[page] & RAM_PAGE_WRITTEN) | changed;
+	}
 }
 
-u8 Ram::load8(u32 offset)
+Ram& Ram::operator=(const Ram& ram)
 {
-	return ram_data_[offset];
+	if (ram.ram_data_ != nullptr && this != &ram)
+	{
+		copy_from_(ram);
+	}
+	return *this;
 }
 
-void Ram::store32(u32 offset, u32 value)
+bool Ram::share_base(const Ram& ram)
 {
-	u8 b0 = static_cast<u8>(value >> 0);
-	u8 b1 = static_cast<u8>(value >> 8);
-	u8 b2 = static_cast<u8>(value >> 16);
-	u8 b3 = static_cast<u8>(value >> 24);
+	if (base_ == ram.base_)
+	{
+		return true;
+	}
+	if (ram_data_ == nullptr || ram.ram_data_ == nullptr ||
+		memcmp(ram_data_, ram.ram_data_, RAM_ADDR_SPACE_SIZE) != 0)
+	{
+		return false;
+	}
+	for (u32 page = 0; page < RAM_N_PAGES; page++)
+	{
+		dirty_[page] = (ram.dirty_[page] & RAM_PAGE_WRITTEN) | (dirty_[page] & RAM_PAGE_CHANGED);
+	}
+	base_ = ram.base_;
+	return true;
+}
 
-	ram_data_[offset + 0] = b0;
-	ram_data_[offset + 1] = b1;
-	ram_data_[offset + 2] = b2;
-	ram_data_[offset + 3] = b3;
+void Ram::mark_(u32 offset, usize size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	u32 first = offset >> RAM_PAGE_SHIFT;
+	u32 last = static_cast<u32>((offset + size - 1) >> RAM_PAGE_SHIFT);
+	memset(dirty_ + first, RAM_PAGE_WRITTEN | RAM_PAGE_CHANGED, last - first + 1);
+}
+
+void Ram::store_block(u32 offset, const u8* data, usize size)
+{
+	mark_(offset, size);
+	if (data == nullptr)
+	{
+		memset(ram_data_ + offset, 0, size);
+		return;
+	}
+	memcpy(ram_data_ + offset, data, size);
+}
+
+u8* Ram::data()
+{
+	memset(dirty_, RAM_PAGE_WRITTEN | RAM_PAGE_CHANGED, sizeof(dirty_));
+	return ram_data_;
+}
+
+const u8* Ram::data() const
+{
+	return ram_data_;
 }
 
-void Ram::store8(u32 offset, u8 value)
+u8* Ram::writable(u32 offset, usize size)
 {
-	ram_data_[offset] = value;
+	mark_(offset, size);
+	return ram_data_ + offset;
+}
+
+u32 Ram::dirty_pages() const
+{
+	u32 n = 0;
+	for (u32 page = 0; page < RAM_N_PAGES; page++)
+	{
+		n += dirty_[page] & RAM_PAGE_WRITTEN;
+	}
+	return n;
+}
+
+u32 Ram::take_changed(u32* pages)
+{
+	u32 n = 0;
+	for (u32 page = 0; page < RAM_N_PAGES; page++)
+	{
+		if ((dirty_[page] & RAM_PAGE_CHANGED) != 0)
+		{
+			pages[n++] = page;
+			dirty_[page] &= ~RAM_PAGE_CHANGED;
+		}
+	}
+	return n;
+}
+
+void Ram::release()
+{
+	free_ram(ram_data_);
+	ram_data_ = nullptr;
 }
@@ -1,19 +1,86 @@
 #pragma once
 #include "types.h"
 #include"address_map.h"
+#include <cstring>
 
+#define RAM_PAGE_SHIFT 12
+#define RAM_N_PAGES (RAM_ADDR_SPACE_SIZE >> RAM_PAGE_SHIFT)
+#define RAM_PAGE_WRITTEN 0x1			// may differ from the base
+#define RAM_PAGE_CHANGED 0x2			// written since the last take_changed()
+
+// While one is alive, RAMs and sound RAMs copy constructed on the same thread
+// start released: for copies of a machine that keep its memory elsewhere
+class ReleasedMemoryCopies
+{
+public:
+	ReleasedMemoryCopies();
+	~ReleasedMemoryCopies();
+	ReleasedMemoryCopies(const ReleasedMemoryCopies&) = delete;
+	ReleasedMemoryCopies& operator=(const ReleasedMemoryCopies&) = delete;
+
+	static bool active();
+};
+
+// Main RAM. Each instance remembers the contents it started from, its base,
+// and the pages written since: assigning between RAMs of the same base
+// copies those pages only, which makes restoring a snapshot of a short run
+// cheap. New and copy constructed RAMs start a base of their own.
+//
+// Pages also remember being changed in any way since take_changed() last
+// collected them, for hashes kept up to date page by page.
 class Ram
 {
 private:
 	u8* ram_data_;
+	u64 base_;						// unique id of the starting contents
+	u8 dirty_[RAM_N_PAGES];			// RAM_PAGE_ flags of every page
+
+	void copy_from_(const Ram& ram);
+	void mark_(u32 offset, usize size);
 public:
 	Ram();
 	~Ram();
 	Ram(const Ram& ram);
-	u32 load32(u32 offset);
-	u8 load8(u32 offset);
-	void store32(u32 offset, u32 value);
-	void store8(u32 offset, u8 value);
-
+	Ram& operator=(const Ram& ram);
+	// Native little endian accesses of any width, at offsets aligned to it
+	template <typename T>
+	T load(u32 offset) const
+	{
+		T value;
+		memcpy(&value, ram_data_ + offset, sizeof(T));
+		return value;
+	}
+	template <typename T>
+	void store(u32 offset, T value)
+	{
+		memcpy(ram_data_ + offset, &value, sizeof(T));
+		dirty_[offset >> RAM_PAGE_SHIFT] = RAM_PAGE_WRITTEN | RAM_PAGE_CHANGED;
+	}
+	// True when page holds the same contents in both RAMs: they have one
+	// base and neither wrote the page since
+	bool shares_page(const Ram& ram, u32 page) const
+	{
+		return base_ == ram.base_ && ((dirty_[page] | ram.dirty_[page]) & RAM_PAGE_WRITTEN) == 0;
+	}
+	// Takes the base and written pages of a RAM with the same contents,
+	// false and unchanged when the contents differ
+	bool share_base(const Ram& ram);
+	// Copies size bytes, nullptr data zero fills
+	void store_block(u32 offset, const u8* data, usize size);
+	// Direct access for bulk operations. Writes through the pointer aren't
+	// tracked, so taking it marks the whole RAM as written.
+	u8* data();
+	const u8* data() const;
+	// Direct access to size bytes at offset, marked as written
+	u8* writable(u32 offset, usize size);
+	// Pages marked as written since the base
+	u32 dirty_pages() const;
+	// Writes the indexes of the pages changed since the last call and
+	// returns their number
+	u32 take_changed(u32* pages);
+	// Frees the contents of a copy that keeps them elsewhere. Assigning a
+	// released RAM to another leaves the target as it is, for tracked
+	// writes to fill in.
+	void release();
 };
 
@@ -0,0 +1,319 @@
+#include "replay.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#define REPLAY_MAGIC "PSXRPLY"
+#define REPLAY_FAST_BOOT 0x1
+
+static void put32(std::ostream& out, u32 value)
+{
+	u8 bytes[4];
+	for (u32 i = 0; i < 4; i++)
+	{
+		bytes[i] = static_cast<u8>(value >> (i * 8));
+	}
+	out.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+static void put64(std::ostream& out, u64 value)
+{
+	put32(out, static_cast<u32>(value));
+	put32(out, static_cast<u32>(value >> 32));
+}
+
+static void put_blob(std::ostream& out, const void* data, usize size)
+{
+	put32(out, static_cast<u32>(size));
+	out.write(static_cast<const char*>(data), size);
+}
+
+static bool get32(std::istream& in, u32& value)
+{
+	u8 bytes[4];
+	if (!in.read(reinterpret_cast<char*>(bytes), 4))
+	{
+		return false;
+	}
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<u32>(bytes[3]) << 24);
+	return true;
+}
+
+static bool get64(std::istream& in, u64& value)
+{
+	u32 low;
+	u32 high;
+	if (!get32(in, low) || !get32(in, high))
+	{
+		return false;
+	}
+	value = low | (static_cast<u64>(high) << 32);
+	return true;
+}
+
+template <typename Blob>
+static bool get_blob(std::istream& in, Blob& blob)
+{
+	u32 size;
+	if (!get32(in, size))
+	{
+		return false;
+	}
+	blob.resize(size);
+	return size == 0 || static_cast<bool>(in.read(reinterpret_cast<char*>(&blob[0]), size));
+}
+
+bool ReplayLog::save(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cerr << "Error opening replay log " << path << std::endl;
+		return false;
+	}
+
+	file.write(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+	put32(file, REPLAY_VERSION);
+	put64(file, bios_hash);
+	put64(file, disc_hash);
+	put64(file, end_cycles);
+	put64(file, final_hash);
+	put32(file, (boot.fast_boot ? REPLAY_FAST_BOOT : 0));
+	put32(file, static_cast<u32>(boot.hle_mode));
+	put_blob(file, boot.exe.data(), boot.exe.size());
+	put_blob(file, boot.kernel.data(), boot.kernel.size());
+	put_blob(file, boot.disc_path.data(), boot.disc_path.size());
+	return static_cast<bool>(file);
+}
+
+bool ReplayLog::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Error opening replay log " << path << std::endl;
+		return false;
+	}
+
+	char magic[sizeof(REPLAY_MAGIC)];
+	u32 version;
+	if (!file.read(magic, sizeof(magic)) || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+		!get32(file, version) || version != REPLAY_VERSION)
+	{
+		std::cerr << "Not a replay log of this version: " << path << std::endl;
+		return false;
+	}
+
+	u32 flags;
+	u32 hle_mode;
+	bool ok = get64(file, bios_hash) && get64(file, disc_hash) && get64(file, end_cycles) &&
+		get64(file, final_hash) && get32(file, flags) && get32(file, hle_mode) &&
+		get_blob(file, boot.exe) && get_blob(file, boot.kernel) && get_blob(file, boot.disc_path);
+	if (!ok)
+	{
+		std::cerr << "Truncated replay log " << path << std::endl;
+		return false;
+	}
+	boot.fast_boot = (flags & REPLAY_FAST_BOOT) != 0;
+	boot.hle_mode = static_cast<HleMode>(hle_mode);
+	return true;
+}
+
+bool boot_core(CPU::Core& core, const ReplayBoot& boot)
+{
+	core.bios_hle().set_mode(boot.hle_mode);
+	if (!boot.disc_path.empty())
+	{
+		std::shared_ptr<DiscImage> disc = open_disc_image(boot.disc_path);
+		if (!disc)
+		{
+			return false;
+		}
+		core.interconnect().cdrom().insert_disc(disc);
+	}
+
+	if (!boot.exe.empty())
+	{
+		std::shared_ptr<PsxExe> exe = parse_psx_exe(boot.exe);
+		if (!exe)
+		{
+			std::cerr << "Invalid PS-X EXE" << std::endl;
+			return false;
+		}
+		if (boot.fast_boot)
+		{
+			core.fast_boot(*exe, boot.kernel.empty() ? nullptr : &boot.kernel);
+		}
+		else
+		{
+			core.sideload_exe(exe);
+		}
+	}
+	return true;
+}
+
+u64 state_hash(CPU::Core& core)
+{
+	const CPU::State& state = core.state();
+	u64 hash = FNV1A_SEED;
+	hash = fnv1a(hash, &state.pc, sizeof(state.pc));
+	hash = fnv1a(hash, &state.hi, sizeof(state.hi));
+	hash = fnv1a(hash, &state.lo, sizeof(state.lo));
+	hash = fnv1a(hash, state.regs, sizeof(state.regs));
+	hash = fnv1a(hash, &state.load.first.value, sizeof(state.load.first.value));
+	hash = fnv1a(hash, &state.load.second, sizeof(state.load.second));
+	hash = fnv1a(hash, &state.cop0regs, sizeof(state.cop0regs));
+	hash = fnv1a(hash, &state.cycles, sizeof(state.cycles));
+	const Ram& ram = core.interconnect().ram();
+	return fnv1a(hash, ram.data(), RAM_ADDR_SPACE_SIZE);
+}
+
+u64 disc_hash(CPU::Core& core)
+{
+	DiscImage* disc = core.interconnect().cdrom().disc();
+	if (disc == nullptr)
+	{
+		return 0;
+	}
+	u64 hash = FNV1A_SEED;
+	u8 sector[CD_SECTOR_SIZE];
+	for (u32 lba = 0; lba < disc->n_sectors(); lba++)
+	{
+		const u8* data = disc->sector_data(lba);
+		if (data == nullptr)
+		{
+			data = disc->read_sector(lba, sector) ? sector : nullptr;
+		}
+		if (data != nullptr)
+		{
+			hash = fnv1a(hash, data, CD_SECTOR_SIZE);
+		}
+	}
+	return hash;
+}
+
+CoreSnapshot::CoreSnapshot(const CPU::Core& core) :
+	CoreSnapshot(core, true)
+{
+}
+
+CoreSnapshot::CoreSnapshot(const CPU::Core& core, bool with_memory)
+{
+	std::unique_ptr<ReleasedMemoryCopies> released;
+	if (!with_memory)
+	{
+		released.reset(new ReleasedMemoryCopies());
+	}
+	usize alignment = alignof(CPU::Core);
+	storage_ = ::operator new(sizeof(CPU::Core) + alignment);
+	uintptr_t address = reinterpret_cast<uintptr_t>(storage_);
+	address = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+	core_ = new (reinterpret_cast<void*>(address)) CPU::Core(core);
+}
+
+CoreSnapshot::~CoreSnapshot()
+{
+	core_->~Core();
+	::operator delete(storage_);
+}
+
+u64 CoreSnapshot::cycles() const
+{
+	return core_->state().cycles;
+}
+
+CPU::Core& CoreSnapshot::core()
+{
+	return *core_;
+}
+
+void CoreSnapshot::restore(CPU::Core& core) const
+{
+	core = *core_;
+}
+
+ReplayRecorder::ReplayRecorder(CPU::Core& core, const ReplayBoot& boot) :
+	core_(core)
+{
+	log_.bios_hash = BlockCache::hash(core.interconnect().bios());
+	log_.disc_hash = disc_hash(core);
+	log_.boot = boot;
+}
+
+const ReplayLog& ReplayRecorder::finish()
+{
+	log_.end_cycles = core_.state().cycles;
+	log_.final_hash = state_hash(core_);
+	return log_;
+}
+
+Replayer::Replayer(CPU::Core& core, const ReplayLog& log, u64 snapshot_interval) :
+	core_(core),
+	log_(log),
+	snapshot_interval_(snapshot_interval)
+{
+	snapshots_.emplace_back(new CoreSnapshot(core_));
+}
+
+RunResult Replayer::run_to(u64 cycle)
+{
+	RunLoop loop(core_);
+	const CPU::State& state = core_.state();
+	RunResult total;
+	total.reason = StopReason::CycleBudget;
+	total.instructions = 0;
+	total.cycles = 0;
+	total.seconds = 0.0;
+
+	for (;;)
+	{
+		u64 next_snapshot = snapshots_.back()->cycles() + snapshot_interval_;
+		if (state.cycles >= next_snapshot)
+		{
+			snapshots_.emplace_back(new CoreSnapshot(core_));
+			next_snapshot = state.cycles + snapshot_interval_;
+		}
+		if (state.cycles >= cycle)
+		{
+			break;
+		}
+
+		u64 stop = std::min(cycle, next_snapshot);
+		RunOptions options;
+		options.max_cycles = stop - state.cycles;
+		RunResult result = loop.run(options);
+		total.instructions += result.instructions;
+		total.cycles += result.cycles;
+		total.seconds += result.seconds;
+		if (result.reason != StopReason::CycleBudget)
+		{
+			total.reason = result.reason;
+			break;
+		}
+	}
+	return total;
+}
+
+RunResult Replayer::seek(u64 cycle)
+{
+	auto after = std::upper_bound(snapshots_.begin(), snapshots_.end(), cycle,
+		[](u64 value, const std::unique_ptr<CoreSnapshot>& snapshot)
+	{
+		return value < snapshot->cycles();
+	});
+	const CoreSnapshot& snapshot = (after == snapshots_.begin()) ? **after : **(after - 1);
+	snapshot.restore(core_);
+	return run_to(cycle);
+}
+
+bool Replayer::verify()
+{
+	run_to(log_.end_cycles);
+	return core_.state().cycles == log_.end_cycles && state_hash(core_) == log_.final_hash;
+}
+
+usize Replayer::n_snapshots() const
+{
+	return snapshots_.size();
+}
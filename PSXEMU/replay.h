@@ -0,0 +1,99 @@
+#pragma once
+#include "cpu_core.h"
+#include "run_loop.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#define REPLAY_VERSION 2
+#define REPLAY_DEFAULT_SNAPSHOT_INTERVAL CPU_CLOCK_HZ		// one guest second
+
+// How a run starts. Emulation is deterministic from there, there are no
+// inputs until the controller ports are emulated.
+struct ReplayBoot
+{
+	HleMode hle_mode = HleMode::Off;
+	bool fast_boot = false;
+	std::vector<u8> exe;			// PS-X EXE file, empty to run the BIOS alone
+	std::vector<u8> kernel;			// kernel snapshot for fast boot, may be empty
+	std::string disc_path;			// empty without a disc
+};
+
+// File layout, little endian: "PSXRPLY\0", version, BIOS hash, disc hash,
+// end cycle, final state hash, boot flags, then exe, kernel and disc path as
+// sized blobs.
+struct ReplayLog
+{
+	u64 bios_hash = 0;
+	u64 disc_hash = 0;					// disc_hash() of the disc, 0 without one
+	ReplayBoot boot;
+	u64 end_cycles = 0;
+	u64 final_hash = 0;					// state_hash() at end_cycles
+
+	bool save(const std::string& path) const;
+	bool load(const std::string& path);
+};
+
+// Sets up a newly constructed core for the boot description
+bool boot_core(CPU::Core& core, const ReplayBoot& boot);
+// FNV-1a of the CPU state and RAM, to check that runs end the same way
+u64 state_hash(CPU::Core& core);
+// FNV-1a of every sector of the disc in the core's drive, 0 without one
+u64 disc_hash(CPU::Core& core);
+
+// Heap copy of a whole machine. Plain new only guarantees 16 byte alignment
+// in C++14 and the core holds 32 byte aligned device state.
+class CoreSnapshot
+{
+private:
+	void* storage_;
+	CPU::Core* core_;
+
+public:
+	explicit CoreSnapshot(const CPU::Core& core);
+	// Without memory the copy has its RAM and sound RAM released, see
+	// ReleasedMemoryCopies
+	CoreSnapshot(const CPU::Core& core, bool with_memory);
+	~CoreSnapshot();
+	CoreSnapshot(const CoreSnapshot&) = delete;
+	CoreSnapshot& operator=(const CoreSnapshot&) = delete;
+
+	u64 cycles() const;
+	CPU::Core& core();
+	// Overwrites the core, attached profiler and block cache included
+	void restore(CPU::Core& core) const;
+};
+
+// Records a run started from a boot description
+class ReplayRecorder
+{
+private:
+	CPU::Core& core_;
+	ReplayLog log_;
+
+public:
+	ReplayRecorder(CPU::Core& core, const ReplayBoot& boot);
+	// Stamps the end of the run
+	const ReplayLog& finish();
+};
+
+// Plays a log back unthrottled on a core set up with boot_core(log.boot),
+// keeping a snapshot every interval cycles so seeks don't start from boot
+class Replayer
+{
+private:
+	CPU::Core& core_;
+	const ReplayLog& log_;
+	u64 snapshot_interval_;
+	std::vector<std::unique_ptr<CoreSnapshot>> snapshots_;	// by cycle
+
+public:
+	Replayer(CPU::Core& core, const ReplayLog& log, u64 snapshot_interval = REPLAY_DEFAULT_SNAPSHOT_INTERVAL);
+	// Runs forward to the cycle, or until the core fails
+	RunResult run_to(u64 cycle);
+	// Restores the latest snapshot not after the cycle and runs forward to it
+	RunResult seek(u64 cycle);
+	// Runs to the end of the log and compares the final state
+	bool verify();
+	usize n_snapshots() const;
+};
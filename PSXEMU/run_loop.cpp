@@ -0,0 +1,204 @@
+#include "run_loop.h"
+#include "debug_traps.h"
+#include "log.h"
+#include <iomanip>
+#include <thread>
+
+#define RUN_LOOP_SPIN_TIME std::chrono::milliseconds(1)		// left to spin after a sleep
+#define RUN_LOOP_MAX_LAG std::chrono::milliseconds(100)		// further behind is not caught up
+
+double RunResult::mips() const
+{
+	return (seconds > 0.0) ? instructions / seconds / 1e6 : 0.0;
+}
+
+double RunResult::speed() const
+{
+	return (seconds > 0.0) ? static_cast<double>(cycles) / CPU_CLOCK_HZ / seconds : 0.0;
+}
+
+RunLoop::RunLoop(CPU::Core& core) :
+	core_(core),
+	stop_requested_(false)
+{
+}
+
+void RunLoop::set_slice_callback(std::function<void()> on_slice)
+{
+	on_slice_ = on_slice;
+}
+
+void RunLoop::request_stop()
+{
+	stop_requested_ = true;
+}
+
+// Sleeps while the target is far, then spins: sleeps overshoot by up to a
+// scheduler tick
+void RunLoop::pace_(std::chrono::steady_clock::time_point target)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (target - now > 2 * RUN_LOOP_SPIN_TIME)
+	{
+		std::this_thread::sleep_for(target - now - RUN_LOOP_SPIN_TIME);
+	}
+	while (std::chrono::steady_clock::now() < target)
+	{
+		std::this_thread::yield();
+	}
+}
+
+RunResult RunLoop::run(const RunOptions& options)
+{
+	using Clock = std::chrono::steady_clock;
+	const CPU::State& state = core_.state();
+	u64 start_cycles = state.cycles;
+	u64 start_instructions = core_.stats().instructions;
+	Clock::time_point start = Clock::now();
+	stop_requested_ = false;
+
+	double speed = (options.pacing == Pacing::RealTime) ? 1.0 : options.speed;
+	bool paced = (options.pacing != Pacing::Unthrottled) && speed > 0.0;
+	// Guest time is measured from here, moved forward when the host falls behind
+	Clock::time_point reference = start;
+	u64 reference_cycles = start_cycles;
+
+	// Output already there when the run starts doesn't count
+	const Tty& tty = core_.interconnect().tty();
+	u64 output_scanned = tty.output_total();
+
+	RunResult result;
+	result.reason = StopReason::Requested;
+	try
+	{
+		for (;;)
+		{
+			if (stop_requested_)
+			{
+				result.reason = StopReason::Requested;
+				break;
+			}
+			if (options.max_seconds > 0.0 &&
+				std::chrono::duration<double>(Clock::now() - start).count() >= options.max_seconds)
+			{
+				result.reason = StopReason::Deadline;
+				break;
+			}
+
+			u64 slice_end = state.cycles + RUN_LOOP_SLICE_CYCLES;
+			if (options.max_cycles > 0)
+			{
+				u64 budget_end = start_cycles + options.max_cycles;
+				if (state.cycles >= budget_end)
+				{
+					result.reason = StopReason::CycleBudget;
+					break;
+				}
+				slice_end = (budget_end < slice_end) ? budget_end : slice_end;
+			}
+
+			// The instruction at pc runs first, so a run resumed from a hit moves on
+			bool hit = false;
+			while (state.cycles < slice_end)
+			{
+				if (options.stop_at_pc)
+				{
+					core_.run_block(1);
+					if (core_.current_pc() == options.stop_pc)
+					{
+						hit = true;
+						break;
+					}
+					continue;
+				}
+				u64 steps = (slice_end - state.cycles) / CYCLES_PER_INSTRUCTION;
+				core_.run_block(static_cast<u32>((steps > 0) ? steps : 1));
+			}
+			if (hit)
+			{
+				result.reason = StopReason::PcHit;
+				break;
+			}
+			if (!options.stop_output.empty() && tty.output_total() != output_scanned)
+			{
+				// The tail holds more than a slice prints
+				const std::string& output = tty.output();
+				u64 fresh = tty.output_total() - output_scanned;
+				usize from = (fresh < output.size()) ? output.size() - static_cast<usize>(fresh) : 0;
+				usize overlap = options.stop_output.size() - 1;
+				from = (from > overlap) ? from - overlap : 0;
+				output_scanned = tty.output_total();
+				if (output.find(options.stop_output, from) != std::string::npos)
+				{
+					result.reason = StopReason::OutputMatch;
+					break;
+				}
+			}
+
+			if (on_slice_)
+			{
+				on_slice_();
+			}
+
+			if (paced)
+			{
+				double guest_seconds = static_cast<double>(state.cycles - reference_cycles) / (CPU_CLOCK_HZ * speed);
+				Clock::time_point target = reference +
+					std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(guest_seconds));
+				Clock::time_point now = Clock::now();
+				if (now - target > RUN_LOOP_MAX_LAG)
+				{
+					reference = now;
+					reference_cycles = state.cycles;
+				}
+				else
+				{
+					pace_(target);
+				}
+			}
+		}
+	}
+	catch (const DebugTrap&)
+	{
+		result.reason = StopReason::Trap;
+	}
+	catch (int)
+	{
+		log_flush();
+		result.reason = StopReason::Error;
+	}
+
+	result.instructions = core_.stats().instructions - start_instructions;
+	result.cycles = state.cycles - start_cycles;
+	result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return result;
+}
+
+const char* RunLoop::name(StopReason reason)
+{
+	switch (reason)
+	{
+	case StopReason::CycleBudget:
+		return "cycle budget";
+	case StopReason::PcHit:
+		return "pc hit";
+	case StopReason::Deadline:
+		return "deadline";
+	case StopReason::Requested:
+		return "request";
+	case StopReason::OutputMatch:
+		return "output match";
+	case StopReason::Trap:
+		return "debugger trap";
+	default:
+		return "error";
+	}
+}
+
+void RunLoop::report(const RunResult& result, std::ostream& out)
+{
+	out << "Stopped by " << name(result.reason) << " after " << std::dec << result.instructions
+		<< " instructions, " << result.cycles << " cycles in " << std::fixed << std::setprecision(3)
+		<< result.seconds << " s: " << std::setprecision(2) << result.mips() << " MIPS, "
+		<< result.speed() << "x real time" << std::endl;
+}
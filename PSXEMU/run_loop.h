@@ -0,0 +1,76 @@
+#pragma once
+#include "cpu_core.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#define CPU_CLOCK_HZ 33868800
+#define RUN_LOOP_SLICE_CYCLES (CPU_CLOCK_HZ / 1000)	// pacing and stop checks every guest ms
+
+enum class Pacing
+{
+	Unthrottled,		// as fast as the host allows
+	RealTime,			// guest time follows host time
+	Ratio				// guest time runs at RunOptions::speed times host time
+};
+
+enum class StopReason
+{
+	CycleBudget,
+	PcHit,
+	Deadline,			// wall clock
+	Requested,			// request_stop()
+	OutputMatch,		// RunOptions::stop_output was printed
+	Trap,				// debugger breakpoint or watchpoint, see DebugTraps
+	Error				// the core hit something it doesn't emulate
+};
+
+struct RunOptions
+{
+	Pacing pacing = Pacing::Unthrottled;
+	double speed = 1.0;
+	u64 max_cycles = 0;			// 0 for no budget
+	bool stop_at_pc = false;	// before the instruction at stop_pc runs
+	u32 stop_pc = 0;
+	double max_seconds = 0.0;	// 0 for no deadline
+	// Stops once the TTY prints this during the run, empty for none. Checked
+	// between slices, so the run ends up to a slice later.
+	std::string stop_output;
+};
+
+struct RunResult
+{
+	StopReason reason;
+	u64 instructions;
+	u64 cycles;
+	double seconds;				// host time
+
+	double mips() const;
+	// Guest time over host time, 1.0 is full speed
+	double speed() const;
+};
+
+// Drives a core with a pacing mode until a stop condition is met. Work is
+// done in slices of guest time; between slices, the callback runs on the
+// emulation thread and the pacing sleeps off any lead over host time.
+class RunLoop
+{
+private:
+	CPU::Core& core_;
+	std::function<void()> on_slice_;
+	std::atomic<bool> stop_requested_;
+
+	void pace_(std::chrono::steady_clock::time_point target);
+
+public:
+	explicit RunLoop(CPU::Core& core);
+	void set_slice_callback(std::function<void()> on_slice);
+	RunResult run(const RunOptions& options);
+	// Safe from any thread, the loop stops at the end of the current slice
+	void request_stop();
+
+	static const char* name(StopReason reason);
+	static void report(const RunResult& result, std::ostream& out);
+};
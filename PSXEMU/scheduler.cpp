@@ -0,0 +1,59 @@
+#include "scheduler.h"
+#include "hash.h"
+
+#define N_EVENTS static_cast<u32>(SchedulerEvent::Count)
+
+Scheduler::Scheduler() :
+	now_(0),
+	next_(SCHEDULER_NEVER)
+{
+	for (u32 i = 0; i < N_EVENTS; i++)
+	{
+		deadline_[i] = SCHEDULER_NEVER;
+	}
+}
+
+void Scheduler::update_next_()
+{
+	next_ = SCHEDULER_NEVER;
+	for (u32 i = 0; i < N_EVENTS; i++)
+	{
+		next_ = (deadline_[i] < next_) ? deadline_[i] : next_;
+	}
+}
+
+void Scheduler::schedule(SchedulerEvent event, u64 at)
+{
+	deadline_[static_cast<u32>(event)] = at;
+	update_next_();
+}
+
+void Scheduler::cancel(SchedulerEvent event)
+{
+	schedule(event, SCHEDULER_NEVER);
+}
+
+bool Scheduler::pop_due(SchedulerEvent& event)
+{
+	if (now_ < next_)
+	{
+		return false;
+	}
+
+	u32 earliest = 0;
+	for (u32 i = 1; i < N_EVENTS; i++)
+	{
+		earliest = (deadline_[i] < deadline_[earliest]) ? i : earliest;
+	}
+
+	event = static_cast<SchedulerEvent>(earliest);
+	deadline_[earliest] = SCHEDULER_NEVER;
+	update_next_();
+	return true;
+}
+
+u64 Scheduler::hash(u64 seed) const
+{
+	u64 hash = fnv1a_value(seed, now_);
+	return fnv1a(hash, deadline_, sizeof(deadline_));
+}
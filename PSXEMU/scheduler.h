@@ -0,0 +1,57 @@
+#pragma once
+#include "types.h"
+
+// Devices that run on their own clock register a deadline (in CPU cycles)
+// and are only brought up to date when it expires, or when the CPU
+// touches one of their registers.
+enum class SchedulerEvent
+{
+	Spu,
+	CdromAck,
+	CdromResponse,
+	CdromSector,
+	Profiler,			// handled by the CPU
+	Count
+};
+
+#define SCHEDULER_NEVER (~0ull)
+
+class Scheduler
+{
+private:
+	u64 now_;											// CPU cycles since reset
+	u64 deadline_[static_cast<u32>(SchedulerEvent::Count)];
+	u64 next_;											// earliest deadline
+
+	void update_next_();
+
+public:
+	Scheduler();
+	void schedule(SchedulerEvent event, u64 at);
+	void cancel(SchedulerEvent event);
+	// Removes and returns the earliest expired event, false if none is due
+	bool pop_due(SchedulerEvent& event);
+	// Chains the state of the device onto an FNV-1a hash
+	u64 hash(u64 seed) const;
+
+	u64 now() const
+	{
+		return now_;
+	}
+
+	void set_now(u64 now)
+	{
+		now_ = now;
+	}
+
+	// Earliest deadline, SCHEDULER_NEVER when nothing is scheduled
+	u64 next() const
+	{
+		return next_;
+	}
+
+	bool pending() const
+	{
+		return now_ >= next_;
+	}
+};
@@ -0,0 +1,931 @@
+#include "spu.h"
+#include "log.h"
+#include "hash.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+static const s32 ADPCM_POS_TABLE[5] = { 0, 60, 115, 98, 122 };
+static const s32 ADPCM_NEG_TABLE[5] = { 0, 0, -52, -55, -60 };
+
+static s32 clamp16(s32 value)
+{
+	return (value < -0x8000) ? -0x8000 : ((value > 0x7fff) ? 0x7fff : value);
+}
+
+static s32 mul15(s32 a, s32 b)
+{
+	return (a * b) >> 15;
+}
+
+// Volume registers: fixed mode stores volume / 2 in bits [14:0].
+// Sweep mode is treated as a completed sweep.
+static s32 volume_of(u16 reg)
+{
+	if ((reg & 0x8000) == 0)
+	{
+		return static_cast<s16>(reg << 1);
+	}
+	return ((reg & 0x2000) == 0) ? 0x7fff : 0;
+}
+
+SoundRam::SoundRam() :
+	data_(SPU_RAM_SIZE, 0)
+{
+	memset(changed_, 0, sizeof(changed_));
+}
+
+SoundRam::SoundRam(const SoundRam& ram)
+{
+	if (!ReleasedMemoryCopies::active())
+	{
+		data_ = ram.data_;
+	}
+	memset(changed_, 0, sizeof(changed_));
+}
+
+SoundRam& SoundRam::operator=(const SoundRam& ram)
+{
+	if (ram.data_.empty())
+	{
+		return *this;
+	}
+	if (data_.empty())
+	{
+		data_ = ram.data_;
+		memset(changed_, 1, sizeof(changed_));
+		return *this;
+	}
+	for (u32 page = 0; page < SPU_RAM_N_PAGES; page++)
+	{
+		u32 offset = page << RAM_PAGE_SHIFT;
+		if (memcmp(&data_[offset], &ram.data_[offset], 1 << RAM_PAGE_SHIFT) != 0)
+		{
+			memcpy(&data_[offset], &ram.data_[offset], 1 << RAM_PAGE_SHIFT);
+			changed_[page] = 1;
+		}
+	}
+	return *this;
+}
+
+const std::vector<u8>& SoundRam::contents() const
+{
+	return data_;
+}
+
+void SoundRam::store_block(u32 offset, const u8* data, usize size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	data_.resize(SPU_RAM_SIZE);
+	memcpy(&data_[offset], data, size);
+	u32 first = offset >> RAM_PAGE_SHIFT;
+	u32 last = static_cast<u32>((offset + size - 1) >> RAM_PAGE_SHIFT);
+	memset(changed_ + first, 1, last - first + 1);
+}
+
+u32 SoundRam::take_changed(u32* pages)
+{
+	u32 n = 0;
+	for (u32 page = 0; page < SPU_RAM_N_PAGES; page++)
+	{
+		if (changed_[page] != 0)
+		{
+			pages[n++] = page;
+			changed_[page] = 0;
+		}
+	}
+	return n;
+}
+
+void SoundRam::release()
+{
+	std::vector<u8>().swap(data_);
+}
+
+Spu::Spu() :
+	key_on_(0),
+	key_off_(0),
+	pitch_mod_(0),
+	noise_on_(0),
+	reverb_on_(0),
+	endx_(0),
+	control_(0),
+	status_(0),
+	transfer_address_(0),
+	reverb_address_(0),
+	reverb_out_left_(0),
+	reverb_out_right_(0),
+	reverb_odd_(false),
+	noise_timer_(0),
+	noise_level_(1),
+	synced_cycles_(0),
+	samples_generated_(0),
+	sink_(nullptr)
+{
+	memset(&voices_, 0, sizeof(voices_));
+	memset(&lanes_, 0, sizeof(lanes_));
+	memset(regs_, 0, sizeof(regs_));
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		voices_.phase[v] = AdsrPhase::Off;
+	}
+
+	// 4 tap bell shaped interpolation kernel, g[k] weighs a sample 2 - k / 256
+	// samples away from the output position; the taps of any phase sum to ~1.0
+	for (s32 k = 0; k < 512; k++)
+	{
+		double t = 2.0 - (k + 0.5) / 256.0;
+		gauss_table_[k] = static_cast<s16>(std::lround(0x59b9 * std::exp(-t * t / (2.0 * 0.32))));
+	}
+
+	output_.reserve(SPU_OUTPUT_BLOCK * 2);
+}
+
+u16 Spu::load16(u32 offset)
+{
+	if (offset < 0x180)
+	{
+		if ((offset & 0xf) == 0xc)
+		{
+			return static_cast<u16>(voices_.adsr_level[offset >> 4]);
+		}
+		return regs_[offset >> 1];
+	}
+
+	switch (offset)
+	{
+	case reg_endx_:
+		return static_cast<u16>(endx_);
+	case reg_endx_ + 2:
+		return static_cast<u16>(endx_ >> 16);
+	case reg_transfer_fifo_:
+		return 0;
+	case reg_status_:
+		return status_;
+	case reg_current_volume_left_:
+		return regs_[reg_main_volume_left_ >> 1];
+	case reg_current_volume_right_:
+		return regs_[reg_main_volume_right_ >> 1];
+	default:
+		break;
+	}
+
+	if (offset >= 0x200 && offset < 0x260)
+	{
+		// Current voice volumes
+		u32 voice = (offset - 0x200) >> 2;
+		return ((offset & 0x2) == 0) ? voices_.volume_left[voice] : voices_.volume_right[voice];
+	}
+
+	return regs_[offset >> 1];
+}
+
+void Spu::store16(u32 offset, u16 value)
+{
+	regs_[offset >> 1] = value;
+
+	if (offset < 0x180)
+	{
+		store_voice_(offset >> 4, offset & 0xf, value);
+		return;
+	}
+
+	switch (offset)
+	{
+	case reg_key_on_:
+		key_on_voices_(value);
+		break;
+	case reg_key_on_ + 2:
+		key_on_voices_(static_cast<u32>(value) << 16);
+		break;
+	case reg_key_off_:
+		key_off_voices_(value);
+		break;
+	case reg_key_off_ + 2:
+		key_off_voices_(static_cast<u32>(value) << 16);
+		break;
+	case reg_pitch_mod_:
+		pitch_mod_ = (pitch_mod_ & 0xffff0000) | (value & 0xfffe);	// voice 0 can't be modulated
+		break;
+	case reg_pitch_mod_ + 2:
+		pitch_mod_ = (pitch_mod_ & 0x0000ffff) | ((static_cast<u32>(value) & 0xff) << 16);
+		break;
+	case reg_noise_on_:
+		noise_on_ = (noise_on_ & 0xffff0000) | value;
+		break;
+	case reg_noise_on_ + 2:
+		noise_on_ = (noise_on_ & 0x0000ffff) | ((static_cast<u32>(value) & 0xff) << 16);
+		break;
+	case reg_reverb_on_:
+		reverb_on_ = (reverb_on_ & 0xffff0000) | value;
+		break;
+	case reg_reverb_on_ + 2:
+		reverb_on_ = (reverb_on_ & 0x0000ffff) | ((static_cast<u32>(value) & 0xff) << 16);
+		break;
+	case reg_endx_:
+	case reg_endx_ + 2:
+		// Read only
+		break;
+	case reg_reverb_base_:
+		reverb_address_ = static_cast<u32>(value) * 8;
+		break;
+	case reg_transfer_address_:
+		transfer_address_ = static_cast<u32>(value) * 8;
+		break;
+	case reg_transfer_fifo_:
+		// Manual write: data goes straight to sound RAM
+		sound_ram_.store8(transfer_address_ + 0, static_cast<u8>(value));
+		sound_ram_.store8(transfer_address_ + 1, static_cast<u8>(value >> 8));
+		transfer_address_ = (transfer_address_ + 2) & (SPU_RAM_SIZE - 2);
+		break;
+	case reg_control_:
+		control_ = value;
+		status_ = (status_ & 0xffc0) | (value & 0x3f);
+		if ((value & 0x40) == 0)
+		{
+			status_ &= ~0x40;		// acknowledge IRQ9
+		}
+		break;
+	case reg_status_:
+		// Read only
+		break;
+	default:
+		break;
+	}
+}
+
+void Spu::store_voice_(u32 voice, u32 reg, u16 value)
+{
+	switch (reg)
+	{
+	case 0x0:
+		voices_.volume_left[voice] = value;
+		break;
+	case 0x2:
+		voices_.volume_right[voice] = value;
+		break;
+	case 0x4:
+		voices_.pitch[voice] = value;
+		break;
+	case 0x6:
+		voices_.start_address[voice] = value;
+		break;
+	case 0x8:
+		voices_.adsr_low[voice] = value;
+		break;
+	case 0xa:
+		voices_.adsr_high[voice] = value;
+		break;
+	case 0xc:
+		voices_.adsr_level[voice] = static_cast<s16>(value);
+		break;
+	case 0xe:
+		// An explicit repeat address wins over the loop start flags
+		voices_.repeat_address[voice] = value;
+		voices_.ignore_loop_address[voice] = true;
+		break;
+	default:
+		LOG_WARN(Spu, "Unaligned SPU voice register write: {}", reg);
+		break;
+	}
+}
+
+void Spu::key_on_voices_(u32 mask)
+{
+	key_on_ = mask;
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		if (((mask >> v) & 0x1) == 0)
+		{
+			continue;
+		}
+
+		voices_.current_address[v] = (static_cast<u32>(voices_.start_address[v]) * 8) & (SPU_RAM_SIZE - 1);
+		voices_.counter[v] = 0;
+		voices_.adpcm_old[v] = 0;
+		voices_.adpcm_older[v] = 0;
+		memset(voices_.samples[v], 0, sizeof(voices_.samples[v]));
+		voices_.ignore_loop_address[v] = false;
+		voices_.phase[v] = AdsrPhase::Attack;
+		voices_.adsr_level[v] = 0;
+		voices_.adsr_wait[v] = 0;
+		endx_ &= ~(1u << v);
+
+		decode_block_(v);
+	}
+}
+
+void Spu::key_off_voices_(u32 mask)
+{
+	key_off_ = mask;
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		if (((mask >> v) & 0x1) != 0 && voices_.phase[v] != AdsrPhase::Off)
+		{
+			voices_.phase[v] = AdsrPhase::Release;
+			voices_.adsr_wait[v] = 0;
+		}
+	}
+}
+
+void Spu::decode_block_(u32 voice)
+{
+	u32 address = voices_.current_address[voice];
+	const u8* block = &sound_ram_.contents()[address & (SPU_RAM_SIZE - 16)];
+	s16* samples = voices_.samples[voice];
+
+	u32 shift = block[0] & 0xf;
+	shift = (shift > 12) ? 9 : shift;
+	u32 filter = (block[0] >> 4) & 0x7;
+	filter = (filter > 4) ? 4 : filter;
+	voices_.block_flags[voice] = block[1];
+
+	if ((block[1] & 0x4) && !voices_.ignore_loop_address[voice])
+	{
+		voices_.repeat_address[voice] = static_cast<u16>(address / 8);
+	}
+
+	if ((control_ & 0x40) != 0)
+	{
+		u32 irq_address = static_cast<u32>(regs_[reg_irq_address_ >> 1]) * 8;
+		if (irq_address >= address && irq_address < address + 16)
+		{
+			status_ |= 0x40;
+		}
+	}
+
+	// Keep the tail of the previous block for the interpolation taps
+	samples[0] = samples[28];
+	samples[1] = samples[29];
+	samples[2] = samples[30];
+
+	s32 old = voices_.adpcm_old[voice];
+	s32 older = voices_.adpcm_older[voice];
+	for (u32 i = 0; i < 28; i++)
+	{
+		s32 nibble = (block[2 + i / 2] >> ((i & 0x1) * 4)) & 0xf;
+		s32 t = static_cast<s16>(static_cast<u16>(nibble << 12)) >> shift;
+		s32 s = t + ((old * ADPCM_POS_TABLE[filter] + older * ADPCM_NEG_TABLE[filter] + 32) >> 6);
+		s = clamp16(s);
+		samples[3 + i] = static_cast<s16>(s);
+		older = old;
+		old = s;
+	}
+	voices_.adpcm_old[voice] = static_cast<s16>(old);
+	voices_.adpcm_older[voice] = static_cast<s16>(older);
+}
+
+void Spu::next_block_(u32 voice)
+{
+	if (voices_.block_flags[voice] & 0x1)
+	{
+		// Loop end
+		endx_ |= 1u << voice;
+		voices_.current_address[voice] = static_cast<u32>(voices_.repeat_address[voice]) * 8;
+		if ((voices_.block_flags[voice] & 0x2) == 0)
+		{
+			voices_.phase[voice] = AdsrPhase::Off;
+			voices_.adsr_level[voice] = 0;
+		}
+	}
+	else
+	{
+		voices_.current_address[voice] = (voices_.current_address[voice] + 16) & (SPU_RAM_SIZE - 1);
+	}
+
+	decode_block_(voice);
+}
+
+void Spu::adsr_tick_(u32 voice)
+{
+	if (voices_.phase[voice] == AdsrPhase::Off)
+	{
+		return;
+	}
+
+	if (voices_.adsr_wait[voice] > 1)
+	{
+		voices_.adsr_wait[voice]--;
+		return;
+	}
+
+	bool exponential;
+	bool decreasing;
+	s32 shift;
+	s32 step;
+	switch (voices_.phase[voice])
+	{
+	case AdsrPhase::Attack:
+		exponential = (voices_.adsr_low[voice] & 0x8000) != 0;
+		decreasing = false;
+		shift = (voices_.adsr_low[voice] >> 10) & 0x1f;
+		step = 7 - ((voices_.adsr_low[voice] >> 8) & 0x3);
+		break;
+	case AdsrPhase::Decay:
+		exponential = true;
+		decreasing = true;
+		shift = (voices_.adsr_low[voice] >> 4) & 0xf;
+		step = -8;
+		break;
+	case AdsrPhase::Sustain:
+		exponential = (voices_.adsr_high[voice] & 0x8000) != 0;
+		decreasing = (voices_.adsr_high[voice] & 0x4000) != 0;
+		shift = (voices_.adsr_high[voice] >> 8) & 0x1f;
+		step = decreasing ? -8 + ((voices_.adsr_high[voice] >> 6) & 0x3) : 7 - ((voices_.adsr_high[voice] >> 6) & 0x3);
+		break;
+	default:
+		exponential = (voices_.adsr_high[voice] & 0x20) != 0;
+		decreasing = true;
+		shift = voices_.adsr_high[voice] & 0x1f;
+		step = -8;
+		break;
+	}
+
+	s32 level = voices_.adsr_level[voice];
+	u32 wait = 1u << ((shift > 11) ? shift - 11 : 0);
+	step = step * (1 << ((shift < 11) ? 11 - shift : 0));
+	if (exponential && !decreasing && level > 0x6000)
+	{
+		wait *= 4;
+	}
+	if (exponential && decreasing)
+	{
+		step = (step * level) >> 15;
+	}
+
+	level += step;
+	level = (level < 0) ? 0 : ((level > 0x7fff) ? 0x7fff : level);
+	voices_.adsr_level[voice] = level;
+	voices_.adsr_wait[voice] = wait;
+
+	switch (voices_.phase[voice])
+	{
+	case AdsrPhase::Attack:
+		if (level >= 0x7fff)
+		{
+			voices_.phase[voice] = AdsrPhase::Decay;
+			voices_.adsr_wait[voice] = 0;
+		}
+		break;
+	case AdsrPhase::Decay:
+	{
+		s32 sustain_level = ((voices_.adsr_low[voice] & 0xf) + 1) * 0x800;
+		if (level <= sustain_level)
+		{
+			voices_.phase[voice] = AdsrPhase::Sustain;
+			voices_.adsr_wait[voice] = 0;
+		}
+	}break;
+	case AdsrPhase::Release:
+		if (level == 0)
+		{
+			voices_.phase[voice] = AdsrPhase::Off;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void Spu::noise_tick_()
+{
+	s32 step = 4 + ((control_ >> 8) & 0x3);
+	s32 shift = (control_ >> 10) & 0xf;
+
+	noise_timer_ -= step;
+	u32 parity = ((noise_level_ >> 15) ^ (noise_level_ >> 12) ^
+		(noise_level_ >> 11) ^ (noise_level_ >> 10) ^ 1) & 0x1;
+	if (noise_timer_ < 0)
+	{
+		noise_level_ = static_cast<u16>((noise_level_ << 1) | parity);
+		noise_timer_ += 0x20000 >> shift;
+		if (noise_timer_ < 0)
+		{
+			noise_timer_ += 0x20000 >> shift;
+		}
+	}
+}
+
+u32 Spu::reverb_address_of_(s32 offset) const
+{
+	s32 base = static_cast<s32>(regs_[reg_reverb_base_ >> 1]) * 8;
+	s32 size = SPU_RAM_SIZE - base;
+	s32 rel = (static_cast<s32>(reverb_address_) - base + offset) % size;
+	if (rel < 0)
+	{
+		rel += size;
+	}
+	return static_cast<u32>(base + rel) & (SPU_RAM_SIZE - 2);
+}
+
+s16 Spu::reverb_load_(s32 offset) const
+{
+	u32 address = reverb_address_of_(offset);
+	return static_cast<s16>(sound_ram_.load8(address) | (sound_ram_.load8(address + 1) << 8));
+}
+
+void Spu::reverb_store_(s32 offset, s32 value)
+{
+	// The work area is only written while reverb is enabled
+	if ((control_ & 0x80) == 0)
+	{
+		return;
+	}
+	u32 address = reverb_address_of_(offset);
+	value = clamp16(value);
+	sound_ram_.store8(address + 0, static_cast<u8>(value));
+	sound_ram_.store8(address + 1, static_cast<u8>(value >> 8));
+}
+
+s32 Spu::reverb_reg_(u32 index) const
+{
+	return static_cast<s16>(regs_[(reg_reverb_config_ >> 1) + index]);
+}
+
+void Spu::reverb_(s32 left, s32 right)
+{
+	// Address registers are in 8 byte units
+	auto m = [this](u32 index) { return static_cast<s32>(static_cast<u16>(reverb_reg_(index))) * 8; };
+
+	s32 lin = mul15(reverb_reg_(rev_vlin_), left);
+	s32 rin = mul15(reverb_reg_(rev_vrin_), right);
+	s32 wall = reverb_reg_(rev_vwall_);
+	s32 iir = reverb_reg_(rev_viir_);
+
+	// Same side reflection
+	s32 lsame_prev = reverb_load_(m(rev_mlsame_) - 2);
+	s32 rsame_prev = reverb_load_(m(rev_mrsame_) - 2);
+	reverb_store_(m(rev_mlsame_),
+		mul15(clamp16(lin + mul15(reverb_load_(m(rev_dlsame_)), wall) - lsame_prev), iir) + lsame_prev);
+	reverb_store_(m(rev_mrsame_),
+		mul15(clamp16(rin + mul15(reverb_load_(m(rev_drsame_)), wall) - rsame_prev), iir) + rsame_prev);
+
+	// Different side reflection
+	s32 ldiff_prev = reverb_load_(m(rev_mldiff_) - 2);
+	s32 rdiff_prev = reverb_load_(m(rev_mrdiff_) - 2);
+	reverb_store_(m(rev_mldiff_),
+		mul15(clamp16(lin + mul15(reverb_load_(m(rev_drdiff_)), wall) - ldiff_prev), iir) + ldiff_prev);
+	reverb_store_(m(rev_mrdiff_),
+		mul15(clamp16(rin + mul15(reverb_load_(m(rev_dldiff_)), wall) - rdiff_prev), iir) + rdiff_prev);
+
+	// Early echo
+	s32 lout = clamp16(
+		mul15(reverb_reg_(rev_vcomb1_), reverb_load_(m(rev_mlcomb1_))) +
+		mul15(reverb_reg_(rev_vcomb2_), reverb_load_(m(rev_mlcomb2_))) +
+		mul15(reverb_reg_(rev_vcomb3_), reverb_load_(m(rev_mlcomb3_))) +
+		mul15(reverb_reg_(rev_vcomb4_), reverb_load_(m(rev_mlcomb4_))));
+	s32 rout = clamp16(
+		mul15(reverb_reg_(rev_vcomb1_), reverb_load_(m(rev_mrcomb1_))) +
+		mul15(reverb_reg_(rev_vcomb2_), reverb_load_(m(rev_mrcomb2_))) +
+		mul15(reverb_reg_(rev_vcomb3_), reverb_load_(m(rev_mrcomb3_))) +
+		mul15(reverb_reg_(rev_vcomb4_), reverb_load_(m(rev_mrcomb4_))));
+
+	// Late reverb all pass filters
+	s32 apf1 = reverb_reg_(rev_vapf1_);
+	s32 apf2 = reverb_reg_(rev_vapf2_);
+	s32 dapf1 = m(rev_dapf1_);
+	s32 dapf2 = m(rev_dapf2_);
+
+	s32 l_delayed = reverb_load_(m(rev_mlapf1_) - dapf1);
+	s32 r_delayed = reverb_load_(m(rev_mrapf1_) - dapf1);
+	lout = clamp16(lout - mul15(apf1, l_delayed));
+	rout = clamp16(rout - mul15(apf1, r_delayed));
+	reverb_store_(m(rev_mlapf1_), lout);
+	reverb_store_(m(rev_mrapf1_), rout);
+	lout = clamp16(mul15(lout, apf1) + l_delayed);
+	rout = clamp16(mul15(rout, apf1) + r_delayed);
+
+	l_delayed = reverb_load_(m(rev_mlapf2_) - dapf2);
+	r_delayed = reverb_load_(m(rev_mrapf2_) - dapf2);
+	lout = clamp16(lout - mul15(apf2, l_delayed));
+	rout = clamp16(rout - mul15(apf2, r_delayed));
+	reverb_store_(m(rev_mlapf2_), lout);
+	reverb_store_(m(rev_mrapf2_), rout);
+	lout = clamp16(mul15(lout, apf2) + l_delayed);
+	rout = clamp16(mul15(rout, apf2) + r_delayed);
+
+	reverb_out_left_ = static_cast<s16>(clamp16(mul15(lout, volume_of(regs_[reg_reverb_volume_left_ >> 1]) >> 1)));
+	reverb_out_right_ = static_cast<s16>(clamp16(mul15(rout, volume_of(regs_[reg_reverb_volume_right_ >> 1]) >> 1)));
+
+	u32 base = static_cast<u32>(regs_[reg_reverb_base_ >> 1]) * 8;
+	reverb_address_ = (reverb_address_ + 2) & (SPU_RAM_SIZE - 2);
+	reverb_address_ = (reverb_address_ < base) ? base : reverb_address_;
+}
+
+void Spu::mix_lanes_reference(const SpuMixLanes& lanes, SpuMixResult& result)
+{
+	result.left = 0;
+	result.right = 0;
+	result.reverb_left = 0;
+	result.reverb_right = 0;
+
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		s32 interpolated = 0;
+		for (u32 j = 0; j < 4; j++)
+		{
+			interpolated += (lanes.gauss[j][v] * lanes.tap[j][v]) >> 15;
+		}
+
+		s32 out = (interpolated * lanes.envelope[v]) >> 15;
+		s32 left = (out * lanes.volume_left[v]) >> 15;
+		s32 right = (out * lanes.volume_right[v]) >> 15;
+
+		result.voice[v] = out;
+		result.left += left;
+		result.right += right;
+		result.reverb_left += left & lanes.reverb[v];
+		result.reverb_right += right & lanes.reverb[v];
+	}
+}
+
+#if defined(__AVX2__)
+static s32 hsum256(__m256i v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+#elif defined(__SSE4_1__)
+static s32 hsum128(__m128i s)
+{
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+	return _mm_cvtsi128_si32(s);
+}
+#endif
+
+void Spu::mix_lanes(const SpuMixLanes& lanes, SpuMixResult& result)
+{
+#if defined(__AVX2__)
+	__m256i left = _mm256_setzero_si256();
+	__m256i right = _mm256_setzero_si256();
+	__m256i reverb_left = _mm256_setzero_si256();
+	__m256i reverb_right = _mm256_setzero_si256();
+
+	for (u32 v = 0; v < SPU_N_VOICES; v += 8)
+	{
+		__m256i interpolated = _mm256_setzero_si256();
+		for (u32 j = 0; j < 4; j++)
+		{
+			__m256i g = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.gauss[j] + v));
+			__m256i t = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.tap[j] + v));
+			interpolated = _mm256_add_epi32(interpolated, _mm256_srai_epi32(_mm256_mullo_epi32(g, t), 15));
+		}
+
+		__m256i env = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.envelope + v));
+		__m256i out = _mm256_srai_epi32(_mm256_mullo_epi32(interpolated, env), 15);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(result.voice + v), out);
+
+		__m256i vl = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.volume_left + v));
+		__m256i vr = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.volume_right + v));
+		__m256i rev = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes.reverb + v));
+		__m256i l = _mm256_srai_epi32(_mm256_mullo_epi32(out, vl), 15);
+		__m256i r = _mm256_srai_epi32(_mm256_mullo_epi32(out, vr), 15);
+
+		left = _mm256_add_epi32(left, l);
+		right = _mm256_add_epi32(right, r);
+		reverb_left = _mm256_add_epi32(reverb_left, _mm256_and_si256(l, rev));
+		reverb_right = _mm256_add_epi32(reverb_right, _mm256_and_si256(r, rev));
+	}
+
+	result.left = hsum256(left);
+	result.right = hsum256(right);
+	result.reverb_left = hsum256(reverb_left);
+	result.reverb_right = hsum256(reverb_right);
+#elif defined(__SSE4_1__)
+	__m128i left = _mm_setzero_si128();
+	__m128i right = _mm_setzero_si128();
+	__m128i reverb_left = _mm_setzero_si128();
+	__m128i reverb_right = _mm_setzero_si128();
+
+	for (u32 v = 0; v < SPU_N_VOICES; v += 4)
+	{
+		__m128i interpolated = _mm_setzero_si128();
+		for (u32 j = 0; j < 4; j++)
+		{
+			__m128i g = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.gauss[j] + v));
+			__m128i t = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.tap[j] + v));
+			interpolated = _mm_add_epi32(interpolated, _mm_srai_epi32(_mm_mullo_epi32(g, t), 15));
+		}
+
+		__m128i env = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.envelope + v));
+		__m128i out = _mm_srai_epi32(_mm_mullo_epi32(interpolated, env), 15);
+		_mm_store_si128(reinterpret_cast<__m128i*>(result.voice + v), out);
+
+		__m128i vl = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.volume_left + v));
+		__m128i vr = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.volume_right + v));
+		__m128i rev = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes.reverb + v));
+		__m128i l = _mm_srai_epi32(_mm_mullo_epi32(out, vl), 15);
+		__m128i r = _mm_srai_epi32(_mm_mullo_epi32(out, vr), 15);
+
+		left = _mm_add_epi32(left, l);
+		right = _mm_add_epi32(right, r);
+		reverb_left = _mm_add_epi32(reverb_left, _mm_and_si128(l, rev));
+		reverb_right = _mm_add_epi32(reverb_right, _mm_and_si128(r, rev));
+	}
+
+	result.left = hsum128(left);
+	result.right = hsum128(right);
+	result.reverb_left = hsum128(reverb_left);
+	result.reverb_right = hsum128(reverb_right);
+#else
+	mix_lanes_reference(lanes, result);
+#endif
+}
+
+void Spu::prepare_block_()
+{
+	// Registers only change between blocks: any access syncs the SPU first
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		lanes_.volume_left[v] = volume_of(voices_.volume_left[v]);
+		lanes_.volume_right[v] = volume_of(voices_.volume_right[v]);
+		lanes_.reverb[v] = ((reverb_on_ >> v) & 0x1) ? -1 : 0;
+		voices_.step[v] = (voices_.pitch[v] > 0x3fff) ? 0x3fff : voices_.pitch[v];
+	}
+}
+
+void Spu::generate_sample_()
+{
+	SpuMixResult mix;
+
+	noise_tick_();
+
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		// A voice that is off has a null envelope, its taps don't matter
+		if (voices_.phase[v] == AdsrPhase::Off)
+		{
+			continue;
+		}
+
+		if ((noise_on_ >> v) & 0x1)
+		{
+			lanes_.tap[0][v] = lanes_.tap[1][v] = lanes_.tap[2][v] = 0;
+			lanes_.tap[3][v] = static_cast<s16>(noise_level_);
+			lanes_.gauss[0][v] = lanes_.gauss[1][v] = lanes_.gauss[2][v] = 0;
+			lanes_.gauss[3][v] = 0x8000;
+			continue;
+		}
+
+		const s16* samples = &voices_.samples[v][voices_.counter[v] >> 12];
+		u32 phase = (voices_.counter[v] >> 4) & 0xff;
+		lanes_.tap[0][v] = samples[0];
+		lanes_.tap[1][v] = samples[1];
+		lanes_.tap[2][v] = samples[2];
+		lanes_.tap[3][v] = samples[3];
+		lanes_.gauss[0][v] = gauss_table_[0x0ff - phase];
+		lanes_.gauss[1][v] = gauss_table_[0x1ff - phase];
+		lanes_.gauss[2][v] = gauss_table_[0x100 + phase];
+		lanes_.gauss[3][v] = gauss_table_[0x000 + phase];
+	}
+
+	memcpy(lanes_.envelope, voices_.adsr_level, sizeof(lanes_.envelope));
+	mix_lanes(lanes_, mix);
+
+	// Pitch modulation scales the step by the output of the previous voice
+	voices_.counter[0] += voices_.step[0];
+	for (u32 v = 1; v < SPU_N_VOICES; v++)
+	{
+		s32 modulated = (voices_.step[v] * (clamp16(mix.voice[v - 1]) + 0x8000)) >> 15;
+		modulated = (modulated > 0x3fff) ? 0x3fff : modulated;
+		voices_.counter[v] += ((pitch_mod_ >> v) & 0x1) ? modulated : voices_.step[v];
+	}
+
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		if (voices_.phase[v] == AdsrPhase::Off)
+		{
+			continue;
+		}
+
+		while ((voices_.counter[v] >> 12) >= 28 && voices_.phase[v] != AdsrPhase::Off)
+		{
+			voices_.counter[v] -= 28 << 12;
+			next_block_(v);
+		}
+
+		adsr_tick_(v);
+	}
+
+	// Reverb runs at 22.05 kHz
+	if (reverb_odd_)
+	{
+		reverb_(clamp16(mix.reverb_left), clamp16(mix.reverb_right));
+	}
+	reverb_odd_ = !reverb_odd_;
+
+	s32 left = mul15(clamp16(mix.left), volume_of(regs_[reg_main_volume_left_ >> 1]));
+	s32 right = mul15(clamp16(mix.right), volume_of(regs_[reg_main_volume_right_ >> 1]));
+	left = clamp16(left + reverb_out_left_);
+	right = clamp16(right + reverb_out_right_);
+
+	// SPU disabled or muted
+	if ((control_ & 0xc000) != 0xc000)
+	{
+		left = 0;
+		right = 0;
+	}
+
+	output_.push_back(static_cast<s16>(left));
+	output_.push_back(static_cast<s16>(right));
+}
+
+void Spu::generate(u32 n_samples)
+{
+	prepare_block_();
+	for (u32 i = 0; i < n_samples; i++)
+	{
+		generate_sample_();
+	}
+	samples_generated_ += n_samples;
+
+	if (output_.size() >= SPU_OUTPUT_BLOCK * 2)
+	{
+		flush();
+	}
+}
+
+void Spu::sync(u64 now)
+{
+	if (now <= synced_cycles_)
+	{
+		return;
+	}
+
+	u64 n_samples = (now - synced_cycles_) / SPU_CYCLES_PER_SAMPLE;
+	synced_cycles_ += n_samples * SPU_CYCLES_PER_SAMPLE;
+	while (n_samples > 0)
+	{
+		u32 block = (n_samples > SPU_BLOCK_SAMPLES) ? SPU_BLOCK_SAMPLES : static_cast<u32>(n_samples);
+		generate(block);
+		n_samples -= block;
+	}
+}
+
+u64 Spu::next_deadline() const
+{
+	return synced_cycles_ + static_cast<u64>(SPU_BLOCK_SAMPLES) * SPU_CYCLES_PER_SAMPLE;
+}
+
+void Spu::set_sink(AudioSink* sink)
+{
+	sink_ = sink;
+}
+
+void Spu::flush()
+{
+	if (sink_ != nullptr && !output_.empty())
+	{
+		sink_->write(output_.data(), output_.size() / 2);
+	}
+	output_.clear();
+}
+
+u64 Spu::samples_generated() const
+{
+	return samples_generated_;
+}
+
+const std::vector<u8>& Spu::sound_ram() const
+{
+	return sound_ram_.contents();
+}
+
+u32 Spu::take_changed_sound_ram(u32* pages)
+{
+	return sound_ram_.take_changed(pages);
+}
+
+// Byte by byte. The voice state is zero filled on construction, padding
+// included, and copied as a whole.
+u64 Spu::hash(u64 seed) const
+{
+	u64 hash = fnv1a(seed, &voices_, sizeof(voices_));
+	hash = fnv1a(hash, regs_, sizeof(regs_));
+	u32 words[] = { key_on_, key_off_, pitch_mod_, noise_on_, reverb_on_, endx_, control_, status_,
+		transfer_address_, reverb_address_, static_cast<u16>(reverb_out_left_),
+		static_cast<u16>(reverb_out_right_), reverb_odd_ ? 1u : 0u, static_cast<u32>(noise_timer_),
+		noise_level_ };
+	hash = fnv1a(hash, words, sizeof(words));
+	hash = fnv1a_value(hash, synced_cycles_);
+	return fnv1a_value(hash, samples_generated_);
+}
+
+void Spu::release_sound_ram()
+{
+	sound_ram_.release();
+}
+
+void Spu::load_sound_ram(u32 offset, const u8* data, usize size)
+{
+	sound_ram_.store_block(offset, data, size);
+}
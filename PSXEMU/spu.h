@@ -0,0 +1,214 @@
+#pragma once
+#include "types.h"
+#include "address_map.h"
+#include "audio_sink.h"
+#include "ram.h"
+#include <vector>
+
+#define SPU_RAM_SIZE (512*1024)
+#define SPU_RAM_N_PAGES (SPU_RAM_SIZE >> RAM_PAGE_SHIFT)		// of the size of RAM pages
+#define SPU_N_VOICES 24
+#define SPU_CYCLES_PER_SAMPLE 768		// 33.8688 MHz / 44.1 kHz
+#define SPU_OUTPUT_BLOCK 1024			// frames buffered before reaching the sink
+#define SPU_BLOCK_SAMPLES 1024			// samples generated per scheduler event
+
+enum class AdsrPhase
+{
+	Off,
+	Attack,
+	Decay,
+	Sustain,
+	Release
+};
+
+// State of the 24 voices, one array entry per voice so the per sample
+// work can run across voices
+struct SpuVoices
+{
+	// Registers
+	u16 volume_left[SPU_N_VOICES];					// 0x0
+	u16 volume_right[SPU_N_VOICES];					// 0x2
+	u16 pitch[SPU_N_VOICES];						// 0x4: 0x1000 = 44.1 kHz
+	u16 start_address[SPU_N_VOICES];				// 0x6: in 8 byte units
+	u16 adsr_low[SPU_N_VOICES];						// 0x8: attack, decay, sustain level
+	u16 adsr_high[SPU_N_VOICES];					// 0xa: sustain, release
+	alignas(32) s32 adsr_level[SPU_N_VOICES];		// 0xc: current envelope volume
+	u16 repeat_address[SPU_N_VOICES];				// 0xe: in 8 byte units
+
+	// Playback state
+	alignas(32) u32 counter[SPU_N_VOICES];			// 4.12 position inside the block
+	alignas(32) s32 step[SPU_N_VOICES];				// counter increment, 0 when the voice is off
+	u32 adsr_wait[SPU_N_VOICES];					// samples until the next envelope step
+	u32 current_address[SPU_N_VOICES];				// byte address of the ADPCM block being played
+	s16 samples[SPU_N_VOICES][32];					// last 3 samples of the previous block + 28 decoded samples
+	s16 adpcm_old[SPU_N_VOICES];
+	s16 adpcm_older[SPU_N_VOICES];
+	u8 block_flags[SPU_N_VOICES];
+	bool ignore_loop_address[SPU_N_VOICES];
+	AdsrPhase phase[SPU_N_VOICES];
+};
+
+// Per voice inputs of one output sample, one voice per lane
+struct SpuMixLanes
+{
+	alignas(32) s32 tap[4][SPU_N_VOICES];		// 4 newest ADPCM samples, oldest first
+	alignas(32) s32 gauss[4][SPU_N_VOICES];		// matching interpolation weights
+	alignas(32) s32 envelope[SPU_N_VOICES];
+	alignas(32) s32 volume_left[SPU_N_VOICES];
+	alignas(32) s32 volume_right[SPU_N_VOICES];
+	alignas(32) s32 reverb[SPU_N_VOICES];		// all ones when the voice feeds the reverb
+};
+
+struct SpuMixResult
+{
+	alignas(32) s32 voice[SPU_N_VOICES];		// voice output after the envelope
+	s32 left;
+	s32 right;
+	s32 reverb_left;
+	s32 reverb_right;
+};
+
+// Sound RAM, whose pages remember being changed since take_changed() last
+// collected them, like those of Ram. Assignments only copy the pages that
+// differ.
+class SoundRam
+{
+private:
+	std::vector<u8> data_;
+	u8 changed_[SPU_RAM_N_PAGES];
+
+public:
+	SoundRam();
+	SoundRam(const SoundRam& ram);
+	SoundRam& operator=(const SoundRam& ram);
+
+	u8 load8(u32 offset) const
+	{
+		return data_[offset];
+	}
+	void store8(u32 offset, u8 value)
+	{
+		data_[offset] = value;
+		changed_[offset >> RAM_PAGE_SHIFT] = 1;
+	}
+	const std::vector<u8>& contents() const;
+	// Copies size bytes, refilling a released sound RAM
+	void store_block(u32 offset, const u8* data, usize size);
+	// Writes the indexes of the pages changed since the last call and
+	// returns their number
+	u32 take_changed(u32* pages);
+	// Frees the contents of a copy that keeps them elsewhere. Assigning a
+	// released sound RAM to another leaves the target as it is, for
+	// store_block() to fill in.
+	void release();
+};
+
+class Spu
+{
+private:
+	SoundRam sound_ram_;
+	SpuVoices voices_;
+	SpuMixLanes lanes_;
+	u16 regs_[SPU_ADDR_SPACE_SIZE / 2];			// last written value of every register
+	s16 gauss_table_[512];
+
+	u32 key_on_;
+	u32 key_off_;
+	u32 pitch_mod_;
+	u32 noise_on_;
+	u32 reverb_on_;
+	u32 endx_;
+	u16 control_;
+	u16 status_;
+	u32 transfer_address_;
+
+	u32 reverb_address_;
+	s16 reverb_out_left_;
+	s16 reverb_out_right_;
+	bool reverb_odd_;
+
+	s32 noise_timer_;
+	u16 noise_level_;
+
+	u64 synced_cycles_;							// CPU cycle up to which samples are generated
+	u64 samples_generated_;
+
+	std::vector<s16> output_;
+	AudioSink* sink_;
+
+	static const u32
+		reg_main_volume_left_ = 0x180,
+		reg_main_volume_right_ = 0x182,
+		reg_reverb_volume_left_ = 0x184,
+		reg_reverb_volume_right_ = 0x186,
+		reg_key_on_ = 0x188,
+		reg_key_off_ = 0x18c,
+		reg_pitch_mod_ = 0x190,
+		reg_noise_on_ = 0x194,
+		reg_reverb_on_ = 0x198,
+		reg_endx_ = 0x19c,
+		reg_reverb_base_ = 0x1a2,
+		reg_irq_address_ = 0x1a4,
+		reg_transfer_address_ = 0x1a6,
+		reg_transfer_fifo_ = 0x1a8,
+		reg_control_ = 0x1aa,
+		reg_status_ = 0x1ae,
+		reg_current_volume_left_ = 0x1b8,
+		reg_current_volume_right_ = 0x1ba,
+		reg_reverb_config_ = 0x1c0;
+
+	// Reverb configuration registers, index from 0x1c0
+	static const u32
+		rev_dapf1_ = 0, rev_dapf2_ = 1, rev_viir_ = 2,
+		rev_vcomb1_ = 3, rev_vcomb2_ = 4, rev_vcomb3_ = 5, rev_vcomb4_ = 6,
+		rev_vwall_ = 7, rev_vapf1_ = 8, rev_vapf2_ = 9,
+		rev_mlsame_ = 10, rev_mrsame_ = 11, rev_mlcomb1_ = 12, rev_mrcomb1_ = 13,
+		rev_mlcomb2_ = 14, rev_mrcomb2_ = 15, rev_dlsame_ = 16, rev_drsame_ = 17,
+		rev_mldiff_ = 18, rev_mrdiff_ = 19, rev_mlcomb3_ = 20, rev_mrcomb3_ = 21,
+		rev_mlcomb4_ = 22, rev_mrcomb4_ = 23, rev_dldiff_ = 24, rev_drdiff_ = 25,
+		rev_mlapf1_ = 26, rev_mrapf1_ = 27, rev_mlapf2_ = 28, rev_mrapf2_ = 29,
+		rev_vlin_ = 30, rev_vrin_ = 31;
+
+	void store_voice_(u32 voice, u32 reg, u16 value);
+	void key_on_voices_(u32 mask);
+	void key_off_voices_(u32 mask);
+	void decode_block_(u32 voice);
+	void next_block_(u32 voice);
+	void adsr_tick_(u32 voice);
+	void prepare_block_();
+	void generate_sample_();
+	void noise_tick_();
+	void reverb_(s32 left, s32 right);
+	u32 reverb_address_of_(s32 offset) const;
+	s16 reverb_load_(s32 offset) const;
+	void reverb_store_(s32 offset, s32 value);
+	s32 reverb_reg_(u32 index) const;
+
+public:
+	Spu();
+	u16 load16(u32 offset);
+	void store16(u32 offset, u16 value);
+	// Generates every sample due before the CPU cycle now, in blocks
+	void sync(u64 now);
+	// CPU cycle by which the next block has to be generated
+	u64 next_deadline() const;
+	void generate(u32 n_samples);
+	void set_sink(AudioSink* sink);
+	void flush();
+	u64 samples_generated() const;
+	// Empty once released
+	const std::vector<u8>& sound_ram() const;
+	// Pages changed since the last call, see SoundRam
+	u32 take_changed_sound_ram(u32* pages);
+	// Chains the state of the device but sound RAM onto an FNV-1a hash
+	u64 hash(u64 seed) const;
+	// Frees sound RAM in a copy that keeps it elsewhere. A copy of the SPU
+	// assigned from it has no sound RAM until load_sound_ram() refills it.
+	void release_sound_ram();
+	void load_sound_ram(u32 offset, const u8* data, usize size);
+
+	// 24 voice interpolation and mix, vectorized when SSE4.1 / AVX2 is available.
+	static void mix_lanes(const SpuMixLanes& lanes, SpuMixResult& result);
+	// Scalar reference of mix_lanes
+	static void mix_lanes_reference(const SpuMixLanes& lanes, SpuMixResult& result);
+};
@@ -0,0 +1,246 @@
+#include "stats.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define STATS_SOCKET_PREFIX "unix:"
+
+Stats::Stats() :
+	time_devices(false)
+{
+	clear();
+}
+
+void Stats::clear()
+{
+	instructions = 0;
+	blocks = 0;
+	cache_hits = 0;
+	cache_misses = 0;
+	exceptions = 0;
+	for (u32 i = 0; i < STATS_N_REGIONS; i++)
+	{
+		accesses[i] = 0;
+	}
+	for (u32 i = 0; i < STATS_N_DEVICES; i++)
+	{
+		device_ns[i] = 0;
+	}
+}
+
+const char* Stats::name(StatsRegion region)
+{
+	static const char* NAMES[STATS_N_REGIONS] =
+	{
+		"bios", "ram", "memcontrol", "irq_control", "dma", "timers",
+		"cdrom", "mdec", "spu", "expansion1", "expansion2", "other"
+	};
+	return NAMES[static_cast<u32>(region)];
+}
+
+const char* Stats::name(StatsDevice device)
+{
+	static const char* NAMES[STATS_N_DEVICES] = { "spu", "cdrom", "dma" };
+	return NAMES[static_cast<u32>(device)];
+}
+
+void write_stats_json(const Stats& stats, std::ostream& out)
+{
+	out << "{\"instructions\": " << stats.instructions
+		<< ", \"blocks\": " << stats.blocks
+		<< ", \"cache_hits\": " << stats.cache_hits
+		<< ", \"cache_misses\": " << stats.cache_misses
+		<< ", \"exceptions\": " << stats.exceptions
+		<< ", \"accesses\": {";
+	for (u32 i = 0; i < STATS_N_REGIONS; i++)
+	{
+		out << (i > 0 ? ", " : "") << "\"" << Stats::name(static_cast<StatsRegion>(i)) << "\": " << stats.accesses[i];
+	}
+	out << "}, \"device_ns\": {";
+	for (u32 i = 0; i < STATS_N_DEVICES; i++)
+	{
+		out << (i > 0 ? ", " : "") << "\"" << Stats::name(static_cast<StatsDevice>(i)) << "\": " << stats.device_ns[i];
+	}
+	out << "}}" << std::endl;
+}
+
+static void prometheus_counter(std::ostream& out, const char* name, const char* help, u64 value)
+{
+	out << "# HELP psxemu_" << name << " " << help << "\n"
+		<< "# TYPE psxemu_" << name << " counter\n"
+		<< "psxemu_" << name << " " << value << "\n";
+}
+
+void write_stats_prometheus(const Stats& stats, std::ostream& out)
+{
+	prometheus_counter(out, "instructions_total", "Guest instructions retired.", stats.instructions);
+	prometheus_counter(out, "blocks_total", "Blocks executed from a block cache.", stats.blocks);
+	prometheus_counter(out, "cache_hits_total", "Decode or block cache hits.", stats.cache_hits);
+	prometheus_counter(out, "cache_misses_total", "Decode or block cache misses.", stats.cache_misses);
+	prometheus_counter(out, "exceptions_total", "Overflow and address errors.", stats.exceptions);
+
+	out << "# HELP psxemu_bus_accesses_total Interconnect accesses per region.\n"
+		<< "# TYPE psxemu_bus_accesses_total counter\n";
+	for (u32 i = 0; i < STATS_N_REGIONS; i++)
+	{
+		out << "psxemu_bus_accesses_total{region=\"" << Stats::name(static_cast<StatsRegion>(i)) << "\"} "
+			<< stats.accesses[i] << "\n";
+	}
+
+	out << "# HELP psxemu_device_seconds_total Host time spent emulating a device.\n"
+		<< "# TYPE psxemu_device_seconds_total counter\n";
+	for (u32 i = 0; i < STATS_N_DEVICES; i++)
+	{
+		out << "psxemu_device_seconds_total{device=\"" << Stats::name(static_cast<StatsDevice>(i)) << "\"} "
+			<< stats.device_ns[i] / 1e9 << "\n";
+	}
+	out.flush();
+}
+
+void write_stats(const Stats& stats, StatsFormat format, std::ostream& out)
+{
+	if (format == StatsFormat::Json)
+	{
+		write_stats_json(stats, out);
+	}
+	else
+	{
+		write_stats_prometheus(stats, out);
+	}
+}
+
+StatsReporter::StatsReporter(const std::string& target, StatsFormat format, u32 period_ms) :
+	target_(target),
+	format_(format),
+	period_(std::chrono::milliseconds(period_ms)),
+	last_(std::chrono::steady_clock::now()),
+	socket_(-1)
+{
+}
+
+StatsReporter::~StatsReporter()
+{
+#if !defined(_WIN32)
+	if (socket_ >= 0)
+	{
+		::close(socket_);
+	}
+#endif
+}
+
+bool StatsReporter::write(const Stats& stats)
+{
+	last_ = std::chrono::steady_clock::now();
+
+	if (target_.compare(0, strlen(STATS_SOCKET_PREFIX), STATS_SOCKET_PREFIX) == 0)
+	{
+		std::ostringstream text;
+		write_stats(stats, format_, text);
+		return send_(text.str());
+	}
+
+	// Scrapers never see a half written file
+	std::string temporary = target_ + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::trunc);
+		if (!file)
+		{
+			std::cerr << "Error opening stats file " << temporary << std::endl;
+			return false;
+		}
+		write_stats(stats, format_, file);
+		if (!file)
+		{
+			std::cerr << "Error writing stats file " << temporary << std::endl;
+			return false;
+		}
+	}
+	if (std::rename(temporary.c_str(), target_.c_str()) != 0)
+	{
+		// Windows doesn't replace existing files
+		std::remove(target_.c_str());
+		if (std::rename(temporary.c_str(), target_.c_str()) != 0)
+		{
+			std::cerr << "Error replacing stats file " << target_ << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+#if defined(_WIN32)
+
+bool StatsReporter::send_(const std::string&)
+{
+	std::cerr << "Stats sockets are not supported on this platform" << std::endl;
+	return false;
+}
+
+#else
+
+// Connects on demand, a reader that goes away is reconnected at the next
+// period. The socket never blocks the emulation: a snapshot the reader has
+// no room for is dropped, and one cut short closes the connection.
+bool StatsReporter::send_(const std::string& text)
+{
+	if (socket_ < 0)
+	{
+		std::string path = target_.substr(strlen(STATS_SOCKET_PREFIX));
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			std::cerr << "Stats socket path too long: " << path << std::endl;
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size());
+
+		socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (socket_ < 0 || connect(socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			if (socket_ >= 0)
+			{
+				::close(socket_);
+				socket_ = -1;
+			}
+			return false;
+		}
+		fcntl(socket_, F_SETFL, fcntl(socket_, F_GETFL) | O_NONBLOCK);
+	}
+
+#if defined(MSG_NOSIGNAL)
+	int flags = MSG_NOSIGNAL;
+#else
+	int flags = 0;
+#endif
+	usize sent = 0;
+	while (sent < text.size())
+	{
+		ssize_t n = ::send(socket_, text.data() + sent, text.size() - sent, flags);
+		if (n < 0 && sent == 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return false;
+		}
+		if (n <= 0)
+		{
+			::close(socket_);
+			socket_ = -1;
+			return false;
+		}
+		sent += static_cast<usize>(n);
+	}
+	return true;
+}
+
+#endif
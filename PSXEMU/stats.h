@@ -0,0 +1,134 @@
+#pragma once
+#include "types.h"
+#include <chrono>
+#include <ostream>
+#include <string>
+
+// Interconnect regions whose accesses are counted
+enum class StatsRegion
+{
+	Bios,
+	Ram,
+	MemControl,
+	IrqControl,
+	Dma,
+	Timers,
+	Cdrom,
+	Mdec,
+	Spu,
+	Expansion1,
+	Expansion2,
+	Other,			// RAM size, cache control, RAM mirror
+	Count
+};
+
+// Devices whose emulation time is measured when Stats::time_devices is set
+enum class StatsDevice
+{
+	Spu,
+	Cdrom,
+	Dma,			// includes MDEC work fed by DMA
+	Count
+};
+
+#define STATS_N_REGIONS static_cast<u32>(StatsRegion::Count)
+#define STATS_N_DEVICES static_cast<u32>(StatsDevice::Count)
+
+// Host side performance counters. They are plain integers owned by one
+// Interconnect: an emulator instance only runs on one thread, so updates
+// need no atomics. Other threads must get copies from the emulation thread.
+struct Stats
+{
+	u64 instructions;
+	u64 blocks;						// executed from a block cache
+	u64 cache_hits;					// decode or block cache lookups
+	u64 cache_misses;
+	u64 exceptions;					// overflow and address errors
+	u64 accesses[STATS_N_REGIONS];
+	bool time_devices;				// off by default: two clock reads per device update
+	u64 device_ns[STATS_N_DEVICES];
+
+	Stats();
+	void clear();
+
+	void count(StatsRegion region)
+	{
+		accesses[static_cast<u32>(region)]++;
+	}
+
+	static const char* name(StatsRegion region);
+	static const char* name(StatsDevice device);
+};
+
+// Adds the time until the end of the scope to a device, when enabled
+class StatsTimer
+{
+private:
+	u64* total_;
+	std::chrono::steady_clock::time_point start_;
+
+public:
+	StatsTimer(Stats& stats, StatsDevice device) :
+		total_(stats.time_devices ? &stats.device_ns[static_cast<u32>(device)] : nullptr)
+	{
+		if (total_ != nullptr)
+		{
+			start_ = std::chrono::steady_clock::now();
+		}
+	}
+
+	~StatsTimer()
+	{
+		if (total_ != nullptr)
+		{
+			*total_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start_).count();
+		}
+	}
+
+	StatsTimer(const StatsTimer&) = delete;
+	StatsTimer& operator=(const StatsTimer&) = delete;
+};
+
+enum class StatsFormat
+{
+	Json,
+	Prometheus
+};
+
+void write_stats_json(const Stats& stats, std::ostream& out);
+// Text exposition format, for the node exporter textfile collector or a scraper
+void write_stats_prometheus(const Stats& stats, std::ostream& out);
+void write_stats(const Stats& stats, StatsFormat format, std::ostream& out);
+
+// Writes a snapshot every period of host time. The target is a file path,
+// rewritten each time, or "unix:/path" for a listening local socket (POSIX
+// only) that receives each snapshot as it is taken.
+class StatsReporter
+{
+private:
+	std::string target_;
+	StatsFormat format_;
+	std::chrono::steady_clock::duration period_;
+	std::chrono::steady_clock::time_point last_;
+	int socket_;
+
+	bool send_(const std::string& text);
+
+public:
+	StatsReporter(const std::string& target, StatsFormat format, u32 period_ms);
+	~StatsReporter();
+	StatsReporter(const StatsReporter&) = delete;
+	StatsReporter& operator=(const StatsReporter&) = delete;
+
+	// Cheap unless the period has elapsed, meant to be called from the run loop
+	void poll(const Stats& stats)
+	{
+		if (std::chrono::steady_clock::now() - last_ >= period_)
+		{
+			write(stats);
+		}
+	}
+
+	bool write(const Stats& stats);
+};
@@ -0,0 +1,257 @@
+#include "tty.h"
+#include "address_map.h"
+#include "hash.h"
+#include "log.h"
+#include <iostream>
+
+// DUART registers, offsets from TTY_DUART_OFFSET. Channel B is 8 further.
+#define DUART_MODE 0x0
+#define DUART_STATUS 0x1			// read, CSR on write
+#define DUART_COMMAND 0x2
+#define DUART_DATA 0x3				// RHR on read, THR on write
+#define DUART_INTERRUPT_STATUS 0x5	// read, IMR on write
+#define DUART_CHANNEL_B 0x8
+
+#define DUART_STATUS_TX_READY 0x0c			// TxRDY and TxEMT
+#define DUART_INTERRUPT_TX_READY 0x11		// TxRDYA and TxRDYB
+#define DUART_COMMAND_RESET_MODE 0x10		// command field of CR, bits 4-6
+
+TtyFile::TtyFile(std::string path) :
+	file_(path, std::ios::trunc),
+	closing_(false)
+{
+	if (!file_)
+	{
+		std::cerr << "Error opening TTY output file " << path << std::endl;
+		return;
+	}
+	writer_ = std::thread(&TtyFile::run_writer_, this);
+}
+
+TtyFile::~TtyFile()
+{
+	if (writer_.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			closing_ = true;
+		}
+		wake_.notify_one();
+		writer_.join();
+	}
+}
+
+void TtyFile::run_writer_()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (;;)
+	{
+		wake_.wait(lock, [this]() { return closing_ || !pending_.empty(); });
+		std::deque<std::string> lines;
+		lines.swap(pending_);
+		bool closing = closing_;
+
+		lock.unlock();
+		for (const std::string& line : lines)
+		{
+			file_ << line << '\n';
+		}
+		file_.flush();
+		lock.lock();
+
+		if (closing && pending_.empty())
+		{
+			return;
+		}
+	}
+}
+
+void TtyFile::write_line(const std::string& line)
+{
+	if (!writer_.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.push_back(line);
+	}
+	wake_.notify_one();
+}
+
+bool TtyFile::is_open() const
+{
+	return file_.is_open();
+}
+
+Tty::Tty() :
+	mode_{},
+	mode_index_{},
+	registers_{},
+	post_(0),
+	transmitted_(0),
+	sink_(nullptr)
+{
+}
+
+u8 Tty::load8(u32 offset)
+{
+	if (offset == TTY_POST_OFFSET)
+	{
+		return post_;
+	}
+	if (offset < TTY_DUART_OFFSET || offset >= TTY_DUART_OFFSET + TTY_DUART_SIZE)
+	{
+		LOG_WARN(Bus, "Unhandled read from Expansion 2 register: {}", EXPANSION2_START_ADDRESS + offset);
+		return 0;
+	}
+
+	u32 reg = offset - TTY_DUART_OFFSET;
+	u32 channel = reg / DUART_CHANNEL_B;
+	switch (reg)
+	{
+	case DUART_MODE:
+	case DUART_CHANNEL_B + DUART_MODE:
+	{
+		u8 value = mode_[channel][mode_index_[channel]];
+		mode_index_[channel] = 1;
+		return value;
+	}
+	case DUART_STATUS:
+	case DUART_CHANNEL_B + DUART_STATUS:
+		return DUART_STATUS_TX_READY;
+	case DUART_DATA:
+	case DUART_CHANNEL_B + DUART_DATA:
+		return 0;
+	case DUART_INTERRUPT_STATUS:
+		return DUART_INTERRUPT_TX_READY;
+	default:
+		return registers_[reg];
+	}
+}
+
+void Tty::store8(u32 offset, u8 value)
+{
+	if (offset == TTY_POST_OFFSET)
+	{
+		post_ = value;
+		LOG_DEBUG(Bus, "POST {}", value);
+		return;
+	}
+	if (offset < TTY_DUART_OFFSET || offset >= TTY_DUART_OFFSET + TTY_DUART_SIZE)
+	{
+		LOG_WARN(Bus, "Unhandled write to Expansion 2 register: {}", EXPANSION2_START_ADDRESS + offset);
+		return;
+	}
+
+	u32 reg = offset - TTY_DUART_OFFSET;
+	u32 channel = reg / DUART_CHANNEL_B;
+	switch (reg)
+	{
+	case DUART_MODE:
+	case DUART_CHANNEL_B + DUART_MODE:
+		mode_[channel][mode_index_[channel]] = value;
+		mode_index_[channel] = 1;
+		break;
+	case DUART_COMMAND:
+	case DUART_CHANNEL_B + DUART_COMMAND:
+		if ((value & 0x70) == DUART_COMMAND_RESET_MODE)
+		{
+			mode_index_[channel] = 0;
+		}
+		registers_[reg] = value;
+		break;
+	case DUART_DATA:
+	case DUART_CHANNEL_B + DUART_DATA:
+		transmit_(value);
+		break;
+	default:
+		registers_[reg] = value;
+		break;
+	}
+}
+
+void Tty::transmit_(u8 c)
+{
+	transmitted_++;
+	text_.total++;
+	text_.tail.push_back(static_cast<char>(c));
+	if (text_.tail.size() >= 2 * TTY_TAIL_SIZE)
+	{
+		text_.tail.erase(0, text_.tail.size() - TTY_TAIL_SIZE);
+	}
+	if (c != '\n')
+	{
+		text_.line.push_back(static_cast<char>(c));
+		if (text_.line.size() >= TTY_TAIL_SIZE)
+		{
+			flush_line();
+		}
+		return;
+	}
+	if (!text_.line.empty() && text_.line.back() == '\r')
+	{
+		text_.line.pop_back();
+	}
+	if (sink_ != nullptr)
+	{
+		sink_->write_line(text_.line);
+	}
+	text_.line.clear();
+}
+
+void Tty::write(const char* text, usize length)
+{
+	for (usize i = 0; i < length; i++)
+	{
+		transmit_(static_cast<u8>(text[i]));
+	}
+}
+
+void Tty::flush_line()
+{
+	if (text_.line.empty())
+	{
+		return;
+	}
+	if (sink_ != nullptr)
+	{
+		sink_->write_line(text_.line);
+	}
+	text_.line.clear();
+}
+
+void Tty::set_sink(TtySink* sink)
+{
+	sink_ = sink;
+}
+
+const std::string& Tty::output() const
+{
+	return text_.tail;
+}
+
+u64 Tty::output_total() const
+{
+	return text_.total;
+}
+
+void Tty::clear_output()
+{
+	text_.tail.clear();
+	text_.line.clear();
+}
+
+u8 Tty::post() const
+{
+	return post_;
+}
+
+u64 Tty::hash(u64 seed) const
+{
+	u64 hash = fnv1a(seed, mode_, sizeof(mode_));
+	hash = fnv1a(hash, mode_index_, sizeof(mode_index_));
+	hash = fnv1a(hash, registers_, sizeof(registers_));
+	hash = fnv1a_value(hash, post_);
+	return fnv1a_value(hash, transmitted_);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "types.h"
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Offsets in Expansion 2
+#define TTY_DUART_OFFSET 0x20
+#define TTY_DUART_SIZE 16
+#define TTY_POST_OFFSET 0x41
+// Output kept by the device, more than a run loop slice can print. The sink
+// gets all of it.
+#define TTY_TAIL_SIZE (64*1024)
+
+// Receives the text written to the TTY one line at a time, without the
+// line ending
+class TtySink
+{
+public:
+	virtual ~TtySink() {}
+	virtual void write_line(const std::string& line) = 0;
+};
+
+// Appends the lines to a text file from a writer thread, so the emulation
+// never waits on the disk. Everything is written when it is destroyed.
+class TtyFile : public TtySink
+{
+private:
+	std::ofstream file_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::deque<std::string> pending_;
+	bool closing_;
+	std::thread writer_;
+
+	void run_writer_();
+
+public:
+	TtyFile(std::string path);
+	~TtyFile();
+	TtyFile(const TtyFile&) = delete;
+	TtyFile& operator=(const TtyFile&) = delete;
+	void write_line(const std::string& line) override;
+	bool is_open() const;
+};
+
+// Text transmitted by the TTY. It is host side output, not machine state:
+// copies start without it and assignments leave it alone, so snapshots
+// neither copy nor rewind it.
+struct TtyText
+{
+	std::string tail;			// the last TTY_TAIL_SIZE characters at least
+	std::string line;			// not passed to the sink yet
+	u64 total;					// characters ever transmitted
+
+	TtyText() :
+		total(0) {}
+	TtyText(const TtyText&) :
+		total(0) {}
+	TtyText& operator=(const TtyText&)
+	{
+		return *this;
+	}
+};
+
+// Debug hardware of Expansion 2: the SCN2681 DUART at 0x1f802020, whose
+// two channels are used as terminals, and the POST display at 0x1f802041.
+// Characters go out as soon as they are written: the transmitters always
+// report ready and nothing is ever received.
+class Tty
+{
+private:
+	u8 mode_[2][2];				// MR1 and MR2 of each channel
+	u8 mode_index_[2];
+	u8 registers_[TTY_DUART_SIZE];	// last value written to the others
+	u8 post_;
+
+	u64 transmitted_;			// both channels
+	TtyText text_;
+	TtySink* sink_;
+
+	void transmit_(u8 c);
+
+public:
+	Tty();
+	// Offsets in Expansion 2
+	u8 load8(u32 offset);
+	void store8(u32 offset, u8 value);
+	// Text printed by any other route, the HLE BIOS putchar for one
+	void write(const char* text, usize length);
+	// Passes the line being written to the sink, at the end of a run.
+	// Lines longer than TTY_TAIL_SIZE are passed in pieces.
+	void flush_line();
+	void set_sink(TtySink* sink);
+
+	// The latest text, see TtyText
+	const std::string& output() const;
+	// Characters transmitted by this instance, output() ends with the last ones
+	u64 output_total() const;
+	void clear_output();
+	u8 post() const;
+	// Chains the registers and the amount of output onto an FNV-1a hash
+	u64 hash(u64 seed) const;
+};
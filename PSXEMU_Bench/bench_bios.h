@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+// BIOS image used by the benchmarks: PSXEMU_BIOS, or the one next to the
+// emulator sources
+inline std::string bench_bios_path()
+{
+	const char* path = std::getenv("PSXEMU_BIOS");
+	return (path != nullptr) ? path : PSXEMU_BENCH_BIOS;
+}
+
+inline bool bench_bios_available()
+{
+	return static_cast<bool>(std::ifstream(bench_bios_path(), std::ios::binary));
+}
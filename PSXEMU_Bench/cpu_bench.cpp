@@ -0,0 +1,299 @@
+#include <benchmark/benchmark.h>
+#include "cpu_core.h"
+#include "bench_bios.h"
+#include "lockstep.h"
+#include "replay.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+
+#define STREAM_ADDRESS 0x80010000
+#define STREAM_DATA 0x80100000
+#define STEPS_PER_ITERATION 10000
+
+enum Reg : u32
+{
+	ZERO = 0, T0 = 8, T1 = 9, T2 = 10, T3 = 11, T4 = 12, T5 = 13, T6 = 14, T7 = 15, S0 = 16
+};
+
+static u32 i_type(u32 op, u32 rs, u32 rt, u32 imm)
+{
+	return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff);
+}
+
+static u32 r_type(u32 funct, u32 rs, u32 rt, u32 rd, u32 sa = 0)
+{
+	return (rs << 21) | (rt << 16) | (rd << 11) | (sa << 6) | funct;
+}
+
+static u32 jump(u32 target)
+{
+	return (0x02 << 26) | ((target >> 2) & 0x3ffffff);
+}
+
+static u32 addiu(u32 rt, u32 rs, u32 imm) { return i_type(0x09, rs, rt, imm); }
+static u32 ori(u32 rt, u32 rs, u32 imm) { return i_type(0x0d, rs, rt, imm); }
+static u32 lui(u32 rt, u32 imm) { return i_type(0x0f, 0, rt, imm); }
+static u32 lw(u32 rt, u32 base, u32 offset) { return i_type(0x23, base, rt, offset); }
+static u32 lbu(u32 rt, u32 base, u32 offset) { return i_type(0x24, base, rt, offset); }
+static u32 sw(u32 rt, u32 base, u32 offset) { return i_type(0x2b, base, rt, offset); }
+static u32 sb(u32 rt, u32 base, u32 offset) { return i_type(0x28, base, rt, offset); }
+static u32 bne(u32 rs, u32 rt, s32 offset) { return i_type(0x05, rs, rt, static_cast<u32>(offset)); }
+static u32 beq(u32 rs, u32 rt, s32 offset) { return i_type(0x04, rs, rt, static_cast<u32>(offset)); }
+static u32 bgtz(u32 rs, s32 offset) { return i_type(0x07, rs, 0, static_cast<u32>(offset)); }
+
+static const u32 NOP = 0;
+
+// Program of `body` repeated, looping forever
+static PsxExe make_stream(const std::function<void(std::vector<u32>&)>& prologue,
+	const std::function<void(std::vector<u32>&)>& body, u32 repeat)
+{
+	std::vector<u32> code;
+	prologue(code);
+	u32 loop = STREAM_ADDRESS + static_cast<u32>(code.size()) * 4;
+	for (u32 i = 0; i < repeat; i++)
+	{
+		body(code);
+	}
+	code.push_back(jump(loop));
+	code.push_back(NOP);
+
+	PsxExe exe;
+	exe.pc = STREAM_ADDRESS;
+	exe.gp = 0;
+	exe.text_address = STREAM_ADDRESS;
+	exe.bss_address = STREAM_DATA;
+	exe.bss_size = 0x1000;
+	exe.stack_address = 0x801ffff0;
+	exe.text.resize(code.size() * 4);
+	for (usize i = 0; i < code.size(); i++)
+	{
+		for (u32 b = 0; b < 4; b++)
+		{
+			exe.text[i * 4 + b] = static_cast<u8>(code[i] >> (b * 8));
+		}
+	}
+	return exe;
+}
+
+static void run_stream(benchmark::State& state, const PsxExe& exe)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	core.fast_boot(exe, nullptr);
+	for (auto _ : state)
+	{
+		for (u32 i = 0; i < STEPS_PER_ITERATION; i++)
+		{
+			core.run_next_instruction();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * STEPS_PER_ITERATION);
+}
+
+static void no_prologue(std::vector<u32>&)
+{
+}
+
+// Register to register arithmetic, no memory access besides the fetch
+static PsxExe alu_stream()
+{
+	return make_stream(no_prologue, [](std::vector<u32>& code)
+	{
+		code.push_back(addiu(T0, T0, 1));
+		code.push_back(r_type(0x21, T1, T0, T1));		// addu
+		code.push_back(r_type(0x25, T1, T0, T2));		// or
+		code.push_back(r_type(0x00, 0, T2, T3, 3));		// sll
+		code.push_back(r_type(0x23, T3, T1, T4));		// subu
+		code.push_back(r_type(0x24, T4, T2, T5));		// and
+		code.push_back(r_type(0x2b, T5, T4, T6));		// sltu
+		code.push_back(r_type(0x03, 0, T4, T7, 2));		// sra
+		code.push_back(ori(T6, T6, 0x55));
+	}, 64);
+}
+
+// Loads and stores to RAM with the values used right after the load delay
+static PsxExe load_stream()
+{
+	return make_stream([](std::vector<u32>& code)
+	{
+		code.push_back(lui(S0, STREAM_DATA >> 16));
+	}, [](std::vector<u32>& code)
+	{
+		code.push_back(lw(T0, S0, 0));
+		code.push_back(lw(T1, S0, 4));
+		code.push_back(r_type(0x21, T0, T1, T2));		// addu
+		code.push_back(sw(T2, S0, 8));
+		code.push_back(lbu(T3, S0, 9));
+		code.push_back(sb(T3, S0, 0));
+		code.push_back(sw(T3, S0, 4));
+		code.push_back(lw(T4, S0, 8));
+		code.push_back(addiu(T4, T4, 3));
+	}, 64);
+}
+
+static void BM_CoreAluStream(benchmark::State& state)
+{
+	run_stream(state, alu_stream());
+}
+BENCHMARK(BM_CoreAluStream);
+
+// Short counted loops: a taken branch every three instructions
+static void BM_CoreBranchStream(benchmark::State& state)
+{
+	PsxExe exe = make_stream(no_prologue, [](std::vector<u32>& code)
+	{
+		code.push_back(addiu(T0, ZERO, 8));
+		code.push_back(addiu(T0, T0, static_cast<u32>(-1)));
+		code.push_back(bne(T0, ZERO, -2));
+		code.push_back(NOP);
+		code.push_back(bgtz(T0, 4));					// never taken
+		code.push_back(NOP);
+		code.push_back(beq(ZERO, ZERO, 1));				// skips one instruction
+		code.push_back(NOP);
+		code.push_back(NOP);
+	}, 32);
+	run_stream(state, exe);
+}
+BENCHMARK(BM_CoreBranchStream);
+
+static void BM_CoreLoadStream(benchmark::State& state)
+{
+	run_stream(state, load_stream());
+}
+BENCHMARK(BM_CoreLoadStream);
+
+// range(0) copies of the booted core, items are instructions summed over
+// every copy
+static void make_lanes(benchmark::State& state, const PsxExe& exe,
+	std::vector<std::unique_ptr<CoreSnapshot>>& copies, std::vector<CPU::Core*>& lanes)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	core.fast_boot(exe, nullptr);
+	for (int64_t i = 0; i < state.range(0); i++)
+	{
+		copies.emplace_back(new CoreSnapshot(core));
+		lanes.push_back(&copies.back()->core());
+	}
+}
+
+// The copies run one after the other, the baseline of the lockstep batch
+static void run_separate_stream(benchmark::State& state, const PsxExe& exe)
+{
+	std::vector<std::unique_ptr<CoreSnapshot>> copies;
+	std::vector<CPU::Core*> lanes;
+	make_lanes(state, exe, copies, lanes);
+	for (auto _ : state)
+	{
+		for (CPU::Core* lane : lanes)
+		{
+			for (u32 i = 0; i < STEPS_PER_ITERATION; i++)
+			{
+				lane->run_next_instruction();
+			}
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * STEPS_PER_ITERATION * state.range(0));
+}
+
+static void run_lockstep_stream(benchmark::State& state, const PsxExe& exe)
+{
+	std::vector<std::unique_ptr<CoreSnapshot>> copies;
+	std::vector<CPU::Core*> lanes;
+	make_lanes(state, exe, copies, lanes);
+	CPU::LockstepBatch batch(lanes);
+	for (auto _ : state)
+	{
+		batch.run(STEPS_PER_ITERATION);
+	}
+	state.SetItemsProcessed(state.iterations() * STEPS_PER_ITERATION * state.range(0));
+}
+
+static void BM_SeparateAluStream(benchmark::State& state)
+{
+	run_separate_stream(state, alu_stream());
+}
+BENCHMARK(BM_SeparateAluStream)->Arg(8)->Arg(16);
+
+static void BM_LockstepAluStream(benchmark::State& state)
+{
+	run_lockstep_stream(state, alu_stream());
+}
+BENCHMARK(BM_LockstepAluStream)->Arg(1)->Arg(8)->Arg(16);
+
+static void BM_SeparateLoadStream(benchmark::State& state)
+{
+	run_separate_stream(state, load_stream());
+}
+BENCHMARK(BM_SeparateLoadStream)->Arg(8)->Arg(16);
+
+static void BM_LockstepLoadStream(benchmark::State& state)
+{
+	run_lockstep_stream(state, load_stream());
+}
+BENCHMARK(BM_LockstepLoadStream)->Arg(1)->Arg(8)->Arg(16);
+
+class NullBuffer : public std::streambuf
+{
+protected:
+	int overflow(int c) override
+	{
+		return c;
+	}
+};
+
+// Cold boot from the reset vector, range(0) million instructions per iteration.
+// The console messages of the interconnect are discarded.
+static void BM_BiosBoot(benchmark::State& state)
+{
+	if (!bench_bios_available())
+	{
+		state.SkipWithError("BIOS image not found, set PSXEMU_BIOS");
+		return;
+	}
+
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	u64 n_instructions = static_cast<u64>(state.range(0)) * 1000000;
+	NullBuffer null_buffer;
+	std::streambuf* cout_buffer = std::cout.rdbuf(&null_buffer);
+	for (auto _ : state)
+	{
+		CPU::Core core = CPU::Core(interconnect);
+		for (u64 i = 0; i < n_instructions; i++)
+		{
+			core.run_next_instruction();
+		}
+	}
+	std::cout.rdbuf(cout_buffer);
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_instructions));
+}
+BENCHMARK(BM_BiosBoot)->Arg(1)->Arg(10)->Unit(benchmark::kMillisecond);
+
+// Same boot with BIOS code run from the block cache, warm after the first iteration
+static void BM_BiosBootBlocks(benchmark::State& state)
+{
+	if (!bench_bios_available())
+	{
+		state.SkipWithError("BIOS image not found, set PSXEMU_BIOS");
+		return;
+	}
+
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	BlockCache cache(interconnect.bios());
+	u64 n_instructions = static_cast<u64>(state.range(0)) * 1000000;
+	NullBuffer null_buffer;
+	std::streambuf* cout_buffer = std::cout.rdbuf(&null_buffer);
+	for (auto _ : state)
+	{
+		CPU::Core core = CPU::Core(interconnect);
+		core.set_block_cache(&cache);
+		for (u64 i = 0; i < n_instructions; )
+		{
+			i += core.run_block(static_cast<u32>(std::min<u64>(n_instructions - i, 0x10000)));
+		}
+	}
+	std::cout.rdbuf(cout_buffer);
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n_instructions));
+}
+BENCHMARK(BM_BiosBootBlocks)->Arg(1)->Arg(10)->Unit(benchmark::kMillisecond);
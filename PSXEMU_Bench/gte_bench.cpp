@@ -0,0 +1,131 @@
+#include <benchmark/benchmark.h>
+#include "gte.h"
+
+using namespace CPU;
+
+static const u32
+	GTE_RTPS = 0x0180001,
+	GTE_RTPT = 0x0280030,
+	GTE_NCLIP = 0x1400006,
+	GTE_MVMVA = 0x0480012,	// sf = 1, RT * V0 + TR
+	GTE_NCDS = 0x0e80413,
+	GTE_NCDT = 0x0f80416,
+	GTE_AVSZ3 = 0x158002d,
+	GTE_AVSZ4 = 0x168002e;
+
+// A typical scene setup: rotated camera, lights and a projection plane
+static void setup_scene(Gte& gte)
+{
+	gte.set_control(0, 0x01000f00);		// RT11, RT12
+	gte.set_control(1, 0xff000100);		// RT13, RT21
+	gte.set_control(2, 0x01000f00);		// RT22, RT23
+	gte.set_control(3, 0x0100ff00);		// RT31, RT32
+	gte.set_control(4, 0x00000f00);		// RT33
+	gte.set_control(5, 0x00000040);		// TRX
+	gte.set_control(6, 0xffffffc0);		// TRY
+	gte.set_control(7, 0x00000800);		// TRZ
+	gte.set_control(8, 0x0c000400);		// L11, L12
+	gte.set_control(9, 0x04000200);		// L13, L21
+	gte.set_control(12, 0x00000800);	// L33
+	gte.set_control(16, 0x08001000);	// LR1, LR2
+	gte.set_control(18, 0x10000800);	// LG2, LG3
+	gte.set_control(20, 0x00001000);	// LB3
+	gte.set_control(13, 0x00000200);	// RBK
+	gte.set_control(21, 0x00000100);	// RFC
+	gte.set_control(24, 160 << 16);		// OFX
+	gte.set_control(25, 120 << 16);		// OFY
+	gte.set_control(26, 0x200);			// H
+	gte.set_control(27, 0xfffffe00);	// DQA
+	gte.set_control(28, 0x01400000);	// DQB
+	gte.set_control(29, 0x155);			// ZSF3
+	gte.set_control(30, 0x100);			// ZSF4
+
+	gte.set_data(0, 0x00400020);		// V0
+	gte.set_data(1, 0x00000100);
+	gte.set_data(2, 0xffc00040);		// V1
+	gte.set_data(3, 0x00000180);
+	gte.set_data(4, 0x0040ffc0);		// V2
+	gte.set_data(5, 0x00000200);
+	gte.set_data(6, 0x00808080);		// RGBC
+	gte.set_data(8, 0x00000800);		// IR0
+}
+
+static void BM_GteCommand(benchmark::State& state, u32 command)
+{
+	Gte gte;
+	setup_scene(gte);
+	for (auto _ : state)
+	{
+		gte.execute(command);
+		benchmark::DoNotOptimize(gte.get_data(14));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_GteCommand, RTPS, GTE_RTPS);
+BENCHMARK_CAPTURE(BM_GteCommand, RTPT, GTE_RTPT);
+BENCHMARK_CAPTURE(BM_GteCommand, NCLIP, GTE_NCLIP);
+BENCHMARK_CAPTURE(BM_GteCommand, MVMVA, GTE_MVMVA);
+BENCHMARK_CAPTURE(BM_GteCommand, NCDS, GTE_NCDS);
+BENCHMARK_CAPTURE(BM_GteCommand, NCDT, GTE_NCDT);
+BENCHMARK_CAPTURE(BM_GteCommand, AVSZ3, GTE_AVSZ3);
+BENCHMARK_CAPTURE(BM_GteCommand, AVSZ4, GTE_AVSZ4);
+
+// The usual per-polygon sequence of a 3D title
+static void BM_GteTriangle(benchmark::State& state)
+{
+	Gte gte;
+	setup_scene(gte);
+	for (auto _ : state)
+	{
+		gte.execute(GTE_RTPT);
+		gte.execute(GTE_NCLIP);
+		gte.execute(GTE_AVSZ3);
+		gte.execute(GTE_NCDT);
+		benchmark::DoNotOptimize(gte.get_data(7));
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GteTriangle);
+
+static void fill_lanes(GteMacLanes& lanes)
+{
+	for (u32 l = 0; l < 4; l++)
+	{
+		lanes.t[l] = 0x1000 * (l + 1);
+		for (u32 i = 0; i < 3; i++)
+		{
+			lanes.a[i][l] = 0x0f00 - static_cast<s32>(i * 0x300);
+			lanes.b[i][l] = 0x0100 + static_cast<s32>(l * 0x40);
+		}
+	}
+}
+
+static void BM_GteMacLanes(benchmark::State& state)
+{
+	GteMacLanes lanes;
+	GteMacResult result;
+	fill_lanes(lanes);
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(&lanes);
+		Gte::mac_lanes(lanes, result);
+		benchmark::DoNotOptimize(&result);
+	}
+	state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(BM_GteMacLanes);
+
+static void BM_GteMacLanesReference(benchmark::State& state)
+{
+	GteMacLanes lanes;
+	GteMacResult result;
+	fill_lanes(lanes);
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(&lanes);
+		Gte::mac_lanes_reference(lanes, result);
+		benchmark::DoNotOptimize(&result);
+	}
+	state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(BM_GteMacLanesReference);
@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+#include "gte_divide.h"
+#include <vector>
+
+using namespace CPU;
+
+struct DivideInput
+{
+	u32 h;
+	u32 sz3;
+};
+
+// Mostly in range divides, as produced by RTPS on visible geometry
+static std::vector<DivideInput> make_divide_inputs()
+{
+	std::vector<DivideInput> inputs(4096);
+	u32 seed = 0x12345678;
+	for (auto& input : inputs)
+	{
+		seed = seed * 1664525 + 1013904223;
+		input.h = 0x100 + ((seed >> 8) & 0x3ff);
+		input.sz3 = 0x200 + ((seed >> 16) & 0x7fff);
+	}
+	return inputs;
+}
+
+static void BM_UnrDivide(benchmark::State& state)
+{
+	auto inputs = make_divide_inputs();
+	for (auto _ : state)
+	{
+		for (const auto& input : inputs)
+		{
+			bool overflow;
+			benchmark::DoNotOptimize(unr_divide(input.h, input.sz3, overflow));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK(BM_UnrDivide);
+
+static void BM_UnrDivideReference(benchmark::State& state)
+{
+	auto inputs = make_divide_inputs();
+	for (auto _ : state)
+	{
+		for (const auto& input : inputs)
+		{
+			bool overflow;
+			benchmark::DoNotOptimize(unr_divide_reference(input.h, input.sz3, overflow));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK(BM_UnrDivideReference);
+
+// Rounded hardware integer division, for scale
+static void BM_ExactDivide(benchmark::State& state)
+{
+	auto inputs = make_divide_inputs();
+	for (auto _ : state)
+	{
+		for (const auto& input : inputs)
+		{
+			u32 q = ((input.h * 0x20000 / input.sz3) + 1) / 2;
+			benchmark::DoNotOptimize(q > 0x1ffff ? 0x1ffff : q);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK(BM_ExactDivide);
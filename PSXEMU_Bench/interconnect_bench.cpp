@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+#include "interconnect.h"
+#include "bench_bios.h"
+#include "log.h"
+
+// Addresses are spread over 4 KB so the loop isn't a single cache line
+#define BENCH_ACCESSES 1024
+
+static void BM_InterconnectLoad32(benchmark::State& state, u32 base)
+{
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	for (auto _ : state)
+	{
+		for (u32 i = 0; i < BENCH_ACCESSES; i++)
+		{
+			benchmark::DoNotOptimize(interconnect.load<u32>(base + ((i * 4) & 0xffc)));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * BENCH_ACCESSES);
+}
+BENCHMARK_CAPTURE(BM_InterconnectLoad32, ram_kseg0, 0x80010000u);
+BENCHMARK_CAPTURE(BM_InterconnectLoad32, ram_kseg1, 0xa0010000u);
+BENCHMARK_CAPTURE(BM_InterconnectLoad32, bios_kseg1, 0xbfc00000u);
+
+// Device registers are a handful of words: the same one is hit every time
+static void BM_InterconnectLoad32Register(benchmark::State& state, u32 address)
+{
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	for (auto _ : state)
+	{
+		for (u32 i = 0; i < BENCH_ACCESSES; i++)
+		{
+			benchmark::DoNotOptimize(interconnect.load<u32>(address));
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * BENCH_ACCESSES);
+}
+BENCHMARK_CAPTURE(BM_InterconnectLoad32Register, spu, 0x1f801d88u);
+BENCHMARK_CAPTURE(BM_InterconnectLoad32Register, dma, 0x1f8010f0u);
+BENCHMARK_CAPTURE(BM_InterconnectLoad32Register, mdec, 0x1f801824u);
+
+static void BM_InterconnectStore32(benchmark::State& state, u32 base, u32 span_mask)
+{
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	u32 value = 0;
+	for (auto _ : state)
+	{
+		for (u32 i = 0; i < BENCH_ACCESSES; i++)
+		{
+			interconnect.store<u32>(base + ((i * 4) & span_mask), value++);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * BENCH_ACCESSES);
+}
+BENCHMARK_CAPTURE(BM_InterconnectStore32, ram_kseg0, 0x80010000u, 0xffcu);
+BENCHMARK_CAPTURE(BM_InterconnectStore32, ram_kseg1, 0xa0010000u, 0xffcu);
+BENCHMARK_CAPTURE(BM_InterconnectStore32, spu_voice, 0x1f801c00u, 0x17cu);
+
+// Unhandled register: every store logs a warning. Filtered, or rate limited
+// so that nearly all messages stop at the call site.
+static void BM_InterconnectStore32Logged(benchmark::State& state, LogLevel level)
+{
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	log_set_level(LogSubsystem::Bus, level);
+	for (auto _ : state)
+	{
+		for (u32 i = 0; i < BENCH_ACCESSES; i++)
+		{
+			interconnect.store<u32>(CACHE_CONTROL, i);
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * BENCH_ACCESSES);
+	log_flush();
+	log_set_level(LogSubsystem::Bus, LogLevel::Info);
+}
+BENCHMARK_CAPTURE(BM_InterconnectStore32Logged, filtered, LogLevel::Error);
+BENCHMARK_CAPTURE(BM_InterconnectStore32Logged, rate_limited, LogLevel::Warn);
+
+// Debug port text going to a file, a line every 64 characters
+static void BM_InterconnectTtyStore8(benchmark::State& state)
+{
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	TtyFile file("tty_bench.txt");
+	interconnect.tty().set_sink(&file);
+	for (auto _ : state)
+	{
+		for (u32 i = 0; i < BENCH_ACCESSES; i++)
+		{
+			interconnect.store<u8>(0x1f802023, ((i & 63) == 63) ? '\n' : 'a' + (i & 15));
+		}
+		interconnect.tty().clear_output();
+	}
+	state.SetItemsProcessed(state.iterations() * BENCH_ACCESSES);
+}
+BENCHMARK(BM_InterconnectTtyStore8);
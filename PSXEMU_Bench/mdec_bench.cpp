@@ -0,0 +1,182 @@
+#include <benchmark/benchmark.h>
+#include "mdec.h"
+#include <cstdlib>
+#include <fstream>
+#include <random>
+
+#define FRAME_MACROBLOCKS 300				// 320x240
+
+static const u16 SCALE_TABLE[MDEC_BLOCK_SIZE] =
+{
+	0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82,
+	0x7d8a, 0x6a6d, 0x471c, 0x18f8, 0xe707, 0xb8e3, 0x9592, 0x8275,
+	0x7641, 0x30fb, 0xcf04, 0x89be, 0x89be, 0xcf04, 0x30fb, 0x7641,
+	0x6a6d, 0xe707, 0x8275, 0xb8e3, 0x471c, 0x7d8a, 0x18f8, 0x9592,
+	0x5a82, 0xa57d, 0xa57d, 0x5a82, 0x5a82, 0xa57d, 0xa57d, 0x5a82,
+	0x471c, 0x8275, 0x18f8, 0x6a6d, 0x9592, 0xe707, 0x7d8a, 0xb8e3,
+	0x30fb, 0x89be, 0x7641, 0xcf04, 0xcf04, 0x7641, 0x89be, 0x30fb,
+	0x18f8, 0xb8e3, 0x6a6d, 0x8275, 0x7d8a, 0x9592, 0x471c, 0xe707
+};
+
+static void upload_tables(Mdec& mdec)
+{
+	// Flat quantization: the cost of decoding doesn't depend on the values
+	mdec.store32(0, (2u << 29) | 0x1);
+	for (u32 i = 0; i < 32; i++)
+	{
+		mdec.store32(0, 0x02020202);
+	}
+	mdec.store32(0, 3u << 29);
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i += 2)
+	{
+		mdec.store32(0, SCALE_TABLE[i] | (static_cast<u32>(SCALE_TABLE[i + 1]) << 16));
+	}
+}
+
+// Run length encoded blocks with a handful of non zero coefficients each,
+// like the output of the movie encoders at usual bitrates
+static std::vector<u32> synthesize_stream(u32 n_macroblocks)
+{
+	std::mt19937 rng(31);
+	std::uniform_int_distribution<u32> run(0, 6);
+	std::uniform_int_distribution<s32> level(-64, 63);
+	std::uniform_int_distribution<s32> dc(-256, 255);
+
+	std::vector<u16> halfwords;
+	for (u32 n = 0; n < n_macroblocks * 6; n++)
+	{
+		halfwords.push_back(static_cast<u16>((4 << 10) | (dc(rng) & 0x3ff)));
+		u32 k = 0;
+		for (;;)
+		{
+			u32 skip = run(rng);
+			if (k + skip + 1 > 63)
+			{
+				break;
+			}
+			k += skip + 1;
+			halfwords.push_back(static_cast<u16>((skip << 10) | (level(rng) & 0x3ff)));
+		}
+		halfwords.push_back(0xfe00);
+	}
+	if (halfwords.size() % 2 != 0)
+	{
+		halfwords.push_back(0xfe00);
+	}
+
+	std::vector<u32> words(halfwords.size() / 2);
+	for (usize i = 0; i < words.size(); i++)
+	{
+		words[i] = halfwords[2 * i] | (static_cast<u32>(halfwords[2 * i + 1]) << 16);
+	}
+	return words;
+}
+
+// Parameter words of a decode command captured from a game (PSXEMU_MDEC_STREAM,
+// raw little endian), a synthetic frame otherwise
+static std::vector<u32> load_stream()
+{
+	const char* path = std::getenv("PSXEMU_MDEC_STREAM");
+	if (path != nullptr)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (file)
+		{
+			std::vector<u32> words(static_cast<usize>(file.tellg()) / 4);
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(words.data()), words.size() * 4);
+			return words;
+		}
+	}
+	return synthesize_stream(FRAME_MACROBLOCKS);
+}
+
+// One frame worth of 24 bit macroblocks through the command port, output drained
+static void BM_MdecDecodeStream(benchmark::State& state)
+{
+	Mdec mdec;
+	upload_tables(mdec);
+	std::vector<u32> stream = load_stream();
+	u32 command = (1u << 29) | (2u << 27) | static_cast<u32>(stream.size());
+
+	usize macroblocks = 0;
+	for (auto _ : state)
+	{
+		mdec.store32(0, command);
+		for (u32 word : stream)
+		{
+			mdec.store32(0, word);
+		}
+		macroblocks += mdec.output_available() / (MDEC_MACROBLOCK_PIXELS * 3 / 4);
+		while (mdec.output_available() > 0)
+		{
+			benchmark::DoNotOptimize(mdec.dma_read());
+		}
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(macroblocks));
+	state.counters["fps"] = benchmark::Counter(static_cast<double>(macroblocks) / FRAME_MACROBLOCKS,
+		benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_MdecDecodeStream);
+
+static void random_blocks(std::vector<MdecBlock>& blocks)
+{
+	std::mt19937 rng(7);
+	std::uniform_int_distribution<s32> coefficient(-0x400, 0x3ff);
+	for (MdecBlock& block : blocks)
+	{
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			block.value[i] = (rng() % 8 == 0) ? coefficient(rng) : 0;
+		}
+	}
+}
+
+template <void (*Idct)(const MdecBlock&, const s32*, MdecBlock&)>
+static void BM_MdecIdct(benchmark::State& state)
+{
+	std::vector<MdecBlock> blocks(1024);
+	random_blocks(blocks);
+	alignas(32) s32 scale[MDEC_BLOCK_SIZE];
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+	{
+		scale[i] = static_cast<s16>(SCALE_TABLE[i]);
+	}
+
+	MdecBlock out;
+	for (auto _ : state)
+	{
+		for (const MdecBlock& block : blocks)
+		{
+			Idct(block, scale, out);
+			benchmark::DoNotOptimize(out);
+		}
+	}
+	state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * blocks.size()));
+}
+BENCHMARK_TEMPLATE(BM_MdecIdct, Mdec::idct);
+BENCHMARK_TEMPLATE(BM_MdecIdct, Mdec::idct_reference);
+
+template <void (*YuvToRgb)(const MdecBlock&, const MdecBlock&, const MdecBlock*, bool, u32*)>
+static void BM_MdecYuvToRgb(benchmark::State& state)
+{
+	std::vector<MdecBlock> blocks(6);
+	std::mt19937 rng(11);
+	for (MdecBlock& block : blocks)
+	{
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			block.value[i] = static_cast<s32>(rng() % 256) - 128;
+		}
+	}
+
+	u32 rgb[MDEC_MACROBLOCK_PIXELS];
+	for (auto _ : state)
+	{
+		YuvToRgb(blocks[0], blocks[1], &blocks[2], false, rgb);
+		benchmark::DoNotOptimize(rgb);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_MdecYuvToRgb, Mdec::yuv_to_rgb);
+BENCHMARK_TEMPLATE(BM_MdecYuvToRgb, Mdec::yuv_to_rgb_reference);
@@ -0,0 +1,219 @@
+#include <benchmark/benchmark.h>
+#include "interconnect.h"
+#include "bench_bios.h"
+#include "divergence.h"
+#include "explore.h"
+#include "fuzz.h"
+#include "page_store.h"
+#include "replay.h"
+
+static void BM_RamConstruct(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		Ram ram;
+		benchmark::DoNotOptimize(ram.data());
+	}
+	state.SetBytesProcessed(state.iterations() * RAM_ADDR_SPACE_SIZE);
+}
+BENCHMARK(BM_RamConstruct);
+
+static void BM_RamCopy(benchmark::State& state)
+{
+	Ram ram;
+	for (auto _ : state)
+	{
+		Ram copy(ram);
+		benchmark::DoNotOptimize(copy.data());
+	}
+	state.SetBytesProcessed(state.iterations() * RAM_ADDR_SPACE_SIZE);
+}
+BENCHMARK(BM_RamCopy);
+
+// Includes reading the image from the file system
+static void BM_BiosConstruct(benchmark::State& state)
+{
+	std::string path = bench_bios_path();
+	for (auto _ : state)
+	{
+		Bios bios(path);
+		benchmark::DoNotOptimize(bios.load<u32>(0));
+	}
+	state.SetBytesProcessed(state.iterations() * BIOS_ADDR_SPACE_SIZE);
+}
+BENCHMARK(BM_BiosConstruct);
+
+static void BM_BiosCopy(benchmark::State& state)
+{
+	Bios bios(bench_bios_path());
+	for (auto _ : state)
+	{
+		Bios copy(bios);
+		benchmark::DoNotOptimize(copy.load<u32>(0));
+	}
+	state.SetBytesProcessed(state.iterations() * BIOS_ADDR_SPACE_SIZE);
+}
+BENCHMARK(BM_BiosCopy);
+
+// Core and Main take the interconnect by value: every device is copied
+static void BM_InterconnectCopy(benchmark::State& state)
+{
+	Interconnect interconnect = Interconnect(Bios(bench_bios_path()));
+	for (auto _ : state)
+	{
+		Interconnect copy(interconnect);
+		benchmark::DoNotOptimize(copy.load<u32>(0xbfc00000));
+	}
+}
+BENCHMARK(BM_InterconnectCopy);
+
+// Branching a machine to run range(1) instructions on, by heap copy and by
+// fork(), range(0) branches per iteration
+static void run_copies(CPU::Core& core, u32 n_branches, u32 steps)
+{
+	for (u32 i = 0; i < n_branches; i++)
+	{
+		CoreSnapshot copy(core);
+		for (u32 step = 0; step < steps; step++)
+		{
+			copy.core().run_next_instruction();
+		}
+	}
+}
+
+static void BM_ExploreCopy(benchmark::State& state)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	for (auto _ : state)
+	{
+		run_copies(core, static_cast<u32>(state.range(0)), static_cast<u32>(state.range(1)));
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExploreCopy)->Args({ 8, 1000 })->Args({ 8, 100000 });
+
+static void BM_ExploreFork(benchmark::State& state)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	u32 steps = static_cast<u32>(state.range(1));
+	for (auto _ : state)
+	{
+		explore(core, static_cast<u32>(state.range(0)), [steps](CPU::Core& branch, u32)
+		{
+			for (u32 step = 0; step < steps; step++)
+			{
+				branch.run_next_instruction();
+			}
+			return std::vector<u8>();
+		});
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExploreFork)->Args({ 8, 1000 })->Args({ 8, 100000 })->UseRealTime();
+
+// Fuzz iterations running range(0) cycles of the BIOS, restore included
+static void BM_FuzzIterations(benchmark::State& state)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	FuzzOptions options;
+	options.input_address = 0x80100000;
+	options.max_cycles = static_cast<u64>(state.range(0));
+	Fuzzer fuzzer(core, options);
+	for (auto _ : state)
+	{
+		fuzzer.fuzz(1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FuzzIterations)->Arg(1000)->Arg(100000);
+
+static void BM_PageHash(benchmark::State& state)
+{
+	Ram ram;
+	const u8* data = static_cast<const Ram&>(ram).data();
+	for (auto _ : state)
+	{
+		for (u32 page = 0; page < RAM_N_PAGES; page++)
+		{
+			benchmark::DoNotOptimize(hash_page(data + page * PAGE_STORE_PAGE_SIZE));
+		}
+	}
+	state.SetBytesProcessed(state.iterations() * RAM_ADDR_SPACE_SIZE);
+}
+BENCHMARK(BM_PageHash);
+
+// 64 snapshots range(0) instructions apart during the BIOS boot, kept in a
+// page store. Reports the pages stored per snapshot, out of 640.
+static void BM_PagedSnapshotCorpus(benchmark::State& state)
+{
+	for (auto _ : state)
+	{
+		CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+		PageStore store;
+		std::vector<std::unique_ptr<PagedSnapshot>> snapshots;
+		for (u32 i = 0; i < 64; i++)
+		{
+			for (s64 step = 0; step < state.range(0); step++)
+			{
+				core.run_next_instruction();
+			}
+			snapshots.emplace_back(new PagedSnapshot(store, core));
+		}
+		state.counters["pages_per_snapshot"] = static_cast<double>(store.n_pages()) / snapshots.size();
+	}
+	state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(BM_PagedSnapshotCorpus)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_PagedSnapshotRestore(benchmark::State& state)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	PageStore store;
+	PagedSnapshot snapshot(store, core);
+	for (auto _ : state)
+	{
+		snapshot.restore(core);
+	}
+}
+BENCHMARK(BM_PagedSnapshotRestore);
+
+// Comparing a run every range(0) instructions of the BIOS boot: the whole
+// machine hashed incrementally, and CPU state and RAM hashed from scratch.
+// The boot starts over before it reaches code the core doesn't emulate.
+static void step_boot(CPU::Core& core, const CoreSnapshot& start, u64 n_instructions)
+{
+	if (core.state().cycles > 10000000)
+	{
+		start.restore(core);
+	}
+	step_interpreter(core, n_instructions);
+}
+
+static void BM_StateHasher(benchmark::State& state)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	CoreSnapshot start(core);
+	StateHasher hasher(core);
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		step_boot(core, start, static_cast<u64>(state.range(0)));
+		state.ResumeTiming();
+		benchmark::DoNotOptimize(hasher.hash());
+	}
+}
+BENCHMARK(BM_StateHasher)->Arg(1000)->Arg(100000);
+
+static void BM_StateHashFull(benchmark::State& state)
+{
+	CPU::Core core = CPU::Core(Interconnect(Bios(bench_bios_path())));
+	CoreSnapshot start(core);
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		step_boot(core, start, static_cast<u64>(state.range(0)));
+		state.ResumeTiming();
+		benchmark::DoNotOptimize(state_hash(core));
+	}
+}
+BENCHMARK(BM_StateHashFull)->Arg(1000)->Arg(100000);
@@ -0,0 +1,97 @@
+#include <benchmark/benchmark.h>
+#include "spu.h"
+#include <random>
+
+class NullSink : public AudioSink
+{
+public:
+	void write(const s16*, usize) override {}
+};
+
+// All 24 voices playing looping noise-like ADPCM with reverb enabled
+static void setup_voices(Spu& spu)
+{
+	std::mt19937 rng(99);
+
+	spu.store16(0x1a6, 0x1000 / 8);
+	for (u32 block = 0; block < 64; block++)
+	{
+		u16 flags = (block == 0) ? 0x0400 : ((block == 63) ? 0x0300 : 0x0000);
+		spu.store16(0x1a8, flags | 0x0024);		// shift 4, filter 2
+		for (u32 i = 0; i < 7; i++)
+		{
+			spu.store16(0x1a8, static_cast<u16>(rng()));
+		}
+	}
+
+	spu.store16(0x1a2, 0xf000);				// reverb work area
+	spu.store16(0x184, 0x3000);
+	spu.store16(0x186, 0x3000);
+	spu.store16(0x1aa, 0xc080);
+	spu.store16(0x180, 0x3fff);
+	spu.store16(0x182, 0x3fff);
+
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		u32 base = v * 0x10;
+		spu.store16(base + 0x0, 0x0800);
+		spu.store16(base + 0x2, 0x0800);
+		spu.store16(base + 0x4, static_cast<u16>(0x0800 + v * 0x100));
+		spu.store16(base + 0x6, 0x1000 / 8);
+		spu.store16(base + 0x8, 0x000f);
+		spu.store16(base + 0xa, 0x0000);
+	}
+	spu.store16(0x198, 0xffff);
+	spu.store16(0x19a, 0x00ff);
+	spu.store16(0x188, 0xffff);
+	spu.store16(0x18a, 0x00ff);
+}
+
+// One second of 24 voice audio per iteration: items/s above 44100 is faster than real time
+static void BM_SpuOneSecond(benchmark::State& state)
+{
+	Spu spu;
+	NullSink sink;
+	spu.set_sink(&sink);
+	setup_voices(spu);
+
+	u64 now = 0;
+	for (auto _ : state)
+	{
+		now += static_cast<u64>(SPU_CYCLES_PER_SAMPLE) * 44100;
+		spu.sync(now);
+	}
+	state.SetItemsProcessed(state.iterations() * 44100);
+	state.counters["realtime_x"] = benchmark::Counter(
+		static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SpuOneSecond)->Unit(benchmark::kMillisecond);
+
+template <void (*Mix)(const SpuMixLanes&, SpuMixResult&)>
+static void BM_SpuMix(benchmark::State& state)
+{
+	std::mt19937 rng(7);
+	SpuMixLanes lanes;
+	for (u32 v = 0; v < SPU_N_VOICES; v++)
+	{
+		for (u32 j = 0; j < 4; j++)
+		{
+			lanes.tap[j][v] = static_cast<s16>(rng());
+			lanes.gauss[j][v] = rng() & 0x7fff;
+		}
+		lanes.envelope[v] = rng() & 0x7fff;
+		lanes.volume_left[v] = static_cast<s16>(rng());
+		lanes.volume_right[v] = static_cast<s16>(rng());
+		lanes.reverb[v] = (rng() & 0x1) ? -1 : 0;
+	}
+
+	SpuMixResult result;
+	for (auto _ : state)
+	{
+		Mix(lanes, result);
+		benchmark::DoNotOptimize(result);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_SpuMix, Spu::mix_lanes);
+BENCHMARK_TEMPLATE(BM_SpuMix, Spu::mix_lanes_reference);
@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "bios_hle.h"
+#include <cstring>
+#include <sstream>
+
+static HleCall make_call(u32 vector, u32 function, u32 a0, u32 a1 = 0, u32 a2 = 0, u32 a3 = 0)
+{
+	HleCall call;
+	call.vector = vector;
+	call.function = function;
+	call.args[0] = a0;
+	call.args[1] = a1;
+	call.args[2] = a2;
+	call.args[3] = a3;
+	call.sp = 0x801ff000;
+	return call;
+}
+
+static void store_string(Ram& ram, u32 offset, const char* string)
+{
+	ram.store_block(offset, reinterpret_cast<const u8*>(string), strlen(string) + 1);
+}
+
+TEST(BiosHle, MemcpyAndMemsetWorkOnRam)
+{
+	Ram ram;
+	BiosHle hle;
+	hle.set_mode(HleMode::On);
+	store_string(ram, 0x1000, "kernel");
+
+	u32 result = 0;
+	ASSERT_TRUE(hle.call(make_call(0xa0, 0x2a, 0x80002000, 0x80001000, 7), ram, result));
+	EXPECT_EQ(result, 0x80002000u);
+	EXPECT_STREQ(reinterpret_cast<const char*>(ram.data() + 0x2000), "kernel");
+
+	ASSERT_TRUE(hle.call(make_call(0xa0, 0x2b, 0xa0002000, 'x', 3), ram, result));
+	EXPECT_STREQ(reinterpret_cast<const char*>(ram.data() + 0x2000), "xxxnel");
+
+	ASSERT_TRUE(hle.call(make_call(0xa0, 0x1b, 0x00002000), ram, result));
+	EXPECT_EQ(result, 6u);
+}
+
+TEST(BiosHle, PrintfReadsStackArguments)
+{
+	Ram ram;
+	BiosHle hle;
+	hle.set_mode(HleMode::On);
+	store_string(ram, 0x1000, "%s %d %04x %u|%-3s|\n");
+	store_string(ram, 0x1100, "frame");
+	store_string(ram, 0x1200, "ab");
+	// Arguments 4 and 5 at sp + 16 and sp + 20
+	ram.store<u32>(0x1ff010, 7);
+	ram.store<u32>(0x1ff014, 0x80001200);
+
+	u32 result = 0;
+	ASSERT_TRUE(hle.call(make_call(0xa0, 0x3f, 0x80001000, 0x80001100, static_cast<u32>(-12), 0xbeef), ram, result));
+	EXPECT_EQ(hle.tty(), "frame -12 beef 7|ab |\n");
+}
+
+TEST(BiosHle, FallsBackOutsideOfRam)
+{
+	Ram ram;
+	BiosHle hle;
+	hle.set_mode(HleMode::On);
+
+	u32 result = 0;
+	// Source in the BIOS ROM, unknown function, C0 table
+	EXPECT_FALSE(hle.call(make_call(0xa0, 0x2a, 0x80002000, 0xbfc00000, 16), ram, result));
+	EXPECT_FALSE(hle.call(make_call(0xa0, 0x00, 0x80001000), ram, result));
+	EXPECT_FALSE(hle.call(make_call(0xc0, 0x12, 0), ram, result));
+}
+
+TEST(BiosHle, CountsCallsAndReports)
+{
+	Ram ram;
+	BiosHle hle;
+	hle.set_mode(HleMode::CountOnly);
+
+	u32 result = 0;
+	for (u32 i = 0; i < 3; i++)
+	{
+		EXPECT_FALSE(hle.call(make_call(0xb0, 0x3d, 'a'), ram, result));
+	}
+	EXPECT_FALSE(hle.call(make_call(0xb0, 0x0b, 0), ram, result));
+	EXPECT_EQ(hle.calls(0xb0, 0x3d), 3u);
+	EXPECT_EQ(hle.calls(0xb0, 0x0b), 1u);
+	EXPECT_TRUE(hle.tty().empty());
+
+	std::ostringstream report;
+	hle.report(report);
+	std::string text = report.str();
+	EXPECT_NE(text.find("putchar"), std::string::npos);
+	EXPECT_LT(text.find("putchar"), text.find("TestEvent"));
+}
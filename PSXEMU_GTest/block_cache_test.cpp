@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "cpu_core.h"
+#include <cstdio>
+
+// Counts t0 up to 100 in a loop, then spins on a jump to itself
+static std::vector<u8> looping_bios(u32 limit)
+{
+	std::vector<u32> code = {
+		0x24080000,				// addiu t0, zero, 0
+		0x25080001,				// loop: addiu t0, t0, 1
+		0x29090000 | limit,		// slti t1, t0, limit
+		0x1520fffd,				// bne t1, zero, loop
+		0x254a0002,				// addiu t2, t2, 2 (delay slot)
+		0x0bf00005,				// j .
+		0x00000000,
+	};
+	std::vector<u8> image;
+	for (u32 word : code)
+	{
+		for (u32 b = 0; b < 4; b++)
+		{
+			image.push_back(static_cast<u8>(word >> (b * 8)));
+		}
+	}
+	return image;
+}
+
+static void run_blocks(CPU::Core& core, u32 steps)
+{
+	while (steps > 0)
+	{
+		steps -= core.run_block(steps);
+	}
+}
+
+TEST(BlockCache, FindsBlocksUpToTheDelaySlot)
+{
+	Bios bios(looping_bios(100));
+	BlockCache cache(bios);
+	Stats stats;
+	EXPECT_EQ(cache.length(0, stats), 5u);
+	EXPECT_EQ(cache.length(4, stats), 4u);
+	EXPECT_EQ(cache.length(20, stats), 2u);
+	EXPECT_EQ(cache.length(4, stats), 4u);
+	EXPECT_EQ(stats.cache_misses, 3u);
+	EXPECT_EQ(stats.cache_hits, 1u);
+	EXPECT_EQ(cache.n_blocks(), 3u);
+}
+
+TEST(BlockCache, MatchesTheInterpreter)
+{
+	Interconnect interconnect = Interconnect(Bios(looping_bios(100)));
+	CPU::Core reference = CPU::Core(interconnect);
+	CPU::Core blocks = CPU::Core(interconnect);
+	BlockCache cache(blocks.interconnect().bios());
+	blocks.set_block_cache(&cache);
+
+	for (u32 run = 0; run < 50; run++)
+	{
+		u32 steps = 3 + run * 7;
+		for (u32 i = 0; i < steps; i++)
+		{
+			reference.run_next_instruction();
+		}
+		run_blocks(blocks, steps);
+		ASSERT_EQ(blocks.state().pc, reference.state().pc);
+		ASSERT_EQ(blocks.state().cycles, reference.state().cycles);
+		for (u32 r = 0; r < N_GP_REG; r++)
+		{
+			ASSERT_EQ(blocks.get_reg(r), reference.get_reg(r)) << "r" << r << " after run " << run;
+		}
+	}
+	EXPECT_EQ(reference.get_reg(8), 100u);
+	// t2 starts from the value registers get at reset
+	EXPECT_EQ(reference.get_reg(10), 0xdeadbeefu + 200u);
+	EXPECT_GT(blocks.stats().blocks, 0u);
+}
+
+TEST(BlockCache, SavesAndMapsTheTable)
+{
+	const char* path = "block_cache_test.bin";
+	Bios bios(looping_bios(100));
+	{
+		BlockCache cache(bios);
+		Stats stats;
+		cache.length(0, stats);
+		cache.length(4, stats);
+		ASSERT_TRUE(cache.save(path));
+	}
+
+	BlockCache warm(bios);
+	ASSERT_TRUE(warm.load(path));
+	EXPECT_EQ(warm.n_blocks(), 2u);
+	Stats stats;
+	EXPECT_EQ(warm.length(4, stats), 4u);
+	EXPECT_EQ(stats.cache_misses, 0u);
+	// Discovering more copies the mapped table
+	EXPECT_EQ(warm.length(20, stats), 2u);
+	EXPECT_EQ(warm.length(0, stats), 5u);
+	EXPECT_EQ(warm.n_blocks(), 3u);
+
+	// Another BIOS can't use it
+	Bios other(looping_bios(50));
+	BlockCache stale(other);
+	EXPECT_FALSE(stale.load(path));
+	std::remove(path);
+}
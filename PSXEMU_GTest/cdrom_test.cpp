@@ -0,0 +1,290 @@
+#include "pch.h"
+#include "cdrom.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#if defined(PSXEMU_ZLIB)
+#include <zlib.h>
+#endif
+
+// Writes n sectors whose bytes identify the sector number
+static void write_bin(const std::string& path, u32 n_sectors, u32 first_tag)
+{
+	std::ofstream bin(path, std::ios::binary | std::ios::trunc);
+	std::vector<u8> sector(CD_SECTOR_SIZE);
+	for (u32 i = 0; i < n_sectors; i++)
+	{
+		for (u32 j = 0; j < CD_SECTOR_SIZE; j++)
+		{
+			sector[j] = static_cast<u8>(first_tag + i + j);
+		}
+		bin.write(reinterpret_cast<const char*>(sector.data()), sector.size());
+	}
+}
+
+static void run_until(Cdrom& cdrom, Scheduler& scheduler, u64 cycles)
+{
+	scheduler.set_now(cycles);
+	SchedulerEvent event;
+	while (scheduler.pop_due(event))
+	{
+		cdrom.run_event(event, scheduler);
+	}
+}
+
+static void send_command(Cdrom& cdrom, Scheduler& scheduler, u8 command, std::vector<u8> params)
+{
+	cdrom.store8(0, 0, scheduler);
+	for (u8 param : params)
+	{
+		cdrom.store8(2, param, scheduler);
+	}
+	cdrom.store8(1, command, scheduler);
+}
+
+static std::vector<u8> read_response(Cdrom& cdrom)
+{
+	std::vector<u8> response;
+	while (cdrom.load8(0) & 0x20)
+	{
+		response.push_back(cdrom.load8(1));
+	}
+	return response;
+}
+
+static u8 acknowledge(Cdrom& cdrom, Scheduler& scheduler)
+{
+	cdrom.store8(0, 1, scheduler);
+	u8 flag = cdrom.load8(3) & 0x7;
+	cdrom.store8(3, 0x1f, scheduler);
+	cdrom.store8(0, 0, scheduler);
+	return flag;
+}
+
+TEST(DiscImage, CueSheetWithPregap)
+{
+	write_bin("cdrom_test_1.bin", 20, 0);
+	write_bin("cdrom_test_2.bin", 10, 100);
+	{
+		std::ofstream cue("cdrom_test.cue");
+		cue << "FILE \"cdrom_test_1.bin\" BINARY\n"
+			"  TRACK 01 MODE2/2352\n"
+			"    INDEX 01 00:00:00\n"
+			"FILE \"cdrom_test_2.bin\" BINARY\n"
+			"  TRACK 02 AUDIO\n"
+			"    PREGAP 00:00:05\n"
+			"    INDEX 01 00:00:00\n";
+	}
+
+	std::shared_ptr<DiscImage> disc = open_disc_image("cdrom_test.cue");
+	ASSERT_NE(disc, nullptr);
+	ASSERT_EQ(disc->tracks().size(), 2u);
+	EXPECT_EQ(disc->n_sectors(), 35u);
+	EXPECT_EQ(disc->tracks()[0].start_lba, 0u);
+	EXPECT_EQ(disc->tracks()[0].n_sectors, 25u);
+	EXPECT_EQ(disc->tracks()[1].start_lba, 25u);
+	EXPECT_TRUE(disc->tracks()[1].audio);
+
+	u8 sector[CD_SECTOR_SIZE];
+	ASSERT_TRUE(disc->read_sector(3, sector));
+	EXPECT_EQ(sector[0], 3);
+	ASSERT_TRUE(disc->read_sector(22, sector));
+	EXPECT_EQ(sector[0], 0);
+	EXPECT_EQ(disc->sector_data(22), nullptr);
+	ASSERT_TRUE(disc->read_sector(27, sector));
+	EXPECT_EQ(sector[0], 102);
+	EXPECT_EQ(sector[1], 103);
+	EXPECT_FALSE(disc->read_sector(35, sector));
+
+	// Zero copy access
+	const u8* data = disc->sector_data(27);
+	ASSERT_NE(data, nullptr);
+	EXPECT_EQ(memcmp(data, sector, CD_SECTOR_SIZE), 0);
+
+	remove("cdrom_test_1.bin");
+	remove("cdrom_test_2.bin");
+	remove("cdrom_test.cue");
+}
+
+TEST(DiscImage, ReadAheadMatchesInner)
+{
+	write_bin("cdrom_test_ra.bin", 200, 7);
+	std::unique_ptr<BinCueImage> bin(new BinCueImage());
+	ASSERT_TRUE(bin->open("cdrom_test_ra.bin"));
+	ReadAheadImage image(std::move(bin));
+	EXPECT_EQ(image.n_sectors(), 200u);
+
+	u8 sector[CD_SECTOR_SIZE];
+	for (u32 lba = 0; lba < 200; lba++)
+	{
+		ASSERT_TRUE(image.read_sector(lba, sector));
+		ASSERT_EQ(sector[0], static_cast<u8>(7 + lba));
+		ASSERT_EQ(sector[CD_SECTOR_SIZE - 1], static_cast<u8>(7 + lba + CD_SECTOR_SIZE - 1));
+	}
+	EXPECT_TRUE(image.read_sector(10, sector));
+	EXPECT_EQ(sector[0], 17);
+	EXPECT_FALSE(image.read_sector(200, sector));
+
+	remove("cdrom_test_ra.bin");
+}
+
+#if defined(PSXEMU_ZLIB)
+// Writes the sectors of write_bin as a CSO of 2 KiB blocks, odd blocks
+// stored uncompressed
+static void write_cso(const std::string& path, u32 n_sectors, u32 first_tag)
+{
+	const u32 block_size = 2048;
+	std::vector<u8> raw(n_sectors * CD_SECTOR_SIZE);
+	for (u32 i = 0; i < raw.size(); i++)
+	{
+		raw[i] = static_cast<u8>(first_tag + i / CD_SECTOR_SIZE + i % CD_SECTOR_SIZE);
+	}
+	u32 n_blocks = static_cast<u32>((raw.size() + block_size - 1) / block_size);
+
+	std::vector<u8> file(CSO_HEADER_SIZE + (n_blocks + 1) * sizeof(u32));
+	std::vector<u32> index;
+	u64 total = raw.size();
+	memcpy(file.data(), "CISO", 4);
+	memcpy(file.data() + 8, &total, sizeof(total));
+	memcpy(file.data() + 16, &block_size, sizeof(block_size));
+	file[20] = 1;
+	for (u32 block = 0; block < n_blocks; block++)
+	{
+		u32 size = std::min<u32>(block_size, static_cast<u32>(raw.size() - block * block_size));
+		const u8* data = raw.data() + block * block_size;
+		if (block % 2 == 1)
+		{
+			index.push_back(static_cast<u32>(file.size()) | CSO_BLOCK_PLAIN);
+			file.insert(file.end(), data, data + size);
+			continue;
+		}
+		index.push_back(static_cast<u32>(file.size()));
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+		std::vector<u8> compressed(deflateBound(&stream, size));
+		stream.next_in = const_cast<Bytef*>(data);
+		stream.avail_in = size;
+		stream.next_out = compressed.data();
+		stream.avail_out = static_cast<uInt>(compressed.size());
+		deflate(&stream, Z_FINISH);
+		file.insert(file.end(), compressed.data(), stream.next_out);
+		deflateEnd(&stream);
+	}
+	index.push_back(static_cast<u32>(file.size()));
+	memcpy(file.data() + CSO_HEADER_SIZE, index.data(), index.size() * sizeof(u32));
+
+	std::ofstream cso(path, std::ios::binary | std::ios::trunc);
+	cso.write(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+TEST(DiscImage, CsoMatchesBin)
+{
+	write_cso("cdrom_test.cso", 50, 3);
+	std::shared_ptr<DiscImage> disc = open_disc_image("cdrom_test.cso");
+	ASSERT_NE(disc, nullptr);
+	EXPECT_EQ(disc->n_sectors(), 50u);
+	ASSERT_EQ(disc->tracks().size(), 1u);
+	EXPECT_EQ(disc->sector_data(0), nullptr);
+
+	u8 sector[CD_SECTOR_SIZE];
+	for (u32 lba : { 0u, 1u, 2u, 49u, 20u, 21u, 7u })
+	{
+		ASSERT_TRUE(disc->read_sector(lba, sector));
+		for (u32 j = 0; j < CD_SECTOR_SIZE; j++)
+		{
+			ASSERT_EQ(sector[j], static_cast<u8>(3 + lba + j));
+		}
+	}
+	EXPECT_FALSE(disc->read_sector(50, sector));
+	disc.reset();
+
+	write_bin("cdrom_test.cso", 4, 0);
+	EXPECT_EQ(open_disc_image("cdrom_test.cso"), nullptr);
+	remove("cdrom_test.cso");
+}
+#endif
+
+TEST(DiscImage, RejectsChd)
+{
+	write_bin("cdrom_test.chd", 4, 0);
+	EXPECT_EQ(open_disc_image("cdrom_test.chd"), nullptr);
+	remove("cdrom_test.chd");
+}
+
+TEST(Cdrom, TestCommandReturnsVersion)
+{
+	Cdrom cdrom;
+	Scheduler scheduler;
+
+	send_command(cdrom, scheduler, 0x19, { 0x20 });
+	EXPECT_EQ(cdrom.load8(0) & 0x80, 0x80);		// busy until the response
+	EXPECT_TRUE(read_response(cdrom).empty());
+
+	run_until(cdrom, scheduler, CDROM_ACK_CYCLES);
+	EXPECT_EQ(cdrom.load8(0) & 0x80, 0);
+	EXPECT_EQ(read_response(cdrom), std::vector<u8>({ 0x94, 0x09, 0x19, 0xc0 }));
+	EXPECT_EQ(acknowledge(cdrom, scheduler), 3);
+}
+
+TEST(Cdrom, GetIdWithoutDisc)
+{
+	Cdrom cdrom;
+	Scheduler scheduler;
+	cdrom.store8(0, 1, scheduler);
+	cdrom.store8(2, 0x1f, scheduler);			// interrupt enable
+
+	send_command(cdrom, scheduler, 0x1a, {});
+	run_until(cdrom, scheduler, CDROM_ACK_CYCLES);
+	EXPECT_TRUE(cdrom.irq());
+	EXPECT_EQ(read_response(cdrom), std::vector<u8>({ 0x10 }));
+	EXPECT_EQ(acknowledge(cdrom, scheduler), 3);
+	EXPECT_FALSE(cdrom.irq());
+
+	run_until(cdrom, scheduler, CDROM_ACK_CYCLES + CDROM_SECOND_RESPONSE_CYCLES);
+	EXPECT_EQ(read_response(cdrom)[0], 0x08);
+	EXPECT_EQ(acknowledge(cdrom, scheduler), 5);
+}
+
+TEST(Cdrom, ReadNDeliversSectors)
+{
+	write_bin("cdrom_test_read.bin", 40, 0);
+	Cdrom cdrom;
+	Scheduler scheduler;
+	cdrom.insert_disc(open_disc_image("cdrom_test_read.bin"));
+
+	send_command(cdrom, scheduler, 0x02, { 0x00, 0x02, 0x16 });		// 00:02:16 = LBA 16
+	run_until(cdrom, scheduler, CDROM_ACK_CYCLES);
+	acknowledge(cdrom, scheduler);
+
+	u64 now = CDROM_ACK_CYCLES;
+	send_command(cdrom, scheduler, 0x06, {});
+	run_until(cdrom, scheduler, now + CDROM_ACK_CYCLES);
+	EXPECT_EQ(acknowledge(cdrom, scheduler), 3);
+
+	for (u32 i = 0; i < 3; i++)
+	{
+		now += CDROM_ACK_CYCLES + CDROM_SECTOR_CYCLES;
+		run_until(cdrom, scheduler, now);
+		EXPECT_EQ(read_response(cdrom)[0] & 0x20, 0x20);
+		ASSERT_EQ(acknowledge(cdrom, scheduler), 1);
+
+		cdrom.store8(3, 0x80, scheduler);
+		EXPECT_EQ(cdrom.load8(0) & 0x40, 0x40);
+		// Form 1 user data starts after the 24 byte header
+		EXPECT_EQ(cdrom.load8(2), static_cast<u8>(16 + i + 24));
+		EXPECT_EQ(cdrom.read_data_word() & 0xff, static_cast<u8>(16 + i + 25));
+	}
+
+	send_command(cdrom, scheduler, 0x09, {});
+	run_until(cdrom, scheduler, now + CDROM_ACK_CYCLES);
+	EXPECT_EQ(read_response(cdrom)[0] & 0x20, 0x20);
+	acknowledge(cdrom, scheduler);
+	run_until(cdrom, scheduler, now + CDROM_ACK_CYCLES + CDROM_SECOND_RESPONSE_CYCLES);
+	EXPECT_EQ(read_response(cdrom)[0] & 0x20, 0);
+	EXPECT_EQ(acknowledge(cdrom, scheduler), 2);
+
+	cdrom.insert_disc(nullptr);
+	remove("cdrom_test_read.bin");
+}
@@ -0,0 +1,157 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include <cstdlib>
+#include <iostream>
+
+TEST(CpuCore, LoadDelaySlot)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x8e080000,			// lw t0, 0(s0)
+		0x01004821,			// addu t1, t0, zero: still the old t0
+		0x01005021,			// addu t2, t0, zero
+	});
+	harness.set_reg(8, 1);
+	harness.set_reg(16, 0x80100000);
+	harness.store32(0x80100000, 0xcafe0001);
+
+	harness.run(1);
+	EXPECT_EQ(harness.state().load.first.value, 8u);
+	EXPECT_EQ(harness.state().load.second, 0xcafe0001u);
+	EXPECT_EQ(harness.reg(8), 1u);
+
+	harness.run(2);
+	EXPECT_EQ(harness.reg(8), 0xcafe0001u);
+	EXPECT_EQ(harness.reg(9), 1u);
+	EXPECT_EQ(harness.reg(10), 0xcafe0001u);
+	EXPECT_EQ(harness.state().load.first.value, 0u);
+}
+
+TEST(CpuCore, BranchDelaySlot)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x10000002,			// beq zero, zero, +2
+		0x24090001,			// addiu t1, zero, 1 (delay slot)
+		0x240a0001,			// addiu t2, zero, 1 (skipped)
+		0x240b0001,			// addiu t3, zero, 1
+	});
+	harness.set_reg(9, 0);
+	harness.set_reg(10, 0);
+	harness.set_reg(11, 0);
+
+	harness.run(2);
+	EXPECT_EQ(harness.reg(9), 1u);
+	// The branch target has been fetched
+	EXPECT_EQ(harness.state().pc, CPU_HARNESS_CODE_ADDRESS + 16u);
+
+	harness.run(1);
+	EXPECT_EQ(harness.reg(10), 0u);
+	EXPECT_EQ(harness.reg(11), 1u);
+}
+
+TEST(CpuCore, AddressErrorException)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x8e080002,			// lw t0, 2(s0): AdEL
+	});
+	harness.store32(0x80000080, 0x42000010);		// rfe
+	harness.set_reg(8, 1);
+	harness.set_reg(16, 0x80100000);
+	harness.state().cop0regs.sr = 0x1;
+
+	harness.run(1);
+	const CPU::Cop0Regs& cop0 = harness.state().cop0regs;
+	EXPECT_EQ(harness.core().current_pc(), 0x80000080u);
+	EXPECT_EQ(cop0.epc, CPU_HARNESS_CODE_ADDRESS);
+	EXPECT_EQ(cop0.cause, 0x4u << 2);
+	EXPECT_EQ(cop0.bad_vaddr, 0x80100002u);
+	EXPECT_EQ(cop0.sr, 0x4u);
+	EXPECT_EQ(harness.state().load.first.value, 0u);
+
+	harness.run(1);
+	EXPECT_EQ(cop0.sr, 0x1u);
+}
+
+TEST(CpuCore, AddressErrorInDelaySlot)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x10000002,			// beq zero, zero, +2
+		0xae080001,			// sw t0, 1(s0): AdES in the delay slot
+	});
+	harness.set_reg(16, 0x80100000);
+	harness.state().cop0regs.sr = 0x400000;		// BEV
+
+	harness.run(2);
+	const CPU::Cop0Regs& cop0 = harness.state().cop0regs;
+	EXPECT_EQ(harness.core().current_pc(), 0xbfc00180u);
+	// The branch runs again on return
+	EXPECT_EQ(cop0.epc, CPU_HARNESS_CODE_ADDRESS);
+	EXPECT_EQ(cop0.cause, 0x80000000u | (0x5u << 2));
+	EXPECT_EQ(cop0.bad_vaddr, 0x80100001u);
+}
+
+// pc is the fetch address: two instructions past the last one executed
+static const char* BUILT_IN_CORPUS = R"([
+	{"name": "addu", "steps": 1, "code": ["0x01095021"],
+	 "initial": {"regs": {"t0": 5, "t1": 7}},
+	 "final": {"pc": "0x80010008", "regs": {"t2": 12}}},
+	{"name": "lui_ori", "steps": 2, "code": ["0x3c081234", "0x35085678"],
+	 "final": {"regs": {"t0": "0x12345678"}}},
+	{"name": "zero_register", "steps": 1, "code": ["0x24000005"],
+	 "final": {"regs": {"zero": 0}}},
+	{"name": "load_delay", "steps": 3, "code": ["0x8e080000", "0x01004821", "0x01005021"],
+	 "initial": {"regs": {"t0": 1, "s0": "0x80100000"}, "ram": {"0x80100000": "0xcafe0001"}},
+	 "final": {"regs": {"t0": "0xcafe0001", "t1": 1, "t2": "0xcafe0001"}}},
+	{"name": "load_pending", "steps": 1, "code": ["0x8e080000"],
+	 "initial": {"regs": {"t0": 1, "s0": "0x80100000"}, "ram": {"0x80100000": "0xcafe0001"}},
+	 "final": {"regs": {"t0": 1}, "load": ["t0", "0xcafe0001"]}},
+	{"name": "branch_delay", "steps": 3, "code": ["0x10000002", "0x24090001", "0x240a0001", "0x240b0001"],
+	 "initial": {"regs": {"t1": 0, "t2": 0, "t3": 0}},
+	 "final": {"pc": "0x80010014", "regs": {"t1": 1, "t2": 0, "t3": 1}}},
+	{"name": "jal_link", "steps": 3, "code": ["0x0c004004", "0x00000000", "0x240a0001", "0x240a0001", "0x240b0007"],
+	 "initial": {"regs": {"t2": 0}},
+	 "final": {"regs": {"ra": "0x80010008", "t2": 0, "t3": 7}}},
+	{"name": "sw_lw", "steps": 3, "code": ["0xae080004", "0x8e090004", "0x00000000"],
+	 "initial": {"regs": {"t0": "0x11223344", "s0": "0x80100000"}},
+	 "final": {"regs": {"t1": "0x11223344"}, "ram": {"0x80100004": "0x11223344"}}},
+	{"name": "divu", "steps": 3, "code": ["0x0109001b", "0x00005012", "0x00005810"],
+	 "initial": {"regs": {"t0": 100, "t1": 7}},
+	 "final": {"hi": 2, "lo": 14, "regs": {"t2": 14, "t3": 2}}}
+])";
+
+TEST(CpuCore, BuiltInCorpus)
+{
+	std::vector<CpuVector> vectors;
+	std::string error;
+	ASSERT_TRUE(parse_cpu_corpus(BUILT_IN_CORPUS, vectors, error)) << error;
+	ASSERT_EQ(vectors.size(), 9u);
+
+	for (const std::string& failure : run_cpu_corpus(vectors))
+	{
+		ADD_FAILURE() << failure;
+	}
+}
+
+// Large corpus given through PSXEMU_CPU_CORPUS, run on every engine
+TEST(CpuCore, ExternalCorpus)
+{
+	const char* path = std::getenv("PSXEMU_CPU_CORPUS");
+	if (path == nullptr)
+	{
+		std::cout << "PSXEMU_CPU_CORPUS not set, external corpus skipped" << std::endl;
+		return;
+	}
+
+	std::vector<CpuVector> vectors;
+	std::string error;
+	ASSERT_TRUE(load_cpu_corpus(path, vectors, error)) << error;
+	std::vector<std::string> failures = run_cpu_corpus(vectors);
+	for (usize i = 0; i < failures.size() && i < 50; i++)
+	{
+		ADD_FAILURE() << failures[i];
+	}
+	EXPECT_EQ(failures.size(), 0u) << "of " << vectors.size() * cpu_engines().size() << " runs";
+}
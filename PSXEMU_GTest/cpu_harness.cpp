@@ -0,0 +1,545 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "lockstep.h"
+#include "replay.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+static void run_interpreter(CPU::Core& core, u32 steps)
+{
+	for (u32 i = 0; i < steps; i++)
+	{
+		core.run_next_instruction();
+	}
+}
+
+// BIOS code runs from blocks, anything else falls back to single steps
+static void run_bios_blocks(CPU::Core& core, u32 steps)
+{
+	BlockCache cache(core.interconnect().bios());
+	core.set_block_cache(&cache);
+	while (steps > 0)
+	{
+		steps -= core.run_block(steps);
+	}
+	core.set_block_cache(nullptr);
+}
+
+// The core and three copies of it run as lanes of one batch
+static void run_lockstep(CPU::Core& core, u32 steps)
+{
+	std::vector<std::unique_ptr<CoreSnapshot>> copies;
+	std::vector<CPU::Core*> lanes = { &core };
+	for (u32 i = 0; i < 3; i++)
+	{
+		copies.emplace_back(new CoreSnapshot(core));
+		lanes.push_back(&copies.back()->core());
+	}
+	CPU::LockstepBatch(lanes).run(steps);
+}
+
+const std::vector<CpuEngine>& cpu_engines()
+{
+	static const std::vector<CpuEngine> engines =
+	{
+		{"interpreter", run_interpreter},
+		{"bios_blocks", run_bios_blocks},
+		{"lockstep", run_lockstep}
+	};
+	return engines;
+}
+
+CpuHarness::CpuHarness() :
+	core_(Interconnect(Bios(std::vector<u8>())))
+{
+}
+
+void CpuHarness::load(u32 pc, const std::vector<u32>& code)
+{
+	PsxExe exe;
+	exe.pc = pc;
+	exe.gp = 0;
+	exe.text_address = pc;
+	exe.bss_address = pc;
+	exe.bss_size = 0;
+	exe.stack_address = 0;
+	for (u32 word : code)
+	{
+		for (u32 b = 0; b < 4; b++)
+		{
+			exe.text.push_back(static_cast<u8>(word >> (b * 8)));
+		}
+	}
+	core_.fast_boot(exe, nullptr);
+	// Runs the empty pipeline slot and fetches the first instruction
+	core_.run_next_instruction();
+}
+
+void CpuHarness::set_reg(u32 index, u32 value)
+{
+	state().regs[index] = value;
+	state().out_regs[index] = value;
+}
+
+void CpuHarness::store32(u32 address, u32 value)
+{
+	core_.interconnect().store<u32>(address, value);
+}
+
+void CpuHarness::run(u32 steps, const CpuEngine& engine)
+{
+	engine.run(core_, steps);
+}
+
+void CpuHarness::run(u32 steps)
+{
+	run(steps, cpu_engines()[0]);
+}
+
+CPU::Core& CpuHarness::core()
+{
+	return core_;
+}
+
+CPU::State& CpuHarness::state()
+{
+	return core_.state();
+}
+
+u32 CpuHarness::reg(u32 index)
+{
+	return core_.get_reg(CPU::RegisterIdx(index));
+}
+
+u32 CpuHarness::load32(u32 address)
+{
+	return core_.interconnect().load<u32>(address);
+}
+
+// Just enough JSON for the corpus files
+struct JsonValue
+{
+	enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+	double number = 0;
+	std::string string;
+	std::vector<JsonValue> array;
+	std::vector<std::pair<std::string, JsonValue>> object;
+
+	const JsonValue* find(const char* key) const
+	{
+		for (const auto& member : object)
+		{
+			if (member.first == key)
+			{
+				return &member.second;
+			}
+		}
+		return nullptr;
+	}
+};
+
+class JsonParser
+{
+private:
+	const std::string& text_;
+	usize pos_;
+
+	void skip_space_()
+	{
+		while (pos_ < text_.size() && isspace(static_cast<unsigned char>(text_[pos_])))
+		{
+			pos_++;
+		}
+	}
+
+	bool expect_(char c)
+	{
+		skip_space_();
+		if (pos_ < text_.size() && text_[pos_] == c)
+		{
+			pos_++;
+			return true;
+		}
+		return false;
+	}
+
+	bool string_(std::string& out)
+	{
+		if (!expect_('"'))
+		{
+			return false;
+		}
+		while (pos_ < text_.size() && text_[pos_] != '"')
+		{
+			char c = text_[pos_++];
+			if (c == '\\' && pos_ < text_.size())
+			{
+				c = text_[pos_++];
+				c = (c == 'n') ? '\n' : ((c == 't') ? '\t' : c);
+			}
+			out.push_back(c);
+		}
+		return expect_('"');
+	}
+
+public:
+	JsonParser(const std::string& text) :
+		text_(text),
+		pos_(0)
+	{
+	}
+
+	usize position() const
+	{
+		return pos_;
+	}
+
+	bool value(JsonValue& out)
+	{
+		skip_space_();
+		if (pos_ >= text_.size())
+		{
+			return false;
+		}
+
+		char c = text_[pos_];
+		if (c == '{')
+		{
+			out.type = JsonValue::Type::Object;
+			pos_++;
+			if (expect_('}'))
+			{
+				return true;
+			}
+			do
+			{
+				std::pair<std::string, JsonValue> member;
+				if (!string_(member.first) || !expect_(':') || !value(member.second))
+				{
+					return false;
+				}
+				out.object.push_back(std::move(member));
+			} while (expect_(','));
+			return expect_('}');
+		}
+		if (c == '[')
+		{
+			out.type = JsonValue::Type::Array;
+			pos_++;
+			if (expect_(']'))
+			{
+				return true;
+			}
+			do
+			{
+				out.array.emplace_back();
+				if (!value(out.array.back()))
+				{
+					return false;
+				}
+			} while (expect_(','));
+			return expect_(']');
+		}
+		if (c == '"')
+		{
+			out.type = JsonValue::Type::String;
+			return string_(out.string);
+		}
+		if (text_.compare(pos_, 4, "true") == 0 || text_.compare(pos_, 5, "false") == 0)
+		{
+			out.type = JsonValue::Type::Bool;
+			out.number = (c == 't') ? 1 : 0;
+			pos_ += (c == 't') ? 4 : 5;
+			return true;
+		}
+		if (text_.compare(pos_, 4, "null") == 0)
+		{
+			pos_ += 4;
+			return true;
+		}
+
+		char* end = nullptr;
+		out.type = JsonValue::Type::Number;
+		out.number = strtod(text_.c_str() + pos_, &end);
+		if (end == text_.c_str() + pos_)
+		{
+			return false;
+		}
+		pos_ = end - text_.c_str();
+		return true;
+	}
+};
+
+static const char* REGISTER_NAMES[N_GP_REG] =
+{
+	"zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+	"t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+	"s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+	"t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+static bool parse_u32(const std::string& text, u32& out)
+{
+	char* end = nullptr;
+	unsigned long value = strtoul(text.c_str(), &end, 0);
+	out = static_cast<u32>(value);
+	return !text.empty() && *end == '\0';
+}
+
+static bool json_u32(const JsonValue& value, u32& out)
+{
+	if (value.type == JsonValue::Type::Number)
+	{
+		out = static_cast<u32>(static_cast<s64>(value.number));
+		return true;
+	}
+	return value.type == JsonValue::Type::String && parse_u32(value.string, out);
+}
+
+static bool register_index(const std::string& name, u32& index)
+{
+	std::string bare = (!name.empty() && name[0] == '$') ? name.substr(1) : name;
+	for (u32 i = 0; i < N_GP_REG; i++)
+	{
+		if (bare == REGISTER_NAMES[i])
+		{
+			index = i;
+			return true;
+		}
+	}
+	return parse_u32(bare, index) && index < N_GP_REG;
+}
+
+static bool json_registers(const JsonValue* value, std::vector<std::pair<u32, u32>>& out)
+{
+	if (value == nullptr)
+	{
+		return true;
+	}
+	for (const auto& member : value->object)
+	{
+		u32 index;
+		u32 content;
+		if (!register_index(member.first, index) || !json_u32(member.second, content))
+		{
+			return false;
+		}
+		out.emplace_back(index, content);
+	}
+	return true;
+}
+
+static bool json_memory(const JsonValue* value, std::vector<std::pair<u32, u32>>& out)
+{
+	if (value == nullptr)
+	{
+		return true;
+	}
+	for (const auto& member : value->object)
+	{
+		u32 address;
+		u32 content;
+		if (!parse_u32(member.first, address) || !json_u32(member.second, content))
+		{
+			return false;
+		}
+		out.emplace_back(address, content);
+	}
+	return true;
+}
+
+static bool json_vector(const JsonValue& entry, CpuVector& vector)
+{
+	const JsonValue* name = entry.find("name");
+	const JsonValue* code = entry.find("code");
+	const JsonValue* steps = entry.find("steps");
+	const JsonValue* initial = entry.find("initial");
+	const JsonValue* expected = entry.find("final");
+	if (name == nullptr || code == nullptr || steps == nullptr || expected == nullptr)
+	{
+		return false;
+	}
+
+	vector.name = name->string;
+	vector.pc = CPU_HARNESS_CODE_ADDRESS;
+	if (!json_u32(*steps, vector.steps))
+	{
+		return false;
+	}
+	for (const JsonValue& word : code->array)
+	{
+		vector.code.emplace_back();
+		if (!json_u32(word, vector.code.back()))
+		{
+			return false;
+		}
+	}
+
+	if (initial != nullptr)
+	{
+		const JsonValue* pc = initial->find("pc");
+		if ((pc != nullptr && !json_u32(*pc, vector.pc)) ||
+			!json_registers(initial->find("regs"), vector.initial_regs) ||
+			!json_memory(initial->find("ram"), vector.initial_ram))
+		{
+			return false;
+		}
+	}
+
+	const JsonValue* pc = expected->find("pc");
+	const JsonValue* hi = expected->find("hi");
+	const JsonValue* lo = expected->find("lo");
+	const JsonValue* load = expected->find("load");
+	vector.check_pc = (pc != nullptr) && json_u32(*pc, vector.final_pc);
+	vector.check_hi_lo = (hi != nullptr) && (lo != nullptr) &&
+		json_u32(*hi, vector.final_hi) && json_u32(*lo, vector.final_lo);
+	vector.check_load = (load != nullptr) && (load->array.size() == 2) &&
+		register_index(load->array[0].string, vector.load_reg) && json_u32(load->array[1], vector.load_value);
+	return json_registers(expected->find("regs"), vector.final_regs) &&
+		json_memory(expected->find("ram"), vector.final_ram);
+}
+
+bool parse_cpu_corpus(const std::string& json, std::vector<CpuVector>& vectors, std::string& error)
+{
+	JsonParser parser(json);
+	JsonValue root;
+	if (!parser.value(root) || root.type != JsonValue::Type::Array)
+	{
+		error = "invalid JSON near offset " + std::to_string(parser.position());
+		return false;
+	}
+	for (const JsonValue& entry : root.array)
+	{
+		CpuVector vector;
+		if (!json_vector(entry, vector))
+		{
+			const JsonValue* name = entry.find("name");
+			error = "invalid vector " + ((name != nullptr) ? name->string : std::to_string(vectors.size()));
+			return false;
+		}
+		vectors.push_back(std::move(vector));
+	}
+	return true;
+}
+
+bool load_cpu_corpus(const std::string& path, std::vector<CpuVector>& vectors, std::string& error)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		error = "cannot open " + path;
+		return false;
+	}
+	std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return parse_cpu_corpus(json, vectors, error);
+}
+
+static std::string mismatch(const CpuVector& vector, const CpuEngine& engine, const std::string& what,
+	u32 expected, u32 actual)
+{
+	std::ostringstream out;
+	out << vector.name << " [" << engine.name << "]: " << what << " expected 0x" << std::hex << expected
+		<< " got 0x" << actual;
+	return out.str();
+}
+
+bool run_cpu_vector(const CpuVector& vector, const CpuEngine& engine, std::string& failure)
+{
+	try
+	{
+		CpuHarness harness;
+		harness.load(vector.pc, vector.code);
+		for (const auto& reg : vector.initial_regs)
+		{
+			harness.set_reg(reg.first, reg.second);
+		}
+		for (const auto& word : vector.initial_ram)
+		{
+			harness.store32(word.first, word.second);
+		}
+		harness.run(vector.steps, engine);
+
+		CPU::State& state = harness.state();
+		if (vector.check_pc && state.pc != vector.final_pc)
+		{
+			failure = mismatch(vector, engine, "pc", vector.final_pc, state.pc);
+			return false;
+		}
+		for (const auto& reg : vector.final_regs)
+		{
+			if (harness.reg(reg.first) != reg.second)
+			{
+				failure = mismatch(vector, engine, REGISTER_NAMES[reg.first], reg.second, harness.reg(reg.first));
+				return false;
+			}
+		}
+		if (vector.check_hi_lo && (state.hi != vector.final_hi || state.lo != vector.final_lo))
+		{
+			failure = mismatch(vector, engine, (state.hi != vector.final_hi) ? "hi" : "lo",
+				(state.hi != vector.final_hi) ? vector.final_hi : vector.final_lo,
+				(state.hi != vector.final_hi) ? state.hi : state.lo);
+			return false;
+		}
+		if (vector.check_load &&
+			(state.load.first.value != vector.load_reg || state.load.second != vector.load_value))
+		{
+			failure = mismatch(vector, engine, "pending load", vector.load_value, state.load.second);
+			return false;
+		}
+		for (const auto& word : vector.final_ram)
+		{
+			u32 actual = harness.load32(word.first);
+			if (actual != word.second)
+			{
+				failure = mismatch(vector, engine, "ram", word.second, actual);
+				return false;
+			}
+		}
+	}
+	catch (int)
+	{
+		failure = vector.name + " [" + engine.name + "]: emulation error";
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::string> run_cpu_corpus(const std::vector<CpuVector>& vectors)
+{
+	const std::vector<CpuEngine>& engines = cpu_engines();
+	usize n_tasks = vectors.size() * engines.size();
+	std::atomic<usize> next_task(0);
+	std::mutex failures_mutex;
+	std::vector<std::string> failures;
+
+	auto worker = [&]()
+	{
+		for (usize task = next_task++; task < n_tasks; task = next_task++)
+		{
+			std::string failure;
+			if (!run_cpu_vector(vectors[task / engines.size()], engines[task % engines.size()], failure))
+			{
+				std::lock_guard<std::mutex> lock(failures_mutex);
+				failures.push_back(failure);
+			}
+		}
+	};
+
+	u32 n_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for (u32 i = 1; i < n_threads; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	return failures;
+}
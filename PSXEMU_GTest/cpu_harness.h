@@ -0,0 +1,72 @@
+#pragma once
+#include "cpu_core.h"
+#include <string>
+#include <vector>
+
+#define CPU_HARNESS_CODE_ADDRESS 0x80010000
+
+// A way of executing guest code. Every engine must produce the same State.
+struct CpuEngine
+{
+	const char* name;
+	void (*run)(CPU::Core& core, u32 steps);
+};
+
+const std::vector<CpuEngine>& cpu_engines();
+
+// Core on top of a zero filled in-memory BIOS, with the code loaded in RAM
+// and the pipeline already primed: every step runs one instruction of it
+class CpuHarness
+{
+private:
+	CPU::Core core_;
+
+public:
+	CpuHarness();
+	void load(u32 pc, const std::vector<u32>& code);
+	void set_reg(u32 index, u32 value);
+	void store32(u32 address, u32 value);
+	void run(u32 steps, const CpuEngine& engine);
+	void run(u32 steps);
+
+	CPU::Core& core();
+	CPU::State& state();
+	u32 reg(u32 index);
+	u32 load32(u32 address);
+};
+
+// One conformance vector: initial state, code, number of steps and the
+// registers, memory words and pending load expected at the end
+struct CpuVector
+{
+	std::string name;
+	u32 pc;
+	std::vector<std::pair<u32, u32>> initial_regs;
+	std::vector<std::pair<u32, u32>> initial_ram;
+	std::vector<u32> code;
+	u32 steps;
+
+	bool check_pc;
+	u32 final_pc;
+	std::vector<std::pair<u32, u32>> final_regs;
+	std::vector<std::pair<u32, u32>> final_ram;
+	bool check_hi_lo;
+	u32 final_hi;
+	u32 final_lo;
+	bool check_load;
+	u32 load_reg;
+	u32 load_value;
+};
+
+// Corpus format, an array of:
+//   {"name": "...", "steps": n, "code": ["0x01095021", ...],
+//    "initial": {"pc": ..., "regs": {"t0": ...}, "ram": {"0x80100000": ...}},
+//    "final": {"pc": ..., "hi": ..., "lo": ..., "regs": {...}, "ram": {...}, "load": ["t0", ...]}}
+// Registers are named or numbered, values are numbers or hex strings.
+bool parse_cpu_corpus(const std::string& json, std::vector<CpuVector>& vectors, std::string& error);
+bool load_cpu_corpus(const std::string& path, std::vector<CpuVector>& vectors, std::string& error);
+
+// Runs a vector with an engine, false with a description of the first mismatch
+bool run_cpu_vector(const CpuVector& vector, const CpuEngine& engine, std::string& failure);
+// Every vector on every engine, spread over the hardware threads. Returns the failures.
+std::vector<std::string> run_cpu_corpus(const std::vector<CpuVector>& vectors);
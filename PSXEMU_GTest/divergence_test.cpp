@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "divergence.h"
+#include "replay.h"
+
+// Appends a counter to a table at 0x80100000
+static const std::vector<u32> TABLE_LOOP = {
+	0x3c108010,			// lui s0, 0x8010
+	0x25080001,			// loop: addiu t0, t0, 1
+	0xae080000,			// sw t0, 0(s0)
+	0x08004001,			// j loop
+	0x26100004,			// addiu s0, s0, 4
+};
+
+TEST(StateHasher, FollowsChanges)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	CPU::Core& core = harness.core();
+	StateHasher hasher(core);
+	u64 start = hasher.hash();
+	EXPECT_EQ(hasher.hash(), start);
+
+	core.interconnect().store<u32>(0x80123454, 0x12345678);
+	u64 stored = hasher.hash();
+	EXPECT_NE(stored, start);
+	core.interconnect().store<u32>(0x80123454, 0xcacacaca);
+	EXPECT_EQ(hasher.hash(), start);
+
+	core.interconnect().spu().store16(0x1a6, 0x1000);		// transfer address
+	u64 addressed = hasher.hash();
+	EXPECT_NE(addressed, start);
+	core.interconnect().spu().store16(0x1a8, 0x1234);		// transfer FIFO
+	EXPECT_NE(hasher.hash(), addressed);
+	EXPECT_EQ(hasher.hash(), StateHasher(core).hash());
+
+	// Restoring a snapshot is seen like any other change
+	CoreSnapshot snapshot(core);
+	step_interpreter(core, 1000);
+	u64 later = hasher.hash();
+	EXPECT_EQ(later, StateHasher(core).hash());
+	snapshot.restore(core);
+	EXPECT_EQ(hasher.hash(), StateHasher(snapshot.core()).hash());
+	EXPECT_NE(hasher.hash(), later);
+}
+
+// Interpreter that writes a stray word at the given cycle, 777 instructions
+// after the start of the tests
+static u64 fault_cycle;
+
+static void step_with_fault(CPU::Core& core, u64 n_instructions)
+{
+	for (u64 i = 0; i < n_instructions; i++)
+	{
+		core.run_next_instruction();
+		if (core.state().cycles == fault_cycle)
+		{
+			core.interconnect().store<u32>(0x80180000, 1);
+		}
+	}
+}
+
+TEST(FindDivergence, FindsTheFirstDivergingInstruction)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	u64 start = harness.core().state().cycles;
+	fault_cycle = start + 777 * 2;
+
+	Divergence divergence = find_divergence(harness.core(), harness.core(), 5000,
+		step_interpreter, step_with_fault);
+	ASSERT_TRUE(divergence.found);
+	EXPECT_EQ(divergence.instructions, 777u);
+	EXPECT_EQ(divergence.cycles, start + 776 * 2);
+
+	CoreSnapshot reference(harness.core());
+	step_interpreter(reference.core(), 776);
+	EXPECT_EQ(divergence.pc, reference.core().current_pc());
+}
+
+TEST(FindDivergence, MatchingRunsAndStartingStates)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	fault_cycle = harness.core().state().cycles + 777 * 2;
+	Divergence same = find_divergence(harness.core(), harness.core(), 5000,
+		step_interpreter, step_interpreter);
+	EXPECT_FALSE(same.found);
+	// Before the fault
+	EXPECT_FALSE(find_divergence(harness.core(), harness.core(), 700,
+		step_interpreter, step_with_fault).found);
+
+	CoreSnapshot other(harness.core());
+	other.core().interconnect().store<u8>(0x80000000, 0);
+	Divergence start = find_divergence(harness.core(), other.core(), 5000,
+		step_interpreter, step_interpreter);
+	EXPECT_TRUE(start.found);
+	EXPECT_EQ(start.instructions, 0u);
+}
@@ -0,0 +1,102 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "explore.h"
+#include "replay.h"
+#include <cstring>
+
+#define INPUT_ADDRESS 0x100
+
+// Adds the word at INPUT_ADDRESS to a counter and appends the sum to a table
+static const std::vector<u32> INPUT_LOOP = {
+	0x3c108010,			// lui s0, 0x8010
+	0x8c090100,			// loop: lw t1, 0x100(zero)
+	0x25080001,			// addiu t0, t0, 1
+	0x01095021,			// addu t2, t0, t1
+	0xae0a0000,			// sw t2, 0(s0)
+	0x08004001,			// j loop
+	0x26100004,			// addiu s0, s0, 4
+};
+
+static void load_input_loop(CpuHarness& harness)
+{
+	harness.load(CPU_HARNESS_CODE_ADDRESS, INPUT_LOOP);
+	harness.set_reg(8, 0);
+	harness.store32(INPUT_ADDRESS, 0);
+	RunOptions options;
+	options.max_cycles = 1000;
+	RunLoop(harness.core()).run(options);
+}
+
+// Feeds the branch its own input and runs on, returns the state hash
+static std::vector<u8> run_branch(CPU::Core& core, u32 branch)
+{
+	core.interconnect().store<u32>(INPUT_ADDRESS, branch * 10);
+	RunOptions options;
+	options.max_cycles = 3000;
+	RunLoop(core).run(options);
+	u64 hash = state_hash(core);
+	std::vector<u8> data(sizeof(hash));
+	memcpy(data.data(), &hash, sizeof(hash));
+	return data;
+}
+
+TEST(Explore, BranchesMatchSnapshotCopies)
+{
+	CpuHarness harness;
+	load_input_loop(harness);
+	u64 parent_hash = state_hash(harness.core());
+
+	std::vector<ExploreResult> results = explore(harness.core(), 6, run_branch);
+	ASSERT_EQ(results.size(), 6u);
+	EXPECT_EQ(state_hash(harness.core()), parent_hash);
+
+	for (u32 i = 0; i < 6; i++)
+	{
+		CoreSnapshot copy(harness.core());
+		EXPECT_TRUE(results[i].ok) << "branch " << i;
+		EXPECT_EQ(results[i].data, run_branch(copy.core(), i)) << "branch " << i;
+	}
+	EXPECT_NE(results[0].data, results[1].data);
+}
+
+TEST(Explore, ReportsFailedBranches)
+{
+	CpuHarness harness;
+	load_input_loop(harness);
+	std::vector<ExploreResult> results = explore(harness.core(), 3, [](CPU::Core& core, u32 branch)
+	{
+		if (branch == 1)
+		{
+			core.interconnect().load<u8>(0x1f900000);		// unmapped, throws
+		}
+		return run_branch(core, branch);
+	});
+	EXPECT_TRUE(results[0].ok);
+	EXPECT_FALSE(results[1].ok);
+	EXPECT_TRUE(results[1].data.empty());
+	EXPECT_TRUE(results[2].ok);
+}
+
+TEST(Explore, PassesBackLargeResultsWithFewChildren)
+{
+	CpuHarness harness;
+	load_input_loop(harness);
+
+	// Whole RAM images, far more than a pipe holds
+	std::vector<ExploreResult> results = explore(harness.core(), 5, [](CPU::Core& core, u32 branch)
+	{
+		run_branch(core, branch);
+		const u8* ram = core.interconnect().ram().data();
+		return std::vector<u8>(ram, ram + RAM_ADDR_SPACE_SIZE);
+	}, 2);
+
+	for (u32 i = 0; i < 5; i++)
+	{
+		CoreSnapshot copy(harness.core());
+		run_branch(copy.core(), i);
+		const u8* ram = copy.core().interconnect().ram().data();
+		ASSERT_TRUE(results[i].ok) << "branch " << i;
+		ASSERT_EQ(results[i].data.size(), static_cast<usize>(RAM_ADDR_SPACE_SIZE));
+		EXPECT_EQ(memcmp(results[i].data.data(), ram, RAM_ADDR_SPACE_SIZE), 0) << "branch " << i;
+	}
+}
@@ -0,0 +1,124 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "fuzz.h"
+#include "debug_traps.h"
+
+#define FUZZ_INPUT_ADDRESS 0x80100000
+
+// Crashes on a load from unmapped memory if the input starts with "FU!"
+static const std::vector<u32> MAGIC_CHECK = {
+	0x3c108010,			// lui s0, 0x8010
+	0x92080000,			// lbu t0, 0(s0)
+	0x24090046,			// addiu t1, zero, 'F'
+	0x1509000b,			// bne t0, t1, done
+	0x00000000,			// nop
+	0x92080001,			// lbu t0, 1(s0)
+	0x24090055,			// addiu t1, zero, 'U'
+	0x15090007,			// bne t0, t1, done
+	0x00000000,			// nop
+	0x92080002,			// lbu t0, 2(s0)
+	0x24090021,			// addiu t1, zero, '!'
+	0x15090003,			// bne t0, t1, done
+	0x00000000,			// nop
+	0x3c0a1f90,			// lui t2, 0x1f90
+	0x8d4b0000,			// lw t3, 0(t2)
+	0x0800400f,			// done: j done
+	0x00000000,			// nop
+};
+
+static FuzzOptions magic_options()
+{
+	FuzzOptions options;
+	options.input_address = FUZZ_INPUT_ADDRESS;
+	options.max_input_size = 8;
+	options.stop_at_pc = true;
+	options.stop_pc = CPU_HARNESS_CODE_ADDRESS + 15 * 4;
+	return options;
+}
+
+TEST(Fuzzer, FindsMagicBytesThroughCoverage)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, MAGIC_CHECK);
+	Fuzzer fuzzer(harness.core(), magic_options());
+	for (u32 round = 0; round < 100 && fuzzer.findings().empty(); round++)
+	{
+		fuzzer.fuzz(5000);
+	}
+
+	ASSERT_EQ(fuzzer.findings().size(), 1u);
+	const FuzzFinding& finding = fuzzer.findings()[0];
+	EXPECT_EQ(finding.crash, FuzzCrash::UnmappedAccess);
+	EXPECT_EQ(finding.pc, CPU_HARNESS_CODE_ADDRESS + 14 * 4);
+	ASSERT_GE(finding.input.size(), 3u);
+	EXPECT_EQ(std::string(finding.input.begin(), finding.input.begin() + 3), "FU!");
+	EXPECT_EQ(fuzzer.edges(), 3u);			// one mismatch branch per byte
+}
+
+TEST(Fuzzer, IterationsStartFromTheSameState)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, MAGIC_CHECK);
+	u64 start_hash = state_hash(harness.core());
+	{
+		Fuzzer fuzzer(harness.core(), magic_options());
+		FuzzResult first = fuzzer.run_input({ 'F', 'x' });
+		EXPECT_TRUE(first.new_coverage);
+		EXPECT_EQ(fuzzer.corpus().size(), 1u);
+
+		fuzzer.fuzz(200);
+		FuzzResult again = fuzzer.run_input({ 'F', 'x' });
+		EXPECT_FALSE(again.new_coverage);
+		EXPECT_EQ(again.cycles, first.cycles);
+		EXPECT_EQ(harness.core().interconnect().load<u8>(FUZZ_INPUT_ADDRESS + 1), 'x');
+		EXPECT_EQ(fuzzer.iterations(), 202u);
+	}
+	EXPECT_EQ(state_hash(harness.core()), start_hash);
+}
+
+static FuzzResult run_program(const std::vector<u32>& code)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, code);
+	harness.set_reg(8, 0x7fffffff);
+	harness.set_reg(9, 0x1f900000);
+	FuzzOptions options;
+	options.max_cycles = 100;
+	Fuzzer fuzzer(harness.core(), options);
+	return fuzzer.run_input({});
+}
+
+TEST(Fuzzer, ClassifiesCrashes)
+{
+	FuzzResult overflow = run_program({ 0x00000000, 0x21080001 });		// addi t0, t0, 1
+	EXPECT_EQ(overflow.crash, FuzzCrash::Overflow);
+	EXPECT_EQ(overflow.pc, CPU_HARNESS_CODE_ADDRESS + 4);
+
+	EXPECT_EQ(run_program({ 0xa1200000 }).crash, FuzzCrash::UnmappedAccess);		// sb zero, 0(t1)
+	EXPECT_EQ(run_program({ 0x84000000 }).crash, FuzzCrash::ReservedInstruction);	// lh zero, 0(zero)
+	EXPECT_EQ(run_program({ 0x0000000c }).crash, FuzzCrash::ReservedInstruction);	// syscall
+	EXPECT_EQ(run_program({ 0x40087800 }).crash, FuzzCrash::Coprocessor);			// mfc0 t0, prid
+	EXPECT_EQ(run_program({ 0x01200008, 0x00000000 }).crash, FuzzCrash::BadFetch);	// jr t1
+	EXPECT_EQ(run_program({ 0x0000000d }).crash, FuzzCrash::Break);				// break
+	EXPECT_EQ(run_program({ 0x4a000000 }).crash, FuzzCrash::Coprocessor);			// GTE command 0, not one
+	// Address errors go to the guest exception handler, a nop slide
+	EXPECT_EQ(run_program({ 0x8d200002 }).crash, FuzzCrash::None);				// lw zero, 2(t1)
+
+	FuzzResult clean = run_program({ 0x25080001, 0x08004000, 0x00000000 });		// addiu in a loop
+	EXPECT_EQ(clean.crash, FuzzCrash::None);
+	EXPECT_GE(clean.cycles, 100u);
+}
+
+TEST(Fuzzer, DebuggerTrapsAreNotCrashes)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, { 0x00000000, 0x25080001, 0x08004000, 0x00000000 });
+	DebugTraps traps(harness.core());
+	harness.core().set_debug_traps(&traps);
+	ASSERT_TRUE(traps.add_breakpoint(CPU_HARNESS_CODE_ADDRESS + 4));
+	FuzzOptions options;
+	options.max_cycles = 100;
+	Fuzzer fuzzer(harness.core(), options);
+	EXPECT_THROW(fuzzer.run_input({}), DebugTrap);
+	EXPECT_TRUE(fuzzer.findings().empty());
+}
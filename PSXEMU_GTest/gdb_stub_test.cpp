@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "gdb_stub.h"
+#include <sstream>
+
+#define WATCHED_ADDRESS 0x80100000
+
+// Counts in t0, storing it at WATCHED_ADDRESS every iteration
+static const std::vector<u32> COUNTER = {
+	0x24080001,			// addiu t0, zero, 1
+	0x25080001,			// loop: addiu t0, t0, 1
+	0x3c098010,			// lui t1, 0x8010
+	0xad280000,			// sw t0, 0(t1)
+	0x240a0007,			// addiu t2, zero, 7
+	0x08004001,			// j loop
+	0x00000000,
+};
+
+static RunOptions budget()
+{
+	RunOptions options;
+	options.max_cycles = 10 * RUN_LOOP_SLICE_CYCLES;
+	return options;
+}
+
+static u32 reg(GdbStub& stub, u32 index)
+{
+	std::ostringstream packet;
+	packet << "p" << std::hex << index;
+	std::string value = stub.handle(packet.str());
+	u32 word = 0;
+	for (u32 i = 0; i < 4; i++)
+	{
+		word |= static_cast<u32>(std::stoul(value.substr(i * 2, 2), nullptr, 16)) << (i * 8);
+	}
+	return word;
+}
+
+TEST(GdbStub, BreakpointStopsAndResumes)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTER);
+	GdbStub stub(harness.core(), budget());
+
+	EXPECT_EQ(stub.handle("?"), "S05");
+	EXPECT_EQ(stub.handle("Z0,80010010,4"), "OK");
+	EXPECT_EQ(stub.handle("c"), "S05");
+	EXPECT_EQ(reg(stub, GDB_STUB_PC_REGISTER), 0x80010010u);
+	EXPECT_EQ(reg(stub, 8), 2u);
+	EXPECT_EQ(stub.handle("g").size(), GDB_STUB_N_REGISTERS * 8u);
+	// The patched instruction reads as the original
+	EXPECT_EQ(stub.handle("m80010010,4"), "07000a24");
+
+	EXPECT_EQ(stub.handle("c"), "S05");
+	EXPECT_EQ(reg(stub, GDB_STUB_PC_REGISTER), 0x80010010u);
+	EXPECT_EQ(reg(stub, 8), 3u);
+	EXPECT_EQ(harness.load32(WATCHED_ADDRESS), 3u);
+
+	// The instruction under the breakpoint runs on the step
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(reg(stub, GDB_STUB_PC_REGISTER), 0x80010014u);
+	EXPECT_EQ(reg(stub, 10), 7u);
+
+	EXPECT_EQ(stub.handle("z0,80010010,4"), "OK");
+	EXPECT_EQ(stub.handle("z0,80010010,4"), "E01");
+	EXPECT_EQ(harness.load32(0x80010010), 0x240a0007u);
+	EXPECT_EQ(stub.handle("Z0,1f000000,4"), "E01");
+	EXPECT_FALSE(stub.done());
+	EXPECT_EQ(stub.handle("D"), "OK");
+	EXPECT_TRUE(stub.done());
+}
+
+TEST(GdbStub, RegistersAndMemoryWrites)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTER);
+	GdbStub stub(harness.core(), budget());
+
+	EXPECT_EQ(stub.handle("P8=78563412"), "OK");
+	EXPECT_EQ(harness.reg(8), 0x12345678u);
+	EXPECT_EQ(stub.handle("P0=ffffffff"), "OK");
+	EXPECT_EQ(harness.reg(0), 0u);
+
+	// Writes under a breakpoint change the instruction it runs
+	EXPECT_EQ(stub.handle("Z0,80010004,4"), "OK");
+	EXPECT_EQ(stub.handle("M80010004,4:05000825"), "OK");
+	EXPECT_EQ(stub.handle("m80010004,4"), "05000825");
+	EXPECT_EQ(stub.handle("c"), "S05");
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(harness.reg(8), 6u);
+
+	// Moving pc refetches
+	EXPECT_EQ(stub.handle("P25=10000180"), "OK");
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(harness.reg(10), 7u);
+	EXPECT_EQ(stub.handle("M1f000000,1:00"), "E01");
+}
+
+TEST(GdbStub, WriteWatchpointStopsAfterTheStore)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTER);
+	GdbStub stub(harness.core(), budget());
+
+	EXPECT_EQ(stub.handle("Z2,80100000,4"), "OK");
+	EXPECT_EQ(stub.handle("c"), "T05watch:80100000;");
+	EXPECT_EQ(reg(stub, GDB_STUB_PC_REGISTER), 0x80010010u);
+	EXPECT_EQ(harness.load32(WATCHED_ADDRESS), 2u);
+
+	EXPECT_EQ(stub.handle("c"), "T05watch:80100000;");
+	EXPECT_EQ(harness.load32(WATCHED_ADDRESS), 3u);
+	// Stepping over the store reports it too
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(stub.handle("s"), "S05");
+	EXPECT_EQ(stub.handle("s"), "T05watch:80100000;");
+
+	// Reads of the debugger don't trigger it
+	EXPECT_EQ(stub.handle("m80100000,4"), "04000000");
+	EXPECT_EQ(stub.handle("z2,80100000,4"), "OK");
+	EXPECT_FALSE(harness.core().interconnect().ram_watched());
+	EXPECT_EQ(stub.handle("c"), "S05");
+}
+
+TEST(GdbStub, ReadWatchpointIgnoresFetchesAndWrites)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTER);
+	GdbStub stub(harness.core(), budget());
+
+	// The code and the stored counter
+	EXPECT_EQ(stub.handle("Z3,80010000,1c"), "OK");
+	EXPECT_EQ(stub.handle("Z3,80100000,4"), "OK");
+	EXPECT_EQ(stub.handle("c"), "S05");
+	EXPECT_EQ(stub.handle("Z4,80100002,1"), "OK");
+	EXPECT_EQ(stub.handle("c"), "T05awatch:80100002;");
+	EXPECT_EQ(stub.handle("Z2,80200000,4"), "E01");		// past the 2 MB of RAM
+}
+
+TEST(GdbStub, TargetDescription)
+{
+	CpuHarness harness;
+	GdbStub stub(harness.core(), budget());
+	EXPECT_NE(stub.handle("qSupported:multiprocess+").find("qXfer:features:read+"), std::string::npos);
+
+	std::string xml;
+	std::string chunk;
+	do
+	{
+		std::ostringstream packet;
+		packet << "qXfer:features:read:target.xml:" << std::hex << xml.size() << ",100";
+		chunk = stub.handle(packet.str());
+		ASSERT_FALSE(chunk.empty());
+		xml += chunk.substr(1);
+	} while (chunk[0] == 'm');
+	EXPECT_EQ(xml, GdbStub::target_xml());
+	EXPECT_NE(xml.find("<reg name=\"pc\" bitsize=\"32\" regnum=\"37\"/>"), std::string::npos);
+	EXPECT_EQ(stub.handle("vMustReplyEmpty"), "");
+}
+
+TEST(GdbStub, Framing)
+{
+	EXPECT_EQ(GdbStub::frame("OK"), "$OK#9a");
+	EXPECT_EQ(GdbStub::frame(""), "$#00");
+	EXPECT_EQ(GdbStub::frame("a#b"), "$a}\x03" "b#43");
+}
+
+// Without a debugger, a BREAK is still something the core doesn't emulate
+TEST(GdbStub, GuestBreakWithoutTraps)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, { 0x00000000, 0x0000000d });
+	RunLoop loop(harness.core());
+	EXPECT_EQ(loop.run(budget()).reason, StopReason::Error);
+}
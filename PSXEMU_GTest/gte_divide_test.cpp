@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "gte_divide.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace CPU;
+
+// The hardware refines a table seed with one Newton-Raphson step, which is
+// up to 3 units off the rounded quotient
+#define UNR_MAX_ERROR 3
+
+struct DivideMismatch
+{
+	u64 count = 0;
+	u32 h = 0;
+	u32 sz3 = 0;
+};
+
+static void check_divide_range(u32 h_begin, u32 h_end, DivideMismatch& mismatch)
+{
+	for (u32 h = h_begin; h < h_end; h++)
+	{
+		for (u32 sz3 = 0; sz3 < 0x10000; sz3++)
+		{
+			bool overflow;
+			u32 q = unr_divide(h, sz3, overflow);
+
+			// Long division of h * 0x10000 by sz3, rounded to nearest
+			bool exact_overflow = (sz3 == 0) || (static_cast<u64>(h) * 0x10000 / sz3 >= 0x20000);
+			u64 exact_q = exact_overflow ? 0x1ffff : (static_cast<u64>(h) * 0x20000 / sz3 + 1) / 2;
+			exact_q = std::min<u64>(exact_q, 0x1ffff);
+			u64 error = (q > exact_q) ? q - exact_q : exact_q - q;
+
+			if ((overflow != exact_overflow) || (exact_overflow && q != 0x1ffff) || error > UNR_MAX_ERROR)
+			{
+				if (mismatch.count == 0)
+				{
+					mismatch.h = h;
+					mismatch.sz3 = sz3;
+				}
+				mismatch.count++;
+			}
+		}
+	}
+}
+
+TEST(GteDivide, TableMatchesFormula)
+{
+	for (s32 i = 0; i < 0x101; i++)
+	{
+		s32 v = ((0x40000 / (i + 0x100)) + 1) / 2 - 0x101;
+		EXPECT_EQ(unr_table.value[i], static_cast<u8>(std::max(0, v))) << "index " << i;
+	}
+}
+
+TEST(GteDivide, KnownValues)
+{
+	bool overflow;
+	EXPECT_EQ(unr_divide(1000, 1000, overflow), 0x10000u);
+	EXPECT_FALSE(overflow);
+	EXPECT_EQ(unr_divide(0, 1, overflow), 0u);
+	EXPECT_FALSE(overflow);
+	EXPECT_EQ(unr_divide(1000, 500, overflow), 0x1ffffu);
+	EXPECT_TRUE(overflow);
+	EXPECT_EQ(unr_divide(0, 0, overflow), 0x1ffffu);
+	EXPECT_TRUE(overflow);
+}
+
+// Every (H, SZ3) pair: the full 32 bit input space of the divider
+TEST(GteDivide, ExhaustiveMatchesLongDivision)
+{
+	u32 n_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<DivideMismatch> mismatches(n_threads);
+	std::vector<std::thread> threads;
+
+	u32 chunk = (0x10000 + n_threads - 1) / n_threads;
+	for (u32 t = 0; t < n_threads; t++)
+	{
+		u32 begin = std::min(0x10000u, t * chunk);
+		u32 end = std::min(0x10000u, begin + chunk);
+		threads.emplace_back(check_divide_range, begin, end, std::ref(mismatches[t]));
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (const auto& mismatch : mismatches)
+	{
+		EXPECT_EQ(mismatch.count, 0u) << "first mismatch at H = " << mismatch.h <<
+			", SZ3 = " << mismatch.sz3;
+	}
+}
@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "gte.h"
+#include <random>
+
+using namespace CPU;
+
+static const u32
+	GTE_RTPS = 0x0180001,	// sf = 1
+	GTE_NCLIP = 0x1400006,
+	GTE_AVSZ3 = 0x158002d;
+
+static void set_identity_rotation(Gte& gte)
+{
+	gte.set_control(0, 0x00001000);		// RT11 = 1.0, RT12 = 0
+	gte.set_control(1, 0x00000000);		// RT13, RT21
+	gte.set_control(2, 0x00001000);		// RT22 = 1.0, RT23 = 0
+	gte.set_control(3, 0x00000000);		// RT31, RT32
+	gte.set_control(4, 0x00001000);		// RT33 = 1.0
+}
+
+TEST(Gte, MacLanesMatchReference)
+{
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<s32> s16_dist(-0x8000, 0x7fff);
+	std::uniform_int_distribution<s32> s32_dist(INT_MIN, INT_MAX);
+
+	for (u32 n = 0; n < 100000; n++)
+	{
+		GteMacLanes lanes;
+		for (u32 l = 0; l < 4; l++)
+		{
+			lanes.t[l] = s32_dist(rng);
+			for (u32 i = 0; i < 3; i++)
+			{
+				lanes.a[i][l] = s16_dist(rng);
+				lanes.b[i][l] = s16_dist(rng);
+			}
+		}
+
+		GteMacResult simd;
+		GteMacResult reference;
+		Gte::mac_lanes(lanes, simd);
+		Gte::mac_lanes_reference(lanes, reference);
+
+		ASSERT_EQ(simd.pos_overflow, reference.pos_overflow);
+		ASSERT_EQ(simd.neg_overflow, reference.neg_overflow);
+		for (u32 l = 0; l < 4; l++)
+		{
+			ASSERT_EQ(simd.value[l], reference.value[l]);
+		}
+	}
+}
+
+TEST(Gte, RtpsIdentityProjection)
+{
+	Gte gte;
+	set_identity_rotation(gte);
+	gte.set_control(26, 1000);						// H
+	gte.set_data(0, (50u << 16) | 100u);			// VX0 = 100, VY0 = 50
+	gte.set_data(1, 1000);							// VZ0 = 1000
+
+	gte.execute(GTE_RTPS);
+
+	EXPECT_EQ(gte.get_data(14), (50u << 16) | 100u);	// SXY2
+	EXPECT_EQ(gte.get_data(19), 1000u);					// SZ3
+	EXPECT_EQ(gte.get_data(25), 100u);					// MAC1
+	EXPECT_EQ(gte.get_data(27), 1000u);					// MAC3
+	EXPECT_EQ(gte.get_control(31), 0u);					// FLAG
+}
+
+TEST(Gte, RtpsDivideOverflowSetsFlag)
+{
+	Gte gte;
+	set_identity_rotation(gte);
+	gte.set_control(26, 1000);
+	gte.set_data(1, 100);							// SZ3 = 100 < H / 2
+
+	gte.execute(GTE_RTPS);
+
+	u32 flag = gte.get_control(31);
+	EXPECT_NE(flag & (1u << 17), 0u);
+	EXPECT_NE(flag & (1u << 31), 0u);
+}
+
+TEST(Gte, RtpsSaturatesScreenCoordinates)
+{
+	Gte gte;
+	set_identity_rotation(gte);
+	gte.set_control(26, 1000);
+	gte.set_data(0, 5000);							// VX0
+	gte.set_data(1, 1000);
+
+	gte.execute(GTE_RTPS);
+
+	EXPECT_EQ(gte.get_data(14) & 0xffff, 0x3ffu);
+	EXPECT_NE(gte.get_control(31) & (1u << 14), 0u);
+}
+
+TEST(Gte, NclipAndAvsz3)
+{
+	Gte gte;
+	gte.set_data(12, 0);							// SXY0 = (0, 0)
+	gte.set_data(13, 10);							// SXY1 = (10, 0)
+	gte.set_data(14, 10u << 16);					// SXY2 = (0, 10)
+	gte.execute(GTE_NCLIP);
+	EXPECT_EQ(gte.get_data(24), 100u);
+
+	gte.set_control(29, 0x555);						// ZSF3 ~ 1/3
+	gte.set_data(17, 300);
+	gte.set_data(18, 300);
+	gte.set_data(19, 300);
+	gte.execute(GTE_AVSZ3);
+	EXPECT_EQ(gte.get_data(7), (0x555u * 900) >> 12);
+}
+
+TEST(Gte, LeadingZeroCount)
+{
+	Gte gte;
+	gte.set_data(30, 0x0000ffff);
+	EXPECT_EQ(gte.get_data(31), 16u);
+	gte.set_data(30, 0xfff00000);
+	EXPECT_EQ(gte.get_data(31), 12u);
+	gte.set_data(30, 0);
+	EXPECT_EQ(gte.get_data(31), 32u);
+}
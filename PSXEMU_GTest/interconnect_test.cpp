@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "interconnect.h"
+
+static std::vector<u8> test_bios()
+{
+	std::vector<u8> image(16);
+	for (u32 i = 0; i < image.size(); i++)
+	{
+		image[i] = static_cast<u8>(0x10 + i);
+	}
+	return image;
+}
+
+TEST(Interconnect, AccessesRamAtEveryWidth)
+{
+	Interconnect interconnect = Interconnect(Bios(test_bios()));
+	interconnect.store<u32>(0x80001000, 0x11223344);
+	EXPECT_EQ(interconnect.load<u16>(0x80001002), 0x1122);
+	EXPECT_EQ(interconnect.load<u8>(0x80001001), 0x33);
+
+	interconnect.store<u16>(0x80001000, 0xbeef);
+	interconnect.store<u8>(0x80001003, 0xaa);
+	EXPECT_EQ(interconnect.load<u32>(0x80001000), 0xaa22beefu);
+	EXPECT_EQ(interconnect.stats().accesses[static_cast<u32>(StatsRegion::Ram)], 6u);
+}
+
+TEST(Interconnect, SegmentsMirrorTheSamePhysicalMemory)
+{
+	Interconnect interconnect = Interconnect(Bios(test_bios()));
+	interconnect.store<u32>(0x00002000, 0xcafe0001);
+	EXPECT_EQ(interconnect.load<u32>(0xa0002000), 0xcafe0001u);
+	EXPECT_EQ((interconnect.load_segment<u32, Segment::Kseg0>(0x80002000)), 0xcafe0001u);
+
+	EXPECT_EQ(interconnect.load<u32>(0xbfc00004), 0x17161514u);
+	EXPECT_EQ((interconnect.load_segment<u32, Segment::Kseg1>(0xbfc00004)), 0x17161514u);
+	EXPECT_EQ((interconnect.load_segment<u16, Segment::Kseg0>(0x9fc00002)), 0x1312);
+}
+
+TEST(Interconnect, SplitsWideDeviceAccesses)
+{
+	Interconnect interconnect = Interconnect(Bios(test_bios()));
+	interconnect.store<u32>(0x1f801c00, 0x22221111);			// voice 0 volume
+	EXPECT_EQ(interconnect.load<u16>(0x1f801c00), 0x1111);
+	EXPECT_EQ(interconnect.load<u16>(0x1f801c02), 0x2222);
+	EXPECT_EQ(interconnect.load<u32>(0x1f801c00), 0x22221111u);
+	EXPECT_EQ(interconnect.stats().accesses[static_cast<u32>(StatsRegion::Spu)], 4u);
+}
+
+TEST(Interconnect, RejectsUnmappedWidths)
+{
+	Interconnect interconnect = Interconnect(Bios(test_bios()));
+	EXPECT_ANY_THROW(interconnect.load<u32>(0x1f801800));		// CD-ROM registers are 8 bit
+	EXPECT_ANY_THROW(interconnect.store<u8>(0xbfc00000, 0));		// BIOS is read only
+	EXPECT_ANY_THROW(interconnect.load<u8>(0x1f900000));
+}
+
+TEST(Interconnect, LastWordOfRamAndBios)
+{
+	Interconnect interconnect = Interconnect(Bios(test_bios()));
+	interconnect.store<u32>(0x001ffffc, 0x44332211);
+	EXPECT_EQ(interconnect.load<u32>(0x801ffffc), 0x44332211u);
+	EXPECT_EQ(interconnect.load<u16>(0x001ffffe), 0x4433);
+	EXPECT_EQ(interconnect.load<u32>(0x1fc7fffc), 0u);
+
+	// Misaligned host accesses are rejected instead of running past the end
+	EXPECT_ANY_THROW(interconnect.load<u32>(0x001ffffd));
+	EXPECT_ANY_THROW(interconnect.store<u32>(0x001fffff, 0));
+	EXPECT_ANY_THROW(interconnect.store<u16>(0x001fffff, 0));
+	EXPECT_ANY_THROW(interconnect.load<u32>(0x1fc7fffd));
+	EXPECT_ANY_THROW(interconnect.load<u16>(0xbfc7ffff));
+	EXPECT_EQ(interconnect.load<u32>(0x001ffffc), 0x44332211u);
+}
+
+TEST(Interconnect, RamAssignmentCopiesWrittenPages)
+{
+	Ram live;
+	live.store<u32>(0x1000, 0x11111111);
+	Ram snapshot(live);
+	EXPECT_EQ(snapshot.dirty_pages(), 0u);
+	live = snapshot;
+	EXPECT_EQ(live.dirty_pages(), 0u);
+
+	// Same starting contents: only pages written on either side differ
+	live.store<u32>(0x5000, 0x22222222);
+	live.store_block(0x8ffe, nullptr, 4);		// two pages
+	EXPECT_EQ(live.dirty_pages(), 3u);
+	live = snapshot;
+	EXPECT_EQ(live.load<u32>(0x5000), 0xcacacacau);
+	EXPECT_EQ(live.load<u32>(0x8ffe), 0xcacacacau);
+	EXPECT_EQ(live.load<u32>(0x1000), 0x11111111u);
+	EXPECT_EQ(live.dirty_pages(), 0u);
+
+	// Writes through the raw pointer can't be tracked
+	live.data()[0x20000] = 0x33;
+	EXPECT_EQ(live.dirty_pages(), static_cast<u32>(RAM_N_PAGES));
+	live = snapshot;
+	EXPECT_EQ(live.load<u8>(0x20000), 0xca);
+	EXPECT_EQ(memcmp(live.data(), static_cast<const Ram&>(snapshot).data(), RAM_ADDR_SPACE_SIZE), 0);
+}
@@ -0,0 +1,264 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "lockstep.h"
+#include "replay.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+// Adds t1 to a counter until it reaches t2, storing the sums. Odd and even
+// sums take paths of the same length, so lanes part there and meet again.
+static const std::vector<u32> DIVERGING_LOOP = {
+	0x40806000,			// mtc0 zero, sr
+	0x3c108010,			// lui s0, 0x8010
+	0x25080001,			// loop: addiu t0, t0, 1
+	0x01095821,			// addu t3, t0, t1
+	0xae0b0000,			// sw t3, 0(s0)
+	0x8e0c0000,			// lw t4, 0(s0)
+	0x26100004,			// addiu s0, s0, 4
+	0x318c0001,			// andi t4, t4, 1
+	0x11800004,			// beq t4, zero, even
+	0x01ac6821,			// addu t5, t5, t4
+	0x25ce0001,			// addiu t6, t6, 1
+	0x08004010,			// j join
+	0x00000000,			// nop
+	0x24420001,			// even: addiu v0, v0, 1
+	0x00000000,			// nop
+	0x00000000,			// nop
+	0x01e87823,			// join: subu t7, t7, t0
+	0x010ac02a,			// slt t8, t0, t2
+	0x1700ffef,			// bne t8, zero, loop
+	0x0008c880,			// sll t9, t0, 2
+	0x01aa001b,			// divu t5, t2
+	0x00007812,			// mflo t7
+	0x00001810,			// mfhi v1
+	0x0c00401c,			// jal sub
+	0x00000000,			// nop
+	0x08004019,			// end: j end
+	0x00000000,			// nop
+	0x00000000,			// nop
+	0x000b2043,			// sub: sra a0, t3, 1
+	0x03e00008,			// jr ra
+	0x008d2825,			// or a1, a0, t5
+};
+
+static void load_lane(CpuHarness& harness, u32 addend, u32 count)
+{
+	harness.load(CPU_HARNESS_CODE_ADDRESS, DIVERGING_LOOP);
+	for (u32 reg = 1; reg < N_GP_REG; reg++)
+	{
+		harness.set_reg(reg, 0);
+	}
+	harness.set_reg(9, addend);
+	harness.set_reg(10, count);
+}
+
+static void expect_same_machine(CPU::Core& actual, CPU::Core& expected, usize lane)
+{
+	const CPU::State& a = actual.state();
+	const CPU::State& e = expected.state();
+	EXPECT_EQ(a.pc, e.pc) << "lane " << lane;
+	EXPECT_EQ(actual.current_pc(), expected.current_pc()) << "lane " << lane;
+	EXPECT_EQ(a.hi, e.hi) << "lane " << lane;
+	EXPECT_EQ(a.lo, e.lo) << "lane " << lane;
+	EXPECT_EQ(a.load.first.value, e.load.first.value) << "lane " << lane;
+	EXPECT_EQ(a.load.second, e.load.second) << "lane " << lane;
+	EXPECT_EQ(a.cycles, e.cycles) << "lane " << lane;
+	for (u32 i = 0; i < N_GP_REG; i++)
+	{
+		EXPECT_EQ(a.regs[i], e.regs[i]) << "lane " << lane << ", register " << i;
+	}
+	EXPECT_EQ(state_hash(actual), state_hash(expected)) << "lane " << lane;
+	EXPECT_EQ(actual.stats().instructions, expected.stats().instructions) << "lane " << lane;
+}
+
+// Lanes are snapshots of a harness, which keep the core aligned on the heap
+static CoreSnapshot* new_lane(u32 addend, u32 count)
+{
+	CpuHarness harness;
+	load_lane(harness, addend, count);
+	return new CoreSnapshot(harness.core());
+}
+
+TEST(Lockstep, LanesMatchTheInterpreter)
+{
+	const usize n_lanes = 11;
+	std::vector<std::unique_ptr<CoreSnapshot>> lanes;
+	std::vector<std::unique_ptr<CoreSnapshot>> references;
+	std::vector<CPU::Core*> cores;
+	for (usize i = 0; i < n_lanes; i++)
+	{
+		u32 addend = static_cast<u32>(i * 3 + 1);
+		u32 count = static_cast<u32>(5 + (i % 4) * 2);
+		lanes.emplace_back(new_lane(addend, count));
+		references.emplace_back(new_lane(addend, count));
+		cores.push_back(&lanes.back()->core());
+	}
+
+	CPU::LockstepBatch batch(cores);
+	for (u32 run = 0; run < 40; run++)
+	{
+		batch.run(7);
+	}
+	for (usize i = 0; i < n_lanes; i++)
+	{
+		for (u32 step = 0; step < 280; step++)
+		{
+			references[i]->core().run_next_instruction();
+		}
+		expect_same_machine(lanes[i]->core(), references[i]->core(), i);
+		EXPECT_EQ(lanes[i]->core().state().regs[31], CPU_HARNESS_CODE_ADDRESS + 0x64u);		// returned from sub
+	}
+}
+
+class StoreCounter : public RamWatcher
+{
+public:
+	u32 stores = 0;
+
+	void ram_access(u32 offset, u32 size, bool write) override
+	{
+		stores += write ? 1 : 0;
+	}
+};
+
+TEST(Lockstep, WatchedLanesRunOnTheCore)
+{
+	std::unique_ptr<CoreSnapshot> watched(new_lane(1, 9));
+	std::unique_ptr<CoreSnapshot> other(new_lane(1, 9));
+	std::unique_ptr<CoreSnapshot> reference(new_lane(1, 9));
+	StoreCounter counter;
+	watched->core().interconnect().set_ram_watcher(&counter);
+
+	CPU::LockstepBatch batch({ &watched->core(), &other->core() });
+	batch.run(300);
+	EXPECT_EQ(counter.stores, 9u);
+	EXPECT_EQ(batch.n_groups(), 2u);
+	for (u32 step = 0; step < 300; step++)
+	{
+		reference->core().run_next_instruction();
+	}
+	expect_same_machine(watched->core(), reference->core(), 0);
+	expect_same_machine(other->core(), reference->core(), 1);
+
+	// Copies aren't watched
+	CoreSnapshot copy(watched->core());
+	EXPECT_FALSE(copy.core().interconnect().ram_watched());
+	copy.restore(watched->core());
+	EXPECT_TRUE(watched->core().interconnect().ram_watched());
+}
+
+TEST(Lockstep, RecordsCoverageLikeTheInterpreter)
+{
+	const usize n_lanes = 3;
+	std::vector<std::unique_ptr<CoreSnapshot>> lanes;
+	std::vector<std::unique_ptr<CoreSnapshot>> references;
+	std::vector<CPU::Core*> cores;
+	std::vector<std::unique_ptr<EdgeCoverage>> coverage;
+	std::vector<std::unique_ptr<EdgeCoverage>> expected;
+	for (usize i = 0; i < n_lanes; i++)
+	{
+		lanes.emplace_back(new_lane(static_cast<u32>(i + 1), 9));
+		references.emplace_back(new_lane(static_cast<u32>(i + 1), 9));
+		coverage.emplace_back(new EdgeCoverage());
+		expected.emplace_back(new EdgeCoverage());
+		lanes.back()->core().set_coverage(coverage.back().get());
+		references.back()->core().set_coverage(expected.back().get());
+		cores.push_back(&lanes.back()->core());
+	}
+
+	CPU::LockstepBatch batch(cores);
+	batch.run(300);
+	for (usize i = 0; i < n_lanes; i++)
+	{
+		for (u32 step = 0; step < 300; step++)
+		{
+			references[i]->core().run_next_instruction();
+		}
+		EXPECT_EQ(memcmp(coverage[i]->hits(), expected[i]->hits(), COVERAGE_MAP_SIZE), 0) << "lane " << i;
+		EXPECT_NE(std::count(expected[i]->hits(), expected[i]->hits() + COVERAGE_MAP_SIZE, 0), COVERAGE_MAP_SIZE);
+		lanes[i]->core().set_coverage(nullptr);
+	}
+}
+
+TEST(Lockstep, DivergedLanesRegroup)
+{
+	std::vector<std::unique_ptr<CoreSnapshot>> lanes;
+	std::vector<CPU::Core*> cores;
+	for (u32 i = 0; i < 8; i++)
+	{
+		lanes.emplace_back(new_lane(i, 11));
+		cores.push_back(&lanes.back()->core());
+	}
+
+	CPU::LockstepBatch batch(cores);
+	u32 most_groups = 0;
+	for (u32 step = 0; step < 300; step++)
+	{
+		batch.run(1);
+		most_groups = std::max(most_groups, batch.n_groups());
+	}
+	EXPECT_EQ(most_groups, 2u);
+	EXPECT_EQ(batch.n_groups(), 1u);
+	for (u32 i = 0; i < 8; i++)
+	{
+		const CPU::State& state = lanes[i]->core().state();
+		EXPECT_EQ(state.regs[8], 11u);
+		EXPECT_EQ(state.regs[14] + state.regs[2], 11u);		// odd and even sums
+	}
+	EXPECT_EQ(lanes[0]->core().state().regs[14], 6u);
+	EXPECT_EQ(lanes[1]->core().state().regs[14], 5u);
+}
+
+// Lanes share the fetch of their code until one of them writes it
+TEST(Lockstep, FetchesCodeALaneRewrote)
+{
+	std::vector<std::unique_ptr<CoreSnapshot>> lanes;
+	std::vector<CPU::Core*> cores;
+	for (u32 i = 0; i < 3; i++)
+	{
+		CpuHarness harness;
+		harness.load(CPU_HARNESS_CODE_ADDRESS, {
+			0x25290001,			// addiu t1, t1, 1
+			0x25290002,			// addiu t1, t1, 2
+			0x25290004,			// addiu t1, t1, 4
+			0x25290008,			// addiu t1, t1, 8
+			0x08004004,			// end: j end
+			0x00000000,			// nop
+		});
+		harness.set_reg(9, 0);
+		lanes.emplace_back(new CoreSnapshot(harness.core()));
+		cores.push_back(&lanes.back()->core());
+	}
+
+	CPU::LockstepBatch batch(cores);
+	cores[1]->interconnect().store<u32>(CPU_HARNESS_CODE_ADDRESS + 8, 0x25290040);		// addiu t1, t1, 0x40
+	batch.run(8);
+	EXPECT_EQ(cores[0]->state().regs[9], 15u);
+	EXPECT_EQ(cores[1]->state().regs[9], 0x4bu);
+	EXPECT_EQ(cores[2]->state().regs[9], 15u);
+}
+
+TEST(Lockstep, KeepsLaneStatesWhenALaneFails)
+{
+	std::vector<std::unique_ptr<CoreSnapshot>> lanes;
+	std::vector<CPU::Core*> cores;
+	for (u32 i = 0; i < 2; i++)
+	{
+		CpuHarness harness;
+		harness.load(CPU_HARNESS_CODE_ADDRESS, {
+			0x25290005,			// addiu t1, t1, 5
+			0x8d0a0000,			// lw t2, 0(t0)
+		});
+		harness.set_reg(8, i == 0 ? 0x80100000 : 0x1f900000);		// unmapped on lane 1
+		harness.set_reg(9, 0);
+		lanes.emplace_back(new CoreSnapshot(harness.core()));
+		cores.push_back(&lanes.back()->core());
+	}
+
+	CPU::LockstepBatch batch(cores);
+	EXPECT_ANY_THROW(batch.run(2));
+	EXPECT_EQ(lanes[0]->core().state().regs[9], 5u);
+	EXPECT_EQ(lanes[1]->core().state().regs[9], 5u);
+	EXPECT_ANY_THROW(CPU::LockstepBatch(std::vector<CPU::Core*>(LOCKSTEP_MAX_LANES + 1, cores[0])));
+}
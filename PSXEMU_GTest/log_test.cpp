@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "log.h"
+#include <mutex>
+#include <thread>
+
+// Collects written records, restoring the default sink and levels afterwards
+class CapturedLog
+{
+private:
+	std::mutex mutex_;
+	std::vector<std::string> lines_;
+
+public:
+	CapturedLog()
+	{
+		log_flush();
+		log_set_sink([this](const LogRecord& record, const std::string& text)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			lines_.push_back(std::string(log_name(record.subsystem)) + " " + text);
+		});
+	}
+
+	~CapturedLog()
+	{
+		log_flush();
+		log_set_sink(nullptr);
+		log_set_level(LogLevel::Info);
+	}
+
+	std::vector<std::string> lines()
+	{
+		log_flush();
+		std::lock_guard<std::mutex> lock(mutex_);
+		return lines_;
+	}
+};
+
+TEST(Log, FormatsArguments)
+{
+	LogRecord record = {};
+	record.format = "store{d} at {}: {} {d} {}";
+	record.args[0] = LogArg(32u);
+	record.args[1] = LogArg(0x1f802041u);
+	record.args[2] = LogArg("value");
+	record.args[3] = LogArg(-5);
+	record.n_args = 4;
+	EXPECT_EQ(log_format(record), "store32 at 1f802041: value -5 {}");
+
+	record.suppressed = 7;
+	EXPECT_EQ(log_format(record), "store32 at 1f802041: value -5 {} (7 more not shown)");
+}
+
+static void warn_repeatedly(u32 i)
+{
+	LOG_WARN(Bus, "message {d}", i);
+}
+
+TEST(Log, RateLimitsEachCallSite)
+{
+	CapturedLog log;
+	for (u32 i = 1; i <= 100; i++)
+	{
+		warn_repeatedly(i);
+	}
+	std::vector<std::string> expected;
+	for (u32 i = 1; i <= 8; i++)
+	{
+		expected.push_back("bus message " + std::to_string(i));
+	}
+	expected.push_back("bus message 16 (7 more not shown)");
+	expected.push_back("bus message 32 (15 more not shown)");
+	expected.push_back("bus message 64 (31 more not shown)");
+	EXPECT_EQ(log.lines(), expected);
+}
+
+TEST(Log, FiltersBySubsystem)
+{
+	CapturedLog log;
+	ASSERT_TRUE(log_configure("error,cdrom=debug"));
+	LOG_WARN(Bus, "bus warning");
+	LOG_DEBUG(Cdrom, "cdrom debug");
+	LOG_ERROR(Bus, "bus error");
+	LOG_TRACE(Cdrom, "compiled out");
+	EXPECT_EQ(log.lines(), std::vector<std::string>({ "cdrom cdrom debug", "bus bus error" }));
+
+	EXPECT_FALSE(log_configure("gpu=warn"));
+	EXPECT_FALSE(log_configure("bus=loud"));
+	EXPECT_FALSE(log_configure("verbose"));
+}
+
+TEST(Log, CollectsMessagesFromAllThreads)
+{
+	CapturedLog log;
+	u64 dropped = log_dropped();
+	std::vector<std::thread> threads;
+	for (u32 t = 0; t < 4; t++)
+	{
+		threads.push_back(std::thread([t]()
+		{
+			for (u32 i = 0; i < LOG_BURST; i++)
+			{
+				LOG_INFO(Host, "thread {d}", t);
+			}
+		}));
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+	// One call site: its burst is shared by the threads
+	std::vector<std::string> lines = log.lines();
+	EXPECT_EQ(lines.size() + (log_dropped() - dropped), static_cast<usize>(LOG_BURST + 2));
+}
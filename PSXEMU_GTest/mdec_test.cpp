@@ -0,0 +1,160 @@
+#include "pch.h"
+#include "mdec.h"
+#include <random>
+
+// Standard table uploaded by the libraries: 0x8000 * c(u) * cos((2x + 1) * u * pi / 16)
+static const u16 SCALE_TABLE[MDEC_BLOCK_SIZE] =
+{
+	0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82,
+	0x7d8a, 0x6a6d, 0x471c, 0x18f8, 0xe707, 0xb8e3, 0x9592, 0x8275,
+	0x7641, 0x30fb, 0xcf04, 0x89be, 0x89be, 0xcf04, 0x30fb, 0x7641,
+	0x6a6d, 0xe707, 0x8275, 0xb8e3, 0x471c, 0x7d8a, 0x18f8, 0x9592,
+	0x5a82, 0xa57d, 0xa57d, 0x5a82, 0x5a82, 0xa57d, 0xa57d, 0x5a82,
+	0x471c, 0x8275, 0x18f8, 0x6a6d, 0x9592, 0xe707, 0x7d8a, 0xb8e3,
+	0x30fb, 0x89be, 0x7641, 0xcf04, 0xcf04, 0x7641, 0x89be, 0x30fb,
+	0x18f8, 0xb8e3, 0x6a6d, 0x8275, 0x7d8a, 0x9592, 0x471c, 0xe707
+};
+
+static void make_scale_table(s32 scale[MDEC_BLOCK_SIZE])
+{
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+	{
+		scale[i] = static_cast<s16>(SCALE_TABLE[i]);
+	}
+}
+
+static void upload_tables(Mdec& mdec)
+{
+	s32 scale[MDEC_BLOCK_SIZE];
+	make_scale_table(scale);
+
+	mdec.store32(0, (2u << 29) | 0x1);
+	for (u32 i = 0; i < 32; i++)
+	{
+		mdec.store32(0, 0x01010101);
+	}
+	mdec.store32(0, 3u << 29);
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i += 2)
+	{
+		mdec.store32(0, (scale[i] & 0xffff) | (static_cast<u32>(scale[i + 1]) << 16));
+	}
+}
+
+TEST(Mdec, IdctMatchesReference)
+{
+	std::mt19937 rng(31);
+	std::uniform_int_distribution<s32> coefficient(-0x400, 0x3ff);
+	std::uniform_int_distribution<s32> sparse(0, 7);
+	s32 scale[MDEC_BLOCK_SIZE];
+	make_scale_table(scale);
+
+	for (u32 n = 0; n < 20000; n++)
+	{
+		MdecBlock in;
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			in.value[i] = (sparse(rng) == 0 || i == 0) ? coefficient(rng) : 0;
+		}
+
+		MdecBlock simd;
+		MdecBlock reference;
+		Mdec::idct(in, scale, simd);
+		Mdec::idct_reference(in, scale, reference);
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			ASSERT_EQ(simd.value[i], reference.value[i]);
+		}
+	}
+}
+
+TEST(Mdec, IdctOfDcIsFlat)
+{
+	s32 scale[MDEC_BLOCK_SIZE];
+	make_scale_table(scale);
+
+	MdecBlock in = {};
+	in.value[0] = 320;
+	MdecBlock out;
+	Mdec::idct_reference(in, scale, out);
+	for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+	{
+		ASSERT_EQ(out.value[i], 40);
+	}
+}
+
+TEST(Mdec, YuvToRgbMatchesReference)
+{
+	std::mt19937 rng(32);
+	std::uniform_int_distribution<s32> sample(-128, 127);
+
+	for (u32 n = 0; n < 5000; n++)
+	{
+		MdecBlock cr;
+		MdecBlock cb;
+		MdecBlock y[4];
+		for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++)
+		{
+			cr.value[i] = sample(rng);
+			cb.value[i] = sample(rng);
+			for (u32 j = 0; j < 4; j++)
+			{
+				y[j].value[i] = sample(rng);
+			}
+		}
+
+		u32 simd[MDEC_MACROBLOCK_PIXELS];
+		u32 reference[MDEC_MACROBLOCK_PIXELS];
+		bool is_signed = (n & 0x1) != 0;
+		Mdec::yuv_to_rgb(cr, cb, y, is_signed, simd);
+		Mdec::yuv_to_rgb_reference(cr, cb, y, is_signed, reference);
+		for (u32 i = 0; i < MDEC_MACROBLOCK_PIXELS; i++)
+		{
+			ASSERT_EQ(simd[i], reference[i]);
+		}
+	}
+}
+
+TEST(Mdec, DecodeFlatMacroblock24Bit)
+{
+	Mdec mdec;
+	upload_tables(mdec);
+
+	// Cr, Cb = 0 and Y = 40 (DC 320), each block followed by end of block
+	std::vector<u16> stream = {
+		(1 << 10) | 0, 0xfe00,
+		(1 << 10) | 0, 0xfe00,
+		(1 << 10) | 320, 0xfe00,
+		(1 << 10) | 320, 0xfe00,
+		(1 << 10) | 320, 0xfe00,
+		(1 << 10) | 320, 0xfe00,
+	};
+
+	u32 n_words = static_cast<u32>(stream.size() / 2);
+	mdec.store32(0, (1u << 29) | (2u << 27) | n_words);
+	EXPECT_EQ(mdec.load32(4) & 0xffff, n_words - 1);
+	for (u32 i = 0; i < n_words; i++)
+	{
+		mdec.store32(0, stream[2 * i] | (static_cast<u32>(stream[2 * i + 1]) << 16));
+	}
+
+	ASSERT_EQ(mdec.output_available(), 192u);
+	EXPECT_EQ(mdec.load32(4) & (1u << 31), 0u);
+	for (u32 i = 0; i < 192; i++)
+	{
+		ASSERT_EQ(mdec.load32(0), 0xa8a8a8a8);		// 40 + 128
+	}
+	EXPECT_EQ(mdec.load32(4) & (1u << 31), 1u << 31);
+}
+
+TEST(Mdec, DecodeMonochrome8Bit)
+{
+	Mdec mdec;
+	upload_tables(mdec);
+
+	std::vector<u16> stream = { (1 << 10) | static_cast<u16>(-160 & 0x3ff), 0xfe00 };
+	mdec.store32(0, (1u << 29) | (1u << 27) | (1u << 26) | 1);	// 8 bit, signed
+	mdec.store32(0, stream[0] | (static_cast<u32>(stream[1]) << 16));
+
+	ASSERT_EQ(mdec.output_available(), 16u);
+	EXPECT_EQ(mdec.dma_read(), 0xecececec);		// -20
+}
@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "page_store.h"
+#include <memory>
+
+// Appends a counter to a table at 0x80100000, spanning many pages
+static const std::vector<u32> TABLE_LOOP = {
+	0x3c108010,			// lui s0, 0x8010
+	0x25080001,			// loop: addiu t0, t0, 1
+	0xae080000,			// sw t0, 0(s0)
+	0x08004001,			// j loop
+	0x26100004,			// addiu s0, s0, 4
+};
+
+static void run_cycles(CPU::Core& core, u64 cycles)
+{
+	RunOptions options;
+	options.max_cycles = cycles;
+	RunLoop(core).run(options);
+}
+
+TEST(PageStore, HashDependsOnContentAndPosition)
+{
+	std::vector<u8> a(PAGE_STORE_PAGE_SIZE, 0xca);
+	std::vector<u8> b(a);
+	EXPECT_EQ(hash_page(a.data()), hash_page(b.data()));
+
+	b[0x7ff] ^= 1;
+	EXPECT_NE(hash_page(a.data()), hash_page(b.data()));
+
+	// Same stripes in another order
+	std::vector<u8> c(PAGE_STORE_PAGE_SIZE, 0);
+	std::vector<u8> d(PAGE_STORE_PAGE_SIZE, 0);
+	c[0] = 1;
+	d[32] = 1;
+	EXPECT_NE(hash_page(c.data()), hash_page(d.data()));
+}
+
+TEST(PageStore, SnapshotsShareIdenticalPages)
+{
+	PageStore store;
+	CpuHarness first;
+	CpuHarness second;
+	first.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	second.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	{
+		PagedSnapshot a(store, first.core());
+		usize n_pages = store.n_pages();
+		// Fill pattern, zeroed sound RAM, code and the harness' vectors
+		EXPECT_LT(n_pages, 8u);
+
+		PagedSnapshot b(store, second.core());
+		EXPECT_EQ(store.n_pages(), n_pages);
+		EXPECT_EQ(store.n_refs(), 2u * (a.ram_pages().size() + a.sound_ram_pages().size()));
+		EXPECT_EQ(a.ram_pages(), b.ram_pages());
+
+		run_cycles(second.core(), 20000);
+		PagedSnapshot c(store, second.core());
+		EXPECT_GT(store.n_pages(), n_pages);
+		EXPECT_NE(c.ram_pages(), a.ram_pages());
+		EXPECT_EQ(c.sound_ram_pages(), a.sound_ram_pages());
+	}
+	EXPECT_EQ(store.n_pages(), 0u);
+	EXPECT_EQ(store.n_refs(), 0u);
+}
+
+TEST(PageStore, RestoreWritesOnlyThePagesThatDiffer)
+{
+	PageStore store;
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	run_cycles(harness.core(), 5000);
+	u64 hash = state_hash(harness.core());
+	PagedSnapshot snapshot(store, harness.core());
+
+	Interconnect& interconnect = harness.core().interconnect();
+	std::vector<u32> pages(RAM_N_PAGES);
+	interconnect.ram().take_changed(pages.data());
+	interconnect.spu().take_changed_sound_ram(pages.data());
+	run_cycles(harness.core(), 10000);
+	u32 written = interconnect.ram().take_changed(pages.data());
+	EXPECT_GT(written, 0u);
+
+	snapshot.restore(harness.core());
+	EXPECT_EQ(state_hash(harness.core()), hash);
+	EXPECT_LE(interconnect.ram().take_changed(pages.data()), written);
+	EXPECT_EQ(interconnect.spu().take_changed_sound_ram(pages.data()), 0u);
+}
+
+TEST(PageStore, RestoresTheMachine)
+{
+	PageStore store;
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, TABLE_LOOP);
+	run_cycles(harness.core(), 5000);
+	u64 hash = state_hash(harness.core());
+	std::unique_ptr<PagedSnapshot> snapshot(new PagedSnapshot(store, harness.core()));
+	std::vector<u8> sound_ram = harness.core().interconnect().spu().sound_ram();
+
+	run_cycles(harness.core(), 10000);
+	u64 later = state_hash(harness.core());
+	EXPECT_NE(later, hash);
+
+	snapshot->restore(harness.core());
+	EXPECT_EQ(state_hash(harness.core()), hash);
+	EXPECT_EQ(harness.core().interconnect().spu().sound_ram(), sound_ram);
+	run_cycles(harness.core(), 10000);
+	EXPECT_EQ(state_hash(harness.core()), later);
+
+	// Releasing the snapshot leaves the restored core alone
+	snapshot.reset();
+	EXPECT_EQ(store.n_pages(), 0u);
+	EXPECT_EQ(state_hash(harness.core()), later);
+}
@@ -0,0 +1,84 @@
+#include "pch.h"
+#include "profiler.h"
+#include "cpu_harness.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+TEST(Profiler, DropsSamplesWhenFull)
+{
+	GuestProfiler profiler(100, 4);
+	for (u32 i = 0; i < 6; i++)
+	{
+		profiler.record(0x80010000 + i * 4, 0);
+	}
+	EXPECT_EQ(profiler.n_samples(), 4u);
+	EXPECT_EQ(profiler.dropped(), 2u);
+	EXPECT_EQ(profiler.sample(3).pc, 0x8001000cu);
+}
+
+TEST(Profiler, SymbolizesFromMapFile)
+{
+	std::string path = "profiler_test.map";
+	{
+		std::ofstream map(path);
+		map << "  Address  Names alphabetically" << std::endl;
+		map << "80010000 T main" << std::endl;				// nm
+		map << "  80010100  update_frame" << std::endl;	// psyq
+		map << "80010200 draw_sprites" << std::endl;
+	}
+	GuestProfiler profiler;
+	ASSERT_TRUE(profiler.load_map(path));
+	std::remove(path.c_str());
+
+	EXPECT_EQ(profiler.symbol(0x80010004), "main");
+	EXPECT_EQ(profiler.symbol(0xa0010180), "update_frame");
+	EXPECT_EQ(profiler.symbol(0x80010200), "draw_sprites");
+	EXPECT_EQ(profiler.symbol(0x8000fffc), "8000fffc");
+}
+
+TEST(Profiler, ReportsAndFoldedStacks)
+{
+	GuestProfiler profiler(100, 64);
+	profiler.add_symbol(0x80010000, "main");
+	profiler.add_symbol(0x80010100, "memcpy");
+	for (u32 i = 0; i < 3; i++)
+	{
+		profiler.record(0x80010104, 0x80010010);
+	}
+	profiler.record(0x80010020, 0x80010010);
+
+	std::ostringstream folded;
+	profiler.write_folded(folded);
+	EXPECT_EQ(folded.str(), "main 1\nmain;memcpy 3\n");
+
+	std::ostringstream flat;
+	profiler.flat_report(flat);
+	EXPECT_LT(flat.str().find("memcpy"), flat.str().find("main"));
+	EXPECT_NE(flat.str().find("75.00%"), std::string::npos);
+}
+
+TEST(Profiler, CoreSamplesEveryInterval)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x25080001,			// addiu t0, t0, 1
+		0x08004000,			// j 0x80010000
+		0x00000000,
+	});
+	GuestProfiler profiler(100, 1024);
+	harness.core().set_profiler(&profiler);
+	harness.run(3000);
+
+	// Two cycles per instruction
+	EXPECT_EQ(profiler.n_samples(), 60u);
+	for (usize i = 0; i < profiler.n_samples(); i++)
+	{
+		u32 pc = profiler.sample(i).pc;
+		EXPECT_TRUE(pc >= CPU_HARNESS_CODE_ADDRESS && pc < CPU_HARNESS_CODE_ADDRESS + 12) << std::hex << pc;
+	}
+
+	harness.core().set_profiler(nullptr);
+	harness.run(3000);
+	EXPECT_EQ(profiler.n_samples(), 60u);
+}
@@ -0,0 +1,119 @@
+#include "pch.h"
+#include "psx_api.h"
+#include "address_map.h"
+#include "psx_exe.h"
+#include <cstring>
+
+#define COUNTER_OFFSET 0x10000
+
+// Counts in RAM at COUNTER_OFFSET, from the reset vector
+static std::vector<u8> counting_bios()
+{
+	const u32 code[] = {
+		0x3c08a001,			// lui t0, 0xa001
+		0x00004821,			// addu t1, zero, zero
+		0x25290001,			// loop: addiu t1, t1, 1
+		0xad090000,			// sw t1, 0(t0)
+		0x0bf00002,			// j loop
+		0x00000000,
+	};
+	std::vector<u8> image(sizeof(code));
+	memcpy(image.data(), code, sizeof(code));
+	return image;
+}
+
+static u32 counter(PsxMachine* machine)
+{
+	size_t size;
+	const uint8_t* ram = psx_memory(machine, PSX_MEMORY_RAM, &size);
+	u32 value;
+	memcpy(&value, ram + COUNTER_OFFSET, sizeof(value));
+	return value;
+}
+
+TEST(PsxApi, RunsAndViewsRamInPlace)
+{
+	std::vector<u8> bios = counting_bios();
+	PsxMachine* machine = psx_create(bios.data(), bios.size());
+	ASSERT_NE(machine, nullptr);
+	EXPECT_EQ(psx_api_version(), PSX_API_VERSION);
+
+	size_t size;
+	const uint8_t* ram = psx_memory(machine, PSX_MEMORY_RAM, &size);
+	EXPECT_EQ(size, static_cast<size_t>(RAM_ADDR_SPACE_SIZE));
+	EXPECT_NE(psx_memory(machine, PSX_MEMORY_SOUND_RAM, &size), nullptr);
+	EXPECT_GT(size, 0u);
+
+	EXPECT_EQ(psx_run(machine, 3000), PSX_STOP_CYCLES);
+	EXPECT_EQ(psx_cycles(machine), 3000u);
+	// Two instructions, then 4 per iteration
+	EXPECT_EQ(counter(machine), (1500u - 2) / 4);
+	EXPECT_EQ(psx_memory(machine, PSX_MEMORY_RAM, &size), ram);
+
+	// Before the store of the incremented counter
+	EXPECT_EQ(psx_run_until(machine, 3000, BIOS_START_ADDRESS + 0xc), PSX_STOP_PC);
+	EXPECT_EQ(psx_pc(machine), BIOS_START_ADDRESS + 0xcu);
+	EXPECT_EQ(psx_reg(machine, 9), counter(machine) + 1);
+	psx_destroy(machine);
+
+	EXPECT_EQ(psx_create(bios.data(), BIOS_ADDR_SPACE_SIZE + 1), nullptr);
+}
+
+TEST(PsxApi, SnapshotRestoresWrites)
+{
+	std::vector<u8> bios = counting_bios();
+	PsxMachine* machine = psx_create(bios.data(), bios.size());
+	psx_run(machine, 1000);
+	PsxSnapshot* snapshot = psx_snapshot(machine);
+	u32 value = counter(machine);
+	u64 hash = psx_hash(machine);
+	EXPECT_EQ(psx_snapshot_cycles(snapshot), 1000u);
+
+	u32 input = 0x12345678;
+	EXPECT_EQ(psx_write(machine, 0x80020000, &input, sizeof(input)), 0);
+	psx_run(machine, 1000);
+	EXPECT_NE(counter(machine), value);
+	EXPECT_NE(psx_hash(machine), hash);
+
+	EXPECT_EQ(psx_restore(machine, snapshot), 0);
+	EXPECT_EQ(psx_cycles(machine), 1000u);
+	EXPECT_EQ(counter(machine), value);
+	EXPECT_EQ(psx_hash(machine), hash);
+	EXPECT_EQ(psx_write(machine, 0x1f000000, &input, sizeof(input)), -1);
+	EXPECT_EQ(psx_write(machine, 0x801ffffe, &input, sizeof(input)), -1);
+
+	psx_snapshot_free(snapshot);
+	psx_destroy(machine);
+}
+
+TEST(PsxApi, FastBootsExe)
+{
+	std::vector<u8> bios = counting_bios();
+	PsxMachine* machine = psx_create(bios.data(), bios.size());
+
+	const u32 text[] = {
+		0x3c088010,			// lui t0, 0x8010
+		0x240a002a,			// addiu t2, zero, 42
+		0xad0a0000,			// sw t2, 0(t0)
+		0x1000ffff,			// b .
+		0x00000000,
+	};
+	std::vector<u8> exe(PSX_EXE_HEADER_SIZE + sizeof(text), 0);
+	const u32 header[] = { 0x80010000, 0, 0x80010000, sizeof(text) };
+	memcpy(exe.data(), "PS-X EXE", 8);
+	memcpy(exe.data() + 0x10, header, sizeof(header));
+	memcpy(exe.data() + PSX_EXE_HEADER_SIZE, text, sizeof(text));
+	EXPECT_EQ(psx_load_exe(machine, exe.data(), 8, 1), -1);
+	// Nothing would answer the kernel calls
+	EXPECT_EQ(psx_load_exe(machine, exe.data(), exe.size(), 1), -1);
+	psx_set_hle(machine, PSX_HLE_ON);
+	ASSERT_EQ(psx_load_exe(machine, exe.data(), exe.size(), 1), 0);
+
+	EXPECT_EQ(psx_run(machine, 100), PSX_STOP_CYCLES);
+	size_t size;
+	const uint8_t* ram = psx_memory(machine, PSX_MEMORY_RAM, &size);
+	EXPECT_EQ(ram[0x100000], 42u);
+	psx_tty_output(machine, &size);
+	EXPECT_EQ(size, 0u);
+	psx_destroy(machine);
+}
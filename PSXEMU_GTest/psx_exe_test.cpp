@@ -0,0 +1,76 @@
+#include "pch.h"
+#include "psx_exe.h"
+#include <cstring>
+
+static void write32(std::vector<u8>& data, usize offset, u32 value)
+{
+	for (u32 i = 0; i < 4; i++)
+	{
+		data[offset + i] = static_cast<u8>(value >> (i * 8));
+	}
+}
+
+static std::vector<u8> make_exe(u32 text_size)
+{
+	std::vector<u8> file(PSX_EXE_HEADER_SIZE + text_size, 0);
+	memcpy(file.data(), "PS-X EXE", 8);
+	write32(file, 0x10, 0x80010000);
+	write32(file, 0x14, 0x8001f000);
+	write32(file, 0x18, 0x80010000);
+	write32(file, 0x1c, text_size);
+	write32(file, 0x28, 0x80020000);
+	write32(file, 0x2c, 0x100);
+	write32(file, 0x30, 0x801ffff0);
+	write32(file, 0x34, 0x8);
+	for (u32 i = 0; i < text_size; i++)
+	{
+		file[PSX_EXE_HEADER_SIZE + i] = static_cast<u8>(i);
+	}
+	return file;
+}
+
+TEST(PsxExe, ParsesHeader)
+{
+	std::shared_ptr<PsxExe> exe = parse_psx_exe(make_exe(0x1000));
+	ASSERT_TRUE(exe != nullptr);
+
+	EXPECT_EQ(exe->pc, 0x80010000u);
+	EXPECT_EQ(exe->gp, 0x8001f000u);
+	EXPECT_EQ(exe->text_address, 0x80010000u);
+	EXPECT_EQ(exe->bss_address, 0x80020000u);
+	EXPECT_EQ(exe->bss_size, 0x100u);
+	EXPECT_EQ(exe->stack_address, 0x801ffff8u);
+	ASSERT_EQ(exe->text.size(), 0x1000u);
+	EXPECT_EQ(exe->text[0x123], 0x23);
+}
+
+TEST(PsxExe, TruncatedTextIsClamped)
+{
+	std::vector<u8> file = make_exe(0x800);
+	write32(file, 0x1c, 0x1000);
+	std::shared_ptr<PsxExe> exe = parse_psx_exe(file);
+	ASSERT_TRUE(exe != nullptr);
+	EXPECT_EQ(exe->text.size(), 0x800u);
+}
+
+TEST(PsxExe, RejectsBadMagic)
+{
+	std::vector<u8> file = make_exe(0x800);
+	file[0] = 'X';
+	EXPECT_TRUE(parse_psx_exe(file) == nullptr);
+	EXPECT_TRUE(parse_psx_exe(std::vector<u8>(16, 0)) == nullptr);
+}
+
+TEST(PsxExe, KernelSnapshotRoundTrip)
+{
+	std::vector<u8> ram(2 * PSX_KERNEL_SIZE);
+	for (usize i = 0; i < ram.size(); i++)
+	{
+		ram[i] = static_cast<u8>(i * 7);
+	}
+	ASSERT_TRUE(save_kernel_snapshot("psx_exe_test_kernel.bin", ram.data()));
+	std::vector<u8> kernel;
+	ASSERT_TRUE(load_kernel_snapshot("psx_exe_test_kernel.bin", kernel));
+	remove("psx_exe_test_kernel.bin");
+	EXPECT_TRUE(kernel == std::vector<u8>(ram.begin(), ram.begin() + PSX_KERNEL_SIZE));
+}
@@ -0,0 +1,149 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "replay.h"
+#include <cstdio>
+#include <fstream>
+
+// Counts in t0 and appends the count to a table
+static const std::vector<u32> COUNTER_LOOP = {
+	0x3c108010,			// lui s0, 0x8010
+	0x25080001,			// loop: addiu t0, t0, 1
+	0xae080000,			// sw t0, 0(s0)
+	0x08004001,			// j loop
+	0x26100004,			// addiu s0, s0, 4
+};
+
+static void load_counter_loop(CpuHarness& harness, u32 start)
+{
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTER_LOOP);
+	harness.set_reg(8, start);
+}
+
+static RunResult run_cycles(CPU::Core& core, u64 cycles)
+{
+	RunOptions options;
+	options.max_cycles = cycles;
+	return RunLoop(core).run(options);
+}
+
+TEST(Replay, SnapshotRestoresTheMachine)
+{
+	CpuHarness harness;
+	load_counter_loop(harness, 0);
+	run_cycles(harness.core(), 1000);
+	u64 hash = state_hash(harness.core());
+	CoreSnapshot snapshot(harness.core());
+
+	run_cycles(harness.core(), 5000);
+	EXPECT_NE(state_hash(harness.core()), hash);
+	snapshot.restore(harness.core());
+	EXPECT_EQ(state_hash(harness.core()), hash);
+	EXPECT_EQ(snapshot.cycles(), harness.state().cycles);
+}
+
+TEST(Replay, ReproducesARecordedRun)
+{
+	const char* path = "replay_test.log";
+	u64 end_cycles;
+	{
+		CpuHarness harness;
+		load_counter_loop(harness, 0);
+		ReplayRecorder recorder(harness.core(), ReplayBoot());
+		run_cycles(harness.core(), 11000);
+		end_cycles = harness.state().cycles;
+		ASSERT_TRUE(recorder.finish().save(path));
+	}
+
+	ReplayLog log;
+	ASSERT_TRUE(log.load(path));
+	std::remove(path);
+	EXPECT_EQ(log.end_cycles, end_cycles);
+	EXPECT_EQ(log.disc_hash, 0u);
+
+	CpuHarness harness;
+	load_counter_loop(harness, 0);
+	Replayer replayer(harness.core(), log, 1000);
+	EXPECT_TRUE(replayer.verify());
+	EXPECT_GT(replayer.n_snapshots(), 10u);
+
+	// A machine that starts differently ends differently
+	CpuHarness other;
+	load_counter_loop(other, 1);
+	EXPECT_FALSE(Replayer(other.core(), log, 1000).verify());
+}
+
+TEST(Replay, HashesTheDisc)
+{
+	CpuHarness harness;
+	EXPECT_EQ(disc_hash(harness.core()), 0u);
+
+	std::vector<u8> sectors(4 * CD_SECTOR_SIZE, 0x5a);
+	{
+		std::ofstream bin("replay_test.bin", std::ios::binary);
+		bin.write(reinterpret_cast<const char*>(sectors.data()), sectors.size());
+	}
+	harness.core().interconnect().cdrom().insert_disc(open_disc_image("replay_test.bin"));
+	u64 hash = disc_hash(harness.core());
+	EXPECT_NE(hash, 0u);
+
+	sectors[3 * CD_SECTOR_SIZE + 100] ^= 1;
+	{
+		std::ofstream bin("replay_test.bin", std::ios::binary);
+		bin.write(reinterpret_cast<const char*>(sectors.data()), sectors.size());
+	}
+	harness.core().interconnect().cdrom().insert_disc(open_disc_image("replay_test.bin"));
+	EXPECT_NE(disc_hash(harness.core()), hash);
+	harness.core().interconnect().cdrom().insert_disc(nullptr);
+	std::remove("replay_test.bin");
+}
+
+TEST(Replay, SeeksFromTheNearestSnapshot)
+{
+	ReplayLog log;
+	log.end_cycles = 20000;
+
+	// Played straight through, without snapshots to seek from
+	CpuHarness reference;
+	load_counter_loop(reference, 0);
+	Replayer straight(reference.core(), log, log.end_cycles);
+	straight.run_to(7000);
+	u64 hash_at_7000 = state_hash(reference.core());
+
+	CpuHarness harness;
+	load_counter_loop(harness, 0);
+	Replayer replayer(harness.core(), log, 2500);
+	replayer.run_to(20000);
+
+	RunResult result = replayer.seek(7000);
+	EXPECT_EQ(harness.state().cycles, 7000u);
+	EXPECT_EQ(state_hash(harness.core()), hash_at_7000);
+	EXPECT_LE(result.cycles, 2500u);
+
+	replayer.seek(1000);
+	replayer.seek(7000);
+	EXPECT_EQ(state_hash(harness.core()), hash_at_7000);
+}
+
+TEST(Replay, ReproducesAFailure)
+{
+	// addi overflows after 16 iterations
+	std::vector<u32> overflow = {
+		0x21080001,			// loop: addi t0, t0, 1
+		0x08004000,			// j loop
+		0x00000000,
+	};
+	CpuHarness recorded;
+	recorded.load(CPU_HARNESS_CODE_ADDRESS, overflow);
+	recorded.set_reg(8, 0x7ffffff0);
+	ReplayRecorder recorder(recorded.core(), ReplayBoot());
+	ASSERT_EQ(run_cycles(recorded.core(), 100000).reason, StopReason::Error);
+	ReplayLog log = recorder.finish();
+
+	CpuHarness replayed;
+	replayed.load(CPU_HARNESS_CODE_ADDRESS, overflow);
+	replayed.set_reg(8, 0x7ffffff0);
+	Replayer replayer(replayed.core(), log);
+	EXPECT_EQ(replayer.run_to(log.end_cycles + 100).reason, StopReason::Error);
+	EXPECT_EQ(replayed.state().cycles, log.end_cycles);
+	EXPECT_EQ(state_hash(replayed.core()), log.final_hash);
+}
@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "run_loop.h"
+
+// addiu t0, t0, 1; j CODE; nop
+static const std::vector<u32> COUNTING_LOOP = { 0x25080001, 0x08004000, 0x00000000 };
+
+TEST(RunLoop, StopsAtTheCycleBudget)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTING_LOOP);
+	harness.set_reg(8, 0);
+	RunLoop loop(harness.core());
+
+	RunOptions options;
+	options.max_cycles = 3000;
+	RunResult result = loop.run(options);
+	EXPECT_EQ(result.reason, StopReason::CycleBudget);
+	EXPECT_EQ(result.cycles, 3000u);
+	EXPECT_EQ(result.instructions, 1500u);
+	EXPECT_EQ(harness.reg(8), 500u);
+}
+
+TEST(RunLoop, StopsAndResumesAtPc)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTING_LOOP);
+	harness.set_reg(8, 0);
+	RunLoop loop(harness.core());
+
+	RunOptions options;
+	options.stop_at_pc = true;
+	options.stop_pc = CPU_HARNESS_CODE_ADDRESS + 4;
+	RunResult result = loop.run(options);
+	EXPECT_EQ(result.reason, StopReason::PcHit);
+	EXPECT_EQ(harness.core().current_pc(), CPU_HARNESS_CODE_ADDRESS + 4u);
+	EXPECT_EQ(harness.reg(8), 1u);
+
+	// Runs the instruction at the hit before checking again
+	result = loop.run(options);
+	EXPECT_EQ(result.reason, StopReason::PcHit);
+	EXPECT_EQ(result.instructions, 3u);
+	EXPECT_EQ(harness.reg(8), 2u);
+}
+
+TEST(RunLoop, StopsOnRequestAndError)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTING_LOOP);
+	RunLoop loop(harness.core());
+	loop.set_slice_callback([&]()
+	{
+		loop.request_stop();
+	});
+	RunResult result = loop.run(RunOptions());
+	EXPECT_EQ(result.reason, StopReason::Requested);
+	EXPECT_EQ(result.cycles, static_cast<u64>(RUN_LOOP_SLICE_CYCLES));
+
+	CpuHarness broken;
+	broken.load(CPU_HARNESS_CODE_ADDRESS, { 0x00000000, 0xfc000000 });		// unhandled opcode
+	result = RunLoop(broken.core()).run(RunOptions());
+	EXPECT_EQ(result.reason, StopReason::Error);
+}
+
+TEST(RunLoop, PacesGuestTime)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTING_LOOP);
+	RunLoop loop(harness.core());
+
+	// 50 ms of guest time
+	RunOptions options;
+	options.pacing = Pacing::RealTime;
+	options.max_cycles = CPU_CLOCK_HZ / 20;
+	RunResult result = loop.run(options);
+	EXPECT_EQ(result.reason, StopReason::CycleBudget);
+	EXPECT_GE(result.seconds, 0.049);
+
+	// 200 ms of guest time at 4x
+	options.pacing = Pacing::Ratio;
+	options.speed = 4.0;
+	options.max_cycles = CPU_CLOCK_HZ / 5;
+	result = loop.run(options);
+	EXPECT_GE(result.seconds, 0.049);
+	EXPECT_LE(result.speed(), 4.1);
+}
+
+TEST(RunLoop, StopsAtTheDeadline)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, COUNTING_LOOP);
+	RunLoop loop(harness.core());
+
+	RunOptions options;
+	options.max_seconds = 0.05;
+	RunResult result = loop.run(options);
+	EXPECT_EQ(result.reason, StopReason::Deadline);
+	EXPECT_GE(result.seconds, 0.05);
+	EXPECT_GT(result.mips(), 0.0);
+}
@@ -0,0 +1,38 @@
+#include "pch.h"
+#include "scheduler.h"
+
+TEST(Scheduler, NothingDueBeforeDeadline)
+{
+	Scheduler scheduler;
+	SchedulerEvent event;
+	EXPECT_FALSE(scheduler.pending());
+
+	scheduler.schedule(SchedulerEvent::Spu, 1000);
+	scheduler.set_now(999);
+	EXPECT_FALSE(scheduler.pending());
+	EXPECT_FALSE(scheduler.pop_due(event));
+
+	scheduler.set_now(1000);
+	EXPECT_TRUE(scheduler.pending());
+	ASSERT_TRUE(scheduler.pop_due(event));
+	EXPECT_EQ(event, SchedulerEvent::Spu);
+
+	// Events fire once
+	EXPECT_FALSE(scheduler.pending());
+	EXPECT_FALSE(scheduler.pop_due(event));
+}
+
+TEST(Scheduler, RescheduleAndCancel)
+{
+	Scheduler scheduler;
+	SchedulerEvent event;
+
+	scheduler.schedule(SchedulerEvent::Spu, 1000);
+	scheduler.schedule(SchedulerEvent::Spu, 5000);
+	scheduler.set_now(2000);
+	EXPECT_FALSE(scheduler.pending());
+
+	scheduler.cancel(SchedulerEvent::Spu);
+	scheduler.set_now(10000);
+	EXPECT_FALSE(scheduler.pop_due(event));
+}
@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "spu.h"
+#include <random>
+
+class CaptureSink : public AudioSink
+{
+public:
+	std::vector<s16> frames;
+	void write(const s16* data, usize n_frames) override
+	{
+		frames.insert(frames.end(), data, data + n_frames * 2);
+	}
+};
+
+// Uploads a looping ADPCM block holding the constant sample 0x7000 at address 0x1000
+static void upload_constant_block(Spu& spu)
+{
+	spu.store16(0x1a6, 0x1000 / 8);
+	spu.store16(0x1a8, 0x0700);			// shift 0, filter 0, flags: loop start + end + repeat
+	for (u32 i = 0; i < 7; i++)
+	{
+		spu.store16(0x1a8, 0x7777);
+	}
+}
+
+static void key_on_voice0(Spu& spu)
+{
+	spu.store16(0x1aa, 0xc000);			// enable, unmute
+	spu.store16(0x180, 0x3fff);			// main volume
+	spu.store16(0x182, 0x3fff);
+	spu.store16(0x000, 0x3fff);			// voice volume
+	spu.store16(0x002, 0x3fff);
+	spu.store16(0x004, 0x1000);			// 44.1 kHz
+	spu.store16(0x006, 0x1000 / 8);
+	spu.store16(0x008, 0x000f);			// fastest linear attack, sustain level max
+	spu.store16(0x00a, 0x0000);
+	spu.store16(0x188, 0x0001);
+}
+
+TEST(Spu, MixLanesMatchReference)
+{
+	std::mt19937 rng(4321);
+	std::uniform_int_distribution<s32> s16_dist(-0x8000, 0x7fff);
+	std::uniform_int_distribution<s32> gauss_dist(0, 0x7fff);
+
+	for (u32 n = 0; n < 10000; n++)
+	{
+		SpuMixLanes lanes;
+		for (u32 v = 0; v < SPU_N_VOICES; v++)
+		{
+			for (u32 j = 0; j < 4; j++)
+			{
+				lanes.tap[j][v] = s16_dist(rng);
+				lanes.gauss[j][v] = gauss_dist(rng);
+			}
+			lanes.envelope[v] = gauss_dist(rng);
+			lanes.volume_left[v] = s16_dist(rng);
+			lanes.volume_right[v] = s16_dist(rng);
+			lanes.reverb[v] = (rng() & 0x1) ? -1 : 0;
+		}
+
+		SpuMixResult simd;
+		SpuMixResult reference;
+		Spu::mix_lanes(lanes, simd);
+		Spu::mix_lanes_reference(lanes, reference);
+
+		for (u32 v = 0; v < SPU_N_VOICES; v++)
+		{
+			ASSERT_EQ(simd.voice[v], reference.voice[v]);
+		}
+		ASSERT_EQ(simd.left, reference.left);
+		ASSERT_EQ(simd.right, reference.right);
+		ASSERT_EQ(simd.reverb_left, reference.reverb_left);
+		ASSERT_EQ(simd.reverb_right, reference.reverb_right);
+	}
+}
+
+TEST(Spu, TransferFifoWritesSoundRam)
+{
+	Spu spu;
+	upload_constant_block(spu);
+
+	const std::vector<u8>& ram = spu.sound_ram();
+	EXPECT_EQ(ram[0x1000], 0x00);
+	EXPECT_EQ(ram[0x1001], 0x07);
+	EXPECT_EQ(ram[0x1002], 0x77);
+	EXPECT_EQ(ram[0x100f], 0x77);
+	EXPECT_EQ(ram[0x1010], 0x00);
+}
+
+TEST(Spu, TracksChangedSoundRamPages)
+{
+	Spu spu;
+	u32 pages[SPU_RAM_N_PAGES];
+	EXPECT_EQ(spu.take_changed_sound_ram(pages), 0u);
+	upload_constant_block(spu);
+	ASSERT_EQ(spu.take_changed_sound_ram(pages), 1u);
+	EXPECT_EQ(pages[0], 0x1000u >> RAM_PAGE_SHIFT);
+	EXPECT_EQ(spu.take_changed_sound_ram(pages), 0u);
+
+	// Assignments mark the pages that differ only
+	Spu copy(spu);
+	copy.store16(0x1a6, 0x2000 / 8);
+	copy.store16(0x1a8, 0x1234);
+	copy.take_changed_sound_ram(pages);
+	spu = copy;
+	ASSERT_EQ(spu.take_changed_sound_ram(pages), 1u);
+	EXPECT_EQ(pages[0], 0x2000u >> RAM_PAGE_SHIFT);
+	EXPECT_EQ(spu.sound_ram(), copy.sound_ram());
+}
+
+TEST(Spu, KeyOnPlaysLoopingVoice)
+{
+	Spu spu;
+	CaptureSink sink;
+	spu.set_sink(&sink);
+	upload_constant_block(spu);
+	key_on_voice0(spu);
+
+	EXPECT_EQ(spu.load16(0x19c), 0);
+	spu.generate(2048);
+	spu.flush();
+
+	ASSERT_EQ(sink.frames.size(), 2048u * 2);
+	// The block ended and looped back to itself
+	EXPECT_EQ(spu.load16(0x19c) & 0x1, 0x1);
+	EXPECT_NE(spu.load16(0x00c), 0);
+
+	// Full envelope and volumes (0x3fff is 1.0 in fixed mode), output follows the block
+	s16 left = sink.frames[2047 * 2];
+	s16 right = sink.frames[2047 * 2 + 1];
+	EXPECT_EQ(left, right);
+	EXPECT_GT(left, 0x6e00);
+	EXPECT_LE(left, 0x7000);
+}
+
+TEST(Spu, MutedOutputIsSilent)
+{
+	Spu spu;
+	CaptureSink sink;
+	spu.set_sink(&sink);
+	upload_constant_block(spu);
+	key_on_voice0(spu);
+	spu.store16(0x1aa, 0x8000);			// enabled but muted
+
+	spu.generate(256);
+	spu.flush();
+
+	for (s16 sample : sink.frames)
+	{
+		ASSERT_EQ(sample, 0);
+	}
+}
+
+TEST(Spu, KeyOffReleasesVoice)
+{
+	Spu spu;
+	upload_constant_block(spu);
+	key_on_voice0(spu);
+	spu.store16(0x00a, 0x0000);			// fastest linear release
+
+	spu.generate(1024);
+	EXPECT_NE(spu.load16(0x00c), 0);
+
+	spu.store16(0x18c, 0x0001);
+	spu.generate(1024);
+	EXPECT_EQ(spu.load16(0x00c), 0);
+}
+
+TEST(Spu, SyncGeneratesOnlyDueSamples)
+{
+	Spu spu;
+	spu.sync(SPU_CYCLES_PER_SAMPLE * 100 + 5);
+	EXPECT_EQ(spu.samples_generated(), 100u);
+	EXPECT_EQ(spu.next_deadline(), static_cast<u64>(SPU_CYCLES_PER_SAMPLE) * (100 + SPU_BLOCK_SAMPLES));
+
+	// The leftover cycles are kept for the next sync
+	spu.sync(SPU_CYCLES_PER_SAMPLE * 101);
+	EXPECT_EQ(spu.samples_generated(), 101u);
+	spu.sync(SPU_CYCLES_PER_SAMPLE * 50);
+	EXPECT_EQ(spu.samples_generated(), 101u);
+
+	spu.sync(static_cast<u64>(SPU_CYCLES_PER_SAMPLE) * 44100);
+	EXPECT_EQ(spu.samples_generated(), 44100u);
+}
@@ -0,0 +1,136 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "stats.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+TEST(Stats, CountsInstructionsAndAccesses)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x8e080000,			// lw t0, 0(s0)
+		0xae080004,			// sw t0, 4(s0)
+		0x00000000,			// nop
+	});
+	harness.set_reg(16, 0x80100000);
+	Stats& stats = harness.core().stats();
+	stats.clear();
+
+	harness.run(3);
+	EXPECT_EQ(stats.instructions, 3u);
+	// Three fetches, one load and one store
+	EXPECT_EQ(stats.accesses[static_cast<u32>(StatsRegion::Ram)], 5u);
+	EXPECT_EQ(stats.accesses[static_cast<u32>(StatsRegion::Bios)], 0u);
+	EXPECT_EQ(stats.exceptions, 0u);
+}
+
+TEST(Stats, CountsAddressErrors)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, {
+		0x8e080002,			// lw t0, 2(s0): unaligned
+	});
+	harness.set_reg(16, 0x80100000);
+	Stats& stats = harness.core().stats();
+	stats.clear();
+
+	harness.run(1);
+	EXPECT_EQ(stats.exceptions, 1u);
+}
+
+TEST(Stats, WritesJsonAndPrometheus)
+{
+	Stats stats;
+	stats.instructions = 1234;
+	stats.cache_hits = 7;
+	stats.accesses[static_cast<u32>(StatsRegion::Spu)] = 42;
+	stats.device_ns[static_cast<u32>(StatsDevice::Cdrom)] = 1500000000;
+
+	std::ostringstream json;
+	write_stats_json(stats, json);
+	EXPECT_NE(json.str().find("\"instructions\": 1234,"), std::string::npos);
+	EXPECT_NE(json.str().find("\"cache_hits\": 7,"), std::string::npos);
+	EXPECT_NE(json.str().find("\"spu\": 42"), std::string::npos);
+	EXPECT_NE(json.str().find("\"cdrom\": 1500000000"), std::string::npos);
+
+	std::ostringstream prometheus;
+	write_stats_prometheus(stats, prometheus);
+	EXPECT_NE(prometheus.str().find("# TYPE psxemu_instructions_total counter\npsxemu_instructions_total 1234\n"), std::string::npos);
+	EXPECT_NE(prometheus.str().find("psxemu_bus_accesses_total{region=\"spu\"} 42\n"), std::string::npos);
+	EXPECT_NE(prometheus.str().find("psxemu_device_seconds_total{device=\"cdrom\"} 1.5\n"), std::string::npos);
+}
+
+TEST(Stats, TimesDevicesOnlyWhenEnabled)
+{
+	Stats stats;
+	{
+		StatsTimer timer(stats, StatsDevice::Spu);
+	}
+	EXPECT_EQ(stats.device_ns[static_cast<u32>(StatsDevice::Spu)], 0u);
+
+	stats.time_devices = true;
+	{
+		StatsTimer timer(stats, StatsDevice::Spu);
+		volatile u32 sink = 0;
+		for (u32 i = 0; i < 100000; i++)
+		{
+			sink = sink + i;
+		}
+	}
+	EXPECT_GT(stats.device_ns[static_cast<u32>(StatsDevice::Spu)], 0u);
+}
+
+TEST(Stats, ReporterReplacesTheFile)
+{
+	Stats stats;
+	stats.instructions = 99;
+	StatsReporter reporter("stats_test.prom", StatsFormat::Prometheus, 1000);
+	ASSERT_TRUE(reporter.write(stats));
+	stats.instructions = 100;
+	ASSERT_TRUE(reporter.write(stats));
+
+	std::ifstream file("stats_test.prom");
+	std::stringstream text;
+	text << file.rdbuf();
+	EXPECT_NE(text.str().find("psxemu_instructions_total 100\n"), std::string::npos);
+	EXPECT_FALSE(static_cast<bool>(std::ifstream("stats_test.prom.tmp")));
+	file.close();
+	remove("stats_test.prom");
+}
+
+#if !defined(_WIN32)
+// A reader that never reads costs dropped snapshots, not a stalled emulator
+TEST(Stats, ReporterNeverBlocksOnTheSocket)
+{
+	const char* path = "stats_test.sock";
+	unlink(path);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	ASSERT_EQ(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+	ASSERT_EQ(listen(listener, 1), 0);
+
+	Stats stats;
+	StatsReporter reporter(std::string("unix:") + path, StatsFormat::Json, 1000);
+	EXPECT_TRUE(reporter.write(stats));
+	u32 dropped = 0;
+	for (u32 i = 0; i < 100000 && dropped == 0; i++)
+	{
+		dropped += reporter.write(stats) ? 0 : 1;
+	}
+	EXPECT_EQ(dropped, 1u);
+
+	close(listener);
+	unlink(path);
+}
+#endif
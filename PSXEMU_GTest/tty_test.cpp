@@ -0,0 +1,169 @@
+#include "pch.h"
+#include "cpu_harness.h"
+#include "run_loop.h"
+#include "tty.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#define TTY_THR_A (TTY_DUART_OFFSET + 0x3)
+#define TTY_THR_B (TTY_DUART_OFFSET + 0xb)
+
+class LineCapture : public TtySink
+{
+public:
+	std::vector<std::string> lines;
+
+	void write_line(const std::string& line) override
+	{
+		lines.push_back(line);
+	}
+};
+
+static void print(Tty& tty, u32 offset, const std::string& text)
+{
+	for (char c : text)
+	{
+		tty.store8(offset, static_cast<u8>(c));
+	}
+}
+
+TEST(Tty, SplitsOutputIntoLines)
+{
+	Tty tty;
+	LineCapture capture;
+	tty.set_sink(&capture);
+	// Transmitters always ready
+	EXPECT_EQ(tty.load8(TTY_DUART_OFFSET + 0x1), 0x0cu);
+	EXPECT_EQ(tty.load8(TTY_DUART_OFFSET + 0x9), 0x0cu);
+
+	print(tty, TTY_THR_A, "hello\r\n\nwor");
+	print(tty, TTY_THR_B, "ld\n");
+	print(tty, TTY_THR_A, "partial");
+	EXPECT_EQ(tty.output(), "hello\r\n\nworld\npartial");
+	EXPECT_EQ(capture.lines, std::vector<std::string>({ "hello", "", "world" }));
+
+	tty.flush_line();
+	tty.flush_line();
+	EXPECT_EQ(capture.lines.back(), "partial");
+	EXPECT_EQ(capture.lines.size(), 4u);
+
+	tty.store8(TTY_POST_OFFSET, 0x0f);
+	EXPECT_EQ(tty.post(), 0x0fu);
+	EXPECT_EQ(tty.load8(TTY_POST_OFFSET), 0x0fu);
+}
+
+TEST(Tty, KeepsOnlyTheTail)
+{
+	Tty tty;
+	LineCapture capture;
+	tty.set_sink(&capture);
+	std::string line(TTY_TAIL_SIZE / 2 - 1, 'x');
+	for (int i = 0; i < 8; i++)
+	{
+		print(tty, TTY_THR_A, line + "\n");
+	}
+	EXPECT_EQ(tty.output_total(), 4u * TTY_TAIL_SIZE);
+	EXPECT_GE(tty.output().size(), static_cast<usize>(TTY_TAIL_SIZE));
+	EXPECT_LT(tty.output().size(), static_cast<usize>(2 * TTY_TAIL_SIZE));
+	EXPECT_EQ(capture.lines, std::vector<std::string>(8, line));
+
+	// Lines without an end go to the sink in pieces
+	print(tty, TTY_THR_A, std::string(TTY_TAIL_SIZE + 1, 'y'));
+	EXPECT_EQ(capture.lines.back(), std::string(TTY_TAIL_SIZE, 'y'));
+	tty.flush_line();
+	EXPECT_EQ(capture.lines.back(), "y");
+}
+
+TEST(Tty, SnapshotsLeaveTheTextOut)
+{
+	Tty tty;
+	print(tty, TTY_THR_A, "before\n");
+	Tty snapshot = tty;
+	EXPECT_EQ(snapshot.output(), "");
+	EXPECT_EQ(snapshot.hash(0), tty.hash(0));
+
+	print(tty, TTY_THR_A, "after\n");
+	EXPECT_NE(snapshot.hash(0), tty.hash(0));
+	tty = snapshot;
+	EXPECT_EQ(snapshot.hash(0), tty.hash(0));
+	EXPECT_EQ(tty.output(), "before\nafter\n");
+	EXPECT_EQ(tty.output_total(), 13u);
+}
+
+TEST(Tty, ModeRegisterPointer)
+{
+	Tty tty;
+	tty.store8(TTY_DUART_OFFSET + 0x2, 0x10);		// reset MR pointer
+	tty.store8(TTY_DUART_OFFSET, 0x13);				// MR1A
+	tty.store8(TTY_DUART_OFFSET, 0x07);				// MR2A
+	tty.store8(TTY_DUART_OFFSET + 0x2, 0x10);
+	EXPECT_EQ(tty.load8(TTY_DUART_OFFSET), 0x13u);
+	EXPECT_EQ(tty.load8(TTY_DUART_OFFSET), 0x07u);
+	EXPECT_EQ(tty.load8(TTY_DUART_OFFSET + 0x8), 0x00u);
+}
+
+TEST(Tty, FileGetsEveryLine)
+{
+	const char* path = "tty_test.txt";
+	{
+		TtyFile file(path);
+		ASSERT_TRUE(file.is_open());
+		Tty tty;
+		tty.set_sink(&file);
+		for (u32 i = 0; i < 1000; i++)
+		{
+			print(tty, TTY_THR_A, "line " + std::to_string(i) + "\n");
+		}
+	}
+	std::ifstream in(path);
+	std::ostringstream expected;
+	for (u32 i = 0; i < 1000; i++)
+	{
+		expected << "line " << i << "\n";
+	}
+	std::ostringstream text;
+	text << in.rdbuf();
+	EXPECT_EQ(text.str(), expected.str());
+	in.close();
+	std::remove(path);
+}
+
+// Prints PASS on the DUART, then spins
+static const std::vector<u32> PRINT_PASS = {
+	0x3c09bf80,			// lui t1, 0xbf80
+	0x24080050,			// addiu t0, zero, 'P'
+	0xa1282023,			// sb t0, 0x2023(t1)
+	0x24080041,			// addiu t0, zero, 'A'
+	0xa1282023,
+	0x24080053,			// addiu t0, zero, 'S'
+	0xa1282023,
+	0xa1282023,
+	0x2408000a,			// addiu t0, zero, '\n'
+	0xa1282023,
+	0x0800400a,			// loop: j loop
+	0x00000000,
+};
+
+TEST(Tty, RunStopsOnExpectedOutput)
+{
+	CpuHarness harness;
+	harness.load(CPU_HARNESS_CODE_ADDRESS, PRINT_PASS);
+	RunLoop loop(harness.core());
+
+	RunOptions options;
+	options.max_cycles = 10 * RUN_LOOP_SLICE_CYCLES;
+	options.stop_output = "FAIL";
+	EXPECT_EQ(loop.run(options).reason, StopReason::CycleBudget);
+	EXPECT_EQ(harness.core().interconnect().tty().output(), "PASS\n");
+
+	// Printed before the run started
+	options.stop_output = "PASS";
+	EXPECT_EQ(loop.run(options).reason, StopReason::CycleBudget);
+
+	CpuHarness fresh;
+	fresh.load(CPU_HARNESS_CODE_ADDRESS, PRINT_PASS);
+	RunResult result = RunLoop(fresh.core()).run(options);
+	EXPECT_EQ(result.reason, StopReason::OutputMatch);
+	EXPECT_EQ(result.cycles, static_cast<u64>(RUN_LOOP_SLICE_CYCLES));
+}
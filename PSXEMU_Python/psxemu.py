@@ -0,0 +1,189 @@
+"""Python bindings of the C API of psx_api.h, through ctypes.
+
+The psxemu shared library is built by the psxemu target of
+PSXEMU_Bench/CMakeLists.txt. It is looked for in PSXEMU_LIBRARY, then next to
+this file.
+
+ctypes releases the GIL for the duration of every call: machines on different
+threads emulate in parallel. Memory views map the machine's memory in place,
+without copies, and stay valid until the machine is closed.
+
+    with Machine(open("SCPH1001.BIN", "rb").read()) as machine:
+        start = machine.snapshot()
+        machine.run(33868800 // 60)
+        ram = machine.ram_array()           # numpy array over guest RAM
+        machine.restore(start)              # ram now shows the restored RAM
+"""
+
+import ctypes
+import os
+import sys
+
+HLE_OFF = 0
+HLE_COUNT_ONLY = 1
+HLE_ON = 2
+
+STOP_CYCLES = 0
+STOP_PC = 1
+STOP_ERROR = 2
+
+MEMORY_RAM = 0
+MEMORY_SOUND_RAM = 1
+
+API_VERSION = 2
+
+
+def _library_path():
+    path = os.environ.get("PSXEMU_LIBRARY")
+    if path:
+        return path
+    name = {"win32": "psxemu.dll", "darwin": "libpsxemu.dylib"}.get(sys.platform, "libpsxemu.so")
+    return os.path.join(os.path.dirname(os.path.abspath(__file__)), name)
+
+
+def _load():
+    lib = ctypes.CDLL(_library_path())
+    machine = ctypes.c_void_p
+    snapshot = ctypes.c_void_p
+    size = ctypes.POINTER(ctypes.c_size_t)
+    signatures = {
+        "psx_api_version": (ctypes.c_int, []),
+        "psx_create": (machine, [ctypes.c_char_p, ctypes.c_size_t]),
+        "psx_destroy": (None, [machine]),
+        "psx_set_hle": (None, [machine, ctypes.c_int]),
+        "psx_load_exe": (ctypes.c_int, [machine, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int]),
+        "psx_insert_disc": (ctypes.c_int, [machine, ctypes.c_char_p]),
+        "psx_run": (ctypes.c_int, [machine, ctypes.c_uint64]),
+        "psx_run_until": (ctypes.c_int, [machine, ctypes.c_uint64, ctypes.c_uint32]),
+        "psx_cycles": (ctypes.c_uint64, [machine]),
+        "psx_reg": (ctypes.c_uint32, [machine, ctypes.c_uint]),
+        "psx_pc": (ctypes.c_uint32, [machine]),
+        "psx_hash": (ctypes.c_uint64, [machine]),
+        "psx_memory": (ctypes.c_void_p, [machine, ctypes.c_int, size]),
+        "psx_write": (ctypes.c_int, [machine, ctypes.c_uint32, ctypes.c_char_p, ctypes.c_size_t]),
+        "psx_tty_output": (ctypes.c_void_p, [machine, size]),
+        "psx_snapshot": (snapshot, [machine]),
+        "psx_restore": (ctypes.c_int, [machine, snapshot]),
+        "psx_snapshot_free": (None, [snapshot]),
+        "psx_snapshot_cycles": (ctypes.c_uint64, [snapshot]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(lib, name)
+        function.restype = restype
+        function.argtypes = argtypes
+    if lib.psx_api_version() != API_VERSION:
+        raise RuntimeError("psxemu library of API version %d, expected %d" % (lib.psx_api_version(), API_VERSION))
+    return lib
+
+
+_lib = _load()
+
+
+class Snapshot:
+    """Copy of a whole machine, freed with the object."""
+
+    def __init__(self, handle):
+        self._handle = handle
+
+    def __del__(self):
+        if self._handle:
+            _lib.psx_snapshot_free(self._handle)
+            self._handle = None
+
+    @property
+    def cycles(self):
+        return _lib.psx_snapshot_cycles(self._handle)
+
+
+class Machine:
+    def __init__(self, bios):
+        bios = bytes(bios)
+        self._handle = _lib.psx_create(bios, len(bios))
+        if not self._handle:
+            raise ValueError("invalid BIOS image")
+        self._views = {}
+
+    def close(self):
+        """Frees the machine, its memory views become invalid."""
+        if self._handle:
+            _lib.psx_destroy(self._handle)
+            self._handle = None
+            self._views = {}
+
+    def __del__(self):
+        self.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exception):
+        self.close()
+
+    def set_hle(self, mode):
+        _lib.psx_set_hle(self._handle, mode)
+
+    def load_exe(self, exe, fast_boot=False):
+        exe = bytes(exe)
+        if _lib.psx_load_exe(self._handle, exe, len(exe), int(fast_boot)) != 0:
+            raise ValueError("invalid PS-X EXE, or fast boot without HLE")
+
+    def insert_disc(self, path):
+        if _lib.psx_insert_disc(self._handle, os.fsencode(path)) != 0:
+            raise OSError("unable to open disc image %s" % path)
+
+    def run(self, cycles, stop_pc=None):
+        """Runs up to cycles CPU cycles, or until stop_pc. Returns a STOP_ value."""
+        if stop_pc is None:
+            return _lib.psx_run(self._handle, cycles)
+        return _lib.psx_run_until(self._handle, cycles, stop_pc)
+
+    @property
+    def cycles(self):
+        return _lib.psx_cycles(self._handle)
+
+    @property
+    def pc(self):
+        return _lib.psx_pc(self._handle)
+
+    def reg(self, index):
+        return _lib.psx_reg(self._handle, index)
+
+    def hash(self):
+        return _lib.psx_hash(self._handle)
+
+    def memory(self, memory=MEMORY_RAM):
+        """Read only memoryview of a memory of the machine, in place."""
+        if memory not in self._views:
+            size = ctypes.c_size_t()
+            address = _lib.psx_memory(self._handle, memory, ctypes.byref(size))
+            if not address:
+                raise ValueError("unknown memory %d" % memory)
+            array = (ctypes.c_uint8 * size.value).from_address(address)
+            self._views[memory] = memoryview(array).cast("B").toreadonly()
+        return self._views[memory]
+
+    def ram_array(self, memory=MEMORY_RAM):
+        """Read only NumPy array over a memory of the machine, without a copy."""
+        import numpy
+        return numpy.frombuffer(self.memory(memory), dtype=numpy.uint8)
+
+    def write(self, address, data):
+        """Writes guest RAM at an address, for inputs: restores undo it."""
+        data = bytes(data)
+        if _lib.psx_write(self._handle, address, data, len(data)) != 0:
+            raise ValueError("write outside of RAM at %08x" % address)
+
+    def tty_output(self):
+        size = ctypes.c_size_t()
+        address = _lib.psx_tty_output(self._handle, ctypes.byref(size))
+        return ctypes.string_at(address, size.value).decode("latin-1")
+
+    def snapshot(self):
+        handle = _lib.psx_snapshot(self._handle)
+        if not handle:
+            raise MemoryError("unable to snapshot the machine")
+        return Snapshot(handle)
+
+    def restore(self, snapshot):
+        if _lib.psx_restore(self._handle, snapshot._handle) != 0:
+            raise MemoryError("unable to restore the snapshot")